@@ -34,6 +34,7 @@
 #                Added code around $SIG{INT} to exit gracefully when terminating with Ctrl-C.
 #                Fixed typos - $lockFile was $lockfile in several locations.
 # 2017-12-11 MJW Fallback to logPath if lockStatusCheck doesn't exist
+# 2017-12-20 MJW Subscribe to the logged channel only
 #
 
 use POSIX;
@@ -141,7 +142,9 @@ $SIG{TERM} = sub {close $sock;unlink $lockFile; ErrorExit("Received SIGTERM - ex
 # catch Ctrl-C so we can log that we were killed
 $SIG{INT} = sub {close $sock;unlink $lockFile; ErrorExit("Received SIGINT - exiting.")};
 
-$sock->send("LISTEN"); # tell okcounterd we are just listening politely
+# tell okcounterd we are just listening politely, and only to our channel
+# (older versions of okcounterd ignore the mask and send all channels)
+$sock->send("LISTEN mask=".(1 << ($chan-1)));
 
 $oldmjd=0;
 $ctrext = $Init{"counter:file extension"};
@@ -34,6 +34,7 @@
 #include <sys/stat.h>
 
 #include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -53,6 +54,7 @@
 #include "CounterMeasurement.h"
 #include "Debug.h"
 #include "Javad.h"
+#include "LogWriter.h"
 #include "MeasurementPair.h"
 #include "NVS.h"
 #include "Receiver.h"
@@ -64,15 +66,6 @@
 #include "Ublox.h"
 #include "Utility.h"
 
-extern Application *app;
-extern ostream *debugStream;
-extern string   debugFileName;
-extern ofstream debugLog;
-extern int verbosity;
-extern bool shortDebugMessage;
-
-Application *app;
-
 static struct option longOptions[] = {
 		{"configuration",required_argument, 0,  0 },
 		{"debug",         required_argument, 0,  0 },
@@ -95,10 +88,14 @@ using boost::bad_lexical_cast;
 //	Public
 //
 
+Application::Application()
+{
+	init();
+	installDebugging();
+}
+
 Application::Application(int argc,char **argv)
 {
-	app = this;
-	
 	init();
 
 	// Process the command line options
@@ -123,16 +120,15 @@ Application::Application(int argc,char **argv)
 							{
 								string dbgout = optarg;
 								if ((string::npos != dbgout.find("stderr"))){
-									debugStream = & std::cerr;
+									sessionDebugStream = & std::cerr;
 								}
 								else{
-									debugFileName = dbgout;
-									debugLog.open(debugFileName.c_str(),ios_base::app);
+									debugLog.open(dbgout.c_str(),ios_base::app);
 									if (!debugLog.is_open()){
 										cerr << "Error! Unable to open " << dbgout << endl;
 										exit(EXIT_FAILURE);
 									}
-									debugStream = & debugLog;
+									sessionDebugStream = & debugLog;
 								}
 								break;
 							}
@@ -161,7 +157,7 @@ Application::Application(int argc,char **argv)
 							break;
 						case 6:
 							{
-								if (1!=sscanf(optarg,"%i",&verbosity)){
+								if (1!=sscanf(optarg,"%i",&sessionVerbosity)){
 									cerr << "Error! Bad value for option --verbosity" << endl;
 									showHelp();
 									exit(EXIT_FAILURE);
@@ -180,7 +176,7 @@ Application::Application(int argc,char **argv)
 							SVDiagnosticsOn=true;
 							break;
 						case 10:
-							shortDebugMessage=true;
+							sessionShortDebugMessage=true;
 							break;
 					}
 				}
@@ -209,6 +205,8 @@ Application::Application(int argc,char **argv)
 		exit(EXIT_FAILURE);
 	}
 	
+	installDebugging();
+	
 	if (!loadConfig()){
 		cerr << "Error! Configuration failed" << endl;
 		exit(EXIT_FAILURE);
@@ -220,22 +218,103 @@ Application::Application(int argc,char **argv)
 
 Application::~Application()
 {
-	for (unsigned int i =0;i<MPAIRS_SIZE;i++)
-		delete mpairs[i];
-	delete[] mpairs;
+	logWriter.flush(); // streams are about to be closed
+	if (debugWriter == &logWriter)
+		debugWriter = NULL;
+	delete receiver;
+	delete counter;
+	delete nextReceiver;
+	delete nextCounter;
+	delete antenna;
+	for (unsigned int i=0;i<outputBuffers.size();i++)
+		delete outputBuffers.at(i);
+}
+
+bool Application::loadConfig(string configFile)
+{
+	installDebugging();
+	configurationFile=configFile;
+	return loadConfig();
+}
+
+void Application::setMJD(int mjd)
+{
+	MJD=mjd;
 }
 
-void Application::run()
+void Application::setTimeWindow(int start,int stop)
 {
+	startTime=start;
+	stopTime=stop;
+}
+
+void Application::setReceiverFile(string fname)
+{
+	userReceiverFile=fname;
+}
+
+void Application::setCounterFile(string fname)
+{
+	userCounterFile=fname;
+}
+
+void Application::setDebugging(ostream *os,int v,bool shortMessages)
+{
+	sessionDebugStream=os;
+	sessionVerbosity=v;
+	sessionShortDebugMessage=shortMessages;
+	installDebugging();
+}
+
+void Application::setInMemoryOutput(bool on)
+{
+	inMemoryOutput=on;
+}
+
+bool Application::run()
+{
+	installDebugging();
+	
+	if (NULL == receiver){
+		cerr << "No receiver has been configured" << endl;
+		return false;
+	}
+	
+	// Each run starts with an empty receiver and counter, so that a session can be run more than once
+	Receiver *rx = makeReceiver(); // gets the configuration of the current receiver
+	delete receiver;
+	receiver = rx;
+	Counter *cntr = new Counter(this);
+	cntr->flipSign = counter->flipSign;
+	delete counter;
+	counter = cntr;
+	delete nextReceiver;
+	nextReceiver = NULL;
+	delete nextCounter;
+	nextCounter = NULL;
+	mpairs.clear();
+	
 	Timer timer;
 	timer.start();
 	
 	makeFilenames();
 	
 	// Create the log file, erasing any existing file
-	ofstream ofs;
-	ofs.open(logFile.c_str());
-	ofs.close();
+	// It is opened here, before anything is queued for it, and not touched again until the next run
+	if (inMemoryOutput){
+		logBuffer="";
+	}
+	else{
+		logWriter.flush();
+		logOpen=false;
+		if (logStream.is_open())
+			logStream.close();
+		logStream.clear();
+		logStream.open(logFile.c_str());
+		logOpen=logStream.is_open();
+		if (!logOpen)
+			cerr << "Unable to open " << logFile << endl;
+	}
 	
 	logMessage(timeStamp() + APP_NAME +  " version " + APP_VERSION + " run started");
 	
@@ -247,22 +326,61 @@ void Application::run()
 	int sloppyStopTime = stopTime + 960;
 	if (sloppyStopTime > 86399) sloppyStopTime = 86399;
 			
+	if (useAdjacentDays && startTime < 4*3600){
+		// Get ephemeris from the end of the previous day so that measurements at the start
+		// of the day can be processed.  The ephemeris has to be available before the day is read
+		// because the receivers resolve millisecond ambiguities as they read the log
+		Receiver *prevReceiver = makeReceiver();
+		if (readAdjacentDay(MJD-1,86400-4*3600,86399,prevReceiver,NULL)){
+			for (unsigned int i=0;i<prevReceiver->gps.ephemeris.size();i++){
+				GPS::EphemerisData *ed = new GPS::EphemerisData(*(prevReceiver->gps.ephemeris.at(i)));
+				ed->previousDay=true;
+				receiver->gps.addEphemeris(ed);
+			}
+			logMessage("got " + boost::lexical_cast<string>(prevReceiver->gps.ephemeris.size()) + " ephemeris entries from MJD " +
+				boost::lexical_cast<string>(MJD-1));
+		}
+		delete prevReceiver;
+	}
+	
+	if (!logAvailable(receiverFile)){
+		cerr << " can't open " << receiverFile << endl;
+		return false;
+	}
 	bool recompress = decompress(receiverFile);
 	if (!receiver->readLog(receiverFile,MJD,sloppyStartTime,sloppyStopTime,interval)){
 		cerr << "Exiting" << endl;
-		exit(EXIT_FAILURE);
+		return false;
 	}
 	if (recompress) compress(receiverFile);
 	
+	if (!logAvailable(counterFile)){
+		cerr << " can't open " << counterFile << endl;
+		return false;
+	}
 	recompress = decompress(counterFile);
 	if (!counter->readLog(counterFile,startTime,sloppyStopTime)){
 		cerr << "Exiting" << endl;
-		exit(EXIT_FAILURE);
+		return false;
 	}
 	if (recompress) compress(counterFile);
 	
 	matchMeasurements(receiver,counter); // only do this once
 	
+	bool nextDayData=false;
+	if (useAdjacentDays && stopTime + 960 > 86399){
+		// Get the start of the following day so that tracks which cross midnight can be completed
+		nextReceiver = makeReceiver();
+		for (unsigned int i=0;i<receiver->gps.ephemeris.size();i++) // needed to resolve millisecond ambiguities
+			nextReceiver->gps.addEphemeris(new GPS::EphemerisData(*(receiver->gps.ephemeris.at(i))));
+		nextCounter = new Counter(this);
+		nextCounter->flipSign = counter->flipSign;
+		if (readAdjacentDay(MJD+1,0,MPAIRS_OVERLAP-1,nextReceiver,nextCounter)){
+			matchMeasurements(nextReceiver,nextCounter,MPAIRS_SIZE);
+			nextDayData=true;
+		}
+	}
+	
 	// Each system+code generates a CGGTTS file
 	if (createCGGTTS){
 		
@@ -272,20 +390,20 @@ void Application::run()
 			if (CGGTTSoutputs.at(i).ephemerisSource==CGGTTSOutput::UserSupplied){
 				if (CGGTTSoutputs.at(i).constellation == GNSSSystem::GPS){
 					receiver->gps.deleteEphemeris();
-					RINEX rnx;
+					RINEX rnx(this);
 					string fname=rnx.makeFileName(CGGTTSoutputs.at(i).ephemerisFile,MJD);
 					if (fname.empty()){
 						cerr << "Unable to make a RINEX navigation file name from the specified pattern: " << CGGTTSoutputs.at(i).ephemerisFile << endl;
-						exit(EXIT_FAILURE);
+						return false;
 					}
 					string navFile=CGGTTSoutputs.at(i).ephemerisPath+"/"+fname;
 					DBGMSG(debugStream,INFO,"using nav file " << navFile);
 					if (!rnx.readNavigationFile(receiver,GNSSSystem::GPS,navFile)){
-						exit(EXIT_FAILURE);
+						return false;
 					}
 				}
 			}
-			CGGTTS cggtts(antenna,counter,receiver);
+			CGGTTS cggtts(antenna,counter,receiver,this);
 			cggtts.ref=CGGTTSref;
 			cggtts.lab=CGGTTSlab;
 			cggtts.comment=CGGTTScomment;
@@ -304,6 +422,7 @@ void Application::run()
 			cggtts.constellation=CGGTTSoutputs.at(i).constellation;
 			cggtts.code=CGGTTSoutputs.at(i).code;
 			cggtts.calID=CGGTTSoutputs.at(i).calID;
+			cggtts.nextDayData=nextDayData;
 		
 			string CGGTTSfile =makeCGGTTSFilename(CGGTTSoutputs.at(i),MJD);
 			cggtts.writeObservationFile(CGGTTSfile,MJD,startTime,stopTime,mpairs,TICenabled);
@@ -312,7 +431,7 @@ void Application::run()
 	} // if createCGGTTS
 	
 	if (createRINEX){
-		RINEX rnx;
+		RINEX rnx(this);
 		rnx.agency = agency;
 		rnx.observer=observer;
 		rnx.allObservations=allObservations;
@@ -324,7 +443,7 @@ void Application::run()
 	}
 	
 	if (timingDiagnosticsOn) 
-		writeReceiverTimingDiagnostics(receiver,counter,"timing.dat");
+		writeReceiverTimingDiagnostics(receiver,counter,timingDiagnosticsFile);
 	
 	if (SVDiagnosticsOn) 
 		writeSVDiagnostics(receiver,tmpPath);
@@ -340,11 +459,10 @@ void Application::run()
 	DBGMSG(debugStream,INFO,"counter data memory usage: " << ctMem << " bytes");
 	DBGMSG(debugStream,INFO,"total memory usage: " << rxMem + ctMem << " bytes");
 	
-	delete receiver;
-	delete counter;
-	delete antenna;
-	
 	logMessage(timeStamp() + " run finished");
+	logWriter.flush();
+	
+	return true;
 }
 
 void Application::showHelp()
@@ -375,7 +493,8 @@ void Application::showVersion()
 
 string Application::timeStamp(){
 	time_t tt = time(NULL);
-	struct tm *gmt = gmtime(&tt);
+	struct tm tmgmt;
+	struct tm *gmt = gmtime_r(&tt,&tmgmt);
 	char ts[32];
 	sprintf(ts,"%4d-%02d-%02d %02d:%02d:%02d ",gmt->tm_year+1900,gmt->tm_mon+1,gmt->tm_mday,
 		gmt->tm_hour,gmt->tm_min,gmt->tm_sec);
@@ -384,29 +503,90 @@ string Application::timeStamp(){
 
 void Application::logMessage(string msg)
 {
-	ofstream ofs;
-	ofs.open(logFile.c_str(),ios::app);
-	ofs << msg << endl;
-	ofs.close();
+	if (inMemoryOutput){
+		logBuffer += msg + "\n";
+	}
+	else if (logOpen){ // messages before the first run aren't kept, as the log is truncated by run()
+		logWriter.write(&logStream,msg);
+	}
 	
 	DBGMSG(debugStream,INFO,msg);
 }
 
+FILE *Application::openOutputFile(string fname)
+{
+	if (!inMemoryOutput)
+		return fopen(fname.c_str(),"w");
+	
+	// Replace any previous output with the same name
+	for (unsigned int i=0;i<outputBuffers.size();i++){
+		if (outputBuffers.at(i)->name == fname){
+			delete outputBuffers.at(i);
+			outputBuffers.erase(outputBuffers.begin()+i);
+			break;
+		}
+	}
+	OutputBuffer *ob = new OutputBuffer(fname);
+	FILE *fout = open_memstream(&(ob->buf),&(ob->size));
+	if (NULL == fout){
+		delete ob;
+		return NULL;
+	}
+	outputBuffers.push_back(ob);
+	return fout;
+}
+
+vector<string> Application::outputFiles()
+{
+	vector<string> names;
+	for (unsigned int i=0;i<outputBuffers.size();i++)
+		names.push_back(outputBuffers.at(i)->name);
+	return names;
+}
+
+bool Application::getOutput(string fname,string &contents)
+{
+	for (unsigned int i=0;i<outputBuffers.size();i++){
+		if (outputBuffers.at(i)->name == fname){
+			if (NULL == outputBuffers.at(i)->buf)
+				contents="";
+			else
+				contents=string(outputBuffers.at(i)->buf,outputBuffers.at(i)->size);
+			return true;
+		}
+	}
+	return false;
+}
+
 
 //	
 //	Private
 //	
 
+// Sessions in the same process share the pid, so each gets a number too
+static std::atomic<unsigned int> sessionCount(0);
+
 void Application::init()
 {
 	pid = getpid();
+	session = sessionCount++;
 	
 	appName = APP_NAME;
 	
 	antenna = new Antenna();
-	counter = new Counter();
+	counter = new Counter(this);
 	// defer instantiating the receiver until we know what kind is configured
 	receiver = NULL;
+	nextReceiver = NULL;
+	nextCounter = NULL;
+	useAdjacentDays=false;
+	
+	sessionDebugStream=NULL;
+	sessionVerbosity=1;
+	sessionShortDebugMessage=false;
+	
+	inMemoryOutput=false;
+	logOpen=false;
 	
 	createCGGTTS=createRINEX=true;
 	
@@ -459,10 +639,20 @@ void Application::init()
 	
 	gzip="/bin/gzip";
 	
-	mpairs= new MeasurementPair*[MPAIRS_SIZE];
-	for (int i=0;i<MPAIRS_SIZE;i++)
-		mpairs[i]=new MeasurementPair();
+}
 
+void Application::installDebugging()
+{
+	debugStream=sessionDebugStream;
+	verbosity=sessionVerbosity;
+	shortDebugMessage=sessionShortDebugMessage;
+	debugWriter=&logWriter;
+}
+
+bool Application::logAvailable(string f)
+{
+	struct stat statBuf;
+	return (stat(f.c_str(),&statBuf) == 0 || stat((f+".gz").c_str(),&statBuf) == 0);
 }
 
 string Application::relativeToAbsolutePath(string path)
@@ -480,19 +670,16 @@ string Application::relativeToAbsolutePath(string path)
 void  Application::makeFilenames()
 {
 	ostringstream ss;
-	ss << "./" << "timing." << pid << "." << MJD << ".dat";  
+	ss << "./" << "timing." << pid << "." << session << "." << MJD << ".dat";  
 	timingDiagnosticsFile=ss.str();
 	
-	ostringstream ss2;
-	ss2 << counterPath << "/" << MJD << "." << counterExtension;
-	counterFile=ss2.str();
-	
-	ostringstream ss3;
-	ss3 << receiverPath << "/" << MJD << "." << receiverExtension;
-	receiverFile = ss3.str();
+	counterFile=makeLogFilename(counterPath,MJD,counterExtension);
+	if (!userCounterFile.empty()) counterFile=userCounterFile;
+	receiverFile=makeLogFilename(receiverPath,MJD,receiverExtension);
+	if (!userReceiverFile.empty()) receiverFile=userReceiverFile;
 	
 	ostringstream ss4;
-	ss4 << "./" << "processing." << pid << "." << MJD << ".log";
+	ss4 << "./" << "processing." << pid << "." << session << "." << MJD << ".log";
 	processingLog=ss4.str();
 	
 	int year,mon,mday,yday;
@@ -579,8 +766,8 @@ bool Application::loadConfig()
 	// Our conventional config file format is used to maintain compatibility with existing scripts
 	ListEntry *last;
 	if (!configfile_parse_as_list(&last,configurationFile.c_str())){
-		cerr << "Unable to open the configuration file " << configurationFile << " - exiting" << endl;
-		exit(EXIT_FAILURE);
+		cerr << "Unable to open the configuration file " << configurationFile << endl;
+		return false;
 	}
 	
 	bool configOK=true;
@@ -646,6 +833,7 @@ bool Application::loadConfig()
 			}
 		}
 		
+		CGGTTSoutputs.clear();
 		if (setConfig(last,"cggtts","outputs",stmp,&configOK)){
 			std::vector<std::string> configs;
 			boost::split(configs, stmp,boost::is_any_of(","), boost::token_compress_on);
@@ -850,27 +1038,20 @@ bool Application::loadConfig()
 	DBGMSG(debugStream,TRACE,"parsed Antenna config");
 	
 	// Receiver
-	string rxModel,rxManufacturer;
 	setConfig(last,"receiver","model",rxModel,&configOK);
 	
 	if (setConfig(last,"receiver","manufacturer",rxManufacturer,&configOK)){
-		if (rxManufacturer.find("Trimble") != string::npos){
-			receiver = new TrimbleResolution(antenna,rxModel); 
-		}
-		else if (rxManufacturer.find("Javad") != string::npos){
-			receiver = new Javad(antenna,rxModel); 
-		}
-		else if (rxManufacturer.find("NVS") != string::npos){
-			receiver = new NVS(antenna,rxModel); 
-		}
-		else if (rxManufacturer.find("ublox") != string::npos){
-			receiver = new Ublox(antenna,rxModel); 
-		}
-		else{
-			cerr << "A valid receiver model/manufacturer has not been configured - exiting" << endl;
-			exit(EXIT_FAILURE);
+		delete receiver; // if the configuration is reloaded
+		receiver = NULL;
+		receiver = makeReceiver();
+		if (NULL == receiver){
+			cerr << "A valid receiver model/manufacturer has not been configured" << endl;
+			return false;
 		}
 	}
+	else{
+		return false;
+	}
 	
 	if (setConfig(last,"receiver","observations",stmp,&configOK,false)){
 		boost::to_upper(stmp);
@@ -904,6 +1085,7 @@ bool Application::loadConfig()
 	}
 	
 	// Counter
+	counter->flipSign=false;
 	if (setConfig(last,"counter","flip sign",stmp,&configOK,false)){
 		boost::to_upper(stmp);
 		if (stmp=="YES")
@@ -927,6 +1109,11 @@ bool Application::loadConfig()
 	
 	setConfig(last,"misc","gzip",gzip,&configOK,false);
 	
+	if (setConfig(last,"misc","adjacent days",stmp,&configOK,false)){
+		boost::to_upper(stmp);
+		useAdjacentDays = (stmp=="YES");
+	}
+	
 	DBGMSG(debugStream,TRACE,"parsed Misc config");
 	
 	return configOK;
@@ -1059,7 +1246,67 @@ bool Application::writeRIN2CGGTTSParamFile(Receiver *rx, Antenna *ant, string fn
 	return true;
 }
 
-void Application::matchMeasurements(Receiver *rx,Counter *cntr)
+Receiver *Application::makeReceiver()
+{
+	Receiver *rx=NULL;
+	if (rxManufacturer.find("Trimble") != string::npos)
+		rx = new TrimbleResolution(antenna,rxModel,this); 
+	else if (rxManufacturer.find("Javad") != string::npos)
+		rx = new Javad(antenna,rxModel,this); 
+	else if (rxManufacturer.find("NVS") != string::npos)
+		rx = new NVS(antenna,rxModel,this); 
+	else if (rxManufacturer.find("ublox") != string::npos)
+		rx = new Ublox(antenna,rxModel,this); 
+	else
+		return NULL;
+	
+	// Receivers made after the configuration has been read get the same configuration
+	if (NULL != receiver){
+		rx->constellations = receiver->constellations;
+		rx->version = receiver->version;
+		rx->ppsOffset = receiver->ppsOffset;
+		rx->sawtoothPhase = receiver->sawtoothPhase;
+	}
+	return rx;
+}
+
+string Application::makeLogFilename(string path,int mjd,string extension)
+{
+	ostringstream ss;
+	ss << path << "/" << mjd << "." << extension;
+	return ss.str();
+}
+
+bool Application::readAdjacentDay(int mjd,int tStart,int tStop,Receiver *rx,Counter *cntr)
+{
+	// Missing data for adjacent days is not an error
+	string rxFile=makeLogFilename(receiverPath,mjd,receiverExtension);
+	if (!logAvailable(rxFile)){
+		logMessage(rxFile + " is not available");
+		return false;
+	}
+	
+	string cntrFile=makeLogFilename(counterPath,mjd,counterExtension);
+	if (NULL != cntr && !logAvailable(cntrFile)){
+		logMessage(cntrFile + " is not available");
+		return false;
+	}
+	
+	bool recompress = decompress(rxFile);
+	bool ok = rx->readLog(rxFile,mjd,tStart,tStop,interval);
+	if (recompress) compress(rxFile);
+	if (!ok) return false;
+	
+	if (NULL != cntr){
+		recompress = decompress(cntrFile);
+		ok = cntr->readLog(cntrFile,tStart,tStop);
+		if (recompress) compress(cntrFile);
+	}
+	
+	return ok;
+}
+
+void Application::matchMeasurements(Receiver *rx,Counter *cntr,int tOffset)
 {
 	// Measurements are matched using PC time stamps
 	if (cntr->measurements.size() == 0 || rx->measurements.size()==0)
@@ -1071,23 +1318,22 @@ void Application::matchMeasurements(Receiver *rx,Counter *cntr)
 	// (2) Allows the PC clock to step forward (this just looks like a gap)
 	// (3) Allows the PC clock to step back (as might happen on a reboot, and ntpd has not synced up yet).
 	//     In this case, data between from the (previous) time of the step to before the step is discarded.
+	// The array is cleared by the caller, so that measurements from the following day can be 
+	// added with tOffset = MPAIRS_SIZE
+	
+	int npairs = mpairs.size();
 	
-	// Clear the array each time its called
-	for (int i=0;i<MPAIRS_SIZE;i++){ 
-		mpairs[i]->flags=0;
-	}
-		
 	for (unsigned int i=0;i<cntr->measurements.size();i++){
 		CounterMeasurement *cm= cntr->measurements[i];
-		int tcntr=((int) cm->hh)*3600 +  ((int) cm->mm)*60 + ((int) cm->ss);
-		if (tcntr>=0 && tcntr<86400){
-			if (mpairs[tcntr]->flags & 0x01){
-				mpairs[tcntr]->flags |= 0x04; // duplicate
+		int tcntr=((int) cm->hh)*3600 +  ((int) cm->mm)*60 + ((int) cm->ss) + tOffset;
+		if (tcntr>=0 && tcntr<npairs){
+			if (mpairs[tcntr].flags & 0x01){
+				mpairs[tcntr].flags |= 0x04; // duplicate
 				DBGMSG(debugStream,WARNING,"duplicate counter measurement " << (int) cm->hh << ":" << (int) cm->mm << ":" <<(int) cm->ss);
 			}
 			else{
-				mpairs[tcntr]->flags |= 0x01;
-				mpairs[tcntr]->cm=cm;
+				mpairs[tcntr].flags |= 0x01;
+				mpairs[tcntr].cm=cm;
 			}
 		}
 	}
@@ -1099,23 +1345,28 @@ void Application::matchMeasurements(Receiver *rx,Counter *cntr)
 	//
 	for (unsigned int i=0;i<rx->measurements.size();i++){
 		ReceiverMeasurement *rxm = rx->measurements[i];
-		int trx=((int) rxm->pchh)*3600 +  ((int) rxm->pcmm)*60 + ((int) rxm->pcss);
-		if (trx>=0 && trx<MPAIRS_SIZE){
-			if (mpairs[trx]->flags & 0x02){
-				mpairs[trx]->flags |= 0x08; // duplicate
+		int trx=((int) rxm->pchh)*3600 +  ((int) rxm->pcmm)*60 + ((int) rxm->pcss) + tOffset;
+		if (trx>=0 && trx<npairs){
+			if (mpairs[trx].flags & 0x02){
+				mpairs[trx].flags |= 0x08; // duplicate
 				DBGMSG(debugStream,WARNING,"duplicate receiver measurement " << (int) rxm->pchh << ":" << (int) rxm->pcmm << ":" <<(int) rxm->pcss);
 			}
 			else{
-				mpairs[trx]->flags |= 0x02;
-				mpairs[trx]->rm=rxm;
+				mpairs[trx].flags |= 0x02;
+				mpairs[trx].rm=rxm;
 			}
 		}
 	}
 	
+	// Only the part of the table that could have been filled needs to be scanned
+	int tstart = (tOffset > 0 ? tOffset : 0);
+	int tstop  = tOffset + MPAIRS_SIZE;
+	if (tstop > npairs) tstop = npairs;
+	
 	int matchcnt=0;
-	for (unsigned int i=0;i<MPAIRS_SIZE;i++){
-		if (mpairs[i]->flags == 0x03){
-			mpairs[i]->rm->cm = mpairs[i]->cm;
+	for (int i=tstart;i<tstop;i++){
+		if (mpairs[i].flags == 0x03){
+			mpairs[i].rm->cm = mpairs[i].cm;
 			matchcnt++;
 		}
 	}
@@ -1125,11 +1376,11 @@ void Application::matchMeasurements(Receiver *rx,Counter *cntr)
 	// Paranoia
 	// Some downstream algorithms require that the data be time-ordered
 	// so check this.
-	for (unsigned int i=1;i<MPAIRS_SIZE;i++){
-		if (mpairs[i]->flags == 0x03 && mpairs[i-1]->flags == 0x03){
-			ReceiverMeasurement *rxm = mpairs[i-1]->rm;
+	for (int i=tstart+1;i<tstop;i++){
+		if (mpairs[i].flags == 0x03 && mpairs[i-1].flags == 0x03){
+			ReceiverMeasurement *rxm = mpairs[i-1].rm;
 			int trx0=((int) rxm->pchh)*3600 +  ((int) rxm->pcmm)*60 + ((int) rxm->pcss);
-			rxm = mpairs[i]->rm;
+			rxm = mpairs[i].rm;
 			int trx1=((int) rxm->pchh)*3600 +  ((int) rxm->pcmm)*60 + ((int) rxm->pcss);
 			if (trx1 < trx0){ // duplicates are already filtered
 				cerr << "Application::matchMeasurements() not monotonically ordered!" << endl;
@@ -1152,9 +1403,9 @@ void Application::writeReceiverTimingDiagnostics(Receiver *rx,Counter *cntr,stri
 	DBGMSG(debugStream,INFO,"writing to " << fname);
 	
 	for (unsigned int i=0;i<MPAIRS_SIZE;i++){
-		if (mpairs[i]->flags == 0x03){
-			CounterMeasurement *cm= mpairs[i]->cm;
-			ReceiverMeasurement *rxm = mpairs[i]->rm;
+		if (mpairs[i].flags == 0x03){
+			CounterMeasurement *cm= mpairs[i].cm;
+			ReceiverMeasurement *rxm = mpairs[i].rm;
 			int tmatch=((int) cm->hh)*3600 +  ((int) cm->mm)*60 + ((int) cm->ss);
 			fprintf(fout,"%i %g %g %.16e\n",tmatch,cm->rdg,rxm->sawtooth,rxm->timeOffset);
 		}
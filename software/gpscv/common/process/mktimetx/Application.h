@@ -28,12 +28,19 @@
 #include <sys/types.h>
 #include <unistd.h>
        
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <ostream>
 #include <string>
 #include <vector>
 
 #include <boost/concept_check.hpp>
 #include <configurator.h>
 
+#include "LogWriter.h"
+#include "MeasurementPair.h"
+
 #define APP_NAME "mktimetx"
 #define APP_AUTHORS "Michael Wouters,Peter Fisk,Bruce Warrington,Louis Marais,Malcolm Lawn"
 #define APP_VERSION "0.1.2"
@@ -48,7 +55,6 @@ class Counter;
 class Receiver;
 class CounterMeasurement;
 class ReceiverMeasurement;
-class MeasurementPair;
 
 class CGGTTSOutput{
 	public:
@@ -76,15 +82,33 @@ class CGGTTSOutput{
 		
 };
 
+// An output file which has been captured in memory
+class OutputBuffer{
+	public:
+		OutputBuffer(string n):name(n),buf(NULL),size(0){};
+		~OutputBuffer(){free(buf);}
+		
+		string name;
+		char *buf;
+		size_t size;
+};
+
 class Application
 {
 	public:
 		
+		Application(); // for use as a library
 		Application(int argc,char **argv);
 		~Application();
 		
+		bool loadConfig(string configFile);
 		void setMJD(int);
-		void run();
+		void setTimeWindow(int start,int stop);
+		void setReceiverFile(string);
+		void setCounterFile(string);
+		void setDebugging(ostream *os,int verbosity,bool shortMessages=false);
+		void setInMemoryOutput(bool);
+		bool run();
 		
 		void showHelp();
 		void showVersion();
@@ -92,11 +116,18 @@ class Application
 		string timeStamp();
 		void logMessage(string msg);
 		
+		FILE *openOutputFile(string fname);
+		vector<string> outputFiles();
+		bool getOutput(string fname,string &contents);
+		string getProcessingLog(){return logBuffer;}
+		
 	private:
 	
 		enum CGGTTSNamingConvention {Plain,BIPM};
 		
 		void init();
+		void installDebugging();
+		bool logAvailable(string);
 		string relativeToAbsolutePath(string);
 		void   makeFilenames();
 		bool decompress(string);
@@ -111,7 +142,11 @@ class Application
 		
 		bool writeRIN2CGGTTSParamFile(Receiver *,Antenna *,string);
 		
-		void matchMeasurements(Receiver *,Counter *);
+		Receiver *makeReceiver();
+		string makeLogFilename(string path,int mjd,string extension);
+		bool readAdjacentDay(int mjd,int startTime,int stopTime,Receiver *rx,Counter *cntr);
+		
+		void matchMeasurements(Receiver *,Counter *,int tOffset=0);
 		void writeReceiverTimingDiagnostics(Receiver *,Counter *,string);
 		void writeSVDiagnostics(Receiver *,string);
 		
@@ -120,6 +155,10 @@ class Application
 		Antenna *antenna;
 		Receiver *receiver;
 		Counter *counter;
+		Receiver *nextReceiver; // head of the following day
+		Counter *nextCounter;
+		string rxManufacturer,rxModel;
+		bool useAdjacentDays;
 		
 		bool createCGGTTS,createRINEX;
 		vector<CGGTTSOutput> CGGTTSoutputs;
@@ -143,6 +182,20 @@ class Application
 		double antCableDelay,refCableDelay;
 		
 		string logFile;
+		ofstream logStream; // kept open, written by the LogWriter
+		bool logOpen;
+		string logBuffer; // used for in-memory output
+		
+		ostream *sessionDebugStream;
+		ofstream debugLog;
+		int sessionVerbosity;
+		bool sessionShortDebugMessage;
+		
+		LogWriter logWriter; // declared after the streams it writes to, so it is destroyed first
+		
+		bool inMemoryOutput;
+		vector<OutputBuffer *> outputBuffers;
+		string userReceiverFile,userCounterFile; // override the default file names
 		
 		int MJD,startTime,stopTime;
 		int interval;
@@ -161,9 +214,10 @@ class Application
 		
 		string gzip;
 		
-		MeasurementPair **mpairs;
+		MeasurementPairs mpairs;
 		
 		pid_t pid;
+		unsigned int session; // distinguishes sessions in the same process
 		bool timingDiagnosticsOn;
 		bool SVDiagnosticsOn;
 		bool generateNavigationFile;
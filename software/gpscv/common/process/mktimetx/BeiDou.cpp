@@ -34,12 +34,6 @@
 #include "ReceiverMeasurement.h"
 #include "SVMeasurement.h"
 
-extern Application *app;
-extern ostream *debugStream;
-extern string   debugFileName;
-extern ofstream debugLog;
-extern int verbosity;
-
 BeiDou::BeiDou():GNSSSystem()
 {
 	n="BeiDou";
@@ -43,9 +43,6 @@
 #include "ReceiverMeasurement.h"
 #include "Utility.h"
 
-extern Application *app;
-extern ostream *debugStream;
-
 #define NTRACKS 89
 #define MAXSV   32 // per constellation 
 
@@ -53,18 +50,19 @@ extern ostream *debugStream;
 //	Public members
 //
 
-CGGTTS::CGGTTS(Antenna *a,Counter *c,Receiver *r)
+CGGTTS::CGGTTS(Antenna *a,Counter *c,Receiver *r,Application *ap)
 {
+	app=ap;
 	ant=a;
 	cntr=c;
 	rx=r;
 	init();
 }
 
-bool CGGTTS::writeObservationFile(string fname,int mjd,int startTime,int stopTime,MeasurementPair **mpairs,bool TICenabled)
+bool CGGTTS::writeObservationFile(string fname,int mjd,int startTime,int stopTime,MeasurementPairs &mpairs,bool TICenabled)
 {
 	FILE *fout;
-	if (!(fout = fopen(fname.c_str(),"w"))){
+	if (!(fout = app->openOutputFile(fname))){
 		cerr << "Unable to open " << fname << endl;
 		return false;
 	}
@@ -120,8 +118,8 @@ bool CGGTTS::writeObservationFile(string fname,int mjd,int startTime,int stopTim
 		// Don't be fancy - no ordering
 		char sout[155];
 		for (int m=startTime;m<=stopTime;m++){	
-			if ((mpairs[m]->flags==0x03)){
-				ReceiverMeasurement *rm = mpairs[m]->rm;
+			if ((mpairs[m].flags==0x03)){
+				ReceiverMeasurement *rm = mpairs[m].rm;
 				int tmeas=rint(rm->tmUTC.tm_sec + rm->tmUTC.tm_min*60+ rm->tmUTC.tm_hour*3600+rm->tmfracs);
 				int hh = tmeas / 3600;
 				int mm = (tmeas - hh*3600)/60;
@@ -199,7 +197,7 @@ bool CGGTTS::writeObservationFile(string fname,int mjd,int startTime,int stopTim
 	std::sort(schedule,schedule+NTRACKS); // don't include the last element, which may or may not be used
 	
 	// Fixup - one more track possibly at the end of the day
-	// Will need the next day's data to use this properly though
+	// This needs the next day's data to be complete
 	if ((schedule[NTRACKS-1]%60) < 43){
 		schedule[NTRACKS]=schedule[NTRACKS-1]+16;
 		ntracks++;
@@ -217,14 +215,15 @@ bool CGGTTS::writeObservationFile(string fname,int mjd,int startTime,int stopTim
 	for (int i=0;i<ntracks;i++){
 		int trackStart = schedule[i]*60;
 		int trackStop =  schedule[i]*60+780-1;
-		if (trackStop >= 86400) trackStop=86400-1;
+		int lastTOD = (nextDayData? mpairs.size():MPAIRS_SIZE) - 1;
+		if (trackStop > lastTOD) trackStop=lastTOD;
 		// Now window it
 		if (trackStart < startTime || trackStart > stopTime) continue;
 		// Matched measurement pairs can be looked up without a search since the index is TOD
 		for (int m=trackStart;m<=trackStop;m++){
 			
-			if ((mpairs[m]->flags==0x03)){
-				ReceiverMeasurement *rm = mpairs[m]->rm;
+			if ((mpairs[m].flags==0x03)){
+				ReceiverMeasurement *rm = mpairs[m].rm;
 				for (unsigned int sv=0;sv<rm->meas.size();sv++){
 					SVMeasurement * svm = rm->meas.at(sv);
 					if (svm->constellation == constellation && svm->code == code)
@@ -254,7 +253,7 @@ bool CGGTTS::writeObservationFile(string fname,int mjd,int startTime,int stopTim
 				int t=trackStart;
 				while (t<=trackStop){
 					ReceiverMeasurement *rxm = svtrk[sv].at(isv)->rm;
-					int tmeas=rint(rxm->tmUTC.tm_sec + rxm->tmUTC.tm_min*60+ rxm->tmUTC.tm_hour*3600+rxm->tmfracs); // tmfracs is set to zero by interpolateMeasurements()
+					int tmeas=measurementTime(rxm,trackStop); // tmfracs is set to zero by interpolateMeasurements()
 					if (t==tmeas){
 						// FIXME MDIO needs to change for L2
 						if (nqfitpts > 14){ // shouldn't happen
@@ -292,6 +291,9 @@ bool CGGTTS::writeObservationFile(string fname,int mjd,int startTime,int stopTim
 							// Compute and save GPS TOW so that we have it available for computing the pseudorange corrections
 							// FIXME This does not handle the week rollover 
 							unsigned int gpsDay = (rxm->gpstow / 86400); // use the last receiver measurement for day number
+							if (measurementTime(rxm,trackStop) >= 86400){ // it's from the following day
+								gpsDay = (gpsDay == 0 ? 6 : gpsDay-1);
+							}
 							unsigned int TOD = tc+rx->leapsecs;
 							if (TOD >= 86400){
 								TOD -= 86400;
@@ -301,7 +303,7 @@ bool CGGTTS::writeObservationFile(string fname,int mjd,int startTime,int stopTim
 								}
 							}
 							// FIXME as a kludge could just drop points at the week rollover
-							gpsTOW[nqfits] =  tc + rx->leapsecs + gpsDay*86400;
+							gpsTOW[nqfits] =  TOD + gpsDay*86400;
 							Utility::quadFit(qtutc,qprange,nqfitpts,tc,&(uncorrprange[nqfits]) );
 							Utility::quadFit(qtutc,qrefpps,nqfitpts,tc,&(refpps[nqfits]) );
 							nqfits++;
@@ -347,7 +349,7 @@ bool CGGTTS::writeObservationFile(string fname,int mjd,int startTime,int stopTim
 				while (t< (int) svtrk[sv].size()){
 					svtrk[sv].at(t)->dbuf2=0.0;
 					ReceiverMeasurement *rxmt = svtrk[sv].at(t)->rm;
-					int tmeas=rint(rxmt->tmUTC.tm_sec + rxmt->tmUTC.tm_min*60+ rxmt->tmUTC.tm_hour*3600+rxmt->tmfracs);
+					int tmeas=measurementTime(rxmt,trackStop);
 					if (tmeas==tsearch){
 						if (ed==NULL) // use only one ephemeris for each track
 							ed = rx->gps.nearestEphemeris(sv,rxmt->gpstow,maxURA);
@@ -494,8 +496,19 @@ void CGGTTS::init()
 	minElevation=10.0;
 	maxDSG=100.0;
 	maxURA=3.0; // as reported by receivers, typically 2.0 m, with a few at 2.8 m
+	nextDayData=false;
 }
 		
+// Time of measurement, as TOD
+// For a track which crosses midnight, measurements from the following day are placed after 86399
+int CGGTTS::measurementTime(ReceiverMeasurement *rm,int trackStop)
+{
+	int tmeas=rint(rm->tmUTC.tm_sec + rm->tmUTC.tm_min*60+ rm->tmUTC.tm_hour*3600+rm->tmfracs);
+	if (trackStop >= 86400 && tmeas < 43200)
+		tmeas += 86400;
+	return tmeas;
+}
+
 void CGGTTS::writeHeader(FILE *fout)
 {
 #define MAXCHARS 128
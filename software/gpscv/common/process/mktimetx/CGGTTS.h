@@ -29,9 +29,11 @@
 #include <boost/concept_check.hpp>
 
 class Antenna;
+class Application;
 class Counter;
-class MeasurementPair;
+class MeasurementPairs;
 class Receiver;
+class ReceiverMeasurement;
 
 using namespace std;
 
@@ -43,8 +45,8 @@ class CGGTTS
 		enum CGGTTSVERSIONS {V1=0, V2E=2}; // used as array indices too ..
 		enum DELAYS {INTDLY=0,SYSDLY=2,TOTDLY=3};
 		
-		CGGTTS(Antenna *,Counter *,Receiver *);
-		bool writeObservationFile(string fname,int mjd,int startTime,int stopTime,MeasurementPair **mpairs,bool TICenabled);
+		CGGTTS(Antenna *,Counter *,Receiver *,Application *);
+		bool writeObservationFile(string fname,int mjd,int startTime,int stopTime,MeasurementPairs &mpairs,bool TICenabled);
 	
 		string ref;
 		string lab;
@@ -65,16 +67,20 @@ class CGGTTS
 		double maxDSG; // in ns
 		double maxURA; // in m
 		
+		bool nextDayData; // measurements from the start of the following day are in the pair table
+		
 	private:
 		
 		void init();
 		
 		void writeHeader(FILE *fout);
 		int checkSum(char *);
+		int measurementTime(ReceiverMeasurement *,int trackStop);
 		
 		Antenna *ant;
 		Counter *cntr;
 		Receiver *rx;
+		Application *app;
 		
 };
 
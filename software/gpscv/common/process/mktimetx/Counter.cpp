@@ -39,15 +39,13 @@
 
 #define MAXSIZE 90000
 
-extern ostream *debugStream;
-extern Application *app;
-
 //
 //	public methods
 //		
 
-Counter::Counter()
+Counter::Counter(Application *a)
 {
+	app=a;
 	flipSign=false;
 }
 
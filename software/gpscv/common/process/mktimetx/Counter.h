@@ -32,13 +32,14 @@
 
 using namespace std;
 
+class Application;
 class CounterMeasurement;
 
 class Counter
 {
 	public:
 		
-		Counter();
+		Counter(Application *);
 		~Counter();
 	
 		bool readLog(string,int startTime=0,int stopTime=86399);
@@ -47,6 +48,10 @@ class Counter
 		vector<CounterMeasurement *> measurements;
 	
 		unsigned int memoryUsage();
+	
+	private:
+	
+		Application *app;
 		
 };
 
@@ -25,23 +25,45 @@
 #ifndef __DEBUG_H_
 #define __DEBUG_H_
 
-extern int verbosity;
-extern bool shortDebugMessage;
+#include <ostream>
+#include <sstream>
+
+class LogWriter;
+
+// Debugging state is per-thread so that processing sessions running in 
+// different threads don't interfere with each other
+extern thread_local std::ostream *debugStream;
+extern thread_local int verbosity;
+extern thread_local bool shortDebugMessage;
+extern thread_local LogWriter *debugWriter; // the session's writer
 
 #define INFO    1
 #define WARNING 2
 #define TRACE 3
 
+// Build with eg -DDEBUG_LEVEL=WARNING to remove the messages above WARNING at compile time,
+// including the TRACE messages in the measurement loops. By default, nothing is removed.
+#ifdef DEBUG_LEVEL
+	#define DBG_COMPILED(v) (v <= DEBUG_LEVEL)
+#else
+	#define DBG_COMPILED(v) true
+#endif
+
+// Formatted messages are handed to the LogWriter, which does the I/O 
+void debugWrite(std::ostream *os,const std::string &msg);
+
 // NB null stream indicates debugging off
 #ifdef DEBUG
 	#define DBGMSG( os, v, msg ) \
-  if (NULL != os && v<=verbosity) \
-		{if (shortDebugMessage)\
-			(*os) <<  __FUNCTION__ << "() "<< msg << std::endl; \
+  if (DBG_COMPILED(v) && NULL != os && v<=verbosity) \
+		{std::ostringstream dbgss;\
+		if (shortDebugMessage)\
+			dbgss <<  __FUNCTION__ << "() "<< msg; \
 		else\
-			(*os) << __FILE__ << "(" << __LINE__ << ") " << __FUNCTION__ << "() " << msg << std::endl;}
+			dbgss << __FILE__ << "(" << __LINE__ << ") " << __FUNCTION__ << "() " << msg;\
+		debugWrite(os,dbgss.str());}
 #else
-	#define DBGMSG( os, msg ) 
+	#define DBGMSG( os, v, msg ) 
 #endif
 
 #endif
@@ -42,14 +42,13 @@
 #define F -4.442807633e-10
 #define MAX_ITERATIONS 10 // for solution of the Kepler equation
 
-extern Application *app;
-extern ostream *debugStream;
-extern string   debugFileName;
-extern ofstream debugLog;
-extern int verbosity;
-
 #define CLIGHT 299792458.0
 
+// Orbit interpolation 
+#define ORBIT_NODE_SPACING 60   // in s
+#define ORBIT_CACHE_SPAN   14400 // cached nodes cover tk in [-ORBIT_CACHE_SPAN,ORBIT_CACHE_SPAN]
+#define ORBIT_INTERP_ORDER 8    // number of nodes used - errors are a few mm with 60 s spacing
+
 // Lookup table to convert URA index [0,15] to URA value in m for SV accuracy
 
 static const double URAvalues[] = {2,2.8,4,5.7,8,11.3,16,32,64,128,256,512,1024,2048,4096,0.0};
@@ -72,6 +71,9 @@ void GPS::deleteEphemeris()
 {
 	DBGMSG(debugStream,TRACE,"deleting rx ephemeris");
 	
+	for (int i=0;i<=NSATS;i++) 
+		orbitCache[i].ed=NULL;
+	
 	while(! ephemeris.empty()){
 		EphemerisData  *tmp= ephemeris.back();
 		delete tmp;
@@ -95,6 +97,8 @@ void GPS::addEphemeris(EphemerisData *ed)
 	for (issue=0;issue < (int) sortedEphemeris[ed->SVN].size();issue++){
 		if (sortedEphemeris[ed->SVN][issue]->t_oe == ed->t_oe){
 			DBGMSG(debugStream,4,"ephemeris: duplicate SVN= "<< (unsigned int) ed->SVN << " toe= " << ed->t_oe);
+			if (!ed->previousDay) // broadcast today too, so it belongs in today's navigation file
+				sortedEphemeris[ed->SVN][issue]->previousDay=false;
 			return;
 		}
 	}
@@ -254,7 +258,7 @@ bool GPS::resolveMsAmbiguity(Antenna* antenna,ReceiverMeasurement *rxm,SVMeasure
 		double tk = gpssvt - clockCorrection;
 		
 		double range,ms,svdist,svrange,ax,ay,az;
-		if (satXYZ(ed,tk,&Ek,x)){
+		if (interpolatedSatXYZ(ed,tk,&Ek,x)){
 			double trel =  -4.442807633e-10*ed->e*ed->sqrtA*sin(Ek);
 			range = svm->meas + clockCorrection + trel - ed->t_GD;
 			// Correction for Earth rotation (Sagnac) (ICD 20.3.3.4.3.4)
@@ -342,6 +346,68 @@ bool GPS::satXYZ(GPS::EphemerisData *ed,double t,double *Ek,double x[3])
 	return true;
 }
 
+class LagrangeDenominators
+{
+	public:
+		LagrangeDenominators(){
+			for (int i=0;i<ORBIT_INTERP_ORDER;i++){
+				d[i]=1.0;
+				for (int j=0;j<ORBIT_INTERP_ORDER;j++)
+					if (j != i) d[i] *= (i-j);
+			}
+		}
+		double d[ORBIT_INTERP_ORDER];
+};
+
+bool GPS::interpolatedSatXYZ(GPS::EphemerisData *ed,double t,double *Ek,double x[3])
+{
+	// Same as satXYZ(), but uses Lagrange interpolation between cached nodes.
+	// Falls back to satXYZ() outside the cached span.
+	
+	double tk;
+	if ( (tk = t - ed->t_oe) > 302400) tk -= 604800;
+	else if (tk < -302400) tk += 604800;
+	
+	int k0 = (int) floor(tk/ORBIT_NODE_SPACING) - (ORBIT_INTERP_ORDER/2 - 1);
+	int nmax = ORBIT_CACHE_SPAN/ORBIT_NODE_SPACING;
+	if (k0 < -nmax || k0 + ORBIT_INTERP_ORDER - 1 > nmax)
+		return satXYZ(ed,t,Ek,x);
+	
+	OrbitCache *oc = &(orbitCache[ed->SVN]);
+	if (oc->ed != ed){
+		oc->ed = ed;
+		oc->nodes.assign(2*nmax+1,OrbitNode());
+	}
+	
+	OrbitNode *nodes[ORBIT_INTERP_ORDER];
+	for (int i=0;i<ORBIT_INTERP_ORDER;i++){
+		nodes[i] = orbitNode(oc,k0+i);
+		if (!(nodes[i]->ok))
+			return satXYZ(ed,t,Ek,x);
+	}
+	
+	// Lagrange interpolation with u in node spacings from node k0
+	// The weights are products of (u-j) over j != i, formed from prefix and suffix products,
+	// divided by the constant denominators prod (i-j)
+	static const LagrangeDenominators denom; 
+	
+	double u = tk/ORBIT_NODE_SPACING - k0;
+	double prefix[ORBIT_INTERP_ORDER],suffix=1.0;
+	prefix[0]=1.0;
+	for (int i=1;i<ORBIT_INTERP_ORDER;i++)
+		prefix[i]=prefix[i-1]*(u-(i-1));
+	*Ek=x[0]=x[1]=x[2]=0.0;
+	for (int i=ORBIT_INTERP_ORDER-1;i>=0;i--){
+		double w=prefix[i]*suffix/denom.d[i];
+		suffix *= (u-i);
+		x[0] += w*nodes[i]->x[0];
+		x[1] += w*nodes[i]->x[1];
+		x[2] += w*nodes[i]->x[2];
+		*Ek  += w*nodes[i]->Ek;
+	}
+	return true;
+}
+
 double GPS::sattime(GPS::EphemerisData *ed,double Ek,double tsv,double toc)
 {
 	// SV clock correction as per ICD 20.3.3.3.3.1
@@ -351,6 +417,16 @@ double GPS::sattime(GPS::EphemerisData *ed,double Ek,double tsv,double toc)
 
 #undef F
 
+GPS::OrbitNode *GPS::orbitNode(GPS::OrbitCache *oc,int k)
+{
+	OrbitNode *node = &(oc->nodes[k + ORBIT_CACHE_SPAN/ORBIT_NODE_SPACING]);
+	if (!(node->computed)){
+		node->ok = satXYZ(oc->ed,oc->ed->t_oe + k*ORBIT_NODE_SPACING,&(node->Ek),node->x);
+		node->computed=true;
+	}
+	return node;
+}
+
 double GPS::ionoDelay(double az, double elev, double lat, double longitude, double GPSt,
 	float alpha0,float alpha1,float alpha2,float alpha3,
 	float beta0,float beta1,float beta2,float beta3)
@@ -450,7 +526,7 @@ bool GPS::getPseudorangeCorrections(double gpsTOW, double pRange, Antenna *ant,
 		double tk = gpssvt - clockCorrection;
 		
 		double range,svdist,svrange,ax,ay,az;
-		if (GPS::satXYZ(ed,tk,&Ek,x)){
+		if (interpolatedSatXYZ(ed,tk,&Ek,x)){
 			double relativisticCorrection =  -4.442807633e-10*ed->e*ed->sqrtA*sin(Ek);
 			range = pRange + clockCorrection + relativisticCorrection - freqCorr*ed->t_GD;
 			// Sagnac correction (ICD 20.3.3.4.3.4)
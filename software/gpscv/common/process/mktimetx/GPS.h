@@ -76,6 +76,8 @@ class GPS: public GNSSSystem
 	{
 		
 		public:
+			EphemerisData():previousDay(false){};
+			
 			UINT8 SVN;
 			SINGLE t_ephem;
 			UINT16 week_number;
@@ -112,6 +114,7 @@ class GPS: public GNSSSystem
 			DOUBLE ODOT_n;
 			
 			int tLogged; // TOD the ephemeris message was logged in seconds - used for debugging
+			bool previousDay; // carried over from the previous day, so not written to the navigation file
 	};
 	
 	GPS();
@@ -132,6 +135,7 @@ class GPS: public GNSSSystem
 	bool resolveMsAmbiguity(Antenna *,ReceiverMeasurement *,SVMeasurement *,double *);
 	
 	bool satXYZ(EphemerisData *ed,double t,double *Ek,double x[3]);
+	bool interpolatedSatXYZ(EphemerisData *ed,double t,double *Ek,double x[3]);
 	
 	double sattime(EphemerisData *ed,double Ek,double tsv,double toc);
 	
@@ -153,6 +157,30 @@ class GPS: public GNSSSystem
 	
 	time_t L1lastunlock[NSATS+1]; // used for tracking loss of carrier-phase lock
 	
+	private:
+	
+	// Satellite positions evaluated from the ephemeris at regularly spaced nodes,
+	// for interpolation. Nodes are computed on demand. 
+	class OrbitNode
+	{
+		public:
+			OrbitNode():computed(false),ok(false){}
+			bool computed,ok;
+			double x[3],Ek;
+	};
+	
+	class OrbitCache
+	{
+		public:
+			OrbitCache():ed(NULL){}
+			EphemerisData *ed; // the cache is invalidated when this changes
+			std::vector<OrbitNode> nodes;
+	};
+	
+	OrbitCache orbitCache[NSATS+1];
+	
+	OrbitNode *orbitNode(OrbitCache *,int);
+	
 };
 
 #endif
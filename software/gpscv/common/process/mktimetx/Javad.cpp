@@ -54,9 +54,6 @@
 #include "SVMeasurement.h"
 #include "Timer.h"
 
-extern ostream *debugStream;
-extern Application *app;
-
 // JAVAD types
 #define I1 char
 #define I2 short
@@ -86,7 +83,7 @@ extern Application *app;
 #define YA_MSG 0x2000
 #define ZA_MSG 0x4000
 
-Javad::Javad(Antenna *ant,string m):Receiver(ant)
+Javad::Javad(Antenna *ant,string m,Application *a):Receiver(ant,a)
 {
   modelName=m;
 	manufacturer="Javad";
@@ -902,8 +899,7 @@ bool Javad::readLog(string fname,int mjd,int startTime,int stopTime,int rinexObs
 	for (unsigned int i=0;i<measurements.size();i++){
 		time_t tUTC = mktime(&(measurements[i]->tmGPS));
 		tUTC -= leapsecs;
-		struct tm *tmUTC = gmtime(&tUTC);
-		measurements[i]->tmUTC=*tmUTC;
+		gmtime_r(&tUTC,&(measurements[i]->tmUTC));
 	}
 	
 	// Extract the receiver id
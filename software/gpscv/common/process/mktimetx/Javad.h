@@ -36,7 +36,7 @@ class Javad:public Receiver
 {
 	public:
 		
-		Javad(Antenna *,string);
+		Javad(Antenna *,string,Application *);
 		virtual ~Javad();
 	
 		virtual bool readLog(string,int,int,int,int);
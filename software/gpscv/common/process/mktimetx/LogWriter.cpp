@@ -0,0 +1,98 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2017  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <chrono>
+
+#include "LogWriter.h"
+
+#define WRITER_SLEEP 10 // in ms
+
+LogWriter::LogWriter():head(NULL),pending(0),stop(false)
+{
+	writer = std::thread(&LogWriter::run,this);
+}
+
+LogWriter::~LogWriter()
+{
+	stop=true;
+	writer.join();
+	drain(); 
+}
+
+void LogWriter::write(std::ostream *os,const std::string &msg)
+{
+	Entry *e = new Entry(os,msg);
+	pending++;
+	e->next = head.load(std::memory_order_relaxed);
+	while (!head.compare_exchange_weak(e->next,e,std::memory_order_release,std::memory_order_relaxed));
+}
+
+void LogWriter::flush()
+{
+	while (pending > 0)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+//
+// private
+//
+
+void LogWriter::run()
+{
+	while (!stop){
+		if (!drain())
+			std::this_thread::sleep_for(std::chrono::milliseconds(WRITER_SLEEP));
+	}
+}
+
+bool LogWriter::drain()
+{
+	Entry *e = head.exchange(NULL,std::memory_order_acquire);
+	if (NULL == e) return false;
+	
+	// the list is newest first so reverse it
+	Entry *fifo=NULL;
+	while (e){
+		Entry *next = e->next;
+		e->next = fifo;
+		fifo = e;
+		e = next;
+	}
+	
+	std::ostream *last=NULL;
+	unsigned long n=0;
+	while (fifo){
+		if (last && fifo->os != last) last->flush();
+		last = fifo->os;
+		(*last) << fifo->msg << "\n";
+		Entry *next = fifo->next;
+		delete fifo;
+		fifo = next;
+		n++;
+	}
+	if (last) last->flush();
+	pending -= n;
+	return true;
+}
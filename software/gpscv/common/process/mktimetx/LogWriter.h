@@ -0,0 +1,74 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2017  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifndef __LOG_WRITER_H_
+#define __LOG_WRITER_H_
+
+#include <atomic>
+#include <ostream>
+#include <string>
+#include <thread>
+
+// Queues messages for writing by a background thread.
+// Producers push onto a lock-free list so that logging from the processing
+// paths never blocks on I/O or on other threads. The writer takes the whole 
+// list at once, restores the order of arrival and writes it out.
+// Each processing session has its own LogWriter, so flushing one session
+// doesn't wait on the others.
+
+class LogWriter
+{
+	public:
+	
+		LogWriter();
+		~LogWriter();
+		
+		void write(std::ostream *os,const std::string &msg);
+		void flush(); // blocks until all queued messages have been written
+		
+	private:
+	
+		class Entry
+		{
+			public:
+				Entry(std::ostream *s,const std::string &m):os(s),msg(m),next(NULL){}
+				std::ostream *os;
+				std::string msg;
+				Entry *next;
+		};
+		
+		LogWriter(const LogWriter &);
+		LogWriter &operator=(const LogWriter &);
+		
+		void run();
+		bool drain();
+		
+		std::atomic<Entry *> head;
+		std::atomic<unsigned long> pending;
+		std::atomic<bool> stop;
+		std::thread writer;
+};
+
+#endif
@@ -44,14 +44,6 @@
 #include "Debug.h"
 #include "Application.h"
 
-ostream *debugStream;
-string   debugFileName;
-ofstream debugLog;
-int verbosity=1;
-bool shortDebugMessage=false;
-
-extern Application *app;
-
 int main(
 	int argc,
 	char **argv)
@@ -61,10 +53,9 @@ int main(
 	setenv("TZ","UTC",1);
 	tzset();
 	
-	debugStream= NULL;
-	new Application(argc,argv); // this will initialize 'app'
-	app->run();
+	Application *app = new Application(argc,argv);
+	bool ok = app->run();
+	delete app;
 	
-	return EXIT_SUCCESS;
+	return (ok ? EXIT_SUCCESS : EXIT_FAILURE);
 }
-
@@ -25,7 +25,14 @@
 #ifndef __MEASUREMENT_PAIR_H_
 #define __MEASUREMENT_PAIR_H_
 
+#include <cstdlib>
+#include <new>
+
 #define MPAIRS_SIZE 86400
+#define MPAIRS_OVERLAP 960 // enough of the following day to complete CGGTTS tracks which cross midnight
+
+class CounterMeasurement;
+class ReceiverMeasurement;
 
 class MeasurementPair
 {
@@ -42,5 +49,49 @@ class MeasurementPair
 		ReceiverMeasurement *rm;
 };
 
-#endif
+// A flat table of measurement pairs, indexed by time of day.
+// It is allocated once, as a single cache-aligned block, and reused for each day that is processed.
+// std::bad_alloc is thrown if the allocation fails.
+// Entries from MPAIRS_SIZE onwards hold measurements from the start of the following day.
 
+class MeasurementPairs
+{
+	public:
+		MeasurementPairs(int n=MPAIRS_SIZE+MPAIRS_OVERLAP)
+		{
+			void *mem=NULL;
+			if (0 != posix_memalign(&mem,64,n*sizeof(MeasurementPair)))
+				throw std::bad_alloc(); // as new[] would
+			pairs = (MeasurementPair *) mem;
+			npairs=n;
+			clear();
+		}
+		
+		~MeasurementPairs()
+		{
+			free(pairs);
+		}
+		
+		void clear()
+		{
+			for (int i=0;i<npairs;i++){
+				pairs[i].flags=0;
+				pairs[i].cm=NULL;
+				pairs[i].rm=NULL;
+			}
+		}
+		
+		int size(){return npairs;}
+		
+		MeasurementPair & operator[](int i){return pairs[i];}
+		
+	private:
+		
+		MeasurementPairs(const MeasurementPairs &);
+		MeasurementPairs & operator=(const MeasurementPairs &);
+		
+		MeasurementPair *pairs;
+		int npairs;
+};
+
+#endif
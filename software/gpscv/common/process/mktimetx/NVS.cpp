@@ -47,9 +47,6 @@
 #include "ReceiverMeasurement.h"
 #include "SVMeasurement.h"
 
-extern ostream *debugStream;
-extern Application *app;
-
 #define MAX_CHANNELS 16 // max channels per constellation
 
 typedef unsigned char INT8U;
@@ -96,7 +93,7 @@ double FP80toFP64(uint8_t *buf)
 	return sign * pow(2,(int) exponent - 16383) * (normalizeCorrection + (double) mantissa/((uint64_t)1 << 63));
 }
 
-NVS::NVS(Antenna *ant,string m):Receiver(ant)
+NVS::NVS(Antenna *ant,string m,Application *a):Receiver(ant,a)
 {
 	modelName=m;
 	manufacturer="NVS";
@@ -206,8 +203,7 @@ bool NVS::readLog(string fname,int mjd,int startTime,int stopTime,int rinexObsIn
 						
 						// Calculate GPS time of measurement 
 						time_t tgps = GPS::GPStoUnix(rmeas->gpstow,rmeas->gpswn);
-						struct tm *tmGPS = gmtime(&tgps);
-						rmeas->tmGPS=*tmGPS;
+						gmtime_r(&tgps,&(rmeas->tmGPS));
 						
 						// This may seem obscure.
 						// What we're doing here is calculating the offset of the measurement time
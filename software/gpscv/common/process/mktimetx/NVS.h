@@ -36,7 +36,7 @@ class NVS:public Receiver
 {
 	public:
 		
-		NVS(Antenna *,string);
+		NVS(Antenna *,string,Application *);
 		virtual ~NVS();
 	
 		virtual bool readLog(string,int,int,int,int);
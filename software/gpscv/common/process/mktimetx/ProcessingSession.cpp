@@ -0,0 +1,95 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2017  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "Application.h"
+#include "ProcessingSession.h"
+
+//
+//	Public
+//
+
+ProcessingSession::ProcessingSession()
+{
+	app = new Application();
+}
+
+ProcessingSession::~ProcessingSession()
+{
+	delete app;
+}
+
+bool ProcessingSession::loadConfig(string configFile)
+{
+	return app->loadConfig(configFile);
+}
+
+void ProcessingSession::setMJD(int mjd)
+{
+	app->setMJD(mjd);
+}
+
+void ProcessingSession::setTimeWindow(int startTime,int stopTime)
+{
+	app->setTimeWindow(startTime,stopTime);
+}
+
+void ProcessingSession::setReceiverLog(string fname)
+{
+	app->setReceiverFile(fname);
+}
+
+void ProcessingSession::setCounterLog(string fname)
+{
+	app->setCounterFile(fname);
+}
+
+void ProcessingSession::setDebugging(ostream *os,int verbosity,bool shortMessages)
+{
+	app->setDebugging(os,verbosity,shortMessages);
+}
+
+void ProcessingSession::setInMemoryOutput(bool on)
+{
+	app->setInMemoryOutput(on);
+}
+
+bool ProcessingSession::run()
+{
+	return app->run();
+}
+
+vector<string> ProcessingSession::outputFiles()
+{
+	return app->outputFiles();
+}
+
+bool ProcessingSession::getOutput(string fname,string &contents)
+{
+	return app->getOutput(fname,contents);
+}
+
+string ProcessingSession::processingLog()
+{
+	return app->getProcessingLog();
+}
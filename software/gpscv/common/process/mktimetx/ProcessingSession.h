@@ -0,0 +1,73 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2017  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef __PROCESSING_SESSION_H_
+#define __PROCESSING_SESSION_H_
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class Application;
+
+// The public interface to libmktimetx
+// A ProcessingSession processes one day of data for one station.
+// It can be run again, eg for another day, after changing the MJD.
+// Sessions share no state, so several can be run concurrently, one per thread.
+// Note that the process must be using UTC (TZ=UTC) so that mktime() works as expected.
+
+class ProcessingSession
+{
+	public:
+		
+		ProcessingSession();
+		~ProcessingSession();
+		
+		bool loadConfig(string configFile);
+		
+		void setMJD(int mjd);
+		void setTimeWindow(int startTime,int stopTime); // TOD in seconds
+		void setReceiverLog(string fname); // override the configured paths
+		void setCounterLog(string fname);
+		void setDebugging(ostream *os,int verbosity,bool shortMessages=false);
+		void setInMemoryOutput(bool on); // by default, output files are written as configured
+		
+		bool run();
+		
+		// Results of the run, when in-memory output is used
+		vector<string> outputFiles(); // the names output files would have had
+		bool getOutput(string fname,string &contents);
+		string processingLog();
+		
+	private:
+		
+		ProcessingSession(const ProcessingSession &);
+		ProcessingSession & operator=(const ProcessingSession &);
+		
+		Application *app;
+};
+
+#endif
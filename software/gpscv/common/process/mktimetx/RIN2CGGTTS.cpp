@@ -29,8 +29,6 @@
 #include "RIN2CGGTTS.h"
 #include "Utility.h"
 
-extern ostream *debugStream;
-
 bool RIN2CGGTTS::read(string paramsFile)
 {
 	DBGMSG(debugStream,1,"reading" << paramsFile);
@@ -126,5 +124,5 @@ bool RIN2CGGTTS::getParam(ifstream &fin,string &currParam,string param,int *val)
 		}
 	}
 	return true;
-}extern ostream *debugStream;
+}
 
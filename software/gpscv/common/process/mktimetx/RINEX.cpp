@@ -48,11 +48,7 @@
 #include "RINEX.h"
 #include "Utility.h"
 
-extern Application *app;
-extern ostream *debugStream;
-
 const char * RINEXVersionName[]= {"2.11","3.03"};
-char gsbuf[256];
 
 #define SBUFSIZE 160
 
@@ -60,16 +56,17 @@ char gsbuf[256];
 // Public methods
 //
 		
-RINEX::RINEX()
+RINEX::RINEX(Application *a)
 {
+	app=a;
 	init();
 }
 
-bool RINEX::writeObservationFile(Antenna *ant, Counter *cntr, Receiver *rx,int ver,string fname,int mjd,int interval, MeasurementPair **mpairs,bool TICenabled)
+bool RINEX::writeObservationFile(Antenna *ant, Counter *cntr, Receiver *rx,int ver,string fname,int mjd,int interval, MeasurementPairs &mpairs,bool TICenabled)
 {
 	char buf[81];
 	FILE *fout;
-	if (!(fout = fopen(fname.c_str(),"w"))){
+	if (!(fout = app->openOutputFile(fname))){
 		return false;
 	}
 	
@@ -88,7 +85,8 @@ bool RINEX::writeObservationFile(Antenna *ant, Counter *cntr, Receiver *rx,int v
 	fprintf(fout,"%9s%11s%-20s%c%-19s%-20s\n",RINEXVersionName[ver],"","O",obs,"","RINEX VERSION / TYPE");
 	
 	time_t tnow = time(NULL);
-	struct tm *tgmt = gmtime(&tnow);
+	struct tm tmgmt;
+	struct tm *tgmt = gmtime_r(&tnow,&tmgmt);
 	
 	switch (ver){
 		case V2:
@@ -204,8 +202,8 @@ bool RINEX::writeObservationFile(Antenna *ant, Counter *cntr, Receiver *rx,int v
 	int obsTime=0;
 	int currMeas=0;
 	while (currMeas < 86400 && obsTime <= 86400){
-		if (mpairs[currMeas]->flags==0x03){
-			ReceiverMeasurement *rm = mpairs[currMeas]->rm;
+		if (mpairs[currMeas].flags==0x03){
+			ReceiverMeasurement *rm = mpairs[currMeas].rm;
 			// Round the measurement time to the nearest second, accounting for any fractional part of the second)
 			int tMeas=(int) rint(rm->tmGPS.tm_hour*3600+rm->tmGPS.tm_min*60+rm->tmGPS.tm_sec + rm->tmfracs);
 			if (tMeas==obsTime){
@@ -229,8 +227,8 @@ bool RINEX::writeObservationFile(Antenna *ant, Counter *cntr, Receiver *rx,int v
 	obsTime=0;
 	currMeas=0;
 	while (currMeas < 86400 && obsTime <= 86400){
-		if (mpairs[currMeas]->flags==0x03){
-			ReceiverMeasurement *rm = mpairs[currMeas]->rm;
+		if (mpairs[currMeas].flags==0x03){
+			ReceiverMeasurement *rm = mpairs[currMeas].rm;
 			
 			double ppsTime = useTIC*(rm->cm->rdg+rm->sawtooth - rx->ppsOffset*1.0E-9); // correction to the local clock
 			
@@ -313,7 +311,7 @@ bool RINEX::writeObservationFile(Antenna *ant, Counter *cntr, Receiver *rx,int v
 						for (unsigned int svc=0;svc<rm->meas.size();svc++){
 							if (rm->meas[svc]->svn == svns[sv] && rm->meas[svc]->constellation == svsys[sv] &&  rm->meas[svc]->code == GNSSSystem::C1){
 								//fprintf(fout,"%14.3lf%1i%1i",(rm->meas[svc]->meas+ppsTime)*CVACUUM,rm->meas[svc]->lli,rm->meas[svc]->signal);
-								fprintf(fout,"%14.3lf%2s",(rm->meas[svc]->meas+ppsTime)*CVACUUM,formatFlags(rm->meas[svc]->lli,rm->meas[svc]->signal));
+								fprintf(fout,"%14.3lf%2s",(rm->meas[svc]->meas+ppsTime)*CVACUUM,formatFlags(rm->meas[svc]->lli,rm->meas[svc]->signal).c_str());
 								foundit=true;
 								break;
 							}
@@ -325,7 +323,7 @@ bool RINEX::writeObservationFile(Antenna *ant, Counter *cntr, Receiver *rx,int v
 						bool foundit=false;
 						for (unsigned int svc=0;svc<rm->meas.size();svc++){
 							if (rm->meas[svc]->svn == svns[sv] && rm->meas[svc]->constellation == svsys[sv] &&  rm->meas[svc]->code == GNSSSystem::P1){
-								fprintf(fout,"%14.3lf%2s",(rm->meas[svc]->meas+ppsTime)*CVACUUM,formatFlags(rm->meas[svc]->lli,rm->meas[svc]->signal));
+								fprintf(fout,"%14.3lf%2s",(rm->meas[svc]->meas+ppsTime)*CVACUUM,formatFlags(rm->meas[svc]->lli,rm->meas[svc]->signal).c_str());
 								foundit=true;
 								break;
 							}
@@ -337,7 +335,7 @@ bool RINEX::writeObservationFile(Antenna *ant, Counter *cntr, Receiver *rx,int v
 						bool foundit=false;
 						for (unsigned int svc=0;svc<rm->meas.size();svc++){
 							if (rm->meas[svc]->svn == svns[sv] && rm->meas[svc]->constellation == svsys[sv] &&  rm->meas[svc]->code == GNSSSystem::P2){
-								fprintf(fout,"%14.3lf%2s",(rm->meas[svc]->meas+ppsTime)*CVACUUM,formatFlags(rm->meas[svc]->lli,rm->meas[svc]->signal));
+								fprintf(fout,"%14.3lf%2s",(rm->meas[svc]->meas+ppsTime)*CVACUUM,formatFlags(rm->meas[svc]->lli,rm->meas[svc]->signal).c_str());
 								foundit=true;
 								break;
 							}
@@ -349,7 +347,7 @@ bool RINEX::writeObservationFile(Antenna *ant, Counter *cntr, Receiver *rx,int v
 						bool foundit=false;
 						for (unsigned int svc=0;svc<rm->meas.size();svc++){
 							if (rm->meas[svc]->svn == svns[sv] && rm->meas[svc]->constellation == svsys[sv] &&  rm->meas[svc]->code == GNSSSystem::L1){
-								fprintf(fout,"%14.3lf%2s",rm->meas[svc]->meas,formatFlags(rm->meas[svc]->lli,rm->meas[svc]->signal)); // ppsTime is never added
+								fprintf(fout,"%14.3lf%2s",rm->meas[svc]->meas,formatFlags(rm->meas[svc]->lli,rm->meas[svc]->signal).c_str()); // ppsTime is never added
 								foundit=true;
 								break;
 							}
@@ -481,13 +479,14 @@ bool  RINEX::writeBeiDouNavigationFile(Receiver *rx,int ver,string fname,int mjd
 	
 	char buf[81];
 	FILE *fout;
-	if (!(fout = fopen(fname.c_str(),"w"))){
+	if (!(fout = app->openOutputFile(fname))){
 		return false;
 	}
 	
 	fprintf(fout,"%9s%11s%-20s%-20s%-20s\n",RINEXVersionName[ver],"","N: GNSS NAV DATA","C: BDS","RINEX VERSION / TYPE");
 	time_t tnow = time(NULL);
-	struct tm *tgmt = gmtime(&tnow);
+	struct tm tmgmt;
+	struct tm *tgmt = gmtime_r(&tnow,&tmgmt);
 	snprintf(buf,80,"%04d%02d%02d %02d%02d%02d UTC",tgmt->tm_year+1900,tgmt->tm_mon+1,tgmt->tm_mday,
 		tgmt->tm_hour,tgmt->tm_min,tgmt->tm_sec);
 	fprintf(fout,"%-20s%-20s%-20s%-20s\n",APP_NAME,agency.c_str(),buf,"PGM / RUN BY / DATE");
@@ -541,7 +540,7 @@ bool  RINEX::writeGPSNavigationFile(Receiver *rx,int ver,string fname,int mjd)
 {
 	char buf[81];
 	FILE *fout;
-	if (!(fout = fopen(fname.c_str(),"w"))){
+	if (!(fout = app->openOutputFile(fname))){
 		return false;
 	}
 	
@@ -558,7 +557,8 @@ bool  RINEX::writeGPSNavigationFile(Receiver *rx,int ver,string fname,int mjd)
 	}
 	
 	time_t tnow = time(NULL);
-	struct tm *tgmt = gmtime(&tnow);
+	struct tm tmgmt;
+	struct tm *tgmt = gmtime_r(&tnow,&tmgmt);
 	
 	// Determine the GPS week number FIXME why am I not using the receiver-provided WN_t ?
 	// GPS week 0 begins midnight 5/6 Jan 1980, MJD 44244
@@ -604,6 +604,8 @@ bool  RINEX::writeGPSNavigationFile(Receiver *rx,int ver,string fname,int mjd)
 	time_t tGPS0=mktime(&tmGPS0);
 	for (unsigned int i=0;i<rx->gps.ephemeris.size();i++){
 			
+		if (rx->gps.ephemeris[i]->previousDay) continue; // kept out of this day's file
+		
 		// Account for GPS rollover:
 		// GPS week 0 begins midnight 5/6 Jan 1980, MJD 44244
 		// GPS week 1024 begins midnight 21/22 Aug 1999, MJD 51412
@@ -646,7 +648,8 @@ bool  RINEX::writeGPSNavigationFile(Receiver *rx,int ver,string fname,int mjd)
 		int second=t;
 	
 		time_t tgps = tGPS0+GPSWeek*86400*7+Toc;
-		struct tm *tmGPS = gmtime(&tgps);
+		struct tm tmgps;
+		struct tm *tmGPS = gmtime_r(&tgps,&tmgps);
 		
 		switch (ver)
 		{
@@ -1058,7 +1061,8 @@ GPS::EphemerisData* RINEX::getGPSEphemeris(int ver,FILE *fin,unsigned int *lineC
 	tmGPS.tm_mday=6;tmGPS.tm_mon=0;tmGPS.tm_year=1980-1900,tmGPS.tm_isdst=0;
 	time_t tGPS0=mktime(&tmGPS);
 	time_t ttmp= tGPS0 + ed->week_number*7*86400;
-	struct tm *tmtmp=gmtime(&ttmp);
+	struct tm tmbuf;
+	struct tm *tmtmp=gmtime_r(&ttmp,&tmbuf);
 	int century=(tmtmp->tm_year/100)*100+1900;
 	
 	// Then, 'full' t_OC so we can get wday
@@ -1184,17 +1188,18 @@ void RINEX::init()
 	allObservations=false; // C1 only is default except for Javad
 }
 
-char * RINEX::formatFlags(int lli,int sn)
+string RINEX::formatFlags(int lli,int sn)
 {
+	char buf[8];
 	if (lli != 0 && sn!=0)
-		sprintf(gsbuf,"%1i%1i",lli,sn);
+		snprintf(buf,8,"%1i%1i",lli,sn);
 	else if (lli != 0 && sn == 0)
-		sprintf(gsbuf,"%1i ",lli);
+		snprintf(buf,8,"%1i ",lli);
 	else if (lli ==0 && sn !=0)
-		sprintf(gsbuf," %1i",sn);
+		snprintf(buf,8," %1i",sn);
 	else
-		sprintf(gsbuf,"  ");
-	return gsbuf;
+		snprintf(buf,8,"  ");
+	return string(buf);
 }
 
 // Note: these subtract one from the index !
@@ -33,9 +33,10 @@
 #include "GPS.h"
 
 class Antenna;
+class Application;
 class Counter;
 class EphemerisData;
-class MeasurementPair;
+class MeasurementPairs;
 class Receiver;
 
 using namespace std;
@@ -47,8 +48,8 @@ class RINEX
 		
 		enum RINEXVERSIONS {V2=0, V3=1}; // used as array indices too ..
 		
-		RINEX();
-		bool writeObservationFile(Antenna *ant, Counter *cntr, Receiver *rx,int ver,string fname,int mjd,int interval,MeasurementPair **mpairs,bool TICenabled);
+		RINEX(Application *);
+		bool writeObservationFile(Antenna *ant, Counter *cntr, Receiver *rx,int ver,string fname,int mjd,int interval,MeasurementPairs &mpairs,bool TICenabled);
 		bool writeNavigationFile(Receiver *rx,int constellation,int ver,string fname,int mjd);
 		
 		bool readNavigationFile(Receiver *rx,int constellation,string fname);
@@ -62,6 +63,8 @@ class RINEX
 		
 	private:
 		
+		Application *app;
+		
 		void init();
 		bool readV2NavigationFile(Receiver* rx, int constellation,string fname);
 		bool readV3NavigationFile(Receiver *rx,int constellation,string fname);
@@ -72,7 +75,7 @@ class RINEX
 		bool writeGPSNavigationFile(Receiver *rx,int ver,string fname,int mjd);
 		bool writeBeiDouNavigationFile(Receiver *rx,int ver,string fname,int mjd);
 		
-		char * formatFlags(int,int);
+		string formatFlags(int,int);
 		
 		void parseParam(char *str,int start,int len,int *val);
 		void parseParam(char *str,int start,int len,float *val);
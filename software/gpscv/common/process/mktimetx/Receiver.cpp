@@ -32,8 +32,6 @@
 #include "Receiver.h"
 #include "ReceiverMeasurement.h"
 
-extern ostream *debugStream;
-
 static double LagrangeInterpolation(double x,double x1, double y1,double x2,double y2,double x3,double y3){
 	return y1*(x-x2)*(x-x3)/((x1-x2)*(x1-x3)) + 
 				 y2*(x-x1)*(x-x3)/((x2-x1)*(x2-x3)) +
@@ -44,8 +42,9 @@ static double LagrangeInterpolation(double x,double x1, double y1,double x2,doub
 //	public
 //	
 
-Receiver::Receiver(Antenna *ant)
+Receiver::Receiver(Antenna *ant,Application *a)
 {
+	app=a;
 	modelName="undefined";
 	manufacturer="undefined";
 	serialNumber="undefined";
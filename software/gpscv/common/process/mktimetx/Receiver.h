@@ -42,6 +42,7 @@ using namespace std;
 
 class ReceiverMeasurement;
 class Antenna;
+class Application;
 
 class Receiver
 {
@@ -49,7 +50,7 @@ class Receiver
 	
 		enum SawtoothPhase {CurrentSecond,NextSecond,ReceiverSpecified};
 		
-		Receiver(Antenna *);
+		Receiver(Antenna *,Application *);
 		virtual ~Receiver();
 		
 		//void setProcessingInterval(int,int);
@@ -90,6 +91,8 @@ class Receiver
 		
 	protected:
 	
+		Application *app;
+		
 		//bool setCurrentLeapSeconds(int,UTCData &);
 		
 		void deleteMeasurements(std::vector<SVMeasurement *> &);
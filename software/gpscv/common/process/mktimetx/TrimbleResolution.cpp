@@ -49,9 +49,6 @@
 #include "SVMeasurement.h"
 #include "TrimbleResolution.h"
 
-extern ostream *debugStream;
-extern Application *app;
-
 #define SLOPPINESS 0.99
 #define CLOCKSTEP  0.001
 #define MAX_CHANNELS 12 // max channels per constellation
@@ -77,7 +74,7 @@ reversestr (
 //	public
 //		
 
-TrimbleResolution::TrimbleResolution(Antenna *ant,string m):Receiver(ant)
+TrimbleResolution::TrimbleResolution(Antenna *ant,string m,Application *a):Receiver(ant,a)
 {
 	modelName = m;
 	if (modelName=="Resolution T"){
@@ -482,8 +479,7 @@ bool TrimbleResolution::readLog(string fname,int mjd,int startTime,int stopTime,
 		
 		time_t tgps = mktime(&(measurements[i]->tmUTC));
 		tgps += leapsecs;
-		struct tm *tmGPS = gmtime(&tgps);
-		measurements[i]->tmGPS=*tmGPS;
+		gmtime_r(&tgps,&(measurements[i]->tmGPS));
 		//printf("%02d:%02d:%02d\n",measurements[i]->tmGPS.tm_hour,measurements[i]->tmGPS.tm_min,measurements[i]->tmGPS.tm_sec);
 	}
 	
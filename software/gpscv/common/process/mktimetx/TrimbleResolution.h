@@ -38,7 +38,7 @@ class TrimbleResolution:public Receiver
 		
 		enum Models {ResolutionT,ResolutionSMT,Resolution360};
 		
-		TrimbleResolution(Antenna *,string);
+		TrimbleResolution(Antenna *,string,Application *);
 		virtual ~TrimbleResolution();
 	
 		virtual bool readLog(string,int,int,int,int);
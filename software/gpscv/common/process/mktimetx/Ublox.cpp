@@ -46,9 +46,6 @@
 #include "ReceiverMeasurement.h"
 #include "SVMeasurement.h"
 
-extern ostream *debugStream;
-extern Application *app;
-
 #define CLIGHT 299792458.0
 #define ICD_PI 3.1415926535898
 
@@ -74,7 +71,7 @@ typedef double         R8;
 #define MSG0D01 0x08
 
 
-Ublox::Ublox(Antenna *ant,string m):Receiver(ant)
+Ublox::Ublox(Antenna *ant,string m,Application *a):Receiver(ant,a)
 {
 	modelName=m;
 	manufacturer="ublox";
@@ -187,8 +184,7 @@ bool Ublox::readLog(string fname,int mjd,int startTime,int stopTime,int rinexObs
 						// Calculate GPS time of measurement 
 						// FIXME why do this ? why not just convert from UTC ? and full WN is known anyway
 						time_t tgps = GPS::GPStoUnix(rmeas->gpstow,rmeas->gpswn);
-						struct tm *tmGPS = gmtime(&tgps);
-						rmeas->tmGPS=*tmGPS;
+						gmtime_r(&tgps,&(rmeas->tmGPS));
 						
 						//rmeas->tmfracs = measTOW - (int)(measTOW); 
 						//if (rmeas->tmfracs > 0.5) rmeas->tmfracs -= 1.0; // place in the previous second
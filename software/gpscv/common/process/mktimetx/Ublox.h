@@ -36,7 +36,7 @@ class Ublox:public Receiver
 {
 	public:
 		
-		Ublox(Antenna *,string);
+		Ublox(Antenna *,string,Application *);
 		virtual ~Ublox();
 	
 		virtual bool readLog(string,int,int,int,int);
@@ -50,7 +50,8 @@ std::string Utility::trim(std::string const& str)
 void Utility::MJDtoDate(int mjd,int *year,int *mon, int *mday, int *yday)
 {
 	time_t tt = (mjd - 40587)*86400;
-	struct tm *utc = gmtime(&tt);
+	struct tm tmutc;
+	struct tm *utc = gmtime_r(&tt,&tmutc);
 	*year = 1900 + utc->tm_year;
 	*mon  = utc->tm_mon+1;
 	*mday = utc->tm_mday;
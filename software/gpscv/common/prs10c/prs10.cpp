@@ -31,6 +31,8 @@
 // 09-01-2002 MJW Port locking
 // 10-01-2002 MJW writeEEPROM, C++ification
 // 14-04-2014 MJW Fixups to make the compiler happy
+// 19-10-2026     getAllVariables() and getTestVoltages() send their queries
+//                ahead, several at a time, instead of waiting for each reply
 
 #include <cstring>
 #include <iostream>
@@ -39,6 +41,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <errno.h>
 #include <fcntl.h>
 
 #include <string>
@@ -159,6 +162,7 @@ PRS10Settings::PRS10Settings()
 PRS10::PRS10()
 {
 	port=DEFAULT_PORT;
+	lockCommand=LOCKPORT;
 	debug=false;
 
 	// SIGALRM is used to detect IO timeouts
@@ -172,6 +176,7 @@ PRS10::PRS10()
 	isErr=false;
 	errBuf="";
 	fd=0;
+	pipelineDepth=PRS10_PIPELINE_DEPTH;
 }
 
 PRS10::~PRS10()
@@ -184,31 +189,10 @@ bool PRS10::openPort()
 {
 		
 	struct termios newtio;
-	int result;
 	
 	// Try to lock the port
-	string buf = LOCKPORT + port + " prs10c";
-	FILE *p=popen(buf.c_str(),"r");
-        
-	if (fscanf(p,"%i",&result) != 1) 
-  {
-		error("Failed to check the serial port lock file\n");
-		fclose(p);
-		buf = LOCKPORT;// remove the lockfile
-		buf += "-r " + port + " > /dev/null";
- 		system(buf.c_str());
-		return false;
-	}
-
-	if (0==result) 
-  {
-		error("The serial port may be in use. Check /var/lock/\n");
-		fclose(p);
-		buf = LOCKPORT;// remove the lockfile
-		buf += "-r " + port + " > /dev/null";
- 		system(buf.c_str());
+	if (!lockPort())
 		return false;
-	} 
 	
   // Open serial port for reading and writing and not as controlling tty
  	// because we don't want to get killed if linenoise sends CTRL-C.
@@ -216,9 +200,7 @@ bool PRS10::openPort()
 	if ((fd = open(port.c_str(), O_RDWR | O_NOCTTY ))<0)
 	{
 		perror(port.c_str());
-		buf = LOCKPORT;// remove the lockfile
-		buf += "-r " + port + " > /dev/null";
- 		system(buf.c_str());
+		unlockPort();
 		exit(-1);
 	}
 
@@ -281,10 +263,7 @@ bool PRS10::openPort()
 bool PRS10::closePort()
 {
 	if (0==fd) return false;
-	// Remove the lock file
-	string buf = LOCKPORT;// FIXME
-	buf += "-r " + port + " > /dev/null";
-  system(buf.c_str());
+	unlockPort();
 
 	tcsetattr(fd,TCSANOW,&oldtio); // restore old terminal settings 
 	close(fd);
@@ -313,6 +292,8 @@ bool PRS10::writeString(const char *msg)
 			msgp += nWritten;
 			count -= nWritten;
 		}
+		else if (errno != EINTR && errno != EAGAIN)
+			return false; // the caller reports the failed command
 	}
 	//stopTimer();
 	return true;
@@ -361,15 +342,12 @@ bool PRS10::query(const char *cmdString,int *i)
 	int bufSize=255;
 	int ibuf;
 	
-	if (writeString(cmdString))
+	if (transact(cmdString,buf,bufSize))
 	{
-		if (readString(buf,bufSize))
+		if (sscanf(buf,"%i",&ibuf)==1)
 		{
-			if (sscanf(buf,"%i",&ibuf)==1)
-			{
-				*i=ibuf;
-				return true;
-			}
+			*i=ibuf;
+			return true;
 		}
 	}
 	return false;
@@ -382,15 +360,12 @@ bool PRS10::query(const char *cmdString,float *f)
 	int bufSize=255;
 	float fbuf;
 	
-	if (writeString(cmdString))
+	if (transact(cmdString,buf,bufSize))
 	{
-		if (readString(buf,bufSize))
+		if (sscanf(buf,"%f",&fbuf)==1)
 		{
-			if (sscanf(buf,"%f",&fbuf)==1)
-			{
-				*f=fbuf;
-				return true;
-			}
+			*f=fbuf;
+			return true;
 		}
 	}
 	return false;
@@ -402,13 +377,10 @@ bool PRS10::query(const char *cmdString,string *s)
 	char buf[255];
 	int bufSize=255;
 	
-	if (writeString(cmdString))
+	if (transact(cmdString,buf,bufSize))
 	{
-		if (readString(buf,bufSize))
-		{
-			*s=buf;
-			return true;
-		}
+		*s=buf;
+		return true;
 	}
 	return false;
 }
@@ -419,19 +391,16 @@ bool PRS10::query(const char *cmdString,int i[],int n)
 	char buf[255];
 	int bufSize=255;
 	char *p;
-	if (writeString(cmdString))
+	if (transact(cmdString,buf,bufSize))
 	{
-		if (readString(buf,bufSize))
+		p=strtok(buf,",");
+		int cnt=0;
+		while (p && cnt<n)
 		{
-			p=strtok(buf,",");
-			int cnt=0;
-			while (p && cnt<n)
-			{
-				sscanf(p,"%i",&(i[cnt++]));
-				p=strtok(NULL,",");
-			}
-			return true;
+			sscanf(p,"%i",&(i[cnt++]));
+			p=strtok(NULL,",");
 		}
+		return true;
 	}
 
 	return false;
@@ -443,19 +412,16 @@ bool PRS10::query(const char *cmdString,float f[],int n)
 	char buf[255];
 	int bufSize=255;
 	char *p;
-	if (writeString(cmdString))
+	if (transact(cmdString,buf,bufSize))
 	{
-		if (readString(buf,bufSize))
+		p=strtok(buf,",");
+		int cnt=0;
+		while (p && cnt<n)
 		{
-			p=strtok(buf,",");
-			int cnt=0;
-			while (p && cnt<n)
-			{
-				sscanf(p,"%f",&(f[cnt++]));
-				p=strtok(NULL,",");
-			}
-			return true;
+			sscanf(p,"%f",&(f[cnt++]));
+			p=strtok(NULL,",");
 		}
+		return true;
 	}
 	return false;
 }
@@ -740,12 +706,22 @@ bool PRS10::command(int cmd,int cmdModifier,int NewValue,int chan)
 bool PRS10::getTestVoltages(float tv[20])
 {
 	// Collects all the ADC readings
-	 
+	
+	vector<string> cmds;
+	char msgbuf[16];
+	for (int i=0;i<=19;i++)
+	{
+		sprintf(msgbuf,"AD%i?\r",i);
+		cmds.push_back(msgbuf);
+	}
+	prefetch(cmds);
+	
 	for (int i=0;i<=19;i++)
 	{
 		command(PRS10_AD,PRS10_QUERY,0,i);
 		tv[i]=s.testVoltages[i];
 	}
+	pending.clear();
 	return true;
 }
 
@@ -761,6 +737,16 @@ bool PRS10::getStatus(unsigned char status[6])
 
 bool PRS10::getAllVariables()
 {
+	// The queries are sent ahead in the same order as the command() calls
+	// below, which then pick up the replies. PP? is left out because
+	// the PRS10 doesn't answer it, and a missing reply would spoil the rest.
+	static const char *queries[]={"VB?\r","ID?\r","SN?\r","LM?\r","LO?\r",
+		"FC?\r","DS?\r","SF?\r","SS?\r","GA?\r","PH?\r","SP?\r","MS?\r",
+		"MO?\r","MR?\r","TT?\r","TS?\r","TO?\r","PS?\r","PL?\r",
+		"PT?\r","PF?\r","PI?\r","SD0?\r","SD1?\r","SD2?\r","SD3?\r",
+		"SD4?\r","SD5?\r","SD6?\r","SD7?\r"};
+	prefetch(vector<string>(queries,queries+sizeof(queries)/sizeof(queries[0])));
+	
 	bool res=true;
 	// Note the order of operands in the following expressions
 	// We don't want short circuited evaluation of Boolean expressions
@@ -791,6 +777,7 @@ bool PRS10::getAllVariables()
 	res = command(PRS10_PI) && res;
 	for (int i=0;i<8;i++)
 		res = command(PRS10_SD,PRS10_QUERY,0,i) && res;
+	pending.clear();
 	return res;
 }
 
@@ -812,6 +799,51 @@ void PRS10::clearErrorMessage()
 //
 //
 
+bool PRS10::lockPort()
+{
+	// The lock command is lockport, or one taking the same arguments, 
+	// which prints 1 if the lock was made and 0 otherwise
+	if (lockCommand == "none") return true;
+	
+	int result;
+	string buf = lockPrefix() + port + " prs10c";
+	FILE *p=popen(buf.c_str(),"r");
+	
+	if (NULL == p || fscanf(p,"%i",&result) != 1) 
+	{
+		error("Failed to check the serial port lock file\n");
+		if (p) pclose(p);
+		unlockPort();
+		return false;
+	}
+	pclose(p);
+	
+	if (0==result) 
+	{
+		error("The serial port may be in use. Check " + 
+			(lockDirectory.empty() ? string("/var/lock/") : lockDirectory) + "\n");
+		unlockPort();
+		return false;
+	} 
+	return true;
+}
+
+void PRS10::unlockPort()
+{
+	// Removes the lock file
+	if (lockCommand == "none") return;
+	string buf = lockPrefix() + "-r " + port + " > /dev/null";
+	system(buf.c_str());
+}
+
+string PRS10::lockPrefix()
+{
+	string buf = lockCommand + " ";
+	if (!lockDirectory.empty())
+		buf += "-d " + lockDirectory + " ";
+	return buf;
+}
+
 void PRS10::error(string msg)
 {
 	// Adds an error message to the error buffer.
@@ -880,6 +912,83 @@ bool PRS10::getIntParam(IntRange *r,const char *cmd)
 	}
 }
 
+bool PRS10::transact(const char *cmdString,char *buf,int bufSize)
+{
+	// Sends a query and reads the reply, unless the reply has
+	// already been collected by prefetch()
+	if (!pending.empty() && pending.front().cmd == cmdString)
+	{
+		strncpy(buf,pending.front().reply.c_str(),bufSize-1);
+		buf[bufSize-1]=0;
+		pending.pop_front();
+		return true;
+	}
+	
+	if (writeString(cmdString))
+		return readString(buf,bufSize);
+	return false;
+}
+
+void PRS10::prefetch(const vector<string> &cmds)
+{
+	// Sends a list of queries, keeping up to pipelineDepth outstanding,
+	// and collects the replies in order. At 9600 baud, this saves most of
+	// the turnaround time of sending each query and waiting for its reply.
+	//
+	// Replies carry nothing to match them to their query, so one which
+	// is never sent shifts the rest. This shows up as a timeout on a later reply.
+	// The whole list is then discarded and the queries are made
+	// one at a time, and prefetching is turned off.
+	
+	char buf[255];
+	unsigned int nSent=0,nRead=0;
+	fd_set readset;
+	struct timeval tv;
+	ssize_t nr;
+	
+	pending.clear();
+	if (pipelineDepth < 2) return;
+	
+	while (nRead < cmds.size())
+	{
+		while (nSent < cmds.size() && nSent - nRead < (unsigned int) pipelineDepth)
+			writeString(cmds[nSent++].c_str());
+		
+		FD_ZERO(&readset);
+		FD_SET(fd,&readset);
+		tv.tv_sec=0;
+		tv.tv_usec=100000; // as for readString()
+		if (select(fd+1,&readset,NULL,NULL,&tv) <= 0 || (nr = read(fd,buf,254)) <= 0)
+			break;
+		buf[nr]=0;
+		
+		Reply r;
+		r.cmd=cmds[nRead++];
+		r.reply=buf;
+		pending.push_back(r);
+	}
+	
+	if (nRead == cmds.size()) return;
+	
+	// Wait until the port has been quiet for a while and discard anything
+	// which is left
+	while (true)
+	{
+		FD_ZERO(&readset);
+		FD_SET(fd,&readset);
+		tv.tv_sec=0;
+		tv.tv_usec=100000;
+		if (select(fd+1,&readset,NULL,NULL,&tv) <= 0 || read(fd,buf,254) <= 0)
+			break;
+	}
+	tcflush(fd,TCIFLUSH);
+	pending.clear();
+	pipelineDepth=1;
+	#ifdef DEBUG
+		if (debug) fprintf(stderr,"prefetch(): missing reply, prefetching turned off\n");
+	#endif
+}
+
 void PRS10::startTimer(long usecs)
 {
 	// Starts an itimer - used for handling I/O timeouts 
@@ -24,11 +24,17 @@
 #ifndef __PRS10_H_
 #define __PRS10_H_
 
+#include <deque>
 #include <string>
+#include <vector>
 #include <termios.h>
 #include <signal.h>
 
-#define LOCKPORT "/usr/local/bin/lockport "
+#define LOCKPORT "/usr/local/bin/lockport" // default command for locking the serial port
+
+// Number of queries which may be outstanding at once when reading
+// many variables. Kept small so that the PRS10's input buffer can't overflow.
+#define PRS10_PIPELINE_DEPTH 8
 
 using namespace std;
 
@@ -129,6 +135,8 @@ class PRS10
 		~PRS10();
 		
 		void setPort(string p){port = p;}
+		void setLockCommand(string c){lockCommand = c;} // "none" to not lock the port
+		void setLockDirectory(string d){lockDirectory = d;} // passed to the lock command with -d
 		bool openPort();
 		bool closePort();
 		bool writeString(const char *msg);
@@ -149,6 +157,7 @@ class PRS10
 		void   clearErrorMessage();
 	
 		void setDebugging(bool d){debug=d;}
+		void setPipelineDepth(int n){pipelineDepth=(n<1?1:n);}
 		PRS10Settings *getSettings(){return &s;}
 		
 		enum PRS10CommandModifiers
@@ -196,6 +205,9 @@ class PRS10
 	private:
 	
 		void error(string errmsg);
+		bool lockPort();
+		void unlockPort();
+		string lockPrefix();
 		string errBuf;
 		bool isErr;
 		int nErr;
@@ -204,6 +216,19 @@ class PRS10
 		bool setIntParam(IntRange *r,const char *cmd,int v);
 		bool getIntParam(IntRange *r,const char *cmd);
 		
+		// Replies to queries which were sent ahead by prefetch()
+		struct Reply
+		{
+			string cmd;
+			string reply;
+		};
+		
+		bool transact(const char *cmdString,char *buf,int bufSize);
+		void prefetch(const vector<string> &cmds);
+		
+		deque<Reply> pending;
+		int pipelineDepth;
+		
 		
 		void startTimer(long);
 		void stopTimer();
@@ -211,6 +236,7 @@ class PRS10
 																		// the right kind of pointer
 		
 		string port; /* serial port */
+		string lockCommand,lockDirectory;
 		int fd;     /* file descriptor for the port */
 		struct termios oldtio; /* for restoring terminal setings */
 	
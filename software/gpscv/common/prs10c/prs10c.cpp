@@ -24,6 +24,15 @@
 //
 // Provides a simple, command line interface to the PRS-10
 //
+// With -d, prs10c runs as a daemon which holds the serial port, keeps a copy
+// of the PRS-10 variables refreshed and serves requests over a Unix socket,
+// so that logging and steering scripts don't contend for the port.
+// The setup file tokens SOCKET (default $HOME/etc/prs10c.socket, or $HOME/prs10c.socket
+// if there is no etc directory) and REFRESH (seconds, default 60) configure it.
+// PIPELINE sets how many queries may be outstanding when reading the variables
+// (default 8, 1 to wait for each reply).
+// LOCK_COMMAND (default /usr/local/bin/lockport, none to not lock) and LOCK_DIRECTORY
+// (passed to the lock command with -d) set how the serial port is locked.
 // 
 
 // Modification history
@@ -61,9 +70,25 @@
 // 14-04-2014 MJW Compiler fixups
 //							Version->1.2.4
 //
+// 19-10-2026     Daemon mode (-d): the port is held open, the variables are
+//							refreshed periodically and requests are served over a Unix socket.
+//							The command line options use a running daemon if there is one.
+//							Version->1.3.0
+// 19-10-2026     PIPELINE token. Fixed the last setup file token being parsed twice.
+//							Version->1.3.1
+// 19-10-2026     The default socket is in the home directory, not /tmp. An existing
+//							socket is only removed if no daemon answers on it. STATUS and RESET
+//							read the status before replying.
+//							Version->1.3.2
+// 19-10-2026     LOCK_COMMAND and LOCK_DIRECTORY tokens. 
+//							Version->1.3.3
+//
 // FIXME Bug ?? Saw an I/O timeout once on startup
 // FIXME Should use libconfigurator one day 
 
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdlib.h>
 
 #include <cstring>
@@ -76,13 +101,17 @@
 #include <time.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/un.h>
 
 #include "prs10.h"
 
-#define PRS10C_VERSION "Version 1.2.4"
+#define PRS10C_VERSION "Version 1.3.3"
 #define PRS10C_HISTORY_FILE "prs10.history"
 #define CCTF_HEADER         "cctf_header"
+#define PRS10C_SOCKET       "prs10c.socket" // default control socket for daemon mode, in ~/etc or ~
+#define PRS10C_REFRESH      60 // default interval, in seconds, between refreshes of the cached variables
 
 #define N_MENU_ITEMS 7
 
@@ -91,6 +120,9 @@ static string mjdstr();
 static void printHelp();
 static void printVersion();
 
+static volatile sig_atomic_t stopDaemon=0;
+static void stopHandler(int);
+
 enum menuIDs 
 {
 	MID_DUMMY,
@@ -147,7 +179,10 @@ class EZPRS10
 		EZPRS10();
 		~EZPRS10();
 		
+		void open();
 		void run();
+		bool runDaemon();
+		bool connectDaemon();
 		
 		void printStatus();
 		void printTestVoltages();
@@ -159,6 +194,19 @@ class EZPRS10
 		void setInteractive(bool i){interactive=i;}	
 	private:
 		
+		void reportStatus(ostream &,unsigned char status[6]);
+		void reportTestVoltages(ostream &,float tv[20]);
+		void reportVariables(ostream &,PRS10Settings *,bool pause);
+		void reportReset(ostream &,unsigned char status[6]);
+		void doStep1pps(ostream &,int);
+		
+		int connectSocket();
+		string request(string);
+		bool openSocket();
+		void refresh();
+		void refreshStatus();
+		void serveClient(int);
+		
 		void adjust1PPSphase();
 		void setExternalLock();
 		void adjustRate();
@@ -183,6 +231,16 @@ class EZPRS10
 		bool cctfComments;
 		string home;
 		bool interactive;
+		
+		// daemon mode
+		string socketPath;
+		int refreshInterval;
+		bool useDaemon; // requests go to a running daemon
+		int listenfd;
+		time_t lastRefresh;
+		PRS10Settings cache;
+		float cachedVoltages[20];
+		unsigned char cachedStatus[6]; // accumulated since a client last read it, as for ST?
 
 };
 
@@ -210,10 +268,36 @@ EZPRS10::EZPRS10()
 	else
 		cerr << "Warning! Couldn't find a directory for prs10.history" << endl;
 	
+	socketPath=home;
+	if (testDirectory(socketPath+"/etc"))
+		socketPath+="/etc";
+	socketPath+=string("/")+string(PRS10C_SOCKET);
+	refreshInterval=PRS10C_REFRESH;
+	useDaemon=false;
+	listenfd=-1;
+	lastRefresh=0;
+	for (int i=0;i<20;i++)
+		cachedVoltages[i]=-1.0;
+	memset(cachedStatus,0,6);
+	
 	if (!loadSetup(hd)) exit(-1);
 	
 	quit=false;
 	interactive=true;
+}
+
+EZPRS10::~EZPRS10()
+{
+	if (listenfd >= 0)
+	{
+		close(listenfd);
+		unlink(socketPath.c_str());
+	}
+	p.closePort();
+}
+
+void EZPRS10::open()
+{
 	int nerr;
 	if (!p.openPort())
 	{
@@ -230,14 +314,10 @@ EZPRS10::EZPRS10()
 		cerr << p.getErrorMessage(&nerr) << endl;
 		cerr << "Most likely the PRS10 is not talking." << endl;
 		cerr << "You may wish to quit." << endl;
+		p.clearErrorMessage();
 	}
 }
 
-EZPRS10::~EZPRS10()
-{
-	p.closePort();
-}
-
 void EZPRS10::run()
 {
 	int menuID;
@@ -258,17 +338,14 @@ void EZPRS10::run()
 void EZPRS10::step1pps(int step)
 {
 	// Intended for command line adjustment of 1 pps epoch
-	int nerr;
-	if (!(p.command(PRS10::PRS10_PP,PRS10::PRS10_SET,step)))
-		cout << p.getErrorMessage(&nerr);
-	else
+	if (useDaemon)
 	{
-		cout << "1 pps step command succeeded" << endl;
 		ostringstream o;
-		o << "1 pps stepped " << step << " ns";
-		logIt(o.str());
-		updateCCTFComment();
+		o << "STEP1PPS " << step;
+		cout << request(o.str());
+		return;
 	}
+	doStep1pps(cout,step);
 }
 
 void EZPRS10::checkReset()
@@ -276,19 +353,76 @@ void EZPRS10::checkReset()
 	// Checks whether PRS10 has been reset by checking 
 	// status bytes
 	// Prints 'Unit reset' / 'Unit not reset'
+	if (useDaemon)
+	{
+		cout << request("RESET");
+		return;
+	}
 	unsigned char buf[6];
 	p.getStatus(buf);
 	PRS10Settings *s = p.getSettings();
-	
-	// ST6 bit 7 flags a unit reset
-	if (s->status[5] & 128)
-	{
-		cout << "Unit reset" << endl;
-	}
-	else
+	reportReset(cout,s->status);
+}
+
+bool EZPRS10::runDaemon()
+{
+	// Holds the port open, refreshing the cached variables every refreshInterval seconds,
+	// and serves requests on the control socket, one per connection:
+	//   STATUS        status, accumulated since the last STATUS or RESET request (as for -s)
+	//   RESET         whether the unit has been reset (as for -x)
+	//   VARIABLES     all variables (as for -q)
+	//   VOLTAGES      test point voltages (as for -t)
+	//   STEP1PPS n    step the 1 pps by n ns (as for -o)
+	//   REFRESH       refresh the cached variables now
+	// Replies are text, and the connection is closed when the reply is complete.
+	
+	if (!openSocket()) return false;
+	
+	struct sigaction sa;
+	memset(&sa,0,sizeof(sa));
+	sa.sa_handler=stopHandler;
+	sigemptyset(&(sa.sa_mask));
+	sigaction(SIGINT,&sa,NULL);
+	sigaction(SIGTERM,&sa,NULL);
+	signal(SIGPIPE,SIG_IGN);
+	
+	refresh();
+	
+	while (!stopDaemon)
 	{
-		cout << "Unit not reset" << endl;
+		time_t now=time(NULL);
+		int timeout = refreshInterval - (now - lastRefresh);
+		if (timeout <= 0)
+		{
+			refresh();
+			continue;
+		}
+		struct pollfd pfd;
+		pfd.fd=listenfd;
+		pfd.events=POLLIN;
+		int res=poll(&pfd,1,timeout*1000);
+		if (res < 0)
+		{
+			if (errno == EINTR) continue;
+			cerr << "poll() failed: " << strerror(errno) << endl;
+			break;
+		}
+		if (res == 0) continue;
+		int fd=accept(listenfd,NULL,NULL);
+		if (fd < 0) continue;
+		serveClient(fd);
+		close(fd);
 	}
+	return true;
+}
+
+bool EZPRS10::connectDaemon()
+{
+	// Requests go to the daemon if one is listening
+	int fd=connectSocket();
+	useDaemon = (fd >= 0);
+	if (useDaemon) close(fd);
+	return useDaemon;
 }
 
 //
@@ -569,274 +703,500 @@ void EZPRS10::adjustRateSF()
 
 void EZPRS10::printStatus()
 {	
-	string status;
+	if (useDaemon)
+	{
+		cout << request("STATUS");
+		return;
+	}
+	
 	unsigned char buf[6];
 	
 	p.getStatus(buf);
 	PRS10Settings *s = p.getSettings();
+	reportStatus(cout,s->status);
+	p.clearErrorMessage();
+
+	if (interactive) waitForKeyPress();
+}
+
+void EZPRS10::printTestVoltages()
+{
+	if (useDaemon)
+	{
+		cout << request("VOLTAGES");
+		return;
+	}
+	
+	float fbuf[20];
+	p.getTestVoltages(fbuf);
+	reportTestVoltages(cout,fbuf);
+	p.clearErrorMessage();
+	
+        if (interactive) waitForKeyPress();
+}
+
+void EZPRS10::printVariables()
+{
+	if (useDaemon)
+	{
+		cout << request("VARIABLES");
+		return;
+	}
+	
+	p.getAllVariables();
+	reportVariables(cout,p.getSettings(),interactive);
+	p.clearErrorMessage();
+	if (interactive) waitForKeyPress();
+}
+
+void EZPRS10::reportStatus(ostream &os,unsigned char st[6])
+{
+	string status;
 	
 	// Power supply and discharge lamp status
 	
-	if (s->status[0] & 1)
+	if (st[0] & 1)
 		status="< 22V";
-	else if(s->status[0] & 2)
+	else if(st[0] & 2)
 		status="> 30V";
 	else
 		status="OK";
-	cout << "24V P/S for electronics: " << status << endl;
+	os << "24V P/S for electronics: " << status << endl;
 	
-	if (s->status[0] & 4)
+	if (st[0] & 4)
 		status="< 22V";
-	else if(s->status[0] & 8)
+	else if(st[0] & 8)
 		status="> 30V";
 	else
 		status="OK";
-	cout << "24V P/S for heaters: " << status << endl;
+	os << "24V P/S for heaters: " << status << endl;
 	
-	if (s->status[0] & 16)
+	if (st[0] & 16)
 		status="LOW";
-	else if(s->status[0] & 32)
+	else if(st[0] & 32)
 		status="HIGH";
 	else
 		status="OK";
-	cout << "Lamp light level: " << status << endl;
+	os << "Lamp light level: " << status << endl;
 	
-	if (s->status[0] & 64)
+	if (st[0] & 64)
 		status="LOW";
-	else if(s->status[0] & 128)
+	else if(st[0] & 128)
 		status="HIGH";
 	else
 		status="OK";
-	cout << "Gate voltage: " << status << endl;
+	os << "Gate voltage: " << status << endl;
 	
 	/* RF synthesizer status */
-	if (s->status[1] & 1)
+	if (st[1] & 1)
 		status="UNLOCKED";
 	else
 		status="OK";
-	cout << "RF synthesizer PLL: " << status << endl;
+	os << "RF synthesizer PLL: " << status << endl;
 	
-	if (s->status[1] & 2)
+	if (st[1] & 2)
 		status="LOW";
-	else if(s->status[1] & 4)
+	else if(st[1] & 4)
 		status="HIGH";
 	else
 		status="OK";
-	cout << "RF crystal varactor: " << status << endl;
+	os << "RF crystal varactor: " << status << endl;
 	
-	if (s->status[1] & 8)
+	if (st[1] & 8)
 		status="LOW";
-	else if(s->status[1] & 16)
+	else if(st[1] & 16)
 		status="HIGH";
 	else
 		status="OK";
-	cout << "RF VCO control: " << status << endl;
+	os << "RF VCO control: " << status << endl;
 	
-	if (s->status[1] & 32)
+	if (st[1] & 32)
 		status="LOW";
-	else if(s->status[1] & 64)
+	else if(st[1] & 64)
 		status="HIGH";
 	else
 		status="OK";
-	cout << "RF AGC control: " << status << endl;
+	os << "RF AGC control: " << status << endl;
 	
-	if (s->status[1] & 128)
+	if (st[1] & 128)
 		status="BAD";
 	else
 		status="OK";
-	cout << "PLL parameter: " << status << endl;
+	os << "PLL parameter: " << status << endl;
 	
 	// Temperature controllers 
 	
-	if (s->status[2] & 1 )
+	if (st[2] & 1 )
 		status="LOW";
-	else if(s->status[2] & 2)
+	else if(st[2] & 2)
 		status="HIGH";
 	else
 		status="OK";
-	cout << "Lamp temperature: " << status << endl;
+	os << "Lamp temperature: " << status << endl;
 	
-	if (s->status[2] & 4 )
+	if (st[2] & 4 )
 		status="LOW";
-	else if(s->status[2] & 8 )
+	else if(st[2] & 8 )
 		status="HIGH";
 	else
 		status="OK";
-	cout << "Crystal temperature: " << status << endl;
+	os << "Crystal temperature: " << status << endl;
 	
-	if (s->status[2] & 16)
+	if (st[2] & 16)
 		status="LOW";
-	else if(s->status[2] & 32)
+	else if(st[2] & 32)
 		status="HIGH";
 	else
 		status="OK";
-	cout << "Cell temperature: " << status << endl;
+	os << "Cell temperature: " << status << endl;
 	
-	if (s->status[2] & 64)
+	if (st[2] & 64)
 		status="LOW";
-	else if(s->status[2] & 128)
+	else if(st[2] & 128)
 		status="HIGH";
 	else
 		status="OK";
-	cout << "Case temperature: " << status << endl;
+	os << "Case temperature: " << status << endl;
 	
 	// Frequency lock-loop control 
 	
-	if (s->status[3] & 1)
-		cout << "Frequency lock control is off" << endl;
+	if (st[3] & 1)
+		os << "Frequency lock control is off" << endl;
 	
-	if (s->status[3] & 2)
-		cout << "Frequency lock is disabled" << endl;
+	if (st[3] & 2)
+		os << "Frequency lock is disabled" << endl;
 		
-	if (s->status[3] & 4)
+	if (st[3] & 4)
 		status="HIGH";
-	else if(s->status[3] & 8)
+	else if(st[3] & 8)
 		status="LOW";
 	else
 		status="OK";
-	cout << "10 MHz EFC: " << status << endl;
+	os << "10 MHz EFC: " << status << endl;
 	
-	if (s->status[3] & 16)
+	if (st[3] & 16)
 		status="> 4.9V";
-	else if(s->status[3] & 32)
+	else if(st[3] & 32)
 		status="< 0.1V";
 	else
 		status="OK";
-	cout << "Analog cal voltage: " << status << endl;
+	os << "Analog cal voltage: " << status << endl;
 	
 	// Frequency lock to external 1 PPS 
-	if (s->status[4] & 1)
-		cout << "Frequency lock to external 1 pps: PLL disabled" << endl;
-	else if (s->status[4] & 4)
-		cout << "Frequency lock to external 1 pps: PLL active" << endl;
+	if (st[4] & 1)
+		os << "Frequency lock to external 1 pps: PLL disabled" << endl;
+	else if (st[4] & 4)
+		os << "Frequency lock to external 1 pps: PLL active" << endl;
 		
-	if (s->status[4] & 2)
-		cout << "Frequency lock to external 1 pps: < 256 good 1 pps inputs" << endl;
+	if (st[4] & 2)
+		os << "Frequency lock to external 1 pps: < 256 good 1 pps inputs" << endl;
 			
-	if (s->status[4] & 8)
-		cout << "Frequency lock to external 1 pps: > 256 bad 1 pps inputs" << endl;
+	if (st[4] & 8)
+		os << "Frequency lock to external 1 pps: > 256 bad 1 pps inputs" << endl;
 		
-	if (s->status[4] & 16)
-		cout << "Frequency lock to external 1 pps: excessive time interval" << endl;
+	if (st[4] & 16)
+		os << "Frequency lock to external 1 pps: excessive time interval" << endl;
 		
-	if (s->status[4] & 32)
-		cout << "Frequency lock to external 1 pps: PLL restarted" << endl;
+	if (st[4] & 32)
+		os << "Frequency lock to external 1 pps: PLL restarted" << endl;
 		
-	if (s->status[4] & 64)
-		cout << "Frequency lock to external 1 pps: f control saturated" << endl;
+	if (st[4] & 64)
+		os << "Frequency lock to external 1 pps: f control saturated" << endl;
 		
-	if (s->status[4] & 128)
-		cout << "Frequency lock to external 1 pps: no 1 PPS input" << endl;
+	if (st[4] & 128)
+		os << "Frequency lock to external 1 pps: no 1 PPS input" << endl;
 				
 	// System level events 
-	if (s->status[5] & 1)
-		cout << "System event: lamp restart" << endl;
+	if (st[5] & 1)
+		os << "System event: lamp restart" << endl;
 	
-	if (s->status[5] & 2)
-		cout << "System event: watchdog timeout and reset" << endl;
+	if (st[5] & 2)
+		os << "System event: watchdog timeout and reset" << endl;
 	
-	if (s->status[5] & 4)
-		cout << "System event: bad interrupt vector" << endl;
+	if (st[5] & 4)
+		os << "System event: bad interrupt vector" << endl;
 	
-	if (s->status[5] & 8)
-		cout << "System event: EEPROM write failure" << endl;
+	if (st[5] & 8)
+		os << "System event: EEPROM write failure" << endl;
 	
-	if (s->status[5] & 16)
-		cout << "System event: EEPROM data corruption" << endl;
+	if (st[5] & 16)
+		os << "System event: EEPROM data corruption" << endl;
 	
-	if (s->status[5] & 32)
-		cout << "System event: bad command syntax" << endl;
+	if (st[5] & 32)
+		os << "System event: bad command syntax" << endl;
 	
-	if (s->status[5] & 64)
-		cout << "System event: bad command parameter" << endl;
+	if (st[5] & 64)
+		os << "System event: bad command parameter" << endl;
 	
-	if (s->status[5] & 128)
-		cout << "System event: unit has been reset" << endl;
-		
-	p.clearErrorMessage();
-
-	if (interactive) waitForKeyPress();
+	if (st[5] & 128)
+		os << "System event: unit has been reset" << endl;
 }
 
-void EZPRS10::printTestVoltages()
+void EZPRS10::reportTestVoltages(ostream &os,float tv[20])
 {
-	float fbuf[20];
-	p.getTestVoltages(fbuf);
 	for (int i=1;i<=19;i++)
-		cout << testStrings[i] << " " << fbuf[i] << endl;
+		os << testStrings[i] << " " << tv[i] << endl;
 	
-	cout << "Note: scaling factors for these voltages have been applied"
+	os << "Note: scaling factors for these voltages have been applied"
 			<< endl;
-	cout << "as described in the PRS10 manual." << endl;
-	p.clearErrorMessage();
-	
-        if (interactive) waitForKeyPress();
+	os << "as described in the PRS10 manual." << endl;
 }
 
 
-void EZPRS10::printVariables()
+void EZPRS10::reportVariables(ostream &os,PRS10Settings *s,bool pause)
 {
-	p.getAllVariables();
-	PRS10Settings *s=p.getSettings();
-			
-	cout << "-- Initialization" << endl;
-	cout << "VB Verbose mode " << s->verboseMode.value() << endl;
-	cout << "SN Serial number " << s->serialNumber << endl;
-	cout << "LM Lock mode pin config "
+	os << "-- Initialization" << endl;
+	os << "VB Verbose mode " << s->verboseMode.value() << endl;
+	os << "SN Serial number " << s->serialNumber << endl;
+	os << "LM Lock mode pin config "
 			<< s->lockModePinConfiguration.value() << endl;
 			
-	cout << "-- Frequency lock loop parameters " << endl;
-	cout << "LO lock on " << s->fLockOn.value()<< endl;
-	cout << "FC f control high " << s->fControlHigh.value()<< endl;
-	cout << "FC f control low " << s->fControlLow.value()<< endl;
+	os << "-- Frequency lock loop parameters " << endl;
+	os << "LO lock on " << s->fLockOn.value()<< endl;
+	os << "FC f control high " << s->fControlHigh.value()<< endl;
+	os << "FC f control low " << s->fControlLow.value()<< endl;
 	// ?? EEPROM values
-	cout << "DS error signal " << s->errorSignal<< endl;
-	cout << "DS signal strength " << s->signalStrength<< endl;
-	cout << "SF f offset " << s->fOffset.value()<< endl;
-	cout << "SS slope calibration factor " <<
+	os << "DS error signal " << s->errorSignal<< endl;
+	os << "DS signal strength " << s->signalStrength<< endl;
+	os << "SF f offset " << s->fOffset.value()<< endl;
+	os << "SS slope calibration factor " <<
 		s->slopeCalibration.value()<< endl;
-	cout << "GA gain " << s->gainParameter.value()<< endl;
-	cout << "PH phase " << s->phase.value()<< endl;
+	os << "GA gain " << s->gainParameter.value()<< endl;
+	os << "PH phase " << s->phase.value()<< endl;
+
+	os << "-- Frequency synthesizer control " << endl;
+	os << "SP R parameter " << s->fsR.value()<< endl;
+	os << "SP N parameter " << s->fsN.value()<< endl;
+	os << "SP A parameter " << s->fsA.value()<< endl;
+
+	os << "-- Magnetic field control " << endl;
+	os << "MS magnetic field " << s->magneticSwitching.value()<< endl;
+	os << "MO offset " << s->magneticOffset.value()<< endl;
+	os << "MR magnetic reading " << s->magneticRead.value()<< endl;
+
+	if (pause) waitForKeyPress();
+
+	os << "-- 1 PPS control" << endl;
+	os << "TT time tag (ns) " << s->timeTag.value()<< endl;
+	os << "TS time slope " << s->timeSlope.value()<< endl;
+	os << "TO time offset (ns) " << s->timeOffset.value()<< endl;
+	//os << "PP pulse offset (ns) " << s->ppsOffset.value()<< endl;
+	os << "PP pulse offset (ns) N/A" << endl;
+	os << "PS pulse slope calibration " << s->ppsSlopeCalibration.value()<< endl;
+
+	os << "-- 1 PPS locking control " << endl;
+	os << "PL PLL on " << s->ppsPLLOn.value()<< endl;
+	os << "PT PLL time constant " << s->ppsPLLTimeConstant.value()<< endl;
+	os << "PF PLL stability factor " << s->ppsPLLStabilityFactor.value()<< endl;
+	os << "PI PLL integrator " << s->ppsPLLIntegrator.value()<< endl;
+
+	os << "-- Analog control" << endl;
+
+	os << "SD0 RF amplitude " << s->DACSettings[0]<< endl;
+	os << "SD1 analog portion of 1 pps delay " << s->DACSettings[1]<< endl;
+	os << "SD2 discharge lamp FET oscillator drain voltage " << s->DACSettings[2]<< endl;
+	os << "SD3 discharge lamp temperature " << s->DACSettings[3]<< endl;
+	os << "SD4 10 MHz crystal temperature " << s->DACSettings[4]<< endl;
+	os << "SD5 Resonance cell temperature " << s->DACSettings[5]<< endl;
+	os << "SD6 10 MHz oscillator amplitude " << s->DACSettings[6]<< endl;
+	os << "SD7 RF phase modulation peak amplitude " << s->DACSettings[7]<< endl;
+}
+
+void EZPRS10::reportReset(ostream &os,unsigned char st[6])
+{
+	// ST6 bit 7 flags a unit reset
+	if (st[5] & 128)
+	{
+		os << "Unit reset" << endl;
+	}
+	else
+	{
+		os << "Unit not reset" << endl;
+	}
+}
 
-	cout << "-- Frequency synthesizer control " << endl;
-	cout << "SP R parameter " << s->fsR.value()<< endl;
-	cout << "SP N parameter " << s->fsN.value()<< endl;
-	cout << "SP A parameter " << s->fsA.value()<< endl;
+void EZPRS10::doStep1pps(ostream &os,int step)
+{
+	int nerr;
+	if (!(p.command(PRS10::PRS10_PP,PRS10::PRS10_SET,step)))
+		os << p.getErrorMessage(&nerr);
+	else
+	{
+		os << "1 pps step command succeeded" << endl;
+		ostringstream o;
+		o << "1 pps stepped " << step << " ns";
+		logIt(o.str());
+		updateCCTFComment();
+	}
+	p.clearErrorMessage();
+}
 
-	cout << "-- Magnetic field control " << endl;
-	cout << "MS magnetic field " << s->magneticSwitching.value()<< endl;
-	cout << "MO offset " << s->magneticOffset.value()<< endl;
-	cout << "MR magnetic reading " << s->magneticRead.value()<< endl;
+int EZPRS10::connectSocket()
+{
+	// Returns a connection to the daemon's socket, or -1
+	int fd=socket(AF_UNIX,SOCK_STREAM,0);
+	if (fd < 0) return -1;
+	struct sockaddr_un addr;
+	memset(&addr,0,sizeof(addr));
+	addr.sun_family=AF_UNIX;
+	strncpy(addr.sun_path,socketPath.c_str(),sizeof(addr.sun_path)-1);
+	if (0 != connect(fd,(struct sockaddr *) &addr,sizeof(addr)))
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
 
-	if (interactive) waitForKeyPress();
+string EZPRS10::request(string req)
+{
+	// Sends a request to the daemon and returns the reply
+	int fd=connectSocket();
+	if (fd < 0)
+		return "Couldn't connect to the prs10c daemon on " + socketPath + "\n";
+	
+	req += "\n";
+	send(fd,req.c_str(),req.size(),MSG_NOSIGNAL);
+	
+	string reply;
+	char buf[1024];
+	ssize_t n;
+	while ((n=read(fd,buf,sizeof(buf))) > 0) // the daemon closes the connection when the reply is complete
+		reply.append(buf,n);
+	close(fd);
+	return reply;
+}
 
-	cout << "-- 1 PPS control" << endl;
-	cout << "TT time tag (ns) " << s->timeTag.value()<< endl;
-	cout << "TS time slope " << s->timeSlope.value()<< endl;
-	cout << "TO time offset (ns) " << s->timeOffset.value()<< endl;
-	//cout << "PP pulse offset (ns) " << s->ppsOffset.value()<< endl;
-	cout << "PP pulse offset (ns) N/A" << endl;
-	cout << "PS pulse slope calibration " << s->ppsSlopeCalibration.value()<< endl;
-
-	cout << "-- 1 PPS locking control " << endl;
-	cout << "PL PLL on " << s->ppsPLLOn.value()<< endl;
-	cout << "PT PLL time constant " << s->ppsPLLTimeConstant.value()<< endl;
-	cout << "PF PLL stability factor " << s->ppsPLLStabilityFactor.value()<< endl;
-	cout << "PI PLL integrator " << s->ppsPLLIntegrator.value()<< endl;
-
-	cout << "-- Analog control" << endl;
-
-	cout << "SD0 RF amplitude " << s->DACSettings[0]<< endl;
-	cout << "SD1 analog portion of 1 pps delay " << s->DACSettings[1]<< endl;
-	cout << "SD2 discharge lamp FET oscillator drain voltage " << s->DACSettings[2]<< endl;
-	cout << "SD3 discharge lamp temperature " << s->DACSettings[3]<< endl;
-	cout << "SD4 10 MHz crystal temperature " << s->DACSettings[4]<< endl;
-	cout << "SD5 Resonance cell temperature " << s->DACSettings[5]<< endl;
-	cout << "SD6 10 MHz oscillator amplitude " << s->DACSettings[6]<< endl;
-	cout << "SD7 RF phase modulation peak amplitude " << s->DACSettings[7]<< endl;
+bool EZPRS10::openSocket()
+{
+	// A socket left behind by a daemon which did not exit cleanly is removed,
+	// but nothing else is
+	struct stat sb;
+	if (0 == lstat(socketPath.c_str(),&sb))
+	{
+		if (!S_ISSOCK(sb.st_mode))
+		{
+			cerr << socketPath << " exists and is not a socket" << endl;
+			return false;
+		}
+		int fd=connectSocket();
+		if (fd >= 0)
+		{
+			close(fd);
+			cerr << "A prs10c daemon is already listening on " << socketPath << endl;
+			return false;
+		}
+		unlink(socketPath.c_str());
+	}
 	
-	p.clearErrorMessage();
-	if (interactive) waitForKeyPress();
+	if ((listenfd=socket(AF_UNIX,SOCK_STREAM,0)) < 0)
+	{
+		cerr << "Couldn't create a socket: " << strerror(errno) << endl;
+		return false;
+	}
+	struct sockaddr_un addr;
+	memset(&addr,0,sizeof(addr));
+	addr.sun_family=AF_UNIX;
+	strncpy(addr.sun_path,socketPath.c_str(),sizeof(addr.sun_path)-1);
+	if (bind(listenfd,(struct sockaddr *) &addr,sizeof(addr)) < 0 || listen(listenfd,8) < 0)
+	{
+		cerr << "Couldn't listen on " << socketPath << ": " << strerror(errno) << endl;
+		close(listenfd);
+		listenfd=-1;
+		return false;
+	}
+	chmod(socketPath.c_str(),0660);
+	return true;
+}
+
+void EZPRS10::refresh()
+{
+	// Failed queries leave the previous values in the cache
+	p.getAllVariables();
+	p.getTestVoltages(cachedVoltages);
+	unsigned char buf[6];
+	p.getStatus(buf);
+	int nerr;
+	if (p.isErrorMessage())
+	{
+		cerr << "Refresh: " << p.getErrorMessage(&nerr);
+		p.clearErrorMessage();
+	}
+	PRS10Settings *s=p.getSettings();
+	cache=*s;
+	for (int i=0;i<6;i++)
+		cachedStatus[i] |= s->status[i];
+	lastRefresh=time(NULL);
+}
+
+void EZPRS10::refreshStatus()
+{
+	// The status is read when a client asks for it, rather than taken from the last refresh
+	unsigned char buf[6];
+	p.getStatus(buf);
+	int nerr;
+	if (p.isErrorMessage())
+	{
+		cerr << "Status: " << p.getErrorMessage(&nerr);
+		p.clearErrorMessage();
+		return;
+	}
+	for (int i=0;i<6;i++)
+		cachedStatus[i] |= buf[i];
+}
+
+void EZPRS10::serveClient(int fd)
+{
+	// A request is a single line
+	struct timeval tv;
+	tv.tv_sec=1;
+	tv.tv_usec=0;
+	setsockopt(fd,SOL_SOCKET,SO_RCVTIMEO,&tv,sizeof(tv));
+	
+	string req;
+	char buf[256];
+	ssize_t n;
+	while (req.find('\n') == string::npos && req.size() < 256 && (n=read(fd,buf,sizeof(buf))) > 0)
+		req.append(buf,n);
+	
+	ostringstream reply;
+	int step;
+	if (0==req.find("STATUS"))
+	{
+		refreshStatus();
+		reportStatus(reply,cachedStatus);
+		memset(cachedStatus,0,6);
+	}
+	else if (0==req.find("RESET"))
+	{
+		refreshStatus();
+		reportReset(reply,cachedStatus);
+		memset(cachedStatus,0,6);
+	}
+	else if (0==req.find("VARIABLES"))
+		reportVariables(reply,&cache,false);
+	else if (0==req.find("VOLTAGES"))
+		reportTestVoltages(reply,cachedVoltages);
+	else if (1==sscanf(req.c_str(),"STEP1PPS %i",&step))
+		doStep1pps(reply,step);
+	else if (0==req.find("REFRESH"))
+	{
+		refresh();
+		reply << "OK" << endl;
+	}
+	else
+		reply << "Unknown request " << req.substr(0,req.find('\n')) << endl;
+	
+	string r=reply.str();
+	const char *rp=r.c_str();
+	size_t count=r.size();
+	while (count > 0)
+	{
+		ssize_t nWritten=send(fd,rp,count,MSG_NOSIGNAL);
+		if (nWritten <= 0) break;
+		rp += nWritten;
+		count -= nWritten;
+	}
 }
 
 void EZPRS10::printMenu()
@@ -941,14 +1301,23 @@ bool EZPRS10::loadSetup(string hd)
 
 	bool result=true;
 	string sarg,token;
-	while (!in.eof())
+	while (in >> token)
 	{
-		in >> token;
 		if (token == "PORT")
 		{
 			in >> sarg;
 			p.setPort(sarg);
 		}
+		else if (token == "LOCK_COMMAND")
+		{
+			in >> sarg;
+			p.setLockCommand(sarg);
+		}
+		else if (token == "LOCK_DIRECTORY")
+		{
+			in >> sarg;
+			p.setLockDirectory(sarg);
+		}
 		else if (token == "CCTF_COMMENTS")
 		{
 			in >> sarg;
@@ -964,6 +1333,37 @@ bool EZPRS10::loadSetup(string hd)
 				result = false;
 			}
 		}
+		else if (token == "SOCKET")
+		{
+			in >> sarg;
+			socketPath=sarg;
+		}
+		else if (token == "REFRESH")
+		{
+			int iarg;
+			if ((in >> iarg) && iarg > 0)
+				refreshInterval=iarg;
+			else
+			{
+				cerr << "Bad argument to token " <<
+					token << " in setup file " <<
+					path << endl;
+				result = false;
+			}
+		}
+		else if (token == "PIPELINE")
+		{
+			int iarg;
+			if ((in >> iarg) && iarg > 0)
+				p.setPipelineDepth(iarg);
+			else
+			{
+				cerr << "Bad argument to token " <<
+					token << " in setup file " <<
+					path << endl;
+				result = false;
+			}
+		}
 		else 
 		{
 			cerr << "Unrecognised token " << token << endl;
@@ -1118,6 +1518,7 @@ static void printHelp()
 {
 	printVersion();
 	cout << "Command line options" << endl;
+	cout << "-d     run as a daemon, serving requests on the control socket" << endl;
 	cout << "-h     print this help" << endl;
 	cout << "-o     adjust 1 pps" << endl;
 	cout << "-q     query all variables" << endl;
@@ -1125,6 +1526,8 @@ static void printHelp()
 	cout << "-s     print status" << endl;
 	//cout << "-r x   adjust rate by x" << endl;
 	cout << "-v     print version" << endl;
+	cout << "-x     report whether the unit has been reset" << endl;
+	cout << "If a daemon is running, the other options are sent to it." << endl;
 }
 
 static void printVersion()
@@ -1132,6 +1535,11 @@ static void printVersion()
 	cout << "PRS10C " << PRS10C_VERSION << endl;
 }
 
+static void stopHandler(int)
+{
+	stopDaemon=1;
+}
+
 
 int main(int argc,char **argv)
 {
@@ -1141,10 +1549,27 @@ int main(int argc,char **argv)
 	// Process any command line arguments
 	char c;
 	if (1 == argc) // no arguments so interactive mode
+	{
+		prsc.open();
 		prsc.run();
+	}
+	else if (0==strcmp(argv[1],"-d"))
+	{
+		if (prsc.connectDaemon())
+		{
+			cerr << "A prs10c daemon is already running" << endl;
+			return -1;
+		}
+		prsc.setInteractive(false);
+		prsc.open();
+		if (!prsc.runDaemon())
+			return -1;
+	}
 	else
 	{
 		prsc.setInteractive(false);
+		if (!prsc.connectDaemon()) // otherwise, use the port directly
+			prsc.open();
 		while ((c=getopt(argc,argv,"hvo:tsqx")) != EOF)
 		{
 			switch(c)
@@ -0,0 +1,392 @@
+#!/usr/bin/python
+#
+
+#
+# The MIT License (MIT)
+#
+# Copyright (c) 2016 Michael J. Wouters
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+#
+# prs10sim.py - simulates a PRS10 on a pseudo-terminal, for testing
+# prs10c, prs10log.pl and prs10adjust.pl without a rubidium
+#
+# Point PORT in prs10.setup (or the PRS10 port in gpscv.conf) at the link
+# made by this script.
+#
+# The oscillator model:
+#   fractional frequency = initial offset + drift + white frequency noise
+#                          + SF x 1e-12
+#                          + 1e-12 x (MO^2 - MO0^2)/SS  (the magnetic offset,
+#                            consistent with prs10c's rate adjustment)
+#                          + the 1 pps PLL correction, when PL is on
+#   The 1 pps phase, relative to a perfect external 1 pps, is the integral of this,
+#   plus any PP steps. TT? reports it.
+#   The PLL is second order, with a time constant of 2^PT minutes.
+#
+# Model time can run faster than real time (--speed) so that steering can be tested
+# over days in a few minutes. The serial line is modelled at 9600 baud,
+# with a processing delay and jitter for each command.
+#
+# Faults can be injected: dropped and corrupted replies, EEPROM write failures,
+# resets and loss of the external 1 pps.
+#
+# Modification history
+# 2026-10-19     First version
+#
+
+import argparse
+import os
+import random
+import select
+import signal
+import sys
+import termios
+import time
+import tty
+
+VERSION = "0.1.0"
+
+BAUD = 9600.0
+CHARTIME = 10.0/BAUD # 8N1
+
+# Globals
+debug = False
+killed = False
+
+# ------------------------------------------
+def SignalHandler(signal,frame):
+	global killed
+	killed=True
+	return
+
+# ------------------------------------------
+def ShowVersion():
+	print(os.path.basename(sys.argv[0]) + ' version ' + VERSION)
+	return
+
+# ------------------------------------------
+def Debug(msg):
+	if (debug):
+		sys.stderr.write(msg + '\n')
+	return
+
+# ------------------------------------------
+class PRS10Model:
+
+	# Integer parameters: [value,min,max]
+	# The limits are as in prs10.cpp
+	def __init__(self,args):
+		self.params = {
+			'VB':[0,0,1],'LM':[1,0,3],'LO':[1,0,1],'SF':[0,-2000,2000],
+			'SS':[1500,1000,1900],'GA':[5,0,10],'PH':[10,0,31],
+			'MS':[1,0,1],'MO':[3000,2300,3600],'MR':[2000,1000,4095],
+			'TS':[10000,7000,25000],'TO':[0,-32767,32768],
+			'PS':[150,100,255],'PL':[0,0,1],'PT':[4,0,14],'PF':[2,0,4],
+			'PI':[0,-2000,2000]
+		}
+		self.settable = ['VB','LM','LO','SF','SS','GA','MS','MO','PL','PT','PF','PI','TO','TS','PS']
+		self.eeprom = {}
+		for k in self.params:
+			self.eeprom[k]=self.params[k][0]
+		self.fc = [2048,2048]
+		self.sp = [5034,2120,23]
+		self.sd = [2048,2048,2048,2048,2048,2048,2048,2048]
+		self.voltages = [2.4,2.4,0.9,1.1,0.5,0.5,0.5,2.4,2.5,4.9,
+			0.22,2.5,2.5,2.4,0.2,1.0,4.9,4.9,4.9,1.0] # raw AD readings
+		self.serialNumber = args.serial
+		self.status = [0,0,0,0,0,128] # powered up
+
+		self.y0 = args.offset*1.0E-12
+		self.drift = args.drift*1.0E-12/86400.0 # per second
+		self.noise = args.noise*1.0E-12
+		self.mo0 = self.params['MO'][0]
+		self.phase = args.phase # ns
+		self.integrator = 0.0
+		self.t = 0.0 # model time, in seconds
+		self.ppsPresent = not args.no_pps
+		self.eepromFail = args.eeprom_fail
+		return
+
+	# ------------------------------------------
+	def Frequency(self):
+		y = self.y0 + self.drift*self.t + random.gauss(0.0,self.noise)
+		y += self.params['SF'][0]*1.0E-12
+		mo = self.params['MO'][0]
+		y += 1.0E-12*(mo*mo - self.mo0*self.mo0)/self.params['SS'][0]
+		return y
+
+	# ------------------------------------------
+	def Step(self):
+		# Advances the model by one second
+		y = self.Frequency()
+		if (self.params['PL'][0] == 1 and self.ppsPresent):
+			tau = 60.0*(2**self.params['PT'][0])
+			e = self.phase*1.0E-9
+			self.integrator += e/(tau*tau)
+			y -= 2.0*e/tau + self.integrator
+			pi = int(round(self.integrator/1.0E-12))
+			if (pi < -2000 or pi > 2000):
+				self.status[4] |= 64 # f control saturated
+			self.params['PI'][0] = max(-2000,min(2000,pi))
+		self.phase += y*1.0E9
+		self.t += 1.0
+		return
+
+	# ------------------------------------------
+	def AdvanceTo(self,t):
+		while (self.t + 1.0 <= t):
+			self.Step()
+		return
+
+	# ------------------------------------------
+	def Reset(self):
+		# Power cycle: RAM values are reloaded from the EEPROM
+		for k in self.eeprom:
+			self.params[k][0]=self.eeprom[k]
+		self.integrator = 0.0
+		self.status[5] |= 128
+		if (self.params['PL'][0]==1):
+			self.status[4] |= 32 # PLL restarted
+		Debug('reset at t=' + str(self.t))
+		return
+
+	# ------------------------------------------
+	def Status(self):
+		# Reading the status clears the latched bits
+		st = list(self.status)
+		if (self.params['LO'][0]==0):
+			st[3] |= 1
+		if (self.params['PL'][0]==0):
+			st[4] |= 1
+		else:
+			st[4] |= 4
+		if (not self.ppsPresent):
+			st[4] |= 128
+		self.status = [0,0,0,0,0,0]
+		return ','.join([str(s) for s in st])
+
+	# ------------------------------------------
+	def Command(self,cmd):
+		# Executes one command and returns the reply, or None
+		if (len(cmd) < 2):
+			self.status[5] |= 32
+			return None
+
+		mnemonic = cmd[0:2].upper()
+		arg = cmd[2:].strip()
+		Debug('t=%.0f %s' % (self.t,cmd))
+
+		if (mnemonic == 'ID' and arg == '?'):
+			return 'PRS10_3.15_SN_' + str(self.serialNumber)
+		if (mnemonic == 'SN' and arg == '?'):
+			return str(self.serialNumber)
+		if (mnemonic == 'ST' and arg == '?'):
+			return self.Status()
+		if (mnemonic == 'RS' or mnemonic == 'RC'):
+			if (arg == '1'):
+				self.Reset()
+			return None
+		if (mnemonic == 'TT' and arg == '?'):
+			return str(int(round(self.phase)) % 1000000000)
+		if (mnemonic == 'PP'):
+			try:
+				self.phase += int(arg)
+				Debug('1 pps stepped ' + arg + ' ns')
+			except ValueError:
+				self.status[5] |= 64
+			return None
+		if (mnemonic == 'DS' and arg == '?'):
+			return str(int(random.gauss(0,20))) + ',' + str(3000 + int(random.gauss(0,5)))
+		if (mnemonic == 'FC' and arg == '?'):
+			return ','.join([str(v) for v in self.fc])
+		if (mnemonic == 'SP' and arg == '?'):
+			return ','.join([str(v) for v in self.sp])
+		if (mnemonic == 'SD' or mnemonic == 'AD'):
+			try:
+				chan = int(arg[0:-1])
+				if (mnemonic == 'SD' and arg[-1] == '?'):
+					return str(self.sd[chan])
+				if (mnemonic == 'AD' and arg[-1] == '?'):
+					return '%.3f' % (self.voltages[chan] + random.gauss(0.0,0.002))
+			except (ValueError,IndexError):
+				pass
+			self.status[5] |= 64
+			return None
+
+		if (mnemonic in self.params):
+			p = self.params[mnemonic]
+			if (arg == '?'):
+				return str(p[0])
+			if (arg == '!?'):
+				return str(self.eeprom[mnemonic])
+			if (arg == '!'):
+				if (self.eepromFail > 0 and random.random() < self.eepromFail):
+					self.status[5] |= 8
+					Debug('EEPROM write of ' + mnemonic + ' failed')
+				else:
+					self.eeprom[mnemonic]=p[0]
+				return None
+			if (mnemonic in self.settable):
+				try:
+					v = int(arg)
+				except ValueError:
+					self.status[5] |= 32
+					return None
+				if (v < p[1] or v > p[2]):
+					self.status[5] |= 64
+					return None
+				if (mnemonic == 'PL' and v != p[0]):
+					self.integrator = 0.0
+					if (v == 1):
+						self.status[4] |= 32
+				p[0]=v
+				return None
+
+		self.status[5] |= 32 # bad command syntax
+		return None
+
+# ------------------------------------------
+# Main
+# ------------------------------------------
+
+parser = argparse.ArgumentParser(description='Simulates a PRS10 rubidium oscillator on a pseudo-terminal')
+parser.add_argument('--link','-l',help='symbolic link to the pty, used as the serial port (default /tmp/prs10sim)',default='/tmp/prs10sim')
+parser.add_argument('--speed',help='model seconds per real second (default 1)',type=float,default=1.0)
+parser.add_argument('--offset',help='initial fractional frequency offset, in parts in 10^12 (default 0)',type=float,default=0.0)
+parser.add_argument('--drift',help='frequency drift, in parts in 10^12 per day (default 0)',type=float,default=0.0)
+parser.add_argument('--noise',help='white frequency noise per second, in parts in 10^12 (default 0)',type=float,default=0.0)
+parser.add_argument('--phase',help='initial 1 pps phase, in ns (default 0)',type=float,default=0.0)
+parser.add_argument('--serial',help='serial number (default 1234)',type=int,default=1234)
+parser.add_argument('--latency',help='processing time for each command, in ms (default 2)',type=float,default=2.0)
+parser.add_argument('--jitter',help='random extra processing time, up to this many ms (default 0)',type=float,default=0.0)
+parser.add_argument('--drop',help='probability that a reply is not sent',type=float,default=0.0)
+parser.add_argument('--corrupt',help='probability that a character of a reply is corrupted',type=float,default=0.0)
+parser.add_argument('--eeprom-fail',help='probability that an EEPROM write fails',type=float,default=0.0)
+parser.add_argument('--reset-every',help='reset the unit every so many model seconds',type=float,default=0.0)
+parser.add_argument('--no-pps',help='no external 1 pps input',action='store_true')
+parser.add_argument('--seed',help='seed for the random number generator',type=int)
+parser.add_argument('--log',help='file to write the model state to, once per model minute')
+parser.add_argument('--debug','-d',help='debug (to stderr)',action='store_true')
+parser.add_argument('--version','-v',help='show version and exit',action='store_true')
+args = parser.parse_args()
+
+if (args.version):
+	ShowVersion()
+	sys.exit(0)
+
+debug = args.debug
+
+if (args.speed <= 0):
+	sys.stderr.write('--speed must be positive\n')
+	sys.exit(1)
+
+random.seed(args.seed)
+
+signal.signal(signal.SIGINT,SignalHandler)
+signal.signal(signal.SIGTERM,SignalHandler)
+
+master,slave = os.openpty()
+tty.setraw(slave)
+try:
+	os.unlink(args.link)
+except OSError:
+	pass
+os.symlink(os.ttyname(slave),args.link)
+Debug('PRS10 on ' + os.ttyname(slave) + ' linked from ' + args.link)
+
+logFile = None
+if (args.log):
+	logFile = open(args.log,'w')
+	logFile.write('# t (s)  phase (ns)  frequency (pp10^12)  SF  MO  PL  PI\n')
+
+prs10 = PRS10Model(args)
+start = time.time()
+nextReset = args.reset_every
+nextLog = 0.0
+
+rxBuf = ''
+rxFree = 0.0 # when the modelled serial lines are next free
+txFree = 0.0
+replies = [] # [time due,bytes]
+
+while (not killed):
+
+	now = time.time()
+
+	# Advance the model
+	tModel = (now - start)*args.speed
+	if (args.reset_every > 0 and tModel >= nextReset):
+		prs10.AdvanceTo(nextReset)
+		prs10.Reset()
+		nextReset += args.reset_every
+	while (logFile and tModel >= nextLog):
+		prs10.AdvanceTo(nextLog)
+		logFile.write('%.0f %.3f %.4f %i %i %i %i\n' % (prs10.t,prs10.phase,prs10.Frequency()/1.0E-12,
+			prs10.params['SF'][0],prs10.params['MO'][0],prs10.params['PL'][0],prs10.params['PI'][0]))
+		logFile.flush()
+		nextLog += 60.0
+	prs10.AdvanceTo(tModel)
+
+	# Send any replies which are due
+	while (replies and replies[0][0] <= now):
+		os.write(master,replies.pop(0)[1])
+
+	timeout = 0.1
+	if (replies):
+		timeout = max(0.0,min(timeout,replies[0][0]-now))
+	try:
+		(r,w,x) = select.select([master],[],[],timeout)
+	except select.error:
+		continue # interrupted
+	if (not r):
+		continue
+
+	try:
+		data = os.read(master,1024)
+	except OSError:
+		continue
+	now = time.time()
+	rxBuf += data.decode('ascii','replace')
+
+	# Commands are terminated by CR and may be combined with ';'
+	while ('\r' in rxBuf):
+		(line,rxBuf) = rxBuf.split('\r',1)
+		rxFree = max(now,rxFree) + (len(line)+1)*CHARTIME
+		for cmd in line.split(';'):
+			reply = prs10.Command(cmd.strip())
+			if (reply is None):
+				continue
+			if (args.drop > 0 and random.random() < args.drop):
+				Debug('dropped reply to ' + cmd)
+				continue
+			if (args.corrupt > 0):
+				chars = list(reply)
+				for i in range(len(chars)):
+					if (random.random() < args.corrupt):
+						chars[i] = chr(random.randint(33,126))
+				reply = ''.join(chars)
+			reply += '\r'
+			t = max(rxFree + args.latency/1000.0 + random.uniform(0,args.jitter/1000.0),txFree)
+			txFree = t + len(reply)*CHARTIME
+			replies.append([txFree,reply.encode('ascii')])
+
+os.unlink(args.link)
+if (logFile):
+	logFile.close()
@@ -0,0 +1,280 @@
+#!/usr/bin/python
+#
+
+#
+# The MIT License (MIT)
+#
+# Copyright (c) 2016 Michael J. Wouters
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+#
+# prs10simtest.py - steers a simulated PRS10 with prs10c, in closed loop
+#
+# prs10sim.py is started with model time running --speed times faster than real time.
+# Its model log stands in for the time-interval counter: every --interval model seconds
+# the 1 pps phase and its slope are read from it, and prs10c is run to
+#   step the 1 pps (prs10c -o) if the phase is more than --step-limit ns out, otherwise
+#   adjust the rate through the menu, with SF (--mode sf) or the magnetic offset (--mode mo),
+#   to remove the frequency offset and the phase over the next two intervals.
+# The test passes if the RMS phase over the second half of the run is within --tolerance.
+#
+# prs10c is run with HOME set to a scratch directory holding the setup file.
+# The pseudo-terminal is private to that directory, so the setup file turns off
+# port locking (LOCK_COMMAND none): lockport can't lock a port outside /dev.
+#
+# Modification history
+# 2026-10-19     First version
+#
+
+import argparse
+import math
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+VERSION = "0.1.0"
+
+SF_MIN = -2000 # as in prs10.cpp
+SF_MAX = 2000
+MO_MIN = 2300
+MO_MAX = 3600
+SS = 1500 # the simulator's slope calibration
+
+PRS10C_TIMEOUT = 30 # real seconds
+
+# Globals
+debug = False
+
+# ------------------------------------------
+def ShowVersion():
+	print(os.path.basename(sys.argv[0]) + ' version ' + VERSION)
+	return
+
+# ------------------------------------------
+def Debug(msg):
+	if (debug):
+		sys.stderr.write(msg + '\n')
+	return
+
+# ------------------------------------------
+def ErrorExit(msg):
+	sys.stderr.write(msg + '\n')
+	sys.exit(1)
+
+# ------------------------------------------
+def Wrap(phase):
+	# The model's phase accumulates 1 pps steps, so it's reduced to (-0.5 s,0.5 s]
+	phase = math.fmod(phase,1.0E9)
+	if (phase > 5.0E8):
+		phase -= 1.0E9
+	elif (phase <= -5.0E8):
+		phase += 1.0E9
+	return phase
+
+# ------------------------------------------
+def ReadModelLog(fname):
+	# Returns a list of [t,phase,frequency,SF,MO,PL,PI]
+	rows = []
+	try:
+		fin = open(fname,'r')
+	except IOError:
+		return rows
+	for l in fin:
+		if (l.startswith('#')):
+			continue
+		f = l.split()
+		if (len(f) != 7):
+			continue # partly written
+		rows.append([float(f[0]),Wrap(float(f[1])),float(f[2]),int(f[3]),int(f[4]),int(f[5]),int(f[6])])
+	fin.close()
+	return rows
+
+# ------------------------------------------
+def WaitForModelTime(fname,t,sim):
+	while True:
+		rows = ReadModelLog(fname)
+		if (rows and rows[-1][0] >= t):
+			return rows
+		if (sim.poll() is not None):
+			ErrorExit('prs10sim.py exited')
+		time.sleep(0.05)
+
+# ------------------------------------------
+def Slope(rows,t0):
+	# Least squares fit of phase (ns) against time, after t0; returns ns/s or None
+	pts = [r for r in rows if r[0] > t0]
+	if (len(pts) < 3):
+		return None
+	n = len(pts)
+	mt = sum([r[0] for r in pts])/n
+	mp = sum([r[1] for r in pts])/n
+	sxx = sum([(r[0]-mt)*(r[0]-mt) for r in pts])
+	sxy = sum([(r[0]-mt)*(r[1]-mp) for r in pts])
+	return sxy/sxx
+
+# ------------------------------------------
+def RunPRS10c(args,opts,stdin):
+	# Runs prs10c, feeding it stdin, and returns [exit status,output]
+	cmd = [args.prs10c] + opts
+	Debug('running ' + ' '.join(cmd))
+	env = dict(os.environ)
+	env['HOME'] = args.home
+	proc = subprocess.Popen(cmd,stdin=subprocess.PIPE,stdout=subprocess.PIPE,
+		stderr=subprocess.STDOUT,env=env)
+	# prs10c loops on bad input, so it is killed if it doesn't finish
+	timer = threading.Timer(PRS10C_TIMEOUT,proc.kill)
+	timer.start()
+	out = proc.communicate(stdin.encode('ascii'))[0].decode('ascii','replace')
+	timer.cancel()
+	Debug(out)
+	return [proc.returncode,out]
+
+# ------------------------------------------
+def Step1pps(args,phase):
+	step = int(round(-phase)) % 1000000000
+	if (step == 0):
+		return True
+	(status,out) = RunPRS10c(args,['-o',str(step)],'')
+	return 'succeeded' in out
+
+# ------------------------------------------
+def AdjustRate(args,ffo,sf,mo):
+	# ffo is the change in fractional frequency, in parts in 10^12
+	if (args.mode == 'sf'):
+		ffo = int(round(ffo))
+		ffo = max(SF_MIN - sf,min(SF_MAX - sf,ffo)) # otherwise prs10c asks again
+		if (ffo == 0):
+			return [True,0]
+		(status,out) = RunPRS10c(args,[],'3\n' + str(ffo) + '\n\n7\n')
+		return ['SF currently' in out,ffo]
+	mo2 = ffo*SS + mo*mo
+	if (mo2 < MO_MIN*MO_MIN or mo2 > MO_MAX*MO_MAX):
+		return [False,0]
+	if (int(math.sqrt(mo2)) == mo):
+		return [True,0] # less than one step
+	(status,out) = RunPRS10c(args,[],'2\n' + ('%.3f' % ffo) + '\n\n7\n')
+	return ['Changes OK!' in out,ffo]
+
+# ------------------------------------------
+# Main
+# ------------------------------------------
+
+parser = argparse.ArgumentParser(description='Steers a simulated PRS10 with prs10c, in closed loop')
+parser.add_argument('--speed',help='model seconds per real second (default 200)',type=float,default=200.0)
+parser.add_argument('--duration',help='length of the run, in model hours (default 6)',type=float,default=6.0)
+parser.add_argument('--interval',help='steering interval, in model seconds (default 600)',type=float,default=600.0)
+parser.add_argument('--mode',help='rate adjustment: sf (SetFrequency) or mo (magnetic offset) (default sf)',
+	choices=['sf','mo'],default='sf')
+parser.add_argument('--offset',help='initial fractional frequency offset, in parts in 10^12 (default 50)',type=float,default=50.0)
+parser.add_argument('--drift',help='frequency drift, in parts in 10^12 per day (default 5)',type=float,default=5.0)
+parser.add_argument('--noise',help='white frequency noise per second, in parts in 10^12 (default 1)',type=float,default=1.0)
+parser.add_argument('--phase',help='initial 1 pps phase, in ns (default 250000)',type=float,default=250000.0)
+parser.add_argument('--step-limit',help='phase, in ns, beyond which the 1 pps is stepped (default 1000)',type=float,default=1000.0)
+parser.add_argument('--tolerance',help='RMS phase, in ns, for the test to pass (default 20)',type=float,default=20.0)
+parser.add_argument('--prs10c',help='prs10c to test (default ./prs10c)',default='./prs10c')
+parser.add_argument('--simulator',help='the simulator (default prs10sim.py, alongside this script)',
+	default=os.path.join(os.path.dirname(os.path.abspath(sys.argv[0])),'prs10sim.py'))
+parser.add_argument('--seed',help='seed for the simulator',type=int,default=1)
+parser.add_argument('--keep',help='keep the scratch directory',action='store_true')
+parser.add_argument('--debug','-d',help='debug (to stderr)',action='store_true')
+parser.add_argument('--version','-v',help='show version and exit',action='store_true')
+args = parser.parse_args()
+
+if (args.version):
+	ShowVersion()
+	sys.exit(0)
+
+debug = args.debug
+
+if (not os.access(args.prs10c,os.X_OK)):
+	ErrorExit(args.prs10c + ' not found - run make first')
+args.prs10c = os.path.abspath(args.prs10c)
+
+# A scratch home directory for prs10c
+args.home = tempfile.mkdtemp(prefix='prs10simtest.')
+os.mkdir(os.path.join(args.home,'etc'))
+os.mkdir(os.path.join(args.home,'logs'))
+port = os.path.join(args.home,'ttyPRS10')
+modelLog = os.path.join(args.home,'model.dat')
+fout = open(os.path.join(args.home,'etc','prs10.conf'),'w')
+fout.write('PORT ' + port + '\nLOCK_COMMAND none\nCCTF_COMMENTS no\n')
+fout.close()
+
+sim = subprocess.Popen([sys.executable,args.simulator,'--link',port,'--speed',str(args.speed),
+	'--offset',str(args.offset),'--drift',str(args.drift),'--noise',str(args.noise),
+	'--phase',str(args.phase),'--seed',str(args.seed),'--log',modelLog])
+
+print('%-8s %12s %14s %10s %s' % ('t (h)','phase (ns)','y (pp10^12)','SF','MO'))
+
+ok = True
+residuals = [] # [t,phase]
+tStart = 0.0 # of the fit
+try:
+	rows = WaitForModelTime(modelLog,0.0,sim)
+	tNext = args.interval
+	while (tNext <= args.duration*3600.0):
+		rows = WaitForModelTime(modelLog,tNext,sim)
+		(t,phase,y,sf,mo,pl,pi) = rows[-1]
+		slope = Slope(rows,tStart)
+		residuals.append([t,phase])
+		action = ''
+		if (abs(phase) > args.step_limit):
+			if (Step1pps(args,phase)):
+				action = '1 pps stepped'
+			else:
+				action = '1 pps step failed'
+				ok = False
+		elif (slope is not None):
+			# remove the frequency offset, and the phase over the next two intervals
+			ffo = -slope*1.0E3 - phase*1.0E3/(2.0*args.interval)
+			(adjusted,applied) = AdjustRate(args,ffo,sf,mo)
+			if (adjusted):
+				action = 'rate %+.1f' % applied
+			else:
+				action = 'rate adjustment failed'
+				ok = False
+		print('%-8.2f %12.1f %14.2f %10i %i  %s' % (t/3600.0,phase,
+			(slope*1.0E3 if slope is not None else float('nan')),sf,mo,action))
+		tStart = WaitForModelTime(modelLog,0.0,sim)[-1][0] # later rows follow the adjustment
+		tNext += args.interval
+finally:
+	sim.terminate()
+	sim.wait()
+
+settled = [r[1] for r in residuals if r[0] > args.duration*3600.0/2.0]
+if (settled):
+	rms = math.sqrt(sum([p*p for p in settled])/len(settled))
+	print('RMS phase over the second half of the run: %.1f ns' % rms)
+	if (rms > args.tolerance):
+		ok = False
+else:
+	print('Not enough steering intervals')
+	ok = False
+
+if (args.keep):
+	print('Results are in ' + args.home)
+else:
+	shutil.rmtree(args.home)
+
+print('PASS' if ok else 'FAIL')
+sys.exit(0 if ok else 1)
@@ -49,6 +49,12 @@ THE SOFTWARE.
 
 #include "OpenOK.h"
 
+#ifdef __linux
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
@@ -566,12 +572,24 @@ OpenOK::OpenOK()
     , m_lastTransferred( 0 )
     , m_enablePrintStdError( true )
     , m_timeoutUSB( 3000 )
+    , m_pipeTransfersInFlight( pipeTransfersInFlight )
+    , m_asynchronousTransfers( false )
+    , m_wireInsChanged( true )
+    , m_designHashWireIn( -1 )
+    , m_designHashWireOut( -1 )
+    , m_timing( false )
+    , m_statisticsEnabled( false )
+    , m_traceStream( NULL )
 {
+    pthread_mutex_init( &m_statisticsMutex, NULL );
+    pthread_mutex_init( &m_wireMutex, NULL );
+
     try {
         int responseLibusb = LIBUSB_SUCCESS;
 
         memset( m_wireOuts, 0, OpenOK::WIREOUTSIZE );
         memset( m_wireIns, 0, OpenOK::WIREINSIZE );
+        memset( m_triggerOuts, 0, OpenOK::TRIGGEROUTSIZE );
 
         // libusb_init return : 0 on success, or a LIBUSB_ERROR code on failure
         if ( ( responseLibusb = libusb_init( &m_ctx ) ) == LIBUSB_SUCCESS ) {
@@ -638,6 +656,9 @@ OpenOK::~OpenOK()
 
         Close( true );
     }
+
+    pthread_mutex_destroy( &m_wireMutex );
+    pthread_mutex_destroy( &m_statisticsMutex );
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
@@ -1164,15 +1185,18 @@ OpenOK::ErrorCode OpenOK::FreeConfigurationDescriptor( libusb_config_descriptor
 /*
 This method get OK devices in list.
 
+Device information is taken from the device manager's cache unless useCache is false.
+
 Parameters:
 [in] 	countEnable	used for GetCountDevices
 [out]	countDevices	number of OK devices
+[in] 	useCache	use the cached device information
 
 Returns:
 ErrorCode
 */
 
-OpenOK::ErrorCode OpenOK::Get_OK_Devices( bool countEnable, int &deviceCount )
+OpenOK::ErrorCode OpenOK::Get_OK_Devices( bool countEnable, int &deviceCount, bool useCache )
 {
     unsigned char countOK_Devices = 0;
 
@@ -1231,6 +1255,10 @@ OpenOK::ErrorCode OpenOK::Get_OK_Devices( bool countEnable, int &deviceCount )
         return NotFoundUSBDevices;
     }
 
+    std::vector< int > keys;
+
+    m_cachedDevices = 0;
+
     for ( unsigned char idxUSBDevice = 0; idxUSBDevice < numUSBDevices; ++idxUSBDevice ) {
 
         libusb_device_descriptor descriptorDevice;
@@ -1244,140 +1272,180 @@ OpenOK::ErrorCode OpenOK::Get_OK_Devices( bool countEnable, int &deviceCount )
                 if ( !countEnable ) {
                     OpenOK_device &currentOpalKellyDevice = m_listOKDevices[ countOK_Devices ];
 
-                    currentOpalKellyDevice.device = m_listUSBDevices[ idxUSBDevice ] ;
+                    const int key = OpenOK_DeviceManager::DeviceKey( m_listUSBDevices[ idxUSBDevice ] );
 
-                    libusb_device_handle *currentHandleDevice;
+                    keys.push_back( key );
 
-                    // Open USB device
-                    const ErrorCode responseOpen = OpenDeviceUSB( currentOpalKellyDevice.device,
-                                                                  &currentHandleDevice );
+                    if ( useCache && OpenOK_DeviceManager::Instance().Lookup( key, currentOpalKellyDevice ) ) {
+                        ++m_cachedDevices;
+                    } else if ( ReadDeviceInfo( m_listUSBDevices[ idxUSBDevice ], descriptorDevice,
+                                                currentOpalKellyDevice ) == NoError ) {
+                        OpenOK_DeviceManager::Instance().Store( key, currentOpalKellyDevice );
+                    }
 
-                    if ( ( responseOpen == NoError ) &&
-                         ( currentHandleDevice != NULL ) ) {
+                    currentOpalKellyDevice.device = m_listUSBDevices[ idxUSBDevice ];
+                }
+                ++countOK_Devices;
+            }
+        }
+    }
 
-                        char strDeviceID[ OpenOK_device::SSIZE ];
+    // Devices which have gone are forgotten
+    if ( !countEnable ) {
+        OpenOK_DeviceManager::Instance().Retain( keys );
+    }
 
-                        // Get Device ID
-                        const int responseControl = ControlTransfer( currentHandleDevice,
-                                                                     controlReadMode,
-                                                                     0xb0,
-                                                                     0x1fd0,
-                                                                     0x0000,
-                                                                     reinterpret_cast< unsigned char* >(strDeviceID),
-                                                                     32,
-                                                                     m_timeoutUSB );
+    deviceCount = countOK_Devices;
 
-                        if ( responseControl >= 0 ) {
-                            strncpy( currentOpalKellyDevice.deviceID, strDeviceID, OpenOK_device::SSIZE );
+    if ( countOK_Devices <= 0 ) {
+        return NotFoundOpallKellyBoard;
+    }
+    return NoError;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-                            // Serial
-                            GetStringDescriptor( currentOpalKellyDevice.serial, currentHandleDevice, descriptorDevice.iSerialNumber,
-                                                 OpenOK_device::SSIZE );
+/*
+Reads the device ID, strings and descriptors of a device, which is opened for the purpose.
 
-                            // Manufacturer
-                            GetStringDescriptor( currentOpalKellyDevice.manufacturer, currentHandleDevice, descriptorDevice.iManufacturer,
-                                                 OpenOK_device::SSIZE );
+Parameters:
+[in] 	device	the device
+[in] 	descriptorDevice	its device descriptor
+[out]	info	what was read
 
-                            // Product
-                            GetStringDescriptor( currentOpalKellyDevice.product, currentHandleDevice, descriptorDevice.iProduct,
-                                                 OpenOK_device::SSIZE );
+Returns:
+ErrorCode
+*/
 
-                            currentOpalKellyDevice.idVendor           = descriptorDevice.idVendor;
-                            currentOpalKellyDevice.idProduct          = descriptorDevice.idProduct;
-                            currentOpalKellyDevice.bcdUSB             = descriptorDevice.bcdDevice;
-                            currentOpalKellyDevice.bNumConfigurations = descriptorDevice.bNumConfigurations;
-                            currentOpalKellyDevice.bDeviceClass       = descriptorDevice.bDeviceClass;
+OpenOK::ErrorCode OpenOK::ReadDeviceInfo( libusb_device *device, const libusb_device_descriptor &descriptorDevice,
+                                          OpenOK_device &info )
+{
+    ErrorCode result = NoError;
 
-                            libusb_config_descriptor* descriptorConfiguration = NULL;
+    libusb_device_handle *currentHandleDevice = NULL;
 
-                            const ErrorCode responseConfigDesc = GetConfigurationDescriptor( m_listUSBDevices[ idxUSBDevice ],
-                                                                                             &descriptorConfiguration );
+    // Open USB device
+    const ErrorCode responseOpen = OpenDeviceUSB( device,
+                                                  &currentHandleDevice );
 
-                            if ( responseConfigDesc != NoError ) {
-                                PrintStdError( "Get_OK_Devices()",
-                                               "GetConfigurationDescriptorListUSB() failed",
-                                               0,
-                                               responseConfigDesc );
-                            }
+    if ( ( responseOpen == NoError ) &&
+         ( currentHandleDevice != NULL ) ) {
 
-                            if ( descriptorConfiguration != NULL ) {
-                                currentOpalKellyDevice.bNumInterfaces = descriptorConfiguration->bNumInterfaces;
+        char strDeviceID[ OpenOK_device::SSIZE ];
 
-                                for ( unsigned char i = 0; i < descriptorConfiguration->bNumInterfaces ; ++i ) {
-                                    const libusb_interface *interface = &descriptorConfiguration->interface[i];
+        // Get Device ID
+        const int responseControl = ControlTransfer( currentHandleDevice,
+                                                     controlReadMode,
+                                                     0xb0,
+                                                     0x1fd0,
+                                                     0x0000,
+                                                     reinterpret_cast< unsigned char* >(strDeviceID),
+                                                     32,
+                                                     m_timeoutUSB );
 
-                                    currentOpalKellyDevice.num_altsetting[ i ] = interface->num_altsetting;
+        if ( responseControl >= 0 ) {
+            strncpy( info.deviceID, strDeviceID, OpenOK_device::SSIZE );
 
-                                    for ( int j = 0; j < interface->num_altsetting ; ++j ) {
-                                        const libusb_interface_descriptor *descriptorInterface = &interface->altsetting[ j ];
+            // Serial
+            GetStringDescriptor( info.serial, currentHandleDevice, descriptorDevice.iSerialNumber,
+                                 OpenOK_device::SSIZE );
 
-                                        currentOpalKellyDevice.bInterfaceNumber[ j ] = descriptorInterface->bInterfaceNumber;
-                                        currentOpalKellyDevice.bNumEndpoints[ j ] = descriptorInterface->bNumEndpoints;
+            // Manufacturer
+            GetStringDescriptor( info.manufacturer, currentHandleDevice, descriptorDevice.iManufacturer,
+                                 OpenOK_device::SSIZE );
 
-                                        for ( unsigned char k = 0; k < descriptorInterface->bNumEndpoints; ++k ) {
-                                            const libusb_endpoint_descriptor* epdesc = &descriptorInterface->endpoint[ k ];
+            // Product
+            GetStringDescriptor( info.product, currentHandleDevice, descriptorDevice.iProduct,
+                                 OpenOK_device::SSIZE );
 
-                                            currentOpalKellyDevice.bDescriptorType[ k ] = epdesc->bDescriptorType;
-                                            currentOpalKellyDevice.bEndpointAddress[ k ] = epdesc->bEndpointAddress;
-                                            currentOpalKellyDevice.bInterval[ k ] = epdesc->bInterval;
-                                            currentOpalKellyDevice.wMaxPacketSize[ k ] = epdesc->wMaxPacketSize;
-                                        }
-                                    }
-                                }
+            info.idVendor           = descriptorDevice.idVendor;
+            info.idProduct          = descriptorDevice.idProduct;
+            info.bcdUSB             = descriptorDevice.bcdDevice;
+            info.bNumConfigurations = descriptorDevice.bNumConfigurations;
+            info.bDeviceClass       = descriptorDevice.bDeviceClass;
 
-                                // High Speed = 512 bytes
-                                // Full Speed = 8, 16, 32 or 64 bytes
-                                currentOpalKellyDevice.maxPacketSize = currentOpalKellyDevice.wMaxPacketSize[ 0 ];
+            libusb_config_descriptor* descriptorConfiguration = NULL;
 
-                                // To calculate multiple of MaxPacketSize.
-                                currentOpalKellyDevice.shiftMaxPacketSize = log2( currentOpalKellyDevice.maxPacketSize << 1 );
+            const ErrorCode responseConfigDesc = GetConfigurationDescriptor( device,
+                                                                             &descriptorConfiguration );
 
-                                if ( FreeConfigurationDescriptor( descriptorConfiguration ) != NoError ) {
-                                    PrintStdError( "Get_OK_Devices()",
-                                                   "FreeConfigurationDescriptor() failed" );
-                                }
-                            } else {
-                                currentOpalKellyDevice.bNumInterfaces = 0;
-                            }
-                        } else {
-                            PrintStdError( "Get_OK_Devices()",
-                                           "ControlTransfer() failed",
-                                           0,
-                                           responseControl );
-                        }
+            if ( responseConfigDesc != NoError ) {
+                PrintStdError( "ReadDeviceInfo()",
+                               "GetConfigurationDescriptorListUSB() failed",
+                               0,
+                               responseConfigDesc );
+            }
 
-                        if ( CloseDeviceUSB( currentHandleDevice ) != NoError ) {
-                            PrintStdError( "Get_OK_Devices()",
-                                           "CloseDeviceUSB() failed" );
-                        }
-                        currentHandleDevice = NULL;
-                    } else {
-                        if ( currentHandleDevice == NULL ) {
-                            PrintStdError( "Get_OK_Devices()",
-                                           "pointer 'currentHandleDevice' is NULL" );
-                        } else {
-                            currentOpalKellyDevice = OpenOK_device();
-                        }
+            if ( descriptorConfiguration != NULL ) {
+                info.bNumInterfaces = descriptorConfiguration->bNumInterfaces;
+
+                for ( unsigned char i = 0; i < descriptorConfiguration->bNumInterfaces ; ++i ) {
+                    const libusb_interface *interface = &descriptorConfiguration->interface[i];
 
-                        if ( responseOpen != NoError ) {
-                            PrintStdError( "Get_OK_Devices()",
-                                           "OpenDeviceUSB() failed",
-                                           0,
-                                           responseOpen );
+                    info.num_altsetting[ i ] = interface->num_altsetting;
+
+                    for ( int j = 0; j < interface->num_altsetting ; ++j ) {
+                        const libusb_interface_descriptor *descriptorInterface = &interface->altsetting[ j ];
+
+                        info.bInterfaceNumber[ j ] = descriptorInterface->bInterfaceNumber;
+                        info.bNumEndpoints[ j ] = descriptorInterface->bNumEndpoints;
+
+                        for ( unsigned char k = 0; k < descriptorInterface->bNumEndpoints; ++k ) {
+                            const libusb_endpoint_descriptor* epdesc = &descriptorInterface->endpoint[ k ];
+
+                            info.bDescriptorType[ k ] = epdesc->bDescriptorType;
+                            info.bEndpointAddress[ k ] = epdesc->bEndpointAddress;
+                            info.bInterval[ k ] = epdesc->bInterval;
+                            info.wMaxPacketSize[ k ] = epdesc->wMaxPacketSize;
                         }
                     }
                 }
-                ++countOK_Devices;
+
+                // High Speed = 512 bytes
+                // Full Speed = 8, 16, 32 or 64 bytes
+                info.maxPacketSize = info.wMaxPacketSize[ 0 ];
+
+                // To calculate multiple of MaxPacketSize.
+                info.shiftMaxPacketSize = log2( info.maxPacketSize << 1 );
+
+                if ( FreeConfigurationDescriptor( descriptorConfiguration ) != NoError ) {
+                    PrintStdError( "ReadDeviceInfo()",
+                                   "FreeConfigurationDescriptor() failed" );
+                }
+            } else {
+                info.bNumInterfaces = 0;
             }
+        } else {
+            PrintStdError( "ReadDeviceInfo()",
+                           "ControlTransfer() failed",
+                           0,
+                           responseControl );
+
+            result = static_cast< ErrorCode >( responseControl );
         }
-    }
 
-    deviceCount = countOK_Devices;
+        if ( CloseDeviceUSB( currentHandleDevice ) != NoError ) {
+            PrintStdError( "ReadDeviceInfo()",
+                           "CloseDeviceUSB() failed" );
+        }
+        currentHandleDevice = NULL;
+    } else {
+        result = ( responseOpen != NoError ) ? responseOpen : PointerNULL;
 
-    if ( countOK_Devices <= 0 ) {
-        return NotFoundOpallKellyBoard;
+        if ( currentHandleDevice == NULL ) {
+            PrintStdError( "ReadDeviceInfo()",
+                           "pointer 'currentHandleDevice' is NULL" );
+        } else {
+            info = OpenOK_device();
+        }
+
+        if ( responseOpen != NoError ) {
+            PrintStdError( "ReadDeviceInfo()",
+                           "OpenDeviceUSB() failed",
+                           0,
+                           responseOpen );
+        }
     }
-    return NoError;
+    return result;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
@@ -1532,6 +1600,212 @@ bool OpenOK::ResetDeviceUSB( std::string serial )
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
+/*
+Statistics and tracing (Not Official)
+
+While statistics are enabled, each operation listed in OpenOK::Operation is timed, and its count, the bytes it moved, failures
+and a histogram of its duration are accumulated. With a trace stream set, a line is written to the stream for each operation.
+When neither is on, the cost is a test of a flag per operation.
+
+Operations nest: UpdateWireOuts() is one ControlTransfer, ReadFromPipeOut() is made of ControlTransfers and BulkTransfers, and
+so on, so comparing the layers shows where the time goes. The transfers of asynchronous operations are not timed individually.
+*/
+
+/*
+Enables or disables the collection of statistics. The statistics collected so far are kept.
+*/
+
+void OpenOK::EnableStatistics( bool enable )
+{
+    pthread_mutex_lock( &m_statisticsMutex );
+    m_statisticsEnabled = enable;
+    m_timing = m_statisticsEnabled || ( m_traceStream != NULL );
+    pthread_mutex_unlock( &m_statisticsMutex );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+bool OpenOK::IsStatisticsEnabled()
+{
+    return m_statisticsEnabled;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void OpenOK::ResetStatistics()
+{
+    pthread_mutex_lock( &m_statisticsMutex );
+
+    for ( int i = 0; i < OperationEnd; i++ ) {
+        m_statistics[ i ] = OpenOK_OperationStatistics();
+    }
+    pthread_mutex_unlock( &m_statisticsMutex );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Returns the statistics of an operation. This may be called from another thread.
+*/
+
+OpenOK_OperationStatistics OpenOK::GetStatistics( Operation op )
+{
+    OpenOK_OperationStatistics stats;
+
+    if ( ( op < 0 ) || ( op >= OperationEnd ) ) {
+        return stats;
+    }
+
+    pthread_mutex_lock( &m_statisticsMutex );
+    stats = m_statistics[ op ];
+    pthread_mutex_unlock( &m_statisticsMutex );
+
+    return stats;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Returns the statistics of all operations as text, one line per operation that has been called, in the form
+
+ operation calls errors bytes mean(us) max(us) histogram
+
+where the histogram is a comma separated list of counts, for times < 1 us, then [2^(k-1),2^k) us for
+k = 1 .. statisticsHistogramBins - 2, then the rest.
+*/
+
+std::string OpenOK::GetStatisticsReport()
+{
+    std::ostringstream ss;
+
+    ss << "# operation calls errors bytes mean(us) max(us) histogram" << std::endl;
+    ss << "# histogram bins are <1 us, then [2^(k-1),2^k) us for k=1.." << statisticsHistogramBins - 2
+       << ", then the rest" << std::endl;
+
+    ss.setf( std::ios::fixed );
+    ss.precision( 1 );
+
+    for ( int i = 0; i < OperationEnd; i++ ) {
+        const OpenOK_OperationStatistics stats = GetStatistics( ( Operation ) i );
+
+        if ( stats.calls == 0 ) {
+            continue;
+        }
+
+        ss << GetOperationName( ( Operation ) i ) << " " << stats.calls << " " << stats.errors << " " << stats.bytes << " "
+           << stats.totalTime * 1.0E6 / stats.calls << " " << stats.maxTime * 1.0E6 << " ";
+
+        for ( int j = 0; j < statisticsHistogramBins; j++ ) {
+            ss << ( j == 0 ? "" : "," ) << stats.histogram[ j ];
+        }
+        ss << std::endl;
+    }
+    return ss.str();
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Writes a line for each operation to the stream, or stops tracing if the stream is NULL. The stream is written to from the
+thread which performs the operation.
+*/
+
+void OpenOK::SetTraceStream( std::ostream *stream )
+{
+    pthread_mutex_lock( &m_statisticsMutex );
+    m_traceStream = stream;
+    m_timing = m_statisticsEnabled || ( m_traceStream != NULL );
+    pthread_mutex_unlock( &m_statisticsMutex );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+std::string OpenOK::GetOperationName( Operation op )
+{
+    switch ( op ) {
+        case OperationControlTransfer:
+            return "ControlTransfer";
+        case OperationBulkTransfer:
+            return "BulkTransfer";
+        case OperationUpdateWireIns:
+            return "UpdateWireIns";
+        case OperationUpdateWireOuts:
+            return "UpdateWireOuts";
+        case OperationUpdateTriggerOuts:
+            return "UpdateTriggerOuts";
+        case OperationWriteToPipeIn:
+            return "WriteToPipeIn";
+        case OperationReadFromPipeOut:
+            return "ReadFromPipeOut";
+        case OperationPipe:
+            return "Pipe";
+        case OperationTransaction:
+            return "Transaction";
+        case OperationCheckEnable:
+            return "CheckEnable";
+        default:
+            return "Unknown";
+    }
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+inline bool OpenOK::StartTiming( struct timespec &start )
+{
+    if ( !m_timing ) {
+        return false;
+    }
+
+    clock_gettime( CLOCK_MONOTONIC, &start );
+
+    return true;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void OpenOK::RecordOperation( Operation op, const struct timespec &start, long long bytes, bool ok )
+{
+    struct timespec end;
+
+    clock_gettime( CLOCK_MONOTONIC, &end );
+
+    const double elapsed = ( end.tv_sec - start.tv_sec ) + ( end.tv_nsec - start.tv_nsec ) * 1.0E-9;
+
+    int bin = 0;
+    const double us = elapsed * 1.0E6;
+
+    if ( us >= 1.0 ) {
+        bin = 1 + ( int ) floor( log2( us ) );
+
+        if ( bin >= statisticsHistogramBins ) {
+            bin = statisticsHistogramBins - 1;
+        }
+    }
+
+    if ( bytes < 0 ) {
+        bytes = 0;
+    }
+
+    pthread_mutex_lock( &m_statisticsMutex );
+
+    if ( m_statisticsEnabled ) {
+        OpenOK_OperationStatistics &stats = m_statistics[ op ];
+
+        stats.calls++;
+        stats.bytes += bytes;
+        stats.totalTime += elapsed;
+        stats.histogram[ bin ]++;
+
+        if ( !ok ) {
+            stats.errors++;
+        }
+
+        if ( elapsed > stats.maxTime ) {
+            stats.maxTime = elapsed;
+        }
+    }
+
+    if ( m_traceStream != NULL ) {
+        *m_traceStream << "OpenOK " << end.tv_sec << "." << std::setfill( '0' ) << std::setw( 9 ) << end.tv_nsec
+                       << std::setfill( ' ' ) << " " << GetOperationName( op ) << " " << bytes << " bytes "
+                       << us << " us" << ( ok ? "" : " failed" ) << std::endl;
+    }
+    pthread_mutex_unlock( &m_statisticsMutex );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
 inline int OpenOK::OptionalControlTransfer( libusb_device_handle *dev_handle,
                                             uint8_t request_type, uint8_t bRequest, uint16_t wValue, uint16_t wIndex,
                                             unsigned char *data, uint16_t wLength, unsigned int timeout )
@@ -1559,10 +1833,17 @@ inline int OpenOK::OptionalControlTransfer( libusb_device_handle *dev_handle,
         // LIBUSB_ERROR_PIPE if the control request was not supported by the device
         // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
         // another LIBUSB_ERROR code on other failures
+        struct timespec start;
+        const bool timed = StartTiming( start );
+
         responseLibusb = libusb_control_transfer( dev_handle,
                                                   request_type, bRequest, wValue, wIndex,
                                                   data, wLength, timeout );
 
+        if ( timed ) {
+            RecordOperation( OperationControlTransfer, start, responseLibusb, responseLibusb == wLength );
+        }
+
 
         if ( responseLibusb < 0 ) {
             if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
@@ -1685,10 +1966,17 @@ inline int OpenOK::OptionalBulkTransfer( libusb_device_handle *dev_handle,
         // LIBUSB_ERROR_OVERFLOW if the device offered more data, see Packets and overflows
         // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
         // another LIBUSB_ERROR code on other failures
+        struct timespec start;
+        const bool timed = StartTiming( start );
+
         responseLibusb = libusb_bulk_transfer( dev_handle,
                                                endpoint, data, length,
                                                actual_length, timeout );
 
+        if ( timed ) {
+            RecordOperation( OperationBulkTransfer, start, *actual_length, *actual_length == length );
+        }
+
         if ( responseLibusb != LIBUSB_SUCCESS ) {
             if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
                 PrintStdError( "OptionalBulkTransfer()",
@@ -1814,10 +2102,17 @@ inline int OpenOK::ControlTransfer( libusb_device_handle *dev_handle,
         // LIBUSB_ERROR_PIPE if the control request was not supported by the device
         // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
         // another LIBUSB_ERROR code on other failures
+        struct timespec start;
+        const bool timed = StartTiming( start );
+
         responseLibusb = libusb_control_transfer( dev_handle,
                                                   request_type, bRequest, wValue, wIndex,
                                                   data, wLength, timeout );
 
+        if ( timed ) {
+            RecordOperation( OperationControlTransfer, start, responseLibusb, responseLibusb == wLength );
+        }
+
         if ( responseLibusb < 0 ) {
             if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
                 PrintStdError( "ControlTransfer()",
@@ -1962,10 +2257,17 @@ inline int OpenOK::BulkTransfer( libusb_device_handle *dev_handle,
         // LIBUSB_ERROR_OVERFLOW if the device offered more data, see Packets and overflows
         // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
         // another LIBUSB_ERROR code on other failures
+        struct timespec start;
+        const bool timed = StartTiming( start );
+
         responseLibusb = libusb_bulk_transfer( dev_handle,
                                                endpoint, data, length,
                                                actual_length, timeout );
 
+        if ( timed ) {
+            RecordOperation( OperationBulkTransfer, start, *actual_length, *actual_length == length );
+        }
+
         if ( responseLibusb != LIBUSB_SUCCESS ) {
             if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
                 PrintStdError( "BulkTransfer()",
@@ -2160,6 +2462,9 @@ OpenOK::ErrorCode OpenOK::CheckEnable()
 {
     unsigned char dataControl[ 2 ] = { 0x00, 0x00 };
 
+    struct timespec start;
+    const bool timed = StartTiming( start );
+
     const int responseControl = OptionalControlTransfer( m_deviceHandle,
                                                          controlReadMode,
                                                          0xb3,
@@ -2169,6 +2474,11 @@ OpenOK::ErrorCode OpenOK::CheckEnable()
                                                          2,
                                                          m_timeoutUSB );
 
+    if ( timed ) {
+        RecordOperation( OperationCheckEnable, start, responseControl,
+                         ( responseControl == 2 ) && ( dataControl[ 0 ] == 0xd7 ) && ( dataControl[ 1 ] == 0xa5 ) );
+    }
+
     if ( responseControl == 2 ) {
         // check for successful status
         if ( ( dataControl[ 0 ] == 0xd7 ) &&
@@ -2404,30 +2714,37 @@ OpenOK::ErrorCode OpenOK::OpenByDeviceID( std::string str )
 
     int numDevices = 0;
 
-    ErrorCode responseGetOKDevices = Get_OK_Devices( false, numDevices );
+    // If the device is not found from cached information, which may be out of date, the devices are read again
+    for ( int pass = 0; pass < 2 && !device_found; ++pass ) {
+        ErrorCode responseGetOKDevices = Get_OK_Devices( false, numDevices, pass == 0 );
 
-    if ( responseGetOKDevices != NoError ) {
-        if ( responseGetOKDevices != NotFoundOpallKellyBoard ) {
-            PrintStdError( "OpenByDeviceID()",
-                           "Get_OK_Devices() failed",
-                           0,
-                           responseGetOKDevices );
+        if ( responseGetOKDevices != NoError ) {
+            if ( responseGetOKDevices != NotFoundOpallKellyBoard ) {
+                PrintStdError( "OpenByDeviceID()",
+                               "Get_OK_Devices() failed",
+                               0,
+                               responseGetOKDevices );
+            }
+            return responseGetOKDevices;
         }
-        return responseGetOKDevices;
-    }
 
-    if ( numDevices > 0 ) {
-        if ( str == "" ) {
-            m_indexOpenedDevice = 0;
-            device_found = true;
-        } else {
-            for ( m_indexOpenedDevice = 0; m_indexOpenedDevice < numDevices; ++m_indexOpenedDevice ) {
-                if ( str == m_listOKDevices[ m_indexOpenedDevice ].deviceID ) {
-                    device_found = true;
-                    break;
+        if ( numDevices > 0 ) {
+            if ( str == "" ) {
+                m_indexOpenedDevice = 0;
+                device_found = true;
+            } else {
+                for ( m_indexOpenedDevice = 0; m_indexOpenedDevice < numDevices; ++m_indexOpenedDevice ) {
+                    if ( str == m_listOKDevices[ m_indexOpenedDevice ].deviceID ) {
+                        device_found = true;
+                        break;
+                    }
                 }
             }
         }
+
+        if ( m_cachedDevices == 0 ) {
+            break;
+        }
     }
 
     if ( !device_found ) {
@@ -2461,30 +2778,37 @@ OpenOK::ErrorCode OpenOK::OpenBySerial( std::string str )
 
     int numDevices = 0;
 
-    ErrorCode responseGetOKDevices = Get_OK_Devices( false, numDevices );
+    // If the device is not found from cached information, which may be out of date, the devices are read again
+    for ( int pass = 0; pass < 2 && !device_found; ++pass ) {
+        ErrorCode responseGetOKDevices = Get_OK_Devices( false, numDevices, pass == 0 );
 
-    if ( responseGetOKDevices != NoError ) {
-        if ( responseGetOKDevices != NotFoundOpallKellyBoard ) {
-            PrintStdError( "OpenBySerial()",
-                           "Get_OK_Devices() failed",
-                           0,
-                           responseGetOKDevices );
+        if ( responseGetOKDevices != NoError ) {
+            if ( responseGetOKDevices != NotFoundOpallKellyBoard ) {
+                PrintStdError( "OpenBySerial()",
+                               "Get_OK_Devices() failed",
+                               0,
+                               responseGetOKDevices );
+            }
+            return responseGetOKDevices;
         }
-        return responseGetOKDevices;
-    }
 
-    if ( numDevices > 0 ) {
-        if ( str == "" ) {
-            m_indexOpenedDevice = 0;
-            device_found = true;
-        } else {
-            for ( m_indexOpenedDevice = 0; m_indexOpenedDevice < numDevices; ++m_indexOpenedDevice ) {
-                if ( str == m_listOKDevices[ m_indexOpenedDevice ].serial ) {
-                    device_found = true;
-                    break;
+        if ( numDevices > 0 ) {
+            if ( str == "" ) {
+                m_indexOpenedDevice = 0;
+                device_found = true;
+            } else {
+                for ( m_indexOpenedDevice = 0; m_indexOpenedDevice < numDevices; ++m_indexOpenedDevice ) {
+                    if ( str == m_listOKDevices[ m_indexOpenedDevice ].serial ) {
+                        device_found = true;
+                        break;
+                    }
                 }
             }
         }
+
+        if ( m_cachedDevices == 0 ) {
+            break;
+        }
     }
 
     if ( !device_found ) {
@@ -2728,8 +3052,20 @@ void OpenOK::Close( bool force )
         return;
     }
 
+    pthread_mutex_lock( &m_wireMutex );
     memset( m_wireIns, 0, OpenOK::WIREINSIZE );
     memset( m_wireOuts, 0, OpenOK::WIREOUTSIZE );
+    m_wireInsChanged = true;
+    pthread_mutex_unlock( &m_wireMutex );
+
+    // Transfers in flight must be returned before the device is closed
+    if ( !m_pipeOperations.empty() ) {
+        CancelPipeTransfers();
+
+        for ( int i = 0; i < 100 && !m_pipeOperations.empty(); i++ ) {
+            HandleEvents( 10 );
+        }
+    }
 
     if ( force ) {
         PrintStdError( "Close()",
@@ -3409,245 +3745,546 @@ void OpenOK::SetDeviceID( const std::string str )
         return;
     }
     strncpy( m_listOKDevices [m_indexOpenedDevice ].deviceID, str.c_str(), OpenOK_device::SSIZE );
+
+    OpenOK_DeviceManager::Instance().Store( OpenOK_DeviceManager::DeviceKey( m_listOKDevices[ m_indexOpenedDevice ].device ),
+                                            m_listOKDevices[ m_indexOpenedDevice ] );
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-This method downloads a configuration file to the FPGA. The filename should be that of a valid Xilinx bitfile (generated from bitgen).
-
-Returns:
-Total
+A bitfile, memory-mapped so that it can be streamed to the FPGA without being copied.
 */
 
-int OpenOK::SendDataBitFile( unsigned char endp, unsigned char *bytes, unsigned int size, unsigned int timeout )
+class OpenOK_BitFile
 {
-    if ( !IsOpen() ) {
-        return DeviceNotOpen;
-    }
+    public:
+        OpenOK_BitFile()
+            : m_data( NULL )
+            , m_length( 0 )
+            , m_mapped( false )
+        {
+        }
 
-    if ( size <= 0 ) {
-        return SignedArgumentError;
-    }
+        ~OpenOK_BitFile()
+        {
+#ifdef __linux
+            if ( m_mapped ) {
+                munmap( m_data, m_length );
+            }
+#endif
+        }
+
+        bool Open( const std::string strFilename )
+        {
+#ifdef __linux
+            const int fd = open( strFilename.c_str(), O_RDONLY );
 
-    unsigned int totalSend = 0;
+            if ( fd < 0 ) {
+                return false;
+            }
 
-    const unsigned int num1 = size >> 14; // Multiple of 16384 (Maximum of bytes that transfers Bulk Package)
-    const unsigned int num2 = size - ( num1 << 14 );// Remainder to give.
+            struct stat st;
 
-    if ( num1 ) {
-        for ( unsigned int j = 0; j < num1; ++j ) {
-            int transferred = 0;
-            int responseBulk = 0;
+            if ( fstat( fd, &st ) < 0 ) {
+                close( fd );
+                return false;
+            }
 
-            responseBulk = BulkTransfer( m_deviceHandle,
-                                         endp,
-                                         bytes + ( j << 14 ),
-                                         16384,
-                                         &transferred,
-                                         timeout );
+            m_length = st.st_size;
 
-            if ( responseBulk < 0 ) {
-                PrintStdError( "SendDataBitFile()",
-                               "BulkTransfer() failed - Step 01",
-                               0,
-                               responseBulk );
+            if ( m_length > 0 ) {
+                void *addr = mmap( NULL, m_length, PROT_READ, MAP_PRIVATE, fd, 0 );
 
-                return responseBulk;
+                if ( addr == MAP_FAILED ) {
+                    close( fd );
+                    return false;
+                }
+                madvise( addr, m_length, MADV_SEQUENTIAL );
+
+                m_data = static_cast< unsigned char * >( addr );
+                m_mapped = true;
             }
-            totalSend += transferred;
-        }
-    }
+            close( fd );
 
-    if ( num2 ) {
-        int transferred = 0;
-        int responseBulk = 0;
+            return true;
+#else
+            std::basic_ifstream< char > file( strFilename.c_str(), std::ios_base::in | std::ios_base::binary );
 
-        responseBulk = BulkTransfer( m_deviceHandle,
-                                     endp,
-                                     bytes + ( ( num1 << 14 ) ),
-                                     num2,
-                                     &transferred,
-                                     timeout );
+            if ( !file ) {
+                return false;
+            }
 
-        if ( responseBulk < 0 ) {
-            PrintStdError( "SendDataBitFile()",
-                           "BulkTransfer() failed - Step 02",
-                           0,
-                           responseBulk );
+            m_contents.assign( std::istreambuf_iterator< char >( file ), std::istreambuf_iterator< char >() );
 
-            return responseBulk;
+            m_length = m_contents.size();
+            m_data = m_length ? &m_contents[ 0 ] : NULL;
+
+            return true;
+#endif
         }
-        totalSend += transferred;
-    }
 
-    if ( totalSend != size ) {
-        return NotSentBitFile;
-    }
-    return totalSend;
-}
-//---------------------------------------------------------------------------------------------------------------------------------
+        const unsigned char *Data() const
+        {
+            return m_data;
+        }
 
-OpenOK::ErrorCode OpenOK::SendPaddedFileToFPGA( unsigned char* buffer, const unsigned int size )
+        unsigned long Length() const
+        {
+            return m_length;
+        }
+
+    private:
+        unsigned char *m_data;
+        unsigned long m_length;
+        bool m_mapped;
+        std::vector< unsigned char > m_contents;
+};
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+This method parses the header of a Xilinx bitfile (generated from bitgen), filling in m_bitStream.
+
+Parameters:
+[in] 	data 	The bitfile.
+[in] 	length 	The length of the bitfile.
+[out] 	syncOffset 	The offset of the sync word ( AA 99 55 66 ) in the bitfile.
+
+Returns:
+ErrorCode.
+*/
+
+OpenOK::ErrorCode OpenOK::ParseBitstream( const unsigned char *data, unsigned long length, unsigned long &syncOffset )
+{
+    unsigned long pos = 0;
+
+    std::string str;
+
+    // Number of header fields, followed by the data field
+    static const unsigned char numberFields = 6;
+
+    for ( unsigned char j = 0 ; j < numberFields ; ++j ) {
+        if ( pos + 2 > length ) {
+            return ReadBitFileError;
+        }
+
+        const unsigned long lengthField = ( data[ pos ] << 8 ) + data[ pos + 1 ];
+
+        pos += 2;
+
+        if ( pos + lengthField > length ) {
+            return ReadBitFileError;
+        }
+
+        str.assign( reinterpret_cast< const char * >( data + pos ), lengthField );
+
+        pos += lengthField;
+
+        if ( pos < length && data[ pos ] >= 'a' && data[ pos ] <= 'e' ) {
+            ++pos;
+        }
+
+        switch( j ) {
+            case 2 :
+                m_bitStream.designName = str;
+                break;
+
+            case 3 :
+                m_bitStream.partName = str;
+                break;
+
+            case 4 :
+                m_bitStream.date = str;
+                break;
+
+            case 5 :
+                m_bitStream.time = str;
+                break;
+
+            default :
+                break;
+        }
+    }
+
+    if ( pos + 4 > length ) {
+        return ReadBitFileError;
+    }
+
+    const unsigned long dataLen = ( static_cast< unsigned long >( data[ pos ] ) << 24 ) + ( data[ pos + 1 ] << 16 ) +
+                                  ( data[ pos + 2 ] << 8 ) + data[ pos + 3 ];
+
+    pos += 4;
+
+    // The dummy bytes ( FF FF FF FF ) are followed by the sync word
+    unsigned long lengthDummy = 0;
+    const unsigned long end = ( dataLen < length - pos ) ? pos + dataLen : length;
+
+    for ( ; pos < end ; ++pos ) {
+        if ( data[ pos ] == 0xFF ) {
+            lengthDummy++;
+        } else if ( data[ pos ] == 0xAA ) {
+            break;
+        }
+    }
+
+    if ( pos == end ) {
+        return NotFoundSyncWord;
+    }
+
+    if ( dataLen - lengthDummy > length - pos ) {
+        return ReadBitFileError;
+    }
+
+    m_bitStream.dataLen = dataLen;
+    m_bitStream.dummyLen = lengthDummy;
+    m_bitStream.addPadWord = ( lengthDummy <= 4 );
+
+    syncOffset = pos;
+
+    return NoError;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+The configuration data is sent as pipeChunkSize bulk transfers, with each transfer's chunk expanded from the bitfile just before
+it is submitted. Chunks are expanded while the earlier ones are in flight, so the padded bitstream is never held in memory.
+*/
+
+struct OpenOK::ConfigurationStream
+{
+        OpenOK *owner;
+
+        const unsigned char *data; // the bitstream, from the sync word
+        unsigned long dataLen; // bytes in the bitstream, including the dummy bytes
+        unsigned long dummyLen;
+        bool addPadWord;
+
+        unsigned long expanded; // bytes of the bitstream expanded into chunks
+        unsigned long size; // bytes to send
+        unsigned long submitted;
+        unsigned long transferred;
+        long error;
+
+        int inFlight;
+
+        std::vector<struct libusb_transfer *> transfers;
+        std::vector<unsigned char> chunks; // one for each transfer
+};
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+This method downloads a bitfile to the FPGA.
+
+Parameters:
+[in] 	data 	The bitfile.
+[in] 	length 	The length of the bitfile.
+
+Returns:
+ErrorCode.
+*/
+
+OpenOK::ErrorCode OpenOK::SendBitstreamToFPGA( const unsigned char *data, unsigned long length )
 {
     if ( !IsOpen() ) {
         return DeviceNotOpen;
     }
 
-    if ( ControlStatus( controlWriteMode ) == NoError ) {
-        // do a bulk transfer of the file to endpoint 0x02, starting with the header of the xilinx file
-        // ff ff ff ff aa 99 55 66. however every byte is sent as an int16 with the actual byte in the upper bits, ie 0xff -> 0xff00
-        // this was taken care of in the loading and parsing of the file
+    // The device is reset by the configuration, so nothing else may be in progress
+    if ( !m_pipeOperations.empty() ) {
+        return OperationNotPermitted;
+    }
+
+    unsigned long syncOffset = 0;
+
+    ErrorCode error = ParseBitstream( data, length, syncOffset );
+
+    if ( error != NoError ) {
+        return error;
+    }
+
+    // The new design starts with its Wire Ins cleared, so they must be sent again
+    pthread_mutex_lock( &m_wireMutex );
+    m_wireInsChanged = true;
+    pthread_mutex_unlock( &m_wireMutex );
+
+    ConfigurationStream cs;
+
+    cs.owner = this;
+    cs.data = data + syncOffset;
+    cs.dataLen = m_bitStream.dataLen;
+    cs.dummyLen = m_bitStream.dummyLen;
+    cs.addPadWord = m_bitStream.addPadWord;
+    cs.expanded = 0;
+    cs.size = m_bitStream.addPadWord ? 2 * cs.dataLen : cs.dataLen;
+    cs.submitted = 0;
+    cs.transferred = 0;
+    cs.error = NoError;
+    cs.inFlight = 0;
+
+    // At least two, so that one chunk is expanded while the other is sent
+    const int numberTransfers = ( m_pipeTransfersInFlight > configurationTransfersInFlight ) ?
+                                m_pipeTransfersInFlight : configurationTransfersInFlight;
+
+    cs.chunks.resize( numberTransfers * pipeChunkSize );
+
+    for ( int i = 0; i < numberTransfers; i++ ) {
+        struct libusb_transfer *transfer = libusb_alloc_transfer( 0 );
+
+        if ( transfer == NULL ) {
+            error = LibusbError;
+            break;
+        }
+
+        libusb_fill_bulk_transfer( transfer, m_deviceHandle, endpointOUT, &cs.chunks[ i * pipeChunkSize ], pipeChunkSize,
+                                   &OpenOK::ConfigurationTransferCallback, &cs, 2000 );
+
+        cs.transfers.push_back( transfer );
+    }
+
+    if ( error == NoError ) {
+        if ( ControlStatus( controlWriteMode ) == NoError ) {
+            // do a bulk transfer of the file to endpoint 0x02, starting with the header of the xilinx file
+            // ff ff ff ff aa 99 55 66. however every byte is sent as an int16 with the actual byte in the upper bits, ie 0xff -> 0xff00
+            // this is taken care of as each chunk is expanded
 
 #ifdef QT_CORE_LIB
-        SleepUtil::usleep( 3200 );
+            SleepUtil::usleep( 3200 );
 #else
-        usleep(3200);
+            usleep( 3200 );
 #endif
 
-        const int sent = SendDataBitFile( endpointOUT, buffer, size, 2000 );
+            for ( size_t i = 0; i < cs.transfers.size() && cs.submitted < cs.size && cs.error == NoError; i++ ) {
+                SubmitConfigurationChunk( &cs, cs.transfers[ i ] );
+            }
 
-        // can not compare to zero, the return can be NoError
-        if ( sent < 0 ) {
-            return static_cast< OpenOK::ErrorCode > ( sent );
-        }
+            while ( cs.inFlight > 0 ) {
+                if ( HandleEvents( m_timeoutUSB ) != NoError && cs.error == NoError ) {
+                    cs.error = LibusbError;
+
+                    // The transfers still have to be returned before they can be freed
+                    for ( size_t i = 0; i < cs.transfers.size(); i++ ) {
+                        libusb_cancel_transfer( cs.transfers[ i ] );
+                    }
+                }
+            }
 
 #ifdef QT_CORE_LIB
-        SleepUtil::usleep( 1000 );
+            SleepUtil::usleep( 1000 );
 #else
-        usleep( 1000 );
+            usleep( 1000 );
 #endif
 
-        if ( static_cast< unsigned int > ( sent ) == size ) {
-            return ControlStatus( controlReadMode );
+            if ( cs.error != NoError ) {
+                error = static_cast< OpenOK::ErrorCode > ( cs.error );
+            } else if ( cs.transferred != cs.size ) {
+                error = NotSentBitFile;
+            } else {
+                error = ControlStatus( controlReadMode );
+            }
+        } else {
+            error = NotConfigureFPGA;
         }
     }
-    return NotConfigureFPGA;
+
+    for ( size_t i = 0; i < cs.transfers.size(); i++ ) {
+        libusb_free_transfer( cs.transfers[ i ] );
+    }
+    return error;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
-template< class iterator >
-OpenOK::ErrorCode OpenOK::SendFileToFPGA( iterator it, iterator end )
+/*
+Expands the next chunk of the bitstream into the transfer's buffer, padding every byte to 16 bits if required, and submits it.
+*/
+
+void OpenOK::SubmitConfigurationChunk( ConfigurationStream *cs, struct libusb_transfer *transfer )
 {
-    if ( !IsOpen() ) {
-        return DeviceNotOpen;
+    unsigned long lengthChunk = cs->size - cs->submitted;
+
+    if ( lengthChunk > pipeChunkSize ) {
+        lengthChunk = pipeChunkSize;
+    }
+
+    unsigned char *chunk = transfer->buffer;
+
+    if ( cs->addPadWord ) {
+        for ( unsigned long i = 0; i < lengthChunk; i += 2, cs->expanded++ ) {
+            chunk[ i ] = ( cs->expanded < cs->dummyLen ) ? 0xFF : cs->data[ cs->expanded - cs->dummyLen ];
+            chunk[ i + 1 ] = 0x00;
+        }
+    } else {
+        for ( unsigned long i = 0; i < lengthChunk; i++, cs->expanded++ ) {
+            chunk[ i ] = ( cs->expanded < cs->dummyLen ) ? 0xFF : cs->data[ cs->expanded - cs->dummyLen ];
+        }
     }
 
-    ErrorCode error = NoError;
+    transfer->length = lengthChunk;
 
-    unsigned int length = 0;
-    unsigned char lengthDummy = 0;
+    const int responseLibusb = libusb_submit_transfer( transfer );
 
-    std::vector<unsigned char> buffer;
+    if ( responseLibusb < 0 ) {
+        PrintStdError( "SubmitConfigurationChunk()",
+                       "libusb_submit_transfer() failed",
+                       responseLibusb );
 
-    std::string str;
+        cs->error = BulkTransferError + responseLibusb;
+        return;
+    }
+    cs->submitted += lengthChunk;
+    cs->inFlight++;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-    // Number of header fields + data field
-    static const unsigned char numberFields = 7;
+void LIBUSB_CALL OpenOK::ConfigurationTransferCallback( struct libusb_transfer *transfer )
+{
+    ConfigurationStream *cs = static_cast<ConfigurationStream *>( transfer->user_data );
+    OpenOK *self = cs->owner;
 
-    for( unsigned char j = 0 ; j < numberFields ; ++j ) {
+    cs->inFlight--;
 
-        str = "";
+    if ( cs->error != NoError ) { // failed earlier - waiting for the rest to be returned
+        return;
+    }
 
-        if ( j < ( numberFields - 1 ) ) { // Read Header
-            length = ( *it & 255 ) << 8;
-            length += ( *(++it) & 255 );
+    if ( transfer->status != LIBUSB_TRANSFER_COMPLETED || transfer->actual_length != transfer->length ) {
+        long error = TransferError;
 
-            for ( unsigned int n = 0 ; n < length ; ++n ) {
-                str += ( *(++it) & 255 );
-            }
+        if ( transfer->status == LIBUSB_TRANSFER_TIMED_OUT ) {
+            error = Timeout;
+        } else if ( transfer->status == LIBUSB_TRANSFER_NO_DEVICE ) {
+            error = DeviceNotOpen;
+        }
 
-            ++it;
+        self->PrintStdError( "ConfigurationTransferCallback()",
+                             "bulk transfer failed",
+                             0,
+                             error );
 
-            if ( ( *it & 255 ) == 'a' || ( *it & 255 ) == 'b' || ( *it & 255 ) == 'c' || ( *it & 255 ) == 'd' ||
-                 ( *it & 255 ) == 'e' ) {
-                ++it;
-            }
-        } else if ( j == ( numberFields - 1 ) ) { // Read Data
-            length = ( *it & 255 ) << 24;
-            length += ( *(++it) & 255 ) << 16;
-            length += ( *(++it) & 255 ) << 8;
-            length += ( *(++it) & 255 );
-
-            for ( unsigned int n = 0 ; n < length ; ++n ) {
-                ++it;
-
-                if ( it != end ) {
-                    if ( ( *it & 255 ) == 0xFF ) {
-                        lengthDummy++;
-                    } else if ( ( *it & 255 ) == 0xAA ) {
-                        break;
-                    }
-                } else {
-                    return NotFoundSyncWord;
-                }
+        cs->error = error;
+
+        for ( size_t i = 0; i < cs->transfers.size(); i++ ) {
+            if ( cs->transfers[ i ] != transfer ) {
+                libusb_cancel_transfer( cs->transfers[ i ] );
             }
         }
+        return;
+    }
 
-        switch( j ) {
-            case 0 :
-                break;
+    cs->transferred += transfer->actual_length;
 
-            case 1 :
-                break;
+    if ( cs->submitted < cs->size ) {
+        self->SubmitConfigurationChunk( cs, transfer );
+    }
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-            case 2 :
-                m_bitStream.designName = str;
-                break;
+/*
+Returns the 32 bit FNV-1a hash of a bitfile. Zero, the value of cleared Wire Ins, is never returned.
+*/
 
-            case 3 :
-                m_bitStream.partName = str;
-                break;
+unsigned long OpenOK::BitstreamHash( const unsigned char *data, unsigned long length )
+{
+    unsigned long hash = 2166136261UL;
 
-            case 4 :
-                m_bitStream.date = str;
-                break;
+    for ( unsigned long i = 0; i < length; i++ ) {
+        hash ^= data[ i ];
+        hash = ( hash * 16777619UL ) & 0xffffffffUL;
+    }
+    return hash ? hash : 1;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-            case 5 :
-                m_bitStream.time = str;
-                break;
+OpenOK::ErrorCode OpenOK::RecordDesignHash( unsigned long hash )
+{
+    SetWireInValue( m_designHashWireIn, hash & 0xffff );
+    SetWireInValue( m_designHashWireIn + 1, ( hash >> 16 ) & 0xffff );
 
-            case 6 :
-                m_bitStream.dataLen = length;
-                m_bitStream.dummyLen = lengthDummy;
+    UpdateWireIns();
 
-                if ( lengthDummy <= 4 ) {
-                    m_bitStream.addPadWord = true;
-                } else {
-                    m_bitStream.addPadWord = false;
-                }
+    return NoError;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-                for ( unsigned int n = 0 ; n < m_bitStream.dataLen ; ++n ) {
-                    if ( n < m_bitStream.dummyLen ) {
-                        buffer.push_back( 0xFF );
+/*
+This method sets the endpoints used to record which bitfile the FPGA was configured with. (Not Official)
+The design must echo the two Wire Ins starting at wireInAddr to the two Wire Outs starting at wireOutAddr. After configuring the
+FPGA, ConfigureFPGA() writes a hash of the bitfile to the Wire Ins, and IsDesignLoaded() compares it with the hash in the
+Wire Outs. The Wire Ins are cleared whenever the FPGA is configured, so a design loaded by other means reads as not loaded.
 
-                        if ( m_bitStream.addPadWord ) {
-                            buffer.push_back(0x00);
-                        }
-                    } else {
-                        buffer.push_back( ( *it & 255 ) );
+Parameters:
+[in] 	wireInAddr 	The first of the two Wire Ins, or -1 to stop recording the hash.
+[in] 	wireOutAddr 	The first of the two Wire Outs.
 
-                        if ( m_bitStream.addPadWord ) {
-                            buffer.push_back(0x00);
-                        }
+Returns:
+ErrorCode.
+*/
 
-                        ++it;
-                    }
-                }
-                break;
+OpenOK::ErrorCode OpenOK::SetDesignHashEndpoints( int wireInAddr, int wireOutAddr )
+{
+    if ( wireInAddr < 0 ) {
+        m_designHashWireIn = -1;
+        m_designHashWireOut = -1;
+        return NoError;
+    }
 
-            default :
-                error = ReadBitFileError;
-                break;
-        }
+    if ( ( wireInAddr > 0x1E ) || ( wireOutAddr < 0x20 ) || ( wireOutAddr > 0x3E ) ) {
+        return RangeAddressError;
     }
-    error = SendPaddedFileToFPGA( &buffer[ 0 ], buffer.size() );
 
-    return error;
+    m_designHashWireIn = wireInAddr;
+    m_designHashWireOut = wireOutAddr;
+
+    return NoError;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+This method checks whether the FPGA is already configured with a bitfile, using the hash recorded by ConfigureFPGA(). (Not Official)
+If it is, the hash is kept in the Wire Ins, so that it survives later calls to UpdateWireIns().
+
+Parameters:
+[in] 	strFilename 	A string containing the filename of the configuration file.
+
+Returns:
+true if the bitfile is loaded, false if it is not, or if no design hash endpoints have been set.
+*/
+
+bool OpenOK::IsDesignLoaded( const std::string strFilename )
+{
+    if ( !IsOpen() || m_designHashWireIn < 0 ) {
+        return false;
+    }
+
+    OpenOK_BitFile file;
+
+    if ( !file.Open( strFilename ) ) {
+        return false;
+    }
+
+    if ( !IsFrontPanelEnabled() ) {
+        return false;
+    }
+
+    const unsigned long hash = BitstreamHash( file.Data(), file.Length() );
+
+    UpdateWireOuts();
+
+    const unsigned long loaded = ( GetWireOutValue( m_designHashWireOut ) & 0xffffUL ) |
+                                 ( ( GetWireOutValue( m_designHashWireOut + 1 ) & 0xffffUL ) << 16 );
+
+    if ( loaded != hash ) {
+        return false;
+    }
+
+    SetWireInValue( m_designHashWireIn, hash & 0xffff );
+    SetWireInValue( m_designHashWireIn + 1, ( hash >> 16 ) & 0xffff );
+
+    return true;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
 This method downloads a configuration file to the FPGA. The filename should be that of a valid Xilinx bitfile (generated from bitgen).
+The file is memory-mapped and streamed to the FPGA. If design hash endpoints have been set, the hash of the bitfile is recorded.
 
 Parameters:
 [in] 	strFilename 	A string containing the filename of the configuration file.
@@ -3684,17 +4321,18 @@ OpenOK::ErrorCode OpenOK::ConfigureFPGA( const std::string strFilename )
     // or if there are other return values indicating other errors
 
     // configures the fpga on an xem with the bitstream in Filename
+    OpenOK_BitFile file;
 
-    // first get and parse the bitstream from the file
-    std::basic_ifstream< char > file( strFilename.c_str(), std::ios_base::in | std::ios_base::binary );
+    if ( !file.Open( strFilename ) ) {
+        return NotOpenBitFile;
+    }
 
-    if ( file ) {
-        std::istreambuf_iterator< char > it( file );
-        std::istreambuf_iterator< char > eos;
+    const ErrorCode error = SendBitstreamToFPGA( file.Data(), file.Length() );
 
-        return SendFileToFPGA( it, eos );
+    if ( error == NoError && m_designHashWireIn >= 0 ) {
+        return RecordDesignHash( BitstreamHash( file.Data(), file.Length() ) );
     }
-    return NotOpenBitFile;
+    return error;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
@@ -3703,7 +4341,13 @@ OpenOK::ErrorCode OpenOK::ConfigureFPGAFromMemory( unsigned char *data, const un
     if ( !IsOpen() ) {
         return DeviceNotOpen;
     }
-    return SendFileToFPGA( data, data + length );
+
+    const ErrorCode error = SendBitstreamToFPGA( data, length );
+
+    if ( error == NoError && m_designHashWireIn >= 0 ) {
+        return RecordDesignHash( BitstreamHash( data, length ) );
+    }
+    return error;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
@@ -3952,7 +4596,16 @@ long OpenOK::WriteToPipeIn( int epAddr, long length, unsigned char *data )
 {
     // I don't know what the 0x04 means.
     // For 0x80 and 0x9F address see FrontPanel-UM.pdf, Endpoint Types, pg 40.
-    const long response = ReadWritePipe( epAddr, endpointOUT, 0x80, 0x9F, 0x04, 0x04, length, data );
+    struct timespec start;
+    const bool timed = StartTiming( start );
+
+    const long response = m_asynchronousTransfers ?
+                          BlockingPipeOperation( epAddr, endpointOUT, 0x80, 0x9F, 0x04, 0x04, length, data ) :
+                          ReadWritePipe( epAddr, endpointOUT, 0x80, 0x9F, 0x04, 0x04, length, data );
+
+    if ( timed ) {
+        RecordOperation( OperationWriteToPipeIn, start, response, response >= 0 );
+    }
 
     if ( response < 0 ) {
         PrintStdError( "WriteToPipeIn()",
@@ -3979,23 +4632,828 @@ Parameters:
 [in] 	length 	The length of the transfer.
 [in] 	data 	A pointer to the transfer data buffer.
 
-Returns:
-The number of bytes read or ErrorCode if the read failed.
-*/
+Returns:
+The number of bytes read or ErrorCode if the read failed.
+*/
+
+long OpenOK::ReadFromPipeOut( int epAddr, long length, unsigned char *data )
+{
+    // I don't know what the 0x05 and 0x06 means.
+    // For 0xA0 and 0xBF address see FrontPanel-UM.pdf, Endpoint Types, pg 40.
+    struct timespec start;
+    const bool timed = StartTiming( start );
+
+    const long response = m_asynchronousTransfers ?
+                          BlockingPipeOperation( epAddr, endpointIN, 0xA0, 0xBF, 0x06, 0x05, length, data ) :
+                          ReadWritePipe( epAddr, endpointIN, 0xA0, 0xBF, 0x06, 0x05, length, data );
+
+    if ( timed ) {
+        RecordOperation( OperationReadFromPipeOut, start, response, response >= 0 );
+    }
+
+    if ( response < 0 ) {
+        PrintStdError( "ReadFromPipeOut()",
+                       "ReadWritePipe() failed",
+                       0,
+                       response );
+    }
+    return response;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+/*
+Asynchronous pipe transfers (Not Official)
+
+A pipe operation has the same sequence of transfers as ReadWritePipe(): a control transfer announcing the part of the
+transfer that is a multiple of MaxPacketSize, followed by the bulk transfer of that part, then a control transfer and a bulk
+transfer for any remainder. The bulk data is sent as pipeChunkSize transfers, several of which are queued at once, so that the
+host controller always has a transfer ready. Transfers go directly to and from the caller's buffer, which must remain valid
+until the operation completes.
+
+Operations are performed in the order in which they are begun. The callback is called from HandleEvents(), so the caller must
+call HandleEvents() (or WaitForPipeTransfers()) while operations are pending. Callbacks may begin new operations, but must not
+make blocking calls.
+*/
+
+struct OpenOK::PipeOperation
+{
+        enum Phase
+        {
+            MainSetup,
+            MainBulk,
+            RemainderSetup,
+            RemainderBulk,
+            Finished
+        };
+
+        OpenOK *owner;
+
+        int32_t epAddr;
+        int32_t endpointDir;
+        int32_t magicNumber1;
+        int32_t magicNumber2;
+
+        long length;
+        long mainLength; // multiple of MaxPacketSize
+        unsigned char *data;
+
+        OpenOK_PipeCallback callback;
+        void *userData;
+
+        bool started;
+        Phase phase;
+        long phaseOffset; // offset of the phase's data in the buffer
+        long phaseLength;
+        long submitted; // bytes submitted in this phase
+        long transferred; // total bytes transferred
+        long error;
+
+        bool timed;
+        struct timespec start;
+
+        std::vector<struct libusb_transfer *> inFlight;
+
+        unsigned char setup[ LIBUSB_CONTROL_SETUP_SIZE + 6 ];
+};
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+This method begins a transfer of data to the given Pipe In endpoint and returns immediately.
+
+Parameters:
+[in] 	epAddr 	The address of the destination Pipe In.
+[in] 	length 	The length of the transfer.
+[in] 	data 	A pointer to the transfer data buffer.
+[in] 	callback 	Called with the number of bytes written, or ErrorCode, when the transfer completes.
+[in] 	userData 	Passed to the callback.
+
+Returns:
+ErrorCode.
+*/
+
+OpenOK::ErrorCode OpenOK::BeginWriteToPipeIn( int epAddr, long length, unsigned char *data,
+                                              OpenOK_PipeCallback callback, void *userData )
+{
+    return BeginPipeOperation( epAddr, endpointOUT, 0x80, 0x9F, 0x04, 0x04, length, data, callback, userData );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+This method begins a transfer of data from the given Pipe Out endpoint and returns immediately.
+
+Parameters:
+[in] 	epAddr 	The address of the source Pipe Out.
+[in] 	length 	The length of the transfer.
+[in] 	data 	A pointer to the transfer data buffer.
+[in] 	callback 	Called with the number of bytes read, or ErrorCode, when the transfer completes.
+[in] 	userData 	Passed to the callback.
+
+Returns:
+ErrorCode.
+*/
+
+OpenOK::ErrorCode OpenOK::BeginReadFromPipeOut( int epAddr, long length, unsigned char *data,
+                                                OpenOK_PipeCallback callback, void *userData )
+{
+    return BeginPipeOperation( epAddr, endpointIN, 0xA0, 0xBF, 0x06, 0x05, length, data, callback, userData );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+This method handles USB events for up to timeout milliseconds, calling the callbacks of completed pipe operations.
+*/
+
+OpenOK::ErrorCode OpenOK::HandleEvents( int timeout )
+{
+    if ( !m_libusbInitialization ) {
+        return LibusbNotInitialization;
+    }
+
+    struct timeval tv;
+    tv.tv_sec = timeout / 1000;
+    tv.tv_usec = ( timeout % 1000 ) * 1000;
+
+    const int responseLibusb = libusb_handle_events_timeout_completed( m_ctx, &tv, NULL );
+
+    if ( responseLibusb < 0 && responseLibusb != LIBUSB_ERROR_INTERRUPTED ) {
+        PrintStdError( "HandleEvents()",
+                       "libusb_handle_events_timeout_completed() failed",
+                       responseLibusb );
+
+        return LibusbError;
+    }
+    return NoError;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+This method waits until all pipe operations have completed.
+*/
+
+OpenOK::ErrorCode OpenOK::WaitForPipeTransfers()
+{
+    while ( !m_pipeOperations.empty() ) {
+        const ErrorCode error = HandleEvents( m_timeoutUSB );
+
+        if ( error != NoError ) {
+            return error;
+        }
+    }
+    return NoError;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+This method cancels all pipe operations. Their callbacks are called with the error code Failed, from HandleEvents() if there
+were transfers in progress.
+*/
+
+void OpenOK::CancelPipeTransfers()
+{
+    while ( !m_pipeOperations.empty() ) {
+        PipeOperation *op = m_pipeOperations.back();
+
+        if ( op->started && !op->inFlight.empty() ) {
+            FailPipeOperation( op, Failed ); // completes when the cancelled transfers are returned
+            break;
+        }
+
+        m_pipeOperations.pop_back();
+
+        if ( op->callback ) {
+            op->callback( op->userData, Failed );
+        }
+        delete op;
+    }
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Returns the number of pipe operations that have not completed.
+*/
+
+int OpenOK::GetPendingPipeTransfers()
+{
+    return m_pipeOperations.size();
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Sets the number of bulk transfers queued at once by a pipe operation.
+*/
+
+void OpenOK::SetPipeTransfersInFlight( int n )
+{
+    m_pipeTransfersInFlight = ( n < 1 ) ? 1 : n;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+When enabled, ReadFromPipeOut() and WriteToPipeIn() use asynchronous pipe operations, with several bulk transfers in flight,
+and wait for them to complete.
+*/
+
+void OpenOK::EnableAsynchronousTransfers( bool enable )
+{
+    m_asynchronousTransfers = enable;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+OpenOK::ErrorCode OpenOK::BeginPipeOperation( int32_t epAddr, int32_t endpointDir, int32_t endpointLower, int32_t endpointUpper,
+                                              int32_t magicNumber1, int32_t magicNumber2, long length, unsigned char *data,
+                                              OpenOK_PipeCallback callback, void *userData )
+{
+#if !defined(WRITE_READ_FAST)
+    // CheckEnable() and CheckDisable() are blocking, so can't be done from a callback
+    return UnsupportedFeature;
+#endif
+
+    if ( !IsOpen() ) {
+        return DeviceNotOpen;
+    }
+
+    if ( ( epAddr < endpointLower ) || ( epAddr > endpointUpper ) ) {
+        return RangeAddressError;
+    }
+
+    if ( length <= 0 ) {
+        return SignedArgumentError;
+    }
+
+    if ( data == NULL ) {
+        return PointerNULL;
+    }
+
+    // Odd transfers will be shortened by one byte.
+    if ( ( length % 2 ) != 0 ) {
+        PrintStdError( "BeginPipeOperation()",
+                       "Odd transfers will be shortened by one byte" );
+
+        length -= 1;
+    }
+
+    PipeOperation *op = new PipeOperation;
+
+    op->owner = this;
+    op->epAddr = epAddr;
+    op->endpointDir = endpointDir;
+    op->magicNumber1 = magicNumber1;
+    op->magicNumber2 = magicNumber2;
+    op->length = length;
+    op->mainLength = ( length >> m_shiftMaxPacketSize ) << m_shiftMaxPacketSize;
+    op->data = data;
+    op->callback = callback;
+    op->userData = userData;
+    op->started = false;
+    op->phase = PipeOperation::MainSetup;
+    op->phaseOffset = 0;
+    op->phaseLength = 0;
+    op->submitted = 0;
+    op->transferred = 0;
+    op->error = NoError;
+    op->timed = StartTiming( op->start );
+
+    m_pipeOperations.push_back( op );
+
+    if ( m_pipeOperations.size() == 1 ) {
+        op->started = true;
+        StartPipePhase( op );
+    }
+    return NoError;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+long OpenOK::BlockingPipeOperation( int32_t epAddr, int32_t endpointDir, int32_t endpointLower, int32_t endpointUpper,
+                                    int32_t magicNumber1, int32_t magicNumber2, long length, unsigned char *data )
+{
+    struct Result
+    {
+        bool done;
+        long value;
+
+        static void Callback( void *userData, long result ) {
+            Result *r = static_cast<Result *>( userData );
+            r->done = true;
+            r->value = result;
+        }
+    } result;
+
+    result.done = false;
+    result.value = Failed;
+
+    const ErrorCode error = BeginPipeOperation( epAddr, endpointDir, endpointLower, endpointUpper,
+                                                magicNumber1, magicNumber2, length, data, &Result::Callback, &result );
+    if ( error != NoError ) {
+        return error;
+    }
+
+    while ( !result.done ) {
+        if ( HandleEvents( m_timeoutUSB ) != NoError ) {
+            CancelPipeTransfers();
+        }
+    }
+    return result.value;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void OpenOK::StartPipePhase( PipeOperation *op )
+{
+    if ( op->phase == PipeOperation::MainSetup && op->mainLength == 0 ) {
+        op->phase = PipeOperation::RemainderSetup;
+    }
+
+    if ( op->phase == PipeOperation::RemainderSetup && op->length == op->mainLength ) {
+        op->phase = PipeOperation::Finished;
+    }
+
+    switch ( op->phase ) {
+        case PipeOperation::MainSetup:
+        case PipeOperation::RemainderSetup: {
+            const bool main = ( op->phase == PipeOperation::MainSetup );
+            const uint32_t lengthPhase = main ? op->mainLength : ( op->length - op->mainLength );
+            unsigned char *dataControl = op->setup + LIBUSB_CONTROL_SETUP_SIZE;
+            uint16_t lengthDataControl = 2;
+
+            dataControl[ 0 ] = op->epAddr;
+            dataControl[ 1 ] = main ? op->magicNumber1 : op->magicNumber2;
+
+            if ( op->endpointDir == endpointIN ) {
+                dataControl[ 2 ] = lengthPhase & 255;
+                dataControl[ 3 ] = ( lengthPhase >> 8 ) & 255;
+                dataControl[ 4 ] = ( lengthPhase >> 16 ) & 255;
+                dataControl[ 5 ] = ( lengthPhase >> 24 ) & 255;
+
+                lengthDataControl = 6;
+            }
+
+            op->phaseOffset = main ? 0 : op->mainLength;
+            op->phaseLength = lengthPhase;
+            op->submitted = 0;
+
+            libusb_fill_control_setup( op->setup, controlWriteMode, 0xb7,
+                                       main ? m_maxPacketSize : ( lengthPhase >> 1 ), 0x0000, lengthDataControl );
+
+            struct libusb_transfer *transfer = libusb_alloc_transfer( 0 );
+
+            if ( transfer == NULL ) {
+                FailPipeOperation( op, LibusbError );
+                return;
+            }
+
+            libusb_fill_control_transfer( transfer, m_deviceHandle, op->setup, &OpenOK::PipeTransferCallback, op, m_timeoutUSB );
+
+            const int responseLibusb = libusb_submit_transfer( transfer );
+
+            if ( responseLibusb < 0 ) {
+                PrintStdError( "StartPipePhase()",
+                               "libusb_submit_transfer() failed",
+                               responseLibusb );
+
+                libusb_free_transfer( transfer );
+                FailPipeOperation( op, ControlTransferError + responseLibusb );
+                return;
+            }
+            op->inFlight.push_back( transfer );
+            break;
+        }
+        case PipeOperation::MainBulk:
+        case PipeOperation::RemainderBulk:
+            SubmitPipeChunks( op );
+            break;
+        case PipeOperation::Finished:
+            CompletePipeOperation( op );
+            break;
+    }
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void OpenOK::SubmitPipeChunks( PipeOperation *op )
+{
+    while ( ( int ) op->inFlight.size() < m_pipeTransfersInFlight && op->submitted < op->phaseLength ) {
+        long lengthChunk = op->phaseLength - op->submitted;
+
+        if ( lengthChunk > pipeChunkSize ) {
+            lengthChunk = pipeChunkSize;
+        }
+
+        struct libusb_transfer *transfer = libusb_alloc_transfer( 0 );
+
+        if ( transfer == NULL ) {
+            FailPipeOperation( op, LibusbError );
+            return;
+        }
+
+        libusb_fill_bulk_transfer( transfer, m_deviceHandle, op->endpointDir,
+                                   op->data + op->phaseOffset + op->submitted, lengthChunk,
+                                   &OpenOK::PipeTransferCallback, op, m_timeoutUSB );
+
+        const int responseLibusb = libusb_submit_transfer( transfer );
+
+        if ( responseLibusb < 0 ) {
+            PrintStdError( "SubmitPipeChunks()",
+                           "libusb_submit_transfer() failed",
+                           responseLibusb );
+
+            libusb_free_transfer( transfer );
+            FailPipeOperation( op, BulkTransferError + responseLibusb );
+            return;
+        }
+        op->inFlight.push_back( transfer );
+        op->submitted += lengthChunk;
+    }
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void OpenOK::FailPipeOperation( PipeOperation *op, long error )
+{
+    if ( op->error == NoError ) {
+        op->error = error;
+    }
+
+    // The operation completes when the last transfer in flight has been returned
+    for ( size_t i = 0; i < op->inFlight.size(); i++ ) {
+        libusb_cancel_transfer( op->inFlight[ i ] );
+    }
+
+    if ( op->inFlight.empty() ) {
+        CompletePipeOperation( op );
+    }
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void OpenOK::CompletePipeOperation( PipeOperation *op )
+{
+    m_pipeOperations.pop_front();
+
+    long result = op->error;
+
+    if ( op->error == NoError ) {
+        m_lastTransferred = op->transferred;
+
+        result = ( op->transferred == op->length ) ? op->transferred : ( long ) TransferError;
+    }
+
+    if ( op->timed ) {
+        RecordOperation( OperationPipe, op->start, op->transferred, result >= 0 );
+    }
+
+    if ( op->callback ) {
+        op->callback( op->userData, result );
+    }
+    delete op;
+
+    // The callback may have started the next operation
+    if ( !m_pipeOperations.empty() && !m_pipeOperations.front()->started ) {
+        m_pipeOperations.front()->started = true;
+        StartPipePhase( m_pipeOperations.front() );
+    }
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void LIBUSB_CALL OpenOK::PipeTransferCallback( struct libusb_transfer *transfer )
+{
+    PipeOperation *op = static_cast<PipeOperation *>( transfer->user_data );
+    OpenOK *self = op->owner;
+
+    for ( size_t i = 0; i < op->inFlight.size(); i++ ) {
+        if ( op->inFlight[ i ] == transfer ) {
+            op->inFlight.erase( op->inFlight.begin() + i );
+            break;
+        }
+    }
+
+    const bool control = ( transfer->type == LIBUSB_TRANSFER_TYPE_CONTROL );
+    const int expected = control ? ( transfer->length - LIBUSB_CONTROL_SETUP_SIZE ) : transfer->length;
+    const libusb_transfer_status status = transfer->status;
+    const int actual = transfer->actual_length;
+
+    libusb_free_transfer( transfer );
+
+    if ( op->error != NoError ) { // failed earlier - waiting for the rest to be returned
+        if ( op->inFlight.empty() ) {
+            self->CompletePipeOperation( op );
+        }
+        return;
+    }
+
+    if ( status != LIBUSB_TRANSFER_COMPLETED || actual != expected ) {
+        long error = TransferError;
+
+        if ( status == LIBUSB_TRANSFER_TIMED_OUT ) {
+            error = Timeout;
+        } else if ( status == LIBUSB_TRANSFER_NO_DEVICE ) {
+            error = DeviceNotOpen;
+        } else if ( status == LIBUSB_TRANSFER_CANCELLED ) {
+            error = Failed;
+        }
+
+        self->PrintStdError( "PipeTransferCallback()",
+                             control ? "control transfer failed" : "bulk transfer failed",
+                             0,
+                             error );
+
+        self->FailPipeOperation( op, error );
+        return;
+    }
+
+    if ( control ) {
+        op->phase = ( op->phase == PipeOperation::MainSetup ) ? PipeOperation::MainBulk : PipeOperation::RemainderBulk;
+        self->StartPipePhase( op );
+        return;
+    }
+
+    op->transferred += actual;
+
+    if ( op->submitted < op->phaseLength ) {
+        self->SubmitPipeChunks( op );
+    } else if ( op->inFlight.empty() ) {
+        op->phase = ( op->phase == PipeOperation::MainBulk ) ? PipeOperation::RemainderSetup : PipeOperation::Finished;
+        self->StartPipePhase( op );
+    }
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+/*
+Transactions (Not Official)
+
+A transaction updates the Wire Ins, and reads the Trigger Outs and Wire Outs, with the control transfers submitted back-to-back
+instead of waiting for each in turn. The Wire Ins are only sent if they have changed. The Trigger Out and Wire Out values
+are only updated when the whole transaction has succeeded, so that IsTriggered() and GetWireOutValue() always see the
+results of the same transaction.
+
+For example, a poll which would be
+
+ xem->UpdateWireIns();
+ xem->UpdateTriggerOuts();
+ xem->UpdateWireOuts();
+
+takes one round trip as
+
+ xem->RunTransaction( OpenOK::TransactionWireIns | OpenOK::TransactionTriggerOuts | OpenOK::TransactionWireOuts );
+*/
+
+struct OpenOK::Transaction
+{
+        static const int NTRANSFERS = 3;
+
+        OpenOK *owner;
+
+        int flags;
+        int pending;
+        int error;
+
+        OpenOK_TransactionCallback callback;
+        void *userData;
+
+        bool timed;
+        struct timespec start;
+
+        // setup packet and data for each transfer
+        unsigned char wireIns[ LIBUSB_CONTROL_SETUP_SIZE + OpenOK::WIREINSIZE ];
+        unsigned char triggerOuts[ LIBUSB_CONTROL_SETUP_SIZE + OpenOK::TRIGGEROUTSIZE ];
+        unsigned char wireOuts[ LIBUSB_CONTROL_SETUP_SIZE + OpenOK::WIREOUTSIZE ];
+
+        struct libusb_transfer *transfers[ NTRANSFERS ];
+};
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+This method begins a transaction and returns immediately. The callback is called from HandleEvents().
+
+Parameters:
+[in] 	flags 	The parts of the transaction : TransactionWireIns, TransactionTriggerOuts, TransactionWireOuts.
+[in] 	callback 	Called with an ErrorCode when the transaction completes.
+[in] 	userData 	Passed to the callback.
+
+Returns:
+ErrorCode.
+*/
+
+OpenOK::ErrorCode OpenOK::BeginTransaction( int flags, OpenOK_TransactionCallback callback, void *userData )
+{
+    if ( !IsOpen() ) {
+        return DeviceNotOpen;
+    }
+
+    Transaction *t = new Transaction;
+
+    // Wire Ins may be set from other threads, so the values are taken under the lock
+    pthread_mutex_lock( &m_wireMutex );
+
+    if ( !m_wireInsChanged ) {
+        flags &= ~TransactionWireIns;
+    } else if ( flags & TransactionWireIns ) {
+        m_wireInsChanged = false;
+        memcpy( t->wireIns + LIBUSB_CONTROL_SETUP_SIZE, m_wireIns, OpenOK::WIREINSIZE );
+    }
+    pthread_mutex_unlock( &m_wireMutex );
+
+    t->owner = this;
+    t->flags = flags;
+    t->pending = 0;
+    t->error = NoError;
+    t->callback = callback;
+    t->userData = userData;
+    t->timed = StartTiming( t->start );
+
+    for ( int i = 0; i < Transaction::NTRANSFERS; i++ ) {
+        t->transfers[ i ] = NULL;
+    }
+
+    // Wire Ins first, so that the outputs reflect them
+    if ( flags & TransactionWireIns ) {
+        libusb_fill_control_setup( t->wireIns, controlWriteMode, 0xb5, 0x0000, 0x0000, OpenOK::WIREINSIZE );
+        t->transfers[ 0 ] = libusb_alloc_transfer( 0 );
+    }
+
+    if ( flags & TransactionTriggerOuts ) {
+        libusb_fill_control_setup( t->triggerOuts, controlReadMode, 0xb5, 0x0060, 0x0001, OpenOK::TRIGGEROUTSIZE );
+        t->transfers[ 1 ] = libusb_alloc_transfer( 0 );
+    }
+
+    if ( flags & TransactionWireOuts ) {
+        libusb_fill_control_setup( t->wireOuts, controlReadMode, 0xb5, 0x0020, 0x0000, OpenOK::WIREOUTSIZE );
+        t->transfers[ 2 ] = libusb_alloc_transfer( 0 );
+    }
+
+    unsigned char *buffers[ Transaction::NTRANSFERS ] = { t->wireIns, t->triggerOuts, t->wireOuts };
+
+    for ( int i = 0; i < Transaction::NTRANSFERS; i++ ) {
+        if ( !( flags & ( 1 << i ) ) ) {
+            continue;
+        }
+
+        struct libusb_transfer *transfer = t->transfers[ i ];
+        t->transfers[ i ] = NULL;
+
+        if ( transfer == NULL ) {
+            t->error = LibusbError;
+            continue;
+        }
+
+        if ( t->error != NoError ) { // don't submit the rest after a failure
+            libusb_free_transfer( transfer );
+            continue;
+        }
+
+        libusb_fill_control_transfer( transfer, m_deviceHandle, buffers[ i ], &OpenOK::TransactionCallback, t, m_timeoutUSB );
+
+        const int responseLibusb = libusb_submit_transfer( transfer );
+
+        if ( responseLibusb < 0 ) {
+            PrintStdError( "BeginTransaction()",
+                           "libusb_submit_transfer() failed",
+                           responseLibusb );
+
+            libusb_free_transfer( transfer );
+            t->error = ControlTransferError + responseLibusb;
+            continue;
+        }
+        t->transfers[ i ] = transfer;
+        t->pending++;
+    }
+
+    if ( t->pending == 0 ) { // nothing to do, or nothing could be submitted
+        const int error = t->error;
+
+        if ( t->timed && error != NoError ) {
+            RecordOperation( OperationTransaction, t->start, 0, false );
+        }
+
+        if ( ( flags & TransactionWireIns ) && error != NoError ) {
+            pthread_mutex_lock( &m_wireMutex );
+            m_wireInsChanged = true;
+            pthread_mutex_unlock( &m_wireMutex );
+        }
+
+        delete t;
+
+        if ( callback ) {
+            callback( userData, error );
+        }
+        return ( ErrorCode ) error;
+    }
+    return NoError;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+This method performs a transaction and waits for it to complete.
+
+Parameters:
+[in] 	flags 	The parts of the transaction : TransactionWireIns, TransactionTriggerOuts, TransactionWireOuts.
+
+Returns:
+ErrorCode.
+*/
+
+OpenOK::ErrorCode OpenOK::RunTransaction( int flags )
+{
+    struct Result
+    {
+        bool done;
+        int value;
+
+        static void Callback( void *userData, int result ) {
+            Result *r = static_cast<Result *>( userData );
+            r->done = true;
+            r->value = result;
+        }
+    } result;
+
+    result.done = false;
+    result.value = Failed;
+
+    const ErrorCode error = BeginTransaction( flags, &Result::Callback, &result );
+
+    if ( error != NoError ) {
+        return error;
+    }
+
+    // The transfers time out after m_timeoutUSB, so this finishes
+    while ( !result.done ) {
+        HandleEvents( m_timeoutUSB );
+    }
+    return ( ErrorCode ) result.value;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void LIBUSB_CALL OpenOK::TransactionCallback( struct libusb_transfer *transfer )
+{
+    Transaction *t = static_cast<Transaction *>( transfer->user_data );
+    OpenOK *self = t->owner;
+
+    if ( transfer->status != LIBUSB_TRANSFER_COMPLETED ||
+         transfer->actual_length != transfer->length - LIBUSB_CONTROL_SETUP_SIZE ) {
+        if ( t->error == NoError ) {
+            t->error = ( transfer->status == LIBUSB_TRANSFER_TIMED_OUT ) ? Timeout : TransferError;
+
+            self->PrintStdError( "TransactionCallback()",
+                                 "control transfer failed",
+                                 0,
+                                 t->error );
+        }
+
+        // Don't wait for the rest
+        for ( int i = 0; i < Transaction::NTRANSFERS; i++ ) {
+            if ( t->transfers[ i ] != NULL && t->transfers[ i ] != transfer ) {
+                libusb_cancel_transfer( t->transfers[ i ] );
+            }
+        }
+    }
+
+    for ( int i = 0; i < Transaction::NTRANSFERS; i++ ) {
+        if ( t->transfers[ i ] == transfer ) {
+            t->transfers[ i ] = NULL;
+        }
+    }
+
+    libusb_free_transfer( transfer );
+
+    if ( --t->pending > 0 ) {
+        return;
+    }
+
+    if ( t->error == NoError ) {
+        if ( t->flags & TransactionTriggerOuts ) {
+            memcpy( self->m_triggerOuts, t->triggerOuts + LIBUSB_CONTROL_SETUP_SIZE, OpenOK::TRIGGEROUTSIZE );
+        }
+
+        if ( t->flags & TransactionWireOuts ) {
+            pthread_mutex_lock( &self->m_wireMutex );
+            memcpy( self->m_wireOuts, t->wireOuts + LIBUSB_CONTROL_SETUP_SIZE, OpenOK::WIREOUTSIZE );
+            pthread_mutex_unlock( &self->m_wireMutex );
+        }
+    } else if ( t->flags & TransactionWireIns ) {
+        pthread_mutex_lock( &self->m_wireMutex );
+        self->m_wireInsChanged = true; // try again next time
+        pthread_mutex_unlock( &self->m_wireMutex );
+    }
+
+    if ( t->timed ) {
+        long long bytes = 0;
+
+        if ( t->flags & TransactionWireIns ) {
+            bytes += OpenOK::WIREINSIZE;
+        }
+
+        if ( t->flags & TransactionTriggerOuts ) {
+            bytes += OpenOK::TRIGGEROUTSIZE;
+        }
+
+        if ( t->flags & TransactionWireOuts ) {
+            bytes += OpenOK::WIREOUTSIZE;
+        }
+        self->RecordOperation( OperationTransaction, t->start, ( t->error == NoError ) ? bytes : 0, t->error == NoError );
+    }
 
-long OpenOK::ReadFromPipeOut( int epAddr, long length, unsigned char *data )
-{
-    // I don't know what the 0x05 and 0x06 means.
-    // For 0xA0 and 0xBF address see FrontPanel-UM.pdf, Endpoint Types, pg 40.
-    const long response = ReadWritePipe( epAddr, endpointIN, 0xA0, 0xBF, 0x06, 0x05, length, data );
+    OpenOK_TransactionCallback callback = t->callback;
+    void *userData = t->userData;
+    const int error = t->error;
 
-    if ( response < 0 ) {
-        PrintStdError( "ReadFromPipeOut()",
-                       "ReadWritePipe() failed",
-                       0,
-                       response );
+    delete t;
+
+    if ( callback ) {
+        callback( userData, error );
     }
-    return response;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
@@ -4018,22 +5476,36 @@ void OpenOK::UpdateWireOuts()
         return;
     }
 
+    struct timespec start;
+    const bool timed = StartTiming( start );
+
+    // read into a copy so that the lock isn't held during the transfer
+    unsigned char wireOuts[ OpenOK::WIREOUTSIZE ];
+
     const int responseControl = ControlTransfer( m_deviceHandle,
                                                  controlReadMode,
                                                  0xb5,
                                                  0x0020,
                                                  0x0000,
-                                                 m_wireOuts,
+                                                 wireOuts,
                                                  OpenOK::WIREOUTSIZE,
                                                  m_timeoutUSB );
+
+    if ( timed ) {
+        RecordOperation( OperationUpdateWireOuts, start, responseControl, responseControl >= 0 );
+    }
     if ( responseControl < 0 ) {
         PrintStdError( "UpdateWireOuts()",
                        "ControlTransfer() failed",
                        0,
                        responseControl );
 
-        memset( m_wireOuts, 0, OpenOK::WIREOUTSIZE );
+        memset( wireOuts, 0, OpenOK::WIREOUTSIZE );
     }
+
+    pthread_mutex_lock( &m_wireMutex );
+    memcpy( m_wireOuts, wireOuts, OpenOK::WIREOUTSIZE );
+    pthread_mutex_unlock( &m_wireMutex );
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
@@ -4066,8 +5538,10 @@ int OpenOK::GetWireOutValue( int epAddr )
     }
 
     unsigned char idx = ( epAddr - 0x20 ) << 1;
+    pthread_mutex_lock( &m_wireMutex );
     unsigned char low = m_wireOuts[ idx ];
     unsigned char high = m_wireOuts[ idx + 1 ];
+    pthread_mutex_unlock( &m_wireMutex );
 
     const int result = ( high << 8 ) + low;
 
@@ -4105,8 +5579,19 @@ OpenOK::ErrorCode OpenOK::SetWireInValue( int epAddr, unsigned long val, unsigne
     if ( ( epAddr < 0x00 ) || ( epAddr > 0x1F ) ) {
         return RangeAddressError;
     }
-    //                          clear bits being modified    OR   bits to be set                  
-    m_wireIns[ 2 * epAddr] = (m_wireIns[ 2 * epAddr] & ~mask) | (val & mask); 
+    // Wire Ins are 16 bits, stored LSB:MSB
+    const unsigned int idx = 2 * epAddr;
+    pthread_mutex_lock( &m_wireMutex );
+    const unsigned int oldValue = m_wireIns[ idx ] | ( m_wireIns[ idx + 1 ] << 8 );
+    //                          clear bits being modified    OR   bits to be set
+    const unsigned int newValue = ( ( oldValue & ~mask ) | ( val & mask ) ) & 0xffff;
+
+    if ( newValue != oldValue ) {
+        m_wireIns[ idx ] = newValue & 0xff;
+        m_wireIns[ idx + 1 ] = ( newValue >> 8 ) & 0xff;
+        m_wireInsChanged = true;
+    }
+    pthread_mutex_unlock( &m_wireMutex );
 
     return NoError;
 }
@@ -4116,6 +5601,7 @@ OpenOK::ErrorCode OpenOK::SetWireInValue( int epAddr, unsigned long val, unsigne
 This method is called after all Wire In values have been updated using SetWireInValue(). The latter call merely updates the values
 held within a data structure inside the class. This method actually commits the changes to the XEM simultaneously so that all wires
 will be updated at the same time.
+Nothing is sent if no Wire In has changed since the last update.
 */
 
 void OpenOK::UpdateWireIns()
@@ -4128,22 +5614,45 @@ void OpenOK::UpdateWireIns()
         return;
     }
 
+    // send a copy so that the lock isn't held during the transfer
+    unsigned char wireIns[ OpenOK::WIREINSIZE ];
+
+    pthread_mutex_lock( &m_wireMutex );
+    const bool changed = m_wireInsChanged;
+    m_wireInsChanged = false;
+    memcpy( wireIns, m_wireIns, OpenOK::WIREINSIZE );
+    pthread_mutex_unlock( &m_wireMutex );
+
+    if ( !changed ) {
+        return;
+    }
+
+    struct timespec start;
+    const bool timed = StartTiming( start );
+
     const int responseControl = ControlTransfer( m_deviceHandle,
                                                  controlWriteMode,
                                                  0xb5,
                                                  0x0000,
                                                  0x0000,
-                                                 m_wireIns,
+                                                 wireIns,
                                                  OpenOK::WIREINSIZE,
                                                  m_timeoutUSB );
 
+    if ( timed ) {
+        RecordOperation( OperationUpdateWireIns, start, responseControl, responseControl >= 0 );
+    }
+
     if ( responseControl < 0 ) {
         PrintStdError( "UpdateWireIns()",
                        "ControlTransfer() failed",
                        0,
                        responseControl );
 
+        pthread_mutex_lock( &m_wireMutex );
         memset( m_wireIns, 0, OpenOK::WIREINSIZE );
+        m_wireInsChanged = true;
+        pthread_mutex_unlock( &m_wireMutex );
     }
 }
 //---------------------------------------------------------------------------------------------------------------------------------
@@ -4187,6 +5696,8 @@ trigger outs are sent exactly the same as wire outs, but with a different setup
 
 void OpenOK::UpdateTriggerOuts(  )
 {
+    struct timespec start;
+    const bool timed = StartTiming( start );
 
     const int responseControl = ControlTransfer( m_deviceHandle,
                                                  controlReadMode,
@@ -4197,6 +5708,10 @@ void OpenOK::UpdateTriggerOuts(  )
                                                  OpenOK::TRIGGEROUTSIZE,
                                                  m_timeoutUSB );
 
+    if ( timed ) {
+        RecordOperation( OperationUpdateTriggerOuts, start, responseControl, responseControl >= 0 );
+    }
+
    if ( responseControl < 0 ) {
         PrintStdError( "UpdateWireOuts()",
                        "ControlTransfer() failed",
@@ -4600,3 +6115,412 @@ void OpenOK::PrintStdError( std::string nameFunction,
     }
 }
 //---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+The device manager
+*/
+
+OpenOK_DeviceManager &OpenOK_DeviceManager::Instance()
+{
+    static OpenOK_DeviceManager manager;
+
+    return manager;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+OpenOK_DeviceManager::OpenOK_DeviceManager()
+    : m_nextListenerID( 1 )
+    , m_enumeration( NULL )
+    , m_hotplug( NULL )
+    , m_hotplugRunning( false )
+    , m_stopHotplug( false )
+{
+    pthread_mutex_init( &m_mutex, NULL );
+    pthread_mutex_init( &m_enumerationMutex, NULL );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+OpenOK_DeviceManager::~OpenOK_DeviceManager()
+{
+    StopHotplug();
+
+    delete m_enumeration;
+
+    pthread_mutex_destroy( &m_enumerationMutex );
+    pthread_mutex_destroy( &m_mutex );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Starts the thread which follows hotplug events. Devices already attached are read straight away.
+
+Returns:
+true if hotplug events are running, false if libusb does not support them
+*/
+
+bool OpenOK_DeviceManager::StartHotplug()
+{
+#ifdef OPENOK_HOTPLUG
+    if ( m_hotplugRunning ) {
+        return true;
+    }
+
+    if ( !libusb_has_capability( LIBUSB_CAP_HAS_HOTPLUG ) ) {
+        return false;
+    }
+
+    m_hotplug = new OpenOK;
+
+    if ( !m_hotplug->InitializationLibUSB() ) {
+        delete m_hotplug;
+        m_hotplug = NULL;
+        return false;
+    }
+
+    // Devices already attached are reported as arriving
+    const int responseLibusb = libusb_hotplug_register_callback( m_hotplug->m_ctx,
+                                                                 static_cast< libusb_hotplug_event >(
+                                                                     LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED |
+                                                                     LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT ),
+                                                                 LIBUSB_HOTPLUG_ENUMERATE,
+                                                                 VENDOR_OPAL_KELLY,
+                                                                 LIBUSB_HOTPLUG_MATCH_ANY,
+                                                                 LIBUSB_HOTPLUG_MATCH_ANY,
+                                                                 &OpenOK_DeviceManager::HotplugCallback,
+                                                                 this,
+                                                                 &m_hotplugHandle );
+
+    if ( responseLibusb != LIBUSB_SUCCESS ) {
+        m_hotplug->PrintStdError( "OpenOK_DeviceManager::StartHotplug()",
+                                  "libusb_hotplug_register_callback() failed",
+                                  responseLibusb );
+        delete m_hotplug;
+        m_hotplug = NULL;
+        return false;
+    }
+
+    m_stopHotplug = false;
+
+    if ( pthread_create( &m_hotplugThread, NULL, &OpenOK_DeviceManager::HotplugThread, this ) != 0 ) {
+        libusb_hotplug_deregister_callback( m_hotplug->m_ctx, m_hotplugHandle );
+        delete m_hotplug;
+        m_hotplug = NULL;
+        return false;
+    }
+
+    m_hotplugRunning = true;
+
+    return true;
+#else
+    return false;
+#endif
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void OpenOK_DeviceManager::StopHotplug()
+{
+#ifdef OPENOK_HOTPLUG
+    if ( !m_hotplugRunning ) {
+        return;
+    }
+
+    m_stopHotplug = true;
+
+    pthread_join( m_hotplugThread, NULL );
+
+    libusb_hotplug_deregister_callback( m_hotplug->m_ctx, m_hotplugHandle );
+
+    // events not handled yet are dropped
+    pthread_mutex_lock( &m_mutex );
+
+    for ( unsigned int i = 0; i < m_hotplugEvents.size(); ++i ) {
+        libusb_unref_device( m_hotplugEvents[ i ].device );
+    }
+    m_hotplugEvents.clear();
+
+    pthread_mutex_unlock( &m_mutex );
+
+    delete m_hotplug;
+    m_hotplug = NULL;
+
+    m_hotplugRunning = false;
+#endif
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+bool OpenOK_DeviceManager::IsHotplugRunning()
+{
+    return m_hotplugRunning;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Registers a function to be called when a device is plugged in or unplugged. It is called from the hotplug thread.
+
+Parameters:
+[in] 	callback	the function
+[in] 	userData	passed to it
+
+Returns:
+an identifier for RemoveHotplugCallback()
+*/
+
+int OpenOK_DeviceManager::AddHotplugCallback( OpenOK_HotplugCallback callback, void *userData )
+{
+    Listener listener;
+
+    listener.callback = callback;
+    listener.userData = userData;
+
+    pthread_mutex_lock( &m_mutex );
+
+    listener.id = m_nextListenerID++;
+
+    m_listeners.push_back( listener );
+
+    pthread_mutex_unlock( &m_mutex );
+
+    return listener.id;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void OpenOK_DeviceManager::RemoveHotplugCallback( int id )
+{
+    pthread_mutex_lock( &m_mutex );
+
+    for ( unsigned int i = 0; i < m_listeners.size(); ++i ) {
+        if ( m_listeners[ i ].id == id ) {
+            m_listeners.erase( m_listeners.begin() + i );
+            break;
+        }
+    }
+
+    pthread_mutex_unlock( &m_mutex );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Lists the attached devices. Only devices not seen before are opened.
+
+Returns:
+the serial numbers of the attached devices
+*/
+
+std::vector< std::string > OpenOK_DeviceManager::GetSerials()
+{
+    std::vector< std::string > serials;
+
+    pthread_mutex_lock( &m_enumerationMutex );
+
+    if ( m_enumeration == NULL ) {
+        m_enumeration = new OpenOK;
+    }
+
+    int numDevices = 0;
+
+    if ( m_enumeration->Get_OK_Devices( false, numDevices ) == OpenOK::NoError ) {
+        for ( int i = 0; i < numDevices; ++i ) {
+            serials.push_back( m_enumeration->m_listOKDevices[ i ].serial );
+        }
+    }
+
+    pthread_mutex_unlock( &m_enumerationMutex );
+
+    return serials;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+bool OpenOK_DeviceManager::IsAttached( const std::string serial )
+{
+    const std::vector< std::string > serials = GetSerials();
+
+    for ( unsigned int i = 0; i < serials.size(); ++i ) {
+        if ( serials[ i ] == serial ) {
+            return true;
+        }
+    }
+    return false;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Forgets all the devices, so that they are read again.
+*/
+
+void OpenOK_DeviceManager::Clear()
+{
+    pthread_mutex_lock( &m_mutex );
+
+    m_cache.clear();
+
+    pthread_mutex_unlock( &m_mutex );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+int OpenOK_DeviceManager::DeviceKey( libusb_device *device )
+{
+    if ( device == NULL ) {
+        return -1;
+    }
+    return ( libusb_get_bus_number( device ) << 8 ) | libusb_get_device_address( device );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+bool OpenOK_DeviceManager::Lookup( int key, OpenOK_device &info )
+{
+    pthread_mutex_lock( &m_mutex );
+
+    const std::map< int, OpenOK_device >::const_iterator it = m_cache.find( key );
+
+    const bool found = ( it != m_cache.end() );
+
+    if ( found ) {
+        info = it->second;
+    }
+
+    pthread_mutex_unlock( &m_mutex );
+
+    return found;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void OpenOK_DeviceManager::Store( int key, const OpenOK_device &info )
+{
+    if ( key < 0 ) {
+        return;
+    }
+
+    pthread_mutex_lock( &m_mutex );
+
+    OpenOK_device &entry = m_cache[ key ];
+
+    entry = info;
+    entry.device = NULL; // each OpenOK has its own
+
+    pthread_mutex_unlock( &m_mutex );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Forgets the devices which are not in the list.
+
+Parameters:
+[in] 	keys	the devices attached
+*/
+
+void OpenOK_DeviceManager::Retain( const std::vector< int > &keys )
+{
+    pthread_mutex_lock( &m_mutex );
+
+    for ( std::map< int, OpenOK_device >::iterator it = m_cache.begin(); it != m_cache.end(); ) {
+        if ( std::find( keys.begin(), keys.end(), it->first ) == keys.end() ) {
+            m_cache.erase( it++ );
+        } else {
+            ++it;
+        }
+    }
+
+    pthread_mutex_unlock( &m_mutex );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void OpenOK_DeviceManager::Notify( const std::string serial, bool arrived )
+{
+    pthread_mutex_lock( &m_mutex );
+
+    const std::vector< Listener > listeners = m_listeners;
+
+    pthread_mutex_unlock( &m_mutex );
+
+    for ( unsigned int i = 0; i < listeners.size(); ++i ) {
+        listeners[ i ].callback( listeners[ i ].userData, serial, arrived );
+    }
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Handles the events queued by HotplugCallback(). Devices can't be opened in the libusb callback, so
+new devices are read here.
+*/
+
+void OpenOK_DeviceManager::HandleHotplugEvents()
+{
+#ifdef OPENOK_HOTPLUG
+    for ( ;; ) {
+        pthread_mutex_lock( &m_mutex );
+
+        if ( m_hotplugEvents.empty() ) {
+            pthread_mutex_unlock( &m_mutex );
+            break;
+        }
+
+        const HotplugEvent hotplugEvent = m_hotplugEvents.front();
+
+        m_hotplugEvents.pop_front();
+
+        pthread_mutex_unlock( &m_mutex );
+
+        const int key = DeviceKey( hotplugEvent.device );
+
+        OpenOK_device info;
+
+        if ( hotplugEvent.event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED ) {
+            libusb_device_descriptor descriptorDevice;
+
+            if ( ( m_hotplug->GetDeviceDescriptor( hotplugEvent.device, &descriptorDevice ) == OpenOK::NoError ) &&
+                 ( m_hotplug->ReadDeviceInfo( hotplugEvent.device, descriptorDevice, info ) == OpenOK::NoError ) ) {
+                Store( key, info );
+                Notify( info.serial, true );
+            }
+        } else if ( Lookup( key, info ) ) {
+            pthread_mutex_lock( &m_mutex );
+
+            m_cache.erase( key );
+
+            pthread_mutex_unlock( &m_mutex );
+
+            Notify( info.serial, false );
+        }
+
+        libusb_unref_device( hotplugEvent.device );
+    }
+#endif
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void *OpenOK_DeviceManager::HotplugThread( void *arg )
+{
+    OpenOK_DeviceManager *manager = static_cast< OpenOK_DeviceManager* >( arg );
+
+    // the devices attached when hotplug events were started
+    manager->HandleHotplugEvents();
+
+    while ( !manager->m_stopHotplug ) {
+        manager->m_hotplug->HandleEvents( hotplugPollInterval );
+        manager->HandleHotplugEvents();
+    }
+    return NULL;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+#ifdef OPENOK_HOTPLUG
+int LIBUSB_CALL OpenOK_DeviceManager::HotplugCallback( libusb_context * /*ctx*/, libusb_device *device,
+                                                       libusb_hotplug_event event, void *userData )
+{
+    OpenOK_DeviceManager *manager = static_cast< OpenOK_DeviceManager* >( userData );
+
+    HotplugEvent hotplugEvent;
+
+    hotplugEvent.device = libusb_ref_device( device );
+    hotplugEvent.event = event;
+
+    pthread_mutex_lock( &manager->m_mutex );
+
+    manager->m_hotplugEvents.push_back( hotplugEvent );
+
+    pthread_mutex_unlock( &manager->m_mutex );
+
+    return 0; // stay registered
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+#endif
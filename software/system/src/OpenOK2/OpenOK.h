@@ -60,12 +60,19 @@ THE SOFTWARE.
 #define LIBUSB_H_
 #endif
 
+#include <algorithm>
+#include <deque>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <iterator>
+#include <map>
 #include <math.h>
+#include <pthread.h>
+#include <sstream>
 #include <string>
 #include <string.h>
+#include <time.h>
 #include <vector>
 
 #ifdef QT_CORE_LIB
@@ -95,6 +102,20 @@ THE SOFTWARE.
 
 #define WAIT_RESET_MICROSECONDS 500000
 
+#define pipeChunkSize 16384 // bytes per bulk transfer in asynchronous pipe operations
+#define pipeTransfersInFlight 4 // default number of bulk transfers queued at once
+
+#define configurationTransfersInFlight 2 // minimum number of bulk transfers queued at once when configuring the FPGA
+
+#define hotplugPollInterval 100 // ms, how long the device manager's thread waits for hotplug events at a time
+
+#define statisticsHistogramBins 22 // bin 0 is for times < 1 us, bin k for [2^(k-1),2^k) us, and the last bin for anything longer
+
+// libusb has hotplug support from 1.0.16
+#if defined( LIBUSB_API_VERSION ) && ( LIBUSB_API_VERSION >= 0x01000102 )
+#define OPENOK_HOTPLUG
+#endif
+
 //---------------------------------------------------------------------------------------------------------------------------------
 
 class OpenOK_CPLL22150
@@ -254,6 +275,45 @@ struct OpenOK_device
 };
 //---------------------------------------------------------------------------------------------------------------------------------
 
+// Called when an asynchronous pipe operation completes, with the number of bytes transferred or an ErrorCode
+typedef void ( *OpenOK_PipeCallback )( void *userData, long result );
+
+// Called when a transaction completes, with an ErrorCode
+typedef void ( *OpenOK_TransactionCallback )( void *userData, int result );
+
+// Called by the device manager when a device is plugged in ( arrived is true ) or unplugged
+typedef void ( *OpenOK_HotplugCallback )( void *userData, const std::string &serial, bool arrived );
+
+//---------------------------------------------------------------------------------------------------------------------------------
+
+// Calls, bytes and times of one kind of operation, collected while statistics are enabled ( see OpenOK::EnableStatistics() )
+struct OpenOK_OperationStatistics
+{
+        unsigned long calls;
+
+        unsigned long errors;
+
+        unsigned long long bytes;
+
+        double totalTime; // seconds
+
+        double maxTime;
+
+        unsigned long histogram[ statisticsHistogramBins ];
+
+        OpenOK_OperationStatistics() {
+            calls = 0;
+            errors = 0;
+            bytes = 0;
+            totalTime = 0.0;
+            maxTime = 0.0;
+
+            memset( histogram, 0, sizeof( histogram ) );
+        }
+};
+
+//---------------------------------------------------------------------------------------------------------------------------------
+
 class OpenOK
 {
     public:
@@ -339,6 +399,33 @@ class OpenOK
             brdEnd // don't put anything after this line
         };
 
+        // The parts of a transaction
+        enum TransactionFlags
+        {
+            TransactionWireIns = 0x01,
+            TransactionTriggerOuts = 0x02,
+            TransactionWireOuts = 0x04
+        };
+
+        // The operations timed by the statistics. ControlTransfer and BulkTransfer are the single USB transfers
+        // which the others are made of. Pipe and Transaction are asynchronous operations, timed from when they
+        // are begun until they complete.
+        enum Operation
+        {
+            OperationControlTransfer = 0,
+            OperationBulkTransfer,
+            OperationUpdateWireIns,
+            OperationUpdateWireOuts,
+            OperationUpdateTriggerOuts,
+            OperationWriteToPipeIn,
+            OperationReadFromPipeOut,
+            OperationPipe,
+            OperationTransaction,
+            OperationCheckEnable,
+
+            OperationEnd // don't put anything after this line
+        };
+
     private:
         static const size_t WIREOUTSIZE = 64;
         static const size_t WIREINSIZE = 64;
@@ -378,16 +465,49 @@ class OpenOK
 
         double m_crystalReference;
 
+        struct PipeOperation;
+
+        std::deque<PipeOperation *> m_pipeOperations; // the first is in progress, the rest wait for it
+
+        int m_pipeTransfersInFlight;
+
+        bool m_asynchronousTransfers;
+
+        bool m_wireInsChanged; // since the last UpdateWireIns()
+
+        pthread_mutex_t m_wireMutex; // Wire In and Wire Out values and m_wireInsChanged
+
+        struct Transaction;
+
         struct bitstream {
                 std::string designName ;
                 std::string partName ;
                 std::string date ;
                 std::string time ;
                 unsigned int dataLen ; // Length of Bitstream Data
-                unsigned char dummyLen;
+                unsigned int dummyLen;
                 bool addPadWord;
         } m_bitStream;
 
+        struct ConfigurationStream;
+
+        int m_designHashWireIn; // first of the two Wire Ins holding the hash of the loaded bitfile, -1 if not used
+        int m_designHashWireOut; // and the Wire Outs they are echoed to
+
+        int m_cachedDevices; // number of devices found by the last Get_OK_Devices() that were not read
+
+        volatile bool m_timing; // statistics are enabled or a trace stream is set
+
+        bool m_statisticsEnabled;
+
+        std::ostream *m_traceStream;
+
+        pthread_mutex_t m_statisticsMutex; // statistics and trace stream
+
+        OpenOK_OperationStatistics m_statistics[ OperationEnd ];
+
+        friend class OpenOK_DeviceManager;
+
     public:
         // Not Official
 
@@ -419,6 +539,44 @@ class OpenOK
 
         void Close( bool force = false );
 
+        ErrorCode BeginWriteToPipeIn( int epAddr, long length, unsigned char *data,
+                                      OpenOK_PipeCallback callback, void *userData );
+
+        ErrorCode BeginReadFromPipeOut( int epAddr, long length, unsigned char *data,
+                                        OpenOK_PipeCallback callback, void *userData );
+
+        ErrorCode HandleEvents( int timeout );
+
+        ErrorCode WaitForPipeTransfers();
+
+        void CancelPipeTransfers();
+
+        int GetPendingPipeTransfers();
+
+        void SetPipeTransfersInFlight( int n );
+
+        ErrorCode BeginTransaction( int flags, OpenOK_TransactionCallback callback, void *userData );
+
+        ErrorCode RunTransaction( int flags );
+
+        ErrorCode SetDesignHashEndpoints( int wireInAddr, int wireOutAddr );
+
+        bool IsDesignLoaded( const std::string strFilename );
+
+        void EnableStatistics( bool enable );
+
+        bool IsStatisticsEnabled();
+
+        void ResetStatistics();
+
+        OpenOK_OperationStatistics GetStatistics( Operation op );
+
+        std::string GetStatisticsReport();
+
+        void SetTraceStream( std::ostream *stream );
+
+        static std::string GetOperationName( Operation op );
+
         // Official
 
         ErrorCode OpenBySerial( std::string str = "" );
@@ -510,17 +668,24 @@ class OpenOK
     private:
         // Not Official
 
-        int SendDataBitFile( unsigned char endp, unsigned char *bytes, unsigned int size, unsigned int timeout );
+        ErrorCode ParseBitstream( const unsigned char *data, unsigned long length, unsigned long &syncOffset );
+
+        ErrorCode SendBitstreamToFPGA( const unsigned char *data, unsigned long length );
 
-        ErrorCode SendPaddedFileToFPGA( unsigned char* buffer, const unsigned int size );
+        void SubmitConfigurationChunk( ConfigurationStream *cs, struct libusb_transfer *transfer );
 
-        // As the method is private, has no problem declaring without setting here
-        template<class iterator>
-        ErrorCode SendFileToFPGA(iterator it, iterator end);
+        static void LIBUSB_CALL ConfigurationTransferCallback( struct libusb_transfer *transfer );
+
+        static unsigned long BitstreamHash( const unsigned char *data, unsigned long length );
+
+        ErrorCode RecordDesignHash( unsigned long hash );
 
         int GetLanguageID( libusb_device_handle *OpenOK_dev_handle );
 
-        ErrorCode Get_OK_Devices( bool countEnable, int &countDevices );
+        ErrorCode Get_OK_Devices( bool countEnable, int &countDevices, bool useCache = true );
+
+        ErrorCode ReadDeviceInfo( libusb_device *device, const libusb_device_descriptor &descriptorDevice,
+                                  OpenOK_device &info );
 
         ErrorCode OpenByDeviceIndexList( unsigned int indexDeviceList );
 
@@ -581,6 +746,29 @@ class OpenOK
         inline long ReadWritePipe( int32_t epAddr, int32_t endpointDir, int32_t endpointLower, int32_t endpointUpper,
                                    int32_t magicNumber1, int32_t magicNumber2, int64_t length, uint8_t *data );
 
+        ErrorCode BeginPipeOperation( int32_t epAddr, int32_t endpointDir, int32_t endpointLower, int32_t endpointUpper,
+                                      int32_t magicNumber1, int32_t magicNumber2, long length, unsigned char *data,
+                                      OpenOK_PipeCallback callback, void *userData );
+
+        long BlockingPipeOperation( int32_t epAddr, int32_t endpointDir, int32_t endpointLower, int32_t endpointUpper,
+                                    int32_t magicNumber1, int32_t magicNumber2, long length, unsigned char *data );
+
+        void StartPipePhase( PipeOperation *op );
+
+        void SubmitPipeChunks( PipeOperation *op );
+
+        void FailPipeOperation( PipeOperation *op, long error );
+
+        void CompletePipeOperation( PipeOperation *op );
+
+        static void LIBUSB_CALL PipeTransferCallback( struct libusb_transfer *transfer );
+
+        static void LIBUSB_CALL TransactionCallback( struct libusb_transfer *transfer );
+
+        inline bool StartTiming( struct timespec &start );
+
+        void RecordOperation( Operation op, const struct timespec &start, long long bytes, bool ok );
+
         inline int ControlTransfer( libusb_device_handle *dev_handle,
                                     uint8_t request_type, uint8_t bRequest, uint16_t wValue, uint16_t wIndex,
                                     unsigned char *data, uint16_t wLength, unsigned int timeout );
@@ -598,3 +786,105 @@ class OpenOK
                                          int *actual_length, unsigned int timeout );
 };
 //---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+The Opal Kelly devices attached, shared by all the OpenOK instances in a process.
+
+Get_OK_Devices() reads the device ID, strings and descriptors of a device only the first time it sees it, so
+reopening a device, or opening several, does not open every device on the bus each time. Devices are
+identified by their bus number and address, which change when a device is plugged in again.
+
+With hotplug events running, a thread keeps the cache up to date as devices come and go, and tells the
+registered callbacks, so that a program can reopen a device as soon as it is back.
+*/
+
+class OpenOK_DeviceManager
+{
+    public:
+        static OpenOK_DeviceManager &Instance();
+
+        bool StartHotplug();
+
+        void StopHotplug();
+
+        bool IsHotplugRunning();
+
+        int AddHotplugCallback( OpenOK_HotplugCallback callback, void *userData );
+
+        void RemoveHotplugCallback( int id );
+
+        std::vector< std::string > GetSerials();
+
+        bool IsAttached( const std::string serial );
+
+        void Clear();
+
+    private:
+        struct Listener
+        {
+            int id;
+            OpenOK_HotplugCallback callback;
+            void *userData;
+        };
+
+        struct HotplugEvent
+        {
+            libusb_device *device;
+            int event;
+        };
+
+        pthread_mutex_t m_mutex; // cache, listeners and queued events
+
+        std::map< int, OpenOK_device > m_cache; // by DeviceKey()
+
+        std::vector< Listener > m_listeners;
+
+        int m_nextListenerID;
+
+        pthread_mutex_t m_enumerationMutex;
+
+        OpenOK *m_enumeration; // for GetSerials()
+
+        OpenOK *m_hotplug; // owned by the hotplug thread while it runs
+
+        pthread_t m_hotplugThread;
+
+        bool m_hotplugRunning;
+
+        volatile bool m_stopHotplug;
+
+        std::deque< HotplugEvent > m_hotplugEvents;
+
+        OpenOK_DeviceManager();
+
+        ~OpenOK_DeviceManager();
+
+        // Not implemented
+        OpenOK_DeviceManager( const OpenOK_DeviceManager & );
+
+        OpenOK_DeviceManager &operator=( const OpenOK_DeviceManager & );
+
+        friend class OpenOK;
+
+        static int DeviceKey( libusb_device *device );
+
+        bool Lookup( int key, OpenOK_device &info );
+
+        void Store( int key, const OpenOK_device &info );
+
+        void Retain( const std::vector< int > &keys );
+
+        void Notify( const std::string serial, bool arrived );
+
+        void HandleHotplugEvents();
+
+        static void *HotplugThread( void *arg );
+
+#ifdef OPENOK_HOTPLUG
+        libusb_hotplug_callback_handle m_hotplugHandle;
+
+        static int LIBUSB_CALL HotplugCallback( libusb_context *ctx, libusb_device *device,
+                                                libusb_hotplug_event event, void *userData );
+#endif
+};
+//---------------------------------------------------------------------------------------------------------------------------------
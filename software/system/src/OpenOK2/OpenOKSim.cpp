@@ -0,0 +1,1564 @@
+/*
+ * OpenOKSim.cpp
+ *
+ * Created on: Dec 22, 2017
+ * Author : Michael J. Wouters
+ *
+ * Simulated Opal Kelly device for OpenOK
+ *
+ * Copyright (c) 2017 Michael J. Wouters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "OpenOKSim.h"
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#define simWireSize 64
+#define simFIFOSize 32768 // bytes
+#define simFIFORecordSize 16
+#define simFIFOClock 200000000LL // ticks per second of the event times
+#define simStatusAddr 0x2c
+#define simFIFOCountAddr 0x2d
+#define simFIFOTimeAddr 0x2e
+#define simDesignHashWireIn 0x1e
+#define simDesignHashWireOut 0x3e
+#define simFIFOPipeAddr 0xa0
+#define simMaxPacketSize 512
+
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+The simulated board, FPGA included.
+*/
+
+struct SimBoard
+{
+    int index;
+    std::string serial;
+
+    bool attached;
+    uint8_t address; // changes each time the board is plugged in
+
+    unsigned char deviceID[ 32 ];
+    unsigned char eepromPLL[ 32 ];
+    unsigned char registersPLL[ 32 ];
+
+    // FPGA
+    bool configured;
+    bool configuring;
+    bool syncWordFound;
+    unsigned int syncWordMatched;
+
+    unsigned char wireIns[ simWireSize ];
+    unsigned char wireOuts[ simWireSize ];
+    unsigned char triggerOuts[ simWireSize ];
+
+    int pipeAddr;
+    unsigned long pipeOutCount;
+
+    std::deque< unsigned char > FIFO;
+
+    long long nextEvent; // index of the next event to be generated, -1 until the FPGA is configured
+};
+
+struct SimHotplugCallback
+{
+    libusb_hotplug_callback_handle handle;
+    int events;
+    libusb_hotplug_callback_fn callback;
+    void *userData;
+};
+
+struct SimHotplugEvent
+{
+    libusb_device *device;
+    libusb_hotplug_event event;
+};
+
+/*
+The opaque libusb types. Each context has its own libusb_device for a board, as libusb does, so that
+the transfers and hotplug events of a context are handled only by that context.
+*/
+
+struct libusb_context
+{
+    int debugLevel;
+
+    std::vector< libusb_device* > devices; // indexed by board
+
+    std::vector< SimHotplugCallback > hotplugCallbacks;
+    std::deque< SimHotplugEvent > hotplugEvents;
+    libusb_hotplug_callback_handle nextHotplugHandle;
+};
+
+struct libusb_device
+{
+    SimBoard *board;
+    libusb_context *ctx;
+};
+
+struct libusb_device_handle
+{
+    libusb_device *device;
+    int configuration;
+};
+
+namespace {
+
+struct SimConfiguration
+{
+    unsigned int latency; // microseconds
+    double bulkRate; // bytes/s, 0 is unlimited
+    double eventRate;
+    unsigned int channelMask;
+    int numDevices;
+};
+
+struct SimTransfer
+{
+    libusb_transfer *transfer;
+    libusb_context *ctx;
+    double completion;
+    bool cancelled;
+};
+
+pthread_mutex_t simMutex = PTHREAD_MUTEX_INITIALIZER;
+
+bool simInitialized = false;
+
+SimConfiguration simConfig;
+
+std::vector< SimBoard* > simBoards;
+
+std::vector< libusb_context* > simContexts;
+
+uint8_t simNextAddress = 2;
+
+std::deque< SimTransfer > simPending;
+
+double simBusIdle = 0.0;
+
+OpenOKSim::Statistics simStats;
+
+const unsigned char simSyncWord[ 4 ] = { 0xaa, 0x99, 0x55, 0x66 };
+
+const char *simManufacturer = "Opal Kelly";
+
+const char *simProduct = "Opal Kelly XEM6001";
+
+//---------------------------------------------------------------------------------------------------------------------------------
+
+double MonotonicTime()
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ts.tv_sec + ts.tv_nsec * 1.0E-9;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+double SystemTime()
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_REALTIME, &ts );
+
+    return ts.tv_sec + ts.tv_nsec * 1.0E-9;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+The FPGA's time, in ticks of simFIFOClock since the Unix epoch, now and at an event.
+These are kept in integers, since a double can't resolve a tick.
+*/
+
+long long SystemTicks()
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_REALTIME, &ts );
+
+    return ts.tv_sec * simFIFOClock + ts.tv_nsec / ( 1000000000LL / simFIFOClock );
+}
+
+long long EventTicks( long long event )
+{
+    const double secs = floor( event / simConfig.eventRate );
+
+    return static_cast< long long >( secs ) * simFIFOClock +
+           llround( ( event - secs * simConfig.eventRate ) / simConfig.eventRate * simFIFOClock );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void SleepUntil( double t )
+{
+    if ( t <= 0.0 ) {
+        return;
+    }
+
+    // The last part of the wait is spun, since sleeps overshoot by tens of microseconds
+    const double spin = 100.0E-6;
+
+    if ( t - MonotonicTime() > 2 * spin ) {
+        struct timespec ts;
+
+        ts.tv_sec = static_cast< time_t >( t - spin );
+        ts.tv_nsec = static_cast< long >( ( t - spin - ts.tv_sec ) * 1.0E9 );
+
+        while ( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL ) == EINTR ) {
+        }
+    }
+
+    while ( MonotonicTime() < t ) {
+        sched_yield();
+    }
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void SetWord( unsigned char *wires, int addr, unsigned int val )
+{
+    wires[ 2 * addr ] = val & 0xff;
+    wires[ 2 * addr + 1 ] = ( val >> 8 ) & 0xff;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void ResetFPGA( SimBoard *dev )
+{
+    memset( dev->wireIns, 0, simWireSize );
+    memset( dev->wireOuts, 0, simWireSize );
+    memset( dev->triggerOuts, 0, simWireSize );
+
+    dev->FIFO.clear();
+    dev->pipeAddr = 0;
+    dev->pipeOutCount = 0;
+    dev->nextEvent = -1;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Brings the counter up to the present, generating all the events due since the last call.
+The simulator lock must be held.
+*/
+
+void UpdateCounter( SimBoard *dev )
+{
+    if ( !dev->configured ) {
+        return;
+    }
+
+    if ( simConfig.eventRate > 0.0 ) {
+        const long long lastEvent = static_cast< long long >( floor( SystemTime() * simConfig.eventRate ) );
+
+        if ( dev->nextEvent < 0 ) {
+            dev->nextEvent = lastEvent + 1; // no events before the FPGA was configured
+        }
+
+        // Events that would have overflowed the FIFO anyway are skipped, leaving a gap in the event counts
+        const long long maxEvents = simFIFOSize / simFIFORecordSize;
+
+        if ( lastEvent - dev->nextEvent >= maxEvents ) {
+            int channels = 0;
+
+            for ( int c = 0; c < OPENOK_SIM_CHANNELS_MAX; ++c ) {
+                channels += ( simConfig.channelMask >> c ) & 1;
+            }
+
+            simStats.FIFOOverflows += ( lastEvent - maxEvents + 1 - dev->nextEvent ) * channels;
+
+            dev->nextEvent = lastEvent - maxEvents + 1;
+        }
+
+        for ( ; dev->nextEvent <= lastEvent; ++dev->nextEvent ) {
+            for ( int c = 0; c < OPENOK_SIM_CHANNELS_MAX; ++c ) {
+                if ( !( simConfig.channelMask & ( 1 << c ) ) ) {
+                    continue;
+                }
+
+                const unsigned int counts = OpenOKSim::CountsForEvent( c + 1, dev->nextEvent );
+
+                SetWord( dev->wireOuts, 2 * c, counts & 0xffff );
+                SetWord( dev->wireOuts, 2 * c + 1, ( counts >> 16 ) & 0xffff );
+                dev->triggerOuts[ 0 ] |= 1 << c;
+
+                if ( dev->FIFO.size() + simFIFORecordSize <= simFIFOSize ) {
+                    const unsigned long long ticks = EventTicks( dev->nextEvent );
+                    const unsigned int record[ 8 ] = { 0xa000u | ( c + 1 ),
+                                                       static_cast< unsigned int >( dev->nextEvent & 0xffff ),
+                                                       counts & 0xffff,
+                                                       ( counts >> 16 ) & 0xffff,
+                                                       static_cast< unsigned int >( ticks & 0xffff ),
+                                                       static_cast< unsigned int >( ( ticks >> 16 ) & 0xffff ),
+                                                       static_cast< unsigned int >( ( ticks >> 32 ) & 0xffff ),
+                                                       static_cast< unsigned int >( ( ticks >> 48 ) & 0xffff ) };
+
+                    for ( int w = 0; w < 8; ++w ) {
+                        dev->FIFO.push_back( record[ w ] & 0xff );
+                        dev->FIFO.push_back( ( record[ w ] >> 8 ) & 0xff );
+                    }
+                } else {
+                    ++simStats.FIFOOverflows;
+                }
+                ++simStats.events;
+            }
+        }
+    }
+
+    // bits 2->0: pps out source, bit 3: GPIO enabled, bit 4: DCM locked
+    SetWord( dev->wireOuts, simStatusAddr - 0x20, ( dev->wireIns[ 0 ] & 0x0f ) | 0x10 );
+
+    SetWord( dev->wireOuts, simFIFOCountAddr - 0x20, dev->FIFO.size() >> 1 );
+
+    const unsigned long long ticks = SystemTicks();
+
+    for ( int w = 0; w < 4; ++w ) {
+        SetWord( dev->wireOuts, simFIFOTimeAddr - 0x20 + w, ( ticks >> ( 16 * w ) ) & 0xffff );
+    }
+
+    // The design hash Wire Ins are echoed
+    memcpy( dev->wireOuts + 2 * ( simDesignHashWireOut - 0x20 ), dev->wireIns + 2 * simDesignHashWireIn, 4 );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Feeds configuration data to the FPGA, which is configured if the Xilinx sync word turns up.
+The padding added by OpenOK to each byte is skipped.
+*/
+
+void ConfigurationData( SimBoard *dev, const unsigned char *data, int length )
+{
+    for ( int i = 0; i < length && !dev->syncWordFound; ++i ) {
+        if ( data[ i ] == simSyncWord[ dev->syncWordMatched ] ) {
+            dev->syncWordFound = ( ++dev->syncWordMatched == sizeof( simSyncWord ) );
+        } else if ( data[ i ] != 0x00 ) {
+            dev->syncWordMatched = ( data[ i ] == simSyncWord[ 0 ] ) ? 1 : 0;
+        }
+    }
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+int StringDescriptor( SimBoard *dev, int index, unsigned char *data, int length )
+{
+    std::string str;
+
+    unsigned char descriptor[ 255 ];
+
+    descriptor[ 1 ] = 0x03; // LIBUSB_DT_STRING
+
+    if ( index == 0 ) { // supported languages
+        descriptor[ 0 ] = 4;
+        descriptor[ 2 ] = 0x09;
+        descriptor[ 3 ] = 0x04;
+    } else {
+        if ( index == 1 ) {
+            str = simManufacturer;
+        } else if ( index == 2 ) {
+            str = simProduct;
+        } else if ( index == 3 ) {
+            str = dev->serial;
+        } else {
+            return LIBUSB_ERROR_PIPE;
+        }
+
+        descriptor[ 0 ] = 2 + 2 * str.size();
+
+        for ( unsigned int i = 0; i < str.size(); ++i ) {
+            descriptor[ 2 + 2 * i ] = str[ i ];
+            descriptor[ 3 + 2 * i ] = 0;
+        }
+    }
+
+    const int n = ( descriptor[ 0 ] < length ) ? descriptor[ 0 ] : length;
+
+    memcpy( data, descriptor, n );
+
+    return n;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+int CopyOut( unsigned char *data, int wLength, const unsigned char *src, int size )
+{
+    const int n = ( size < wLength ) ? size : wLength;
+
+    memcpy( data, src, n );
+
+    return n;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Handles a request on the control endpoint.
+The simulator lock must be held.
+
+Returns:
+The number of data bytes transferred, LIBUSB_ERROR_PIPE if the request is not supported or
+LIBUSB_ERROR_NO_DEVICE if the board has been unplugged.
+*/
+
+int ControlRequest( SimBoard *dev, uint8_t requestType, uint8_t bRequest, uint16_t wValue, uint16_t /*wIndex*/,
+                    unsigned char *data, uint16_t wLength )
+{
+    if ( !dev->attached ) {
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+
+    ++simStats.controlTransfers;
+
+    if ( requestType & 0x80 ) {
+        simStats.bytesIn += wLength;
+    } else {
+        simStats.bytesOut += wLength;
+    }
+
+    // GET_DESCRIPTOR
+    if ( ( requestType == 0x80 ) && ( bRequest == 0x06 ) ) {
+        if ( ( wValue >> 8 ) == 0x03 ) {
+            return StringDescriptor( dev, wValue & 0xff, data, wLength );
+        }
+        return LIBUSB_ERROR_PIPE;
+    }
+
+    if ( requestType == 0x40 ) {
+        switch ( bRequest ) {
+            case 0xb0 :
+                if ( wValue == 0x1fd0 ) {
+                    memcpy( dev->deviceID, data, ( wLength < 32 ) ? wLength : 32 );
+                } else if ( wValue == 0x1ff0 ) {
+                    memcpy( dev->eepromPLL, data, ( wLength < 32 ) ? wLength : 32 );
+                } else {
+                    return LIBUSB_ERROR_PIPE;
+                }
+                return wLength;
+
+            case 0xb1 :
+                memcpy( dev->registersPLL, data, ( wLength < 32 ) ? wLength : 32 );
+                return wLength;
+
+            case 0xb2 : // start configuration
+                dev->configured = false;
+                dev->configuring = true;
+                dev->syncWordFound = false;
+                dev->syncWordMatched = 0;
+                ResetFPGA( dev );
+                return wLength;
+
+            case 0xb3 : // reset the FPGA design
+                ResetFPGA( dev );
+                return wLength;
+
+            case 0xb5 :
+                if ( wValue == 0x0000 ) {
+                    memcpy( dev->wireIns, data, ( wLength < simWireSize ) ? wLength : simWireSize );
+                    UpdateCounter( dev );
+                    return wLength;
+                } else if ( wValue == 0x0001 ) { // trigger in - the counter has none
+                    return wLength;
+                }
+                return LIBUSB_ERROR_PIPE;
+
+            case 0xb7 : // pipe setup
+                if ( wLength < 2 ) {
+                    return LIBUSB_ERROR_PIPE;
+                }
+                dev->pipeAddr = data[ 0 ];
+                return wLength;
+
+            default :
+                return LIBUSB_ERROR_PIPE;
+        }
+    }
+
+    if ( requestType == 0xc0 ) {
+        switch ( bRequest ) {
+            case 0xb0 :
+                if ( wValue == 0x1fd0 ) {
+                    return CopyOut( data, wLength, dev->deviceID, 32 );
+                } else if ( wValue == 0x1ff0 ) {
+                    return CopyOut( data, wLength, dev->eepromPLL, 32 );
+                }
+                return LIBUSB_ERROR_PIPE;
+
+            case 0xb1 :
+                return CopyOut( data, wLength, dev->registersPLL, 32 );
+
+            case 0xb2 : // configuration status
+                if ( wLength < 1 ) {
+                    return LIBUSB_ERROR_PIPE;
+                }
+                if ( dev->configuring ) {
+                    dev->configuring = false;
+                    dev->configured = dev->syncWordFound;
+                    data[ 0 ] = dev->configured ? 0x01 : 0x02;
+                } else {
+                    data[ 0 ] = dev->configured ? 0x01 : 0x00;
+                }
+                return 1;
+
+            case 0xb3 : { // FrontPanel enabled
+                const unsigned char enabled[ 2 ] = { 0xd7, 0xa5 };
+                const unsigned char disabled[ 2 ] = { 0x00, 0x00 };
+
+                return CopyOut( data, wLength, dev->configured ? enabled : disabled, 2 );
+            }
+
+            case 0xb8 :
+            case 0xb9 : {
+                const unsigned char response = ( bRequest == 0xb9 ) ? 0x80 : 0x00;
+
+                return CopyOut( data, wLength, &response, 1 );
+            }
+
+            case 0xb5 :
+                UpdateCounter( dev );
+
+                if ( wValue == 0x0020 ) {
+                    return CopyOut( data, wLength, dev->wireOuts, simWireSize );
+                } else if ( wValue == 0x0060 ) {
+                    // trigger outs are cleared when they are read
+                    const int n = CopyOut( data, wLength, dev->triggerOuts, simWireSize );
+
+                    memset( dev->triggerOuts, 0, simWireSize );
+
+                    return n;
+                }
+                return LIBUSB_ERROR_PIPE;
+
+            default :
+                return LIBUSB_ERROR_PIPE;
+        }
+    }
+    return LIBUSB_ERROR_PIPE;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Handles a bulk transfer. Endpoint 0x02 carries configuration data or pipe in data,
+endpoint 0x86 pipe out data, read from the FIFO for pipe 0xa0 and a counting pattern otherwise.
+The simulator lock must be held.
+*/
+
+int BulkRequest( SimBoard *dev, unsigned char endpoint, unsigned char *data, int length, int *transferred )
+{
+    *transferred = 0;
+
+    if ( !dev->attached ) {
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+
+    if ( endpoint == 0x02 ) {
+        if ( dev->configuring ) {
+            ConfigurationData( dev, data, length );
+        }
+        simStats.bytesOut += length;
+    } else if ( endpoint == 0x86 ) {
+        if ( dev->pipeAddr == simFIFOPipeAddr ) {
+            UpdateCounter( dev );
+
+            // an empty FIFO reads as zeros
+            int n = 0;
+
+            for ( ; n < length && !dev->FIFO.empty(); ++n ) {
+                data[ n ] = dev->FIFO.front();
+                dev->FIFO.pop_front();
+            }
+
+            memset( data + n, 0, length - n );
+        } else {
+            for ( int n = 0; n + 1 < length; n += 2 ) {
+                SetWord( data + n, 0, dev->pipeOutCount++ & 0xffff );
+            }
+        }
+        simStats.bytesIn += length;
+    } else {
+        return LIBUSB_ERROR_PIPE;
+    }
+
+    ++simStats.bulkTransfers;
+
+    *transferred = length;
+
+    return LIBUSB_SUCCESS;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Schedules a transfer of the given number of bytes. Transfers queued together wait out their latencies
+at the same time, but the data moves one transfer at a time.
+The simulator lock must be held.
+
+Returns:
+The time (CLOCK_MONOTONIC) at which the transfer completes, or 0 if it completes at once.
+*/
+
+double ScheduleTransfer( int bytes )
+{
+    if ( ( simConfig.latency == 0 ) && ( simConfig.bulkRate <= 0.0 ) ) {
+        return 0.0;
+    }
+
+    const double ready = MonotonicTime() + simConfig.latency * 1.0E-6;
+
+    const double start = ( simBusIdle > ready ) ? simBusIdle : ready;
+
+    simBusIdle = start + ( ( simConfig.bulkRate > 0.0 ) ? bytes / simConfig.bulkRate : 0.0 );
+
+    return simBusIdle;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+int Environment( const char *name, double &value )
+{
+    const char *str = getenv( name );
+
+    if ( ( str == NULL ) || ( *str == '\0' ) ) {
+        return 0;
+    }
+
+    char *end;
+
+    value = strtod( str, &end );
+
+    if ( *end != '\0' ) {
+        fprintf( stderr, "OpenOKSim: ignoring invalid value for %s\n", name );
+        return 0;
+    }
+    return 1;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Sets up the simulator on first use.
+The simulator lock must be held.
+*/
+
+void Initialize()
+{
+    if ( simInitialized ) {
+        return;
+    }
+
+    simInitialized = true;
+
+    simConfig.latency = 0;
+    simConfig.bulkRate = 0.0;
+    simConfig.eventRate = 1.0;
+    simConfig.channelMask = 0x3f;
+    simConfig.numDevices = 1;
+
+    double val;
+
+    if ( Environment( "OPENOK_SIM_LATENCY_US", val ) && val >= 0.0 ) {
+        simConfig.latency = static_cast< unsigned int >( val );
+    }
+
+    if ( Environment( "OPENOK_SIM_BULK_MBPS", val ) && val >= 0.0 ) {
+        simConfig.bulkRate = val * 1.0E6;
+    }
+
+    if ( Environment( "OPENOK_SIM_EVENT_RATE", val ) && val >= 0.0 ) {
+        simConfig.eventRate = val;
+    }
+
+    const char *str = getenv( "OPENOK_SIM_CHANNELS" );
+
+    if ( ( str != NULL ) && ( *str != '\0' ) ) {
+        simConfig.channelMask = strtoul( str, NULL, 0 ) & ( ( 1 << OPENOK_SIM_CHANNELS_MAX ) - 1 );
+    }
+
+    if ( Environment( "OPENOK_SIM_DEVICES", val ) && val >= 0.0 ) {
+        simConfig.numDevices = static_cast< int >( val );
+    }
+
+    memset( &simStats, 0, sizeof( simStats ) );
+
+    for ( int i = 0; i < simConfig.numDevices; ++i ) {
+        SimBoard *dev = new SimBoard;
+
+        char serial[ 16 ];
+
+        snprintf( serial, sizeof( serial ), "SIM%07d", i + 1 );
+
+        dev->index = i;
+        dev->serial = serial;
+        dev->attached = true;
+        dev->address = simNextAddress++;
+
+        memset( dev->deviceID, 0, sizeof( dev->deviceID ) );
+        strncpy( reinterpret_cast< char* >( dev->deviceID ), "Counter simulator", sizeof( dev->deviceID ) - 1 );
+
+        memset( dev->eepromPLL, 0, sizeof( dev->eepromPLL ) );
+        memset( dev->registersPLL, 0, sizeof( dev->registersPLL ) );
+
+        // The FPGA starts out configured with the counter, as if it had been loaded by okbfloader
+        dev->configured = true;
+        dev->configuring = false;
+        dev->syncWordFound = false;
+        dev->syncWordMatched = 0;
+
+        ResetFPGA( dev );
+
+        simBoards.push_back( dev );
+    }
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+class SimLock
+{
+    public:
+        SimLock() { pthread_mutex_lock( &simMutex ); Initialize(); }
+        ~SimLock() { pthread_mutex_unlock( &simMutex ); }
+};
+
+/*
+The context's libusb_device for a board.
+The simulator lock must be held.
+*/
+
+libusb_device *ContextDevice( libusb_context *ctx, SimBoard *board )
+{
+    libusb_device *&dev = ctx->devices[ board->index ];
+
+    if ( dev == NULL ) {
+        dev = new libusb_device;
+
+        dev->board = board;
+        dev->ctx = ctx;
+    }
+    return dev;
+}
+
+} // namespace
+
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void OpenOKSim::SetTransferLatency( unsigned int microseconds )
+{
+    SimLock lock;
+
+    simConfig.latency = microseconds;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void OpenOKSim::SetBulkRate( double MBps )
+{
+    SimLock lock;
+
+    simConfig.bulkRate = ( MBps > 0.0 ) ? MBps * 1.0E6 : 0.0;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void OpenOKSim::SetEventRate( double eventsPerSecond )
+{
+    SimLock lock;
+
+    simConfig.eventRate = ( eventsPerSecond > 0.0 ) ? eventsPerSecond : 0.0;
+
+    for ( unsigned int i = 0; i < simBoards.size(); ++i ) {
+        simBoards[ i ]->nextEvent = -1;
+    }
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void OpenOKSim::SetChannelMask( unsigned int mask )
+{
+    SimLock lock;
+
+    simConfig.channelMask = mask & ( ( 1 << OPENOK_SIM_CHANNELS_MAX ) - 1 );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void OpenOKSim::GetStatistics( Statistics &stats )
+{
+    SimLock lock;
+
+    stats = simStats;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void OpenOKSim::ResetStatistics()
+{
+    SimLock lock;
+
+    memset( &simStats, 0, sizeof( simStats ) );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+The reading for a channel (1 to OPENOK_SIM_CHANNELS_MAX) and event, in 1.25 ns counts.
+Each channel has its own offset, with a ramp so that lost or repeated readings can be spotted.
+*/
+
+int OpenOKSim::CountsForEvent( int channel, long long event )
+{
+    return OPENOK_SIM_EVENT_MODULUS * channel + static_cast< int >( event % OPENOK_SIM_EVENT_MODULUS );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Unplugs or plugs in a device (0 to the number of devices - 1). An unplugged device disappears from the device list
+and its transfers fail with LIBUSB_ERROR_NO_DEVICE. When it is plugged in again, it gets a new address and its
+FPGA is unconfigured. Contexts with hotplug callbacks registered get the events in libusb_handle_events().
+*/
+
+void OpenOKSim::SetAttached( int device, bool attached )
+{
+    SimLock lock;
+
+    if ( ( device < 0 ) || ( device >= static_cast< int >( simBoards.size() ) ) ) {
+        return;
+    }
+
+    SimBoard *board = simBoards[ device ];
+
+    if ( board->attached == attached ) {
+        return;
+    }
+
+    board->attached = attached;
+
+    if ( attached ) {
+        board->address = simNextAddress;
+        simNextAddress = ( simNextAddress == 127 ) ? 2 : simNextAddress + 1;
+
+        board->configured = false;
+        board->configuring = false;
+        ResetFPGA( board );
+    }
+
+    for ( unsigned int i = 0; i < simContexts.size(); ++i ) {
+        if ( simContexts[ i ]->hotplugCallbacks.empty() ) {
+            continue;
+        }
+
+        SimHotplugEvent event;
+
+        event.device = ContextDevice( simContexts[ i ], board );
+        event.event = attached ? LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED : LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT;
+
+        simContexts[ i ]->hotplugEvents.push_back( event );
+    }
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+The libusb-1.0 API
+*/
+
+int LIBUSB_CALL libusb_init( libusb_context **ctx )
+{
+    SimLock lock;
+
+    if ( ctx == NULL ) {
+        return LIBUSB_ERROR_NOT_SUPPORTED; // there is no default context
+    }
+
+    libusb_context *context = new libusb_context;
+
+    context->debugLevel = 0;
+    context->devices.assign( simBoards.size(), NULL );
+    context->nextHotplugHandle = 1;
+
+    simContexts.push_back( context );
+
+    *ctx = context;
+
+    return LIBUSB_SUCCESS;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void LIBUSB_CALL libusb_exit( libusb_context *ctx )
+{
+    if ( ctx == NULL ) {
+        return;
+    }
+
+    SimLock lock;
+
+    for ( unsigned int i = 0; i < simContexts.size(); ++i ) {
+        if ( simContexts[ i ] == ctx ) {
+            simContexts.erase( simContexts.begin() + i );
+            break;
+        }
+    }
+
+    for ( unsigned int i = 0; i < ctx->devices.size(); ++i ) {
+        delete ctx->devices[ i ];
+    }
+
+    delete ctx;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void LIBUSB_CALL libusb_set_debug( libusb_context *ctx, int level )
+{
+    if ( ctx != NULL ) {
+        ctx->debugLevel = level;
+    }
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+const struct libusb_version* LIBUSB_CALL libusb_get_version( void )
+{
+    static const struct libusb_version version = { 1, 0, 0, 0, "", "OpenOK simulator" };
+
+    return &version;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+ssize_t LIBUSB_CALL libusb_get_device_list( libusb_context *ctx, libusb_device ***list )
+{
+    if ( ( ctx == NULL ) || ( list == NULL ) ) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+
+    SimLock lock;
+
+    libusb_device **devices = new libusb_device*[ simBoards.size() + 1 ];
+
+    int n = 0;
+
+    for ( unsigned int i = 0; i < simBoards.size(); ++i ) {
+        if ( simBoards[ i ]->attached ) {
+            devices[ n++ ] = ContextDevice( ctx, simBoards[ i ] );
+        }
+    }
+
+    devices[ n ] = NULL;
+
+    *list = devices;
+
+    return n;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void LIBUSB_CALL libusb_free_device_list( libusb_device **list, int /*unref_devices*/ )
+{
+    delete [] list;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+A context's devices live until the context is closed, so references are not counted.
+*/
+
+libusb_device* LIBUSB_CALL libusb_ref_device( libusb_device *dev )
+{
+    return dev;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void LIBUSB_CALL libusb_unref_device( libusb_device * /*dev*/ )
+{
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+uint8_t LIBUSB_CALL libusb_get_bus_number( libusb_device * /*dev*/ )
+{
+    return 1;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+uint8_t LIBUSB_CALL libusb_get_device_address( libusb_device *dev )
+{
+    SimLock lock;
+
+    return dev->board->address;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+int LIBUSB_CALL libusb_get_device_descriptor( libusb_device *dev, struct libusb_device_descriptor *desc )
+{
+    if ( ( dev == NULL ) || ( desc == NULL ) ) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+
+    memset( desc, 0, sizeof( *desc ) );
+
+    desc->bLength = 18;
+    desc->bDescriptorType = 0x01;
+    desc->bcdUSB = 0x0200;
+    desc->bDeviceClass = 0xff;
+    desc->bMaxPacketSize0 = 64;
+    desc->idVendor = OPENOK_SIM_VENDOR_ID;
+    desc->idProduct = OPENOK_SIM_PRODUCT_ID;
+    desc->bcdDevice = 0x0104;
+    desc->iManufacturer = 1;
+    desc->iProduct = 2;
+    desc->iSerialNumber = 3;
+    desc->bNumConfigurations = 1;
+
+    return LIBUSB_SUCCESS;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+The configuration descriptor is the same for every device and never changes, so it is static.
+*/
+
+int LIBUSB_CALL libusb_get_config_descriptor( libusb_device *dev, uint8_t config_index, struct libusb_config_descriptor **config )
+{
+    static struct libusb_endpoint_descriptor endpoints[ 2 ];
+    static struct libusb_interface_descriptor altsetting;
+    static struct libusb_interface interface;
+    static struct libusb_config_descriptor descriptor;
+
+    if ( ( dev == NULL ) || ( config == NULL ) ) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+
+    if ( config_index != 0 ) {
+        return LIBUSB_ERROR_NOT_FOUND;
+    }
+
+    SimLock lock;
+
+    if ( descriptor.bLength == 0 ) {
+        const unsigned char addresses[ 2 ] = { 0x02, 0x86 };
+
+        for ( int i = 0; i < 2; ++i ) {
+            endpoints[ i ].bLength = 7;
+            endpoints[ i ].bDescriptorType = 0x05;
+            endpoints[ i ].bEndpointAddress = addresses[ i ];
+            endpoints[ i ].bmAttributes = 0x02; // bulk
+            endpoints[ i ].wMaxPacketSize = simMaxPacketSize;
+        }
+
+        altsetting.bLength = 9;
+        altsetting.bDescriptorType = 0x04;
+        altsetting.bNumEndpoints = 2;
+        altsetting.bInterfaceClass = 0xff;
+        altsetting.endpoint = endpoints;
+
+        interface.altsetting = &altsetting;
+        interface.num_altsetting = 1;
+
+        descriptor.bDescriptorType = 0x02;
+        descriptor.wTotalLength = 9 + 9 + 2 * 7;
+        descriptor.bNumInterfaces = 1;
+        descriptor.bConfigurationValue = 1;
+        descriptor.bmAttributes = 0x80;
+        descriptor.MaxPower = 250;
+        descriptor.interface = &interface;
+        descriptor.bLength = 9;
+    }
+
+    *config = &descriptor;
+
+    return LIBUSB_SUCCESS;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void LIBUSB_CALL libusb_free_config_descriptor( struct libusb_config_descriptor * /*config*/ )
+{
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+int LIBUSB_CALL libusb_open( libusb_device *dev, libusb_device_handle **handle )
+{
+    if ( ( dev == NULL ) || ( handle == NULL ) ) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+
+    SimLock lock;
+
+    if ( !dev->board->attached ) {
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+
+    *handle = new libusb_device_handle;
+
+    ( *handle )->device = dev;
+    ( *handle )->configuration = 1;
+
+    return LIBUSB_SUCCESS;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void LIBUSB_CALL libusb_close( libusb_device_handle *dev_handle )
+{
+    delete dev_handle;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+int LIBUSB_CALL libusb_get_configuration( libusb_device_handle *dev, int *config )
+{
+    *config = dev->configuration;
+
+    return LIBUSB_SUCCESS;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+int LIBUSB_CALL libusb_set_configuration( libusb_device_handle *dev, int configuration )
+{
+    if ( configuration != 1 ) {
+        return LIBUSB_ERROR_NOT_FOUND;
+    }
+
+    dev->configuration = configuration;
+
+    return LIBUSB_SUCCESS;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+int LIBUSB_CALL libusb_claim_interface( libusb_device_handle * /*dev*/, int interface_number )
+{
+    return ( interface_number == 0 ) ? LIBUSB_SUCCESS : LIBUSB_ERROR_NOT_FOUND;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+int LIBUSB_CALL libusb_release_interface( libusb_device_handle * /*dev*/, int interface_number )
+{
+    return ( interface_number == 0 ) ? LIBUSB_SUCCESS : LIBUSB_ERROR_NOT_FOUND;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+int LIBUSB_CALL libusb_kernel_driver_active( libusb_device_handle * /*dev*/, int /*interface_number*/ )
+{
+    return 0;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+int LIBUSB_CALL libusb_detach_kernel_driver( libusb_device_handle * /*dev*/, int /*interface_number*/ )
+{
+    return LIBUSB_ERROR_NOT_FOUND;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+int LIBUSB_CALL libusb_clear_halt( libusb_device_handle * /*dev*/, unsigned char /*endpoint*/ )
+{
+    return LIBUSB_SUCCESS;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+int LIBUSB_CALL libusb_reset_device( libusb_device_handle *dev )
+{
+    SimLock lock;
+
+    dev->device->board->pipeAddr = 0;
+
+    return LIBUSB_SUCCESS;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+int LIBUSB_CALL libusb_control_transfer( libusb_device_handle *dev_handle, uint8_t request_type, uint8_t bRequest,
+                                         uint16_t wValue, uint16_t wIndex, unsigned char *data, uint16_t wLength,
+                                         unsigned int /*timeout*/ )
+{
+    if ( dev_handle == NULL ) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+
+    double completion;
+
+    {
+        SimLock lock;
+
+        completion = ScheduleTransfer( LIBUSB_CONTROL_SETUP_SIZE + wLength );
+    }
+
+    SleepUntil( completion );
+
+    SimLock lock;
+
+    return ControlRequest( dev_handle->device->board, request_type, bRequest, wValue, wIndex, data, wLength );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+int LIBUSB_CALL libusb_bulk_transfer( libusb_device_handle *dev_handle, unsigned char endpoint, unsigned char *data,
+                                      int length, int *actual_length, unsigned int /*timeout*/ )
+{
+    if ( ( dev_handle == NULL ) || ( length < 0 ) ) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+
+    double completion;
+
+    {
+        SimLock lock;
+
+        completion = ScheduleTransfer( length );
+    }
+
+    SleepUntil( completion );
+
+    SimLock lock;
+
+    int transferred = 0;
+
+    const int response = BulkRequest( dev_handle->device->board, endpoint, data, length, &transferred );
+
+    if ( actual_length != NULL ) {
+        *actual_length = transferred;
+    }
+    return response;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+int LIBUSB_CALL libusb_get_string_descriptor_ascii( libusb_device_handle *dev, uint8_t desc_index, unsigned char *data, int length )
+{
+    if ( ( dev == NULL ) || ( data == NULL ) || ( length <= 0 ) ) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+
+    if ( desc_index == 0 ) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+
+    unsigned char descriptor[ 255 ];
+
+    const int response = libusb_control_transfer( dev, 0x80, 0x06, ( 0x03 << 8 ) | desc_index, 0x0409,
+                                                  descriptor, sizeof( descriptor ), 1000 );
+
+    if ( response < 0 ) {
+        return response;
+    }
+
+    int n = 0;
+
+    for ( int i = 2; ( i + 1 < response ) && ( n < length - 1 ); i += 2 ) {
+        data[ n++ ] = ( descriptor[ i + 1 ] == 0 ) ? descriptor[ i ] : '?';
+    }
+
+    data[ n ] = 0;
+
+    return n;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+struct libusb_transfer* LIBUSB_CALL libusb_alloc_transfer( int iso_packets )
+{
+    const size_t size = sizeof( struct libusb_transfer ) + iso_packets * sizeof( struct libusb_iso_packet_descriptor );
+
+    struct libusb_transfer *transfer = static_cast< struct libusb_transfer* >( calloc( 1, size ) );
+
+    if ( transfer != NULL ) {
+        transfer->num_iso_packets = iso_packets;
+    }
+    return transfer;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void LIBUSB_CALL libusb_free_transfer( struct libusb_transfer *transfer )
+{
+    if ( transfer == NULL ) {
+        return;
+    }
+
+    if ( transfer->flags & LIBUSB_TRANSFER_FREE_BUFFER ) {
+        free( transfer->buffer );
+    }
+
+    free( transfer );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+int LIBUSB_CALL libusb_submit_transfer( struct libusb_transfer *transfer )
+{
+    if ( ( transfer == NULL ) || ( transfer->dev_handle == NULL ) ) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+
+    if ( ( transfer->type != LIBUSB_TRANSFER_TYPE_CONTROL ) &&
+         ( transfer->type != LIBUSB_TRANSFER_TYPE_BULK ) ) {
+        return LIBUSB_ERROR_NOT_SUPPORTED;
+    }
+
+    SimLock lock;
+
+    if ( !transfer->dev_handle->device->board->attached ) {
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+
+    for ( unsigned int i = 0; i < simPending.size(); ++i ) {
+        if ( simPending[ i ].transfer == transfer ) {
+            return LIBUSB_ERROR_BUSY;
+        }
+    }
+
+    SimTransfer pending;
+
+    pending.transfer = transfer;
+    pending.ctx = transfer->dev_handle->device->ctx;
+    pending.completion = ScheduleTransfer( transfer->length );
+    pending.cancelled = false;
+
+    simPending.push_back( pending );
+
+    ++simStats.asynchronousTransfers;
+
+    return LIBUSB_SUCCESS;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+int LIBUSB_CALL libusb_cancel_transfer( struct libusb_transfer *transfer )
+{
+    SimLock lock;
+
+    for ( unsigned int i = 0; i < simPending.size(); ++i ) {
+        if ( ( simPending[ i ].transfer == transfer ) && !simPending[ i ].cancelled ) {
+            simPending[ i ].cancelled = true;
+            return LIBUSB_SUCCESS;
+        }
+    }
+    return LIBUSB_ERROR_NOT_FOUND;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Completes the context's asynchronous transfers which are due, in the order in which they were submitted,
+and delivers its hotplug events. Cancelled transfers complete straight away. Callbacks are made without
+the simulator lock, so that they can submit and cancel transfers.
+*/
+
+int LIBUSB_CALL libusb_handle_events_timeout_completed( libusb_context *ctx, struct timeval *tv, int *completed )
+{
+    if ( ctx == NULL ) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+
+    const double timeout = MonotonicTime() + ( ( tv != NULL ) ? tv->tv_sec + tv->tv_usec * 1.0E-6 : 60.0 );
+
+    // hotplug events are looked for at this interval while waiting
+    const double hotplugPoll = 10.0E-3;
+
+    bool handled = false;
+
+    for ( ;; ) {
+        struct libusb_transfer *transfer = NULL;
+
+        SimHotplugEvent event;
+        std::vector< SimHotplugCallback > hotplugCallbacks;
+
+        double next = timeout;
+
+        {
+            SimLock lock;
+
+            if ( !ctx->hotplugEvents.empty() ) {
+                event = ctx->hotplugEvents.front();
+                ctx->hotplugEvents.pop_front();
+
+                for ( unsigned int i = 0; i < ctx->hotplugCallbacks.size(); ++i ) {
+                    if ( ctx->hotplugCallbacks[ i ].events & event.event ) {
+                        hotplugCallbacks.push_back( ctx->hotplugCallbacks[ i ] );
+                    }
+                }
+            } else {
+                std::deque< SimTransfer >::iterator first = simPending.end();
+
+                for ( std::deque< SimTransfer >::iterator it = simPending.begin(); it != simPending.end(); ++it ) {
+                    if ( it->ctx != ctx ) {
+                        continue;
+                    }
+
+                    if ( it->cancelled ) {
+                        transfer = it->transfer;
+                        transfer->status = LIBUSB_TRANSFER_CANCELLED;
+                        transfer->actual_length = 0;
+                        simPending.erase( it );
+                        break;
+                    }
+
+                    if ( first == simPending.end() ) {
+                        first = it;
+                    }
+                }
+
+                if ( ( transfer == NULL ) && ( first != simPending.end() ) ) {
+                    if ( first->completion <= MonotonicTime() ) {
+                        transfer = first->transfer;
+                        simPending.erase( first );
+
+                        SimBoard *dev = transfer->dev_handle->device->board;
+
+                        int response;
+
+                        if ( transfer->type == LIBUSB_TRANSFER_TYPE_CONTROL ) {
+                            const unsigned char *setup = transfer->buffer;
+
+                            response = ControlRequest( dev, setup[ 0 ], setup[ 1 ],
+                                                       setup[ 2 ] | ( setup[ 3 ] << 8 ),
+                                                       setup[ 4 ] | ( setup[ 5 ] << 8 ),
+                                                       transfer->buffer + LIBUSB_CONTROL_SETUP_SIZE,
+                                                       setup[ 6 ] | ( setup[ 7 ] << 8 ) );
+
+                            transfer->actual_length = ( response < 0 ) ? 0 : response;
+                        } else {
+                            response = BulkRequest( dev, transfer->endpoint, transfer->buffer, transfer->length,
+                                                    &transfer->actual_length );
+                        }
+
+                        if ( response == LIBUSB_ERROR_NO_DEVICE ) {
+                            transfer->status = LIBUSB_TRANSFER_NO_DEVICE;
+                        } else {
+                            transfer->status = ( response < 0 ) ? LIBUSB_TRANSFER_STALL : LIBUSB_TRANSFER_COMPLETED;
+                        }
+                    } else if ( first->completion < next ) {
+                        next = first->completion;
+                    }
+                }
+
+                if ( !ctx->hotplugCallbacks.empty() && ( next > MonotonicTime() + hotplugPoll ) ) {
+                    next = MonotonicTime() + hotplugPoll;
+                }
+            }
+        }
+
+        if ( !hotplugCallbacks.empty() ) {
+            for ( unsigned int i = 0; i < hotplugCallbacks.size(); ++i ) {
+                if ( hotplugCallbacks[ i ].callback( ctx, event.device, event.event, hotplugCallbacks[ i ].userData ) ) {
+                    libusb_hotplug_deregister_callback( ctx, hotplugCallbacks[ i ].handle );
+                }
+            }
+            handled = true;
+            continue;
+        }
+
+        if ( transfer != NULL ) {
+            const bool freeTransfer = ( transfer->flags & LIBUSB_TRANSFER_FREE_TRANSFER );
+
+            if ( transfer->callback != NULL ) {
+                transfer->callback( transfer );
+            }
+
+            if ( freeTransfer ) {
+                libusb_free_transfer( transfer );
+            }
+
+            handled = true;
+
+            if ( ( completed != NULL ) && *completed ) {
+                return LIBUSB_SUCCESS;
+            }
+            continue; // everything else that is already due is handled before returning
+        }
+
+        if ( handled || ( MonotonicTime() >= timeout ) ) {
+            return LIBUSB_SUCCESS;
+        }
+
+        SleepUntil( ( next < timeout ) ? next : timeout );
+    }
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+int LIBUSB_CALL libusb_handle_events_timeout( libusb_context *ctx, struct timeval *tv )
+{
+    return libusb_handle_events_timeout_completed( ctx, tv, NULL );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+int LIBUSB_CALL libusb_handle_events( libusb_context *ctx )
+{
+    struct timeval tv = { 60, 0 };
+
+    return libusb_handle_events_timeout_completed( ctx, &tv, NULL );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+int LIBUSB_CALL libusb_has_capability( uint32_t capability )
+{
+    return ( capability == LIBUSB_CAP_HAS_HOTPLUG ) ? 1 : 0;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+With LIBUSB_HOTPLUG_ENUMERATE, the callback is made for each device already attached before returning, as libusb does.
+The vendor, product and class are not checked, since all the simulated devices are the same.
+*/
+
+int LIBUSB_CALL libusb_hotplug_register_callback( libusb_context *ctx, libusb_hotplug_event events, libusb_hotplug_flag flags,
+                                                  int /*vendor_id*/, int /*product_id*/, int /*dev_class*/,
+                                                  libusb_hotplug_callback_fn cb_fn, void *user_data,
+                                                  libusb_hotplug_callback_handle *handle )
+{
+    if ( ( ctx == NULL ) || ( cb_fn == NULL ) ) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+
+    SimHotplugCallback callback;
+
+    std::vector< libusb_device* > attached;
+
+    {
+        SimLock lock;
+
+        callback.handle = ctx->nextHotplugHandle++;
+        callback.events = events;
+        callback.callback = cb_fn;
+        callback.userData = user_data;
+
+        ctx->hotplugCallbacks.push_back( callback );
+
+        if ( ( flags & LIBUSB_HOTPLUG_ENUMERATE ) && ( events & LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED ) ) {
+            for ( unsigned int i = 0; i < simBoards.size(); ++i ) {
+                if ( simBoards[ i ]->attached ) {
+                    attached.push_back( ContextDevice( ctx, simBoards[ i ] ) );
+                }
+            }
+        }
+    }
+
+    if ( handle != NULL ) {
+        *handle = callback.handle;
+    }
+
+    for ( unsigned int i = 0; i < attached.size(); ++i ) {
+        if ( cb_fn( ctx, attached[ i ], LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED, user_data ) ) {
+            libusb_hotplug_deregister_callback( ctx, callback.handle );
+            break;
+        }
+    }
+    return LIBUSB_SUCCESS;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void LIBUSB_CALL libusb_hotplug_deregister_callback( libusb_context *ctx, libusb_hotplug_callback_handle handle )
+{
+    if ( ctx == NULL ) {
+        return;
+    }
+
+    SimLock lock;
+
+    for ( unsigned int i = 0; i < ctx->hotplugCallbacks.size(); ++i ) {
+        if ( ctx->hotplugCallbacks[ i ].handle == handle ) {
+            ctx->hotplugCallbacks.erase( ctx->hotplugCallbacks.begin() + i );
+            break;
+        }
+    }
+
+    // events already queued go nowhere once the last callback has gone
+    if ( ctx->hotplugCallbacks.empty() ) {
+        ctx->hotplugEvents.clear();
+    }
+}
@@ -0,0 +1,108 @@
+/*
+ * OpenOKSim.h
+ *
+ * Created on: Dec 22, 2017
+ * Author : Michael J. Wouters
+ *
+ * Simulated Opal Kelly device for OpenOK
+ *
+ * Copyright (c) 2017 Michael J. Wouters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+OpenOKSim.cpp implements the part of the libusb-1.0 API that OpenOK uses, on top of a simulated XEM6001
+running the counter firmware. Linking OpenOKSim.o instead of -lusb-1.0 swaps the transport, so
+the whole of OpenOK above libusb is exercised unchanged.
+
+The simulated counter generates an event on each enabled channel every 1/rate seconds, aligned to the
+system clock, so a rate of 1 gives a PPS at the start of each second. For each event, the
+reading is latched in the channel's wire outs (0x20 + 2*channel, low word first), the channel's
+bit is set in trigger out 0x60 and a 16 byte record, timestamped in 5 ns ticks, is pushed into the FIFO read
+through pipe out 0xa0, with the number of words in the FIFO at wire out 0x2d and the current time in ticks at wire outs
+0x2e-0x31. Wire out 0x2c is the status register. Wire ins 0x1e and 0x1f
+are echoed to wire outs 0x3e and 0x3f, for recording the design hash (see OpenOK::SetDesignHashEndpoints()).
+
+Each transfer completes the configured latency after it is started, plus the time to move its data at the
+configured bulk rate. The latencies of transfers queued together overlap, but their data moves one transfer
+at a time, as on the bus. Asynchronous transfers complete in libusb_handle_events_timeout_completed(), called
+on the context they were submitted on. Hotplug events are delivered there too.
+
+The defaults may be changed with the environment variables
+OPENOK_SIM_LATENCY_US   per transfer latency, in microseconds (default 0)
+OPENOK_SIM_BULK_MBPS    bulk transfer rate, in MB/s (default 0, unlimited)
+OPENOK_SIM_EVENT_RATE   events per second on each channel (default 1)
+OPENOK_SIM_CHANNELS     mask of the channels generating events (default 0x3f)
+OPENOK_SIM_DEVICES      number of devices attached (default 1)
+or with the methods below, which take precedence.
+*/
+
+#ifndef OpenOKSim_H_
+#define OpenOKSim_H_
+
+#ifndef LIBUSB_H_
+#ifdef __linux
+#include <libusb-1.0/libusb.h>
+#else
+#include "libusbx-1.0/libusb.h"
+#endif
+#define LIBUSB_H_
+#endif
+
+#define OPENOK_SIM_VENDOR_ID  0x151F
+#define OPENOK_SIM_PRODUCT_ID 0x0101
+
+#define OPENOK_SIM_CHANNELS_MAX 6
+
+#define OPENOK_SIM_EVENT_MODULUS 1000 // readings repeat after this many events
+
+class OpenOKSim
+{
+    public:
+
+        struct Statistics
+        {
+            unsigned long controlTransfers;
+            unsigned long bulkTransfers;
+            unsigned long asynchronousTransfers; // included in the above
+            unsigned long long bytesIn;
+            unsigned long long bytesOut;
+            unsigned long events;
+            unsigned long FIFOOverflows;
+        };
+
+        static void SetTransferLatency( unsigned int microseconds );
+
+        static void SetBulkRate( double MBps );
+
+        static void SetEventRate( double eventsPerSecond );
+
+        static void SetChannelMask( unsigned int mask );
+
+        static void GetStatistics( Statistics &stats );
+
+        static void ResetStatistics();
+
+        static int CountsForEvent( int channel, long long event );
+
+        static void SetAttached( int device, bool attached );
+};
+
+#endif // OpenOKSim_H_
@@ -66,6 +66,7 @@ class CFA635
 	protected:
 		
 		int	Serial_Init(const char *devname, int baud_rate);
+		int	SerialHandle(){return handle;}
 		void	Uninit_Serial();
 		void	SendByte(unsigned char datum);
 		void	Sync_Read_Buffer(void);
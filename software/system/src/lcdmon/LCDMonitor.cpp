@@ -25,6 +25,8 @@
 // Modification history
 //
 // 2018-04-05 MJW Many fixups for networking but still not working for OpenTTP
+// 2026-10-19     Main loop waits on the serial port, a one second timerfd and inotify
+//                so that key presses are handled immediately
 
 #include "Debug.h"
 
@@ -35,6 +37,9 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <signal.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/timerfd.h>
 #include <sys/timex.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -106,6 +111,7 @@ extern bool shortDebugMessage;
 LCDMonitor::LCDMonitor(int argc,char **argv)
 {
 	verbosity=TRACE;
+	inotifyfd=-1;
 	
 	int c;
 	while ((c=getopt(argc,argv,"hvd:")) != EOF)
@@ -145,10 +151,74 @@ LCDMonitor::~LCDMonitor()
 	clearDisplay();
 	statusLEDsOff();
 	Uninit_Serial();
+	if (inotifyfd >= 0) close(inotifyfd);
 	log("Shutdown");
 	unlink(lockFile.c_str());
 }
 
+void LCDMonitor::watchStatusFiles()
+{
+	// The directories are watched, rather than the files, because status files
+	// may be replaced or not exist yet
+	inotifyfd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotifyfd < 0){
+		log("inotify_init1() failed - status files will be polled");
+		return;
+	}
+	
+	alarmDir = alarmPath;
+	if (alarmDir.size() > 2 && alarmDir.substr(alarmDir.size()-2) == "/*")
+		alarmDir.resize(alarmDir.size()-2);
+	int wd = inotify_add_watch(inotifyfd,alarmDir.c_str(),IN_MASK_ADD | IN_CREATE | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM);
+	if (wd >= 0)
+		watchedDirs[wd]=alarmDir;
+	
+	watchFile(refStatusFile);
+	watchFile(GPSStatusFile);
+	watchFile(GPSDOStatusFile);
+#ifdef TTS
+	watchFile(GLONASSStatusFile);
+	watchFile(BeidouStatusFile);
+#endif
+}
+
+void LCDMonitor::watchFile(std::string f)
+{
+	size_t pos = f.find_last_of('/');
+	if (pos == std::string::npos) return;
+	std::string dir = f.substr(0,pos);
+	watchedFiles.push_back(f);
+	// adding a directory twice returns the same watch descriptor, and IN_MASK_ADD keeps the events already asked for
+	int wd = inotify_add_watch(inotifyfd,dir.c_str(),IN_MASK_ADD | IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE);
+	if (wd >= 0)
+		watchedDirs[wd]=dir;
+	else
+		DBGMSG(debugStream,TRACE,"can't watch " << dir);
+}
+
+bool LCDMonitor::statusFilesChanged()
+{
+	// Reads the pending inotify events and returns true if any were for
+	// a status file or the alarms
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	bool changed=false;
+	ssize_t len;
+	while ((len = read(inotifyfd,buf,sizeof(buf))) > 0){
+		const struct inotify_event *event;
+		for (char *ptr = buf; ptr < buf + len; ptr += sizeof(struct inotify_event) + event->len){
+			event = (const struct inotify_event *) ptr;
+			if (event->len == 0) continue;
+			std::map<int,std::string>::iterator it = watchedDirs.find(event->wd);
+			if (it == watchedDirs.end()) continue;
+			std::string path = it->second + "/" + event->name;
+			if (path.substr(0,alarmDir.size()+1) == alarmDir + "/" ||
+				std::find(watchedFiles.begin(),watchedFiles.end(),path) != watchedFiles.end())
+				changed=true;
+		}
+	}
+	return changed;
+}
+
 void LCDMonitor::touchLock()
 {
 	// the lock is touched periodically to signal that
@@ -917,36 +987,115 @@ void LCDMonitor::run()
 	std::time_t ts = std::time(NULL);
 	displaybacklightoff = false;
 	COMMAND_PACKET cmd;
+	
+	int epollfd = epoll_create1(0);
+	if (epollfd < 0){
+		log("ERROR in epoll_create1()");
+		exit(EXIT_FAILURE);
+	}
+	
+	// The display is updated a bit after each second rollover, so that the displayed time
+	// doesn't jump because of rounding and we're not fighting ntpd.
+	// An absolute CLOCK_REALTIME timer stays aligned to the second if the clock is stepped.
+	int timerfd = timerfd_create(CLOCK_REALTIME,0);
+	if (timerfd < 0){
+		log("ERROR in timerfd_create()");
+		exit(EXIT_FAILURE);
+	}
+	struct timespec tnow;
+	clock_gettime(CLOCK_REALTIME,&tnow);
+	struct itimerspec its;
+	its.it_value.tv_sec = tnow.tv_sec + 1;
+	its.it_value.tv_nsec = 10000000;
+	its.it_interval.tv_sec = 1;
+	its.it_interval.tv_nsec = 0;
+	timerfd_settime(timerfd,TFD_TIMER_ABSTIME,&its,NULL);
+	
+	watchStatusFiles();
+	
+	struct epoll_event ev;
+	memset(&ev,0,sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = timerfd;
+	epoll_ctl(epollfd,EPOLL_CTL_ADD,timerfd,&ev);
+	if (inotifyfd >= 0){
+		ev.data.fd = inotifyfd;
+		epoll_ctl(epollfd,EPOLL_CTL_ADD,inotifyfd,&ev);
+	}
+	
+	struct epoll_event events[3];
+	bool watchSerial=true;
 	while (1)
 	{
-		// use usleep timing otherwise the displayed time jumps 1s occasionally because of rounding
-		struct timeval tv;
-		gettimeofday(&tv,0);
-		usleep(1000000-tv.tv_usec+10000); // wait until a bit after the second rollover so we're not fighting ntpd 
-		if(packetReceived())
-		{
-			// check the packet type - timeouts can generate unexpected packets
-			if (incoming_command.command==0x80) // key events only
-			{
-				// Turn backlight on if it was off
-				if(displaybacklightoff)
-				{
-					cmd.command=14;
-					cmd.data[0]=intensity;
-					cmd.data_length=1;
-					sendCommand(cmd);
-					displaybacklightoff=false;
-					ts = std::time(NULL);
+		// getResponse() reopens the serial port after a timeout, so (re)add the current descriptor
+		if (watchSerial){
+			ev.data.fd = SerialHandle();
+			if (epoll_ctl(epollfd,EPOLL_CTL_ADD,SerialHandle(),&ev) < 0 && errno != EEXIST)
+				DBGMSG(debugStream,TRACE,"epoll_ctl() failed for the serial port");
+		}
+		
+		int nfds = epoll_wait(epollfd,events,3,-1);
+		if (nfds < 0){
+			if (errno == EINTR) continue; // SIGALRM from startTimer()
+			log("ERROR in epoll_wait()");
+			exit(EXIT_FAILURE);
+		}
+		
+		bool tick=false,keyPressed=false;
+		for (int i=0;i<nfds;i++){
+			int fd = events[i].data.fd;
+			if (fd == timerfd){
+				uint64_t expirations;
+				if (read(timerfd,&expirations,sizeof(expirations)) == sizeof(expirations))
+					tick=true;
+			}
+			else if (fd == inotifyfd){
+				if (statusFilesChanged())
+					lastLazyCheck=0; // shown on the next tick
+			}
+			else if (fd == SerialHandle()){
+				if (events[i].events & (EPOLLERR | EPOLLHUP)){
+					// eg the display has been unplugged - stop watching until the next tick
+					// so that we don't spin
+					epoll_ctl(epollfd,EPOLL_CTL_DEL,fd,NULL);
+					watchSerial=false;
+					continue;
+				}
+				// check the packet type - timeouts can generate unexpected packets
+				while (packetReceived()){
+					if (incoming_command.command==0x80){ // key events only
+						keyPressed=true;
+						break;
+					}
 				}
-				ShowReceivedPacket();
-				clearDisplay();
-				execMenu();
-				lastLazyCheck=0; // trigger immediate update
-				clearDisplay();
 			}
 		}
-		else
+		
+		if (keyPressed)
+		{
+			// Turn backlight on if it was off
+			if(displaybacklightoff)
+			{
+				cmd.command=14;
+				cmd.data[0]=intensity;
+				cmd.data_length=1;
+				sendCommand(cmd);
+				displaybacklightoff=false;
+				ts = std::time(NULL);
+			}
+			ShowReceivedPacket();
+			clearDisplay();
+			execMenu();
+			lastLazyCheck=0; // trigger immediate update
+			clearDisplay();
 			showStatus();
+			continue;
+		}
+		
+		if (!tick) continue;
+		
+		watchSerial=true;
+		showStatus();
 		// if LCD backlight is of, turn it off if timeout is reached
 		if(displaytimeout != 0)
 			if(std::time(NULL) > (ts+displaytimeout) && !displaybacklightoff)
@@ -32,6 +32,7 @@
 #include <time.h>
 #include <sys/time.h>
 
+#include <map>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -131,6 +132,15 @@ class LCDMonitor:public CFA635
 		
 		time_t lastLazyCheck;
 		
+		// status files and alarms are watched with inotify so that changes are shown promptly
+		void watchStatusFiles();
+		void watchFile(std::string);
+		bool statusFilesChanged();
+		int inotifyfd;
+		std::map<int,std::string> watchedDirs; // watch descriptor -> directory
+		std::vector<std::string> watchedFiles;
+		std::string alarmDir;
+		
 		
 		void parseNetworkConfig();
 		void parseConfigEntry(std::string &,std::string &,char );
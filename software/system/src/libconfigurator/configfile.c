@@ -35,6 +35,7 @@
  * 25-11-2003 MJW Added configfile_isasection()
  * 08-03-2006 MJW Remove error messages
  * 10-08-2015 MJW Silly bug in parsing into a list - comments not ignored !								
+ * 19-10-2026     lastError is per-thread, so that threads can read configurations independently
  */
 
 #include <string.h>
@@ -56,7 +57,7 @@ static int configfile_split(char delim,char *buf,char *t,char *v);
 static int configfile_get_section_name(char *buf,char **name);
 static int configfile_isasection(char *buf);
 
-int lastError;
+__thread int lastError;
 
 
 void 
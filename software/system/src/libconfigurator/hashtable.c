@@ -42,7 +42,7 @@
 
 #include "configurator.h"
 
-extern int lastError;
+extern __thread int lastError;
 
 static int hash_makehash(const char *token);
 
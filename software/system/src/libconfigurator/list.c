@@ -31,7 +31,7 @@
 
 #include "configurator.h"
 
-extern int lastError;
+extern __thread int lastError;
 
 #define TRUE 1
 #define FALSE 0
@@ -0,0 +1,557 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2017  Michael J. Wouters
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE
+//
+// Benchmarks for OpenOK and the okcounterd pipeline
+//
+// In device mode, the cost of the calls okcounterd makes is measured directly.
+// In pipeline mode, readings are received from a running okcounterd, either over TCP or
+// from shared memory, and their latency and rate are measured.
+//
+// When built against the simulator (OpenOKSim), the time of each counter event is known,
+// so the latency from the event to its delivery can be measured, and the readings checked.
+// For this, okcounterd must also be built against the simulator (Makefile.OpenOKSim) and
+// run with the same OPENOK_SIM_EVENT_RATE.
+//
+// Modification history
+// 2017-12-22 MJW First version
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "OpenOK.h"
+#ifdef OPENOKSIM
+#include "OpenOKSim.h"
+#endif
+#include "Frame.h"
+#include "ShmRing.h"
+
+using namespace std;
+
+#define APPNAME "okbench"
+#define VERSION "0.1"
+#define AUTHOR  "Michael Wouters"
+
+// Samples of some quantity, summarized when the benchmark is done
+
+class Samples
+{
+	public:
+
+		Samples(string n,string u,double s):name(n),unit(u),scale(s){}
+		void add(double x){vals.push_back(x);}
+		int count(){return vals.size();}
+		void report();
+
+	private:
+
+		string name,unit;
+		double scale; // for reporting in 'unit'
+		vector<double> vals;
+};
+
+void Samples::report()
+{
+	if (vals.empty()){
+		printf("%-28s no samples\n",name.c_str());
+		return;
+	}
+	sort(vals.begin(),vals.end());
+	double sum=0.0;
+	for (unsigned int i=0;i<vals.size();i++)
+		sum += vals[i];
+	int n=vals.size();
+	printf("%-28s n=%-7d mean=%-9.3f min=%-9.3f p50=%-9.3f p99=%-9.3f max=%-9.3f %s\n",name.c_str(),n,
+		scale*sum/n,scale*vals[0],scale*vals[n/2],scale*vals[(int) (0.99*(n-1))],scale*vals[n-1],unit.c_str());
+}
+
+static double eventRate=1.0;
+
+static double monotonicTime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec + ts.tv_nsec*1.0E-9;
+}
+
+static double systemTime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME,&ts);
+	return ts.tv_sec + ts.tv_nsec*1.0E-9;
+}
+
+//
+// Device benchmark
+//
+
+static void timeCalls(OpenOK *xem,string name,int ncalls,int what)
+{
+	Samples s(name,"us",1.0E6);
+	for (int i=0;i<ncalls;i++){
+		double t0=monotonicTime();
+		switch (what){
+			case 0: // a wire in that the counter does not use, changed so that it is sent
+				xem->SetWireInValue(0x01,i & 0xffff);
+				xem->UpdateWireIns();
+				break;
+			case 1:
+				xem->UpdateWireOuts();
+				break;
+			case 2:
+				xem->UpdateTriggerOuts();
+				break;
+			case 3: // a poll, as done with okFrontPanel
+				xem->SetWireInValue(0x01,i & 0xffff);
+				xem->UpdateWireIns();
+				xem->UpdateTriggerOuts();
+				xem->UpdateWireOuts();
+				break;
+			case 4: // a poll, as done with OpenOK
+				xem->SetWireInValue(0x01,i & 0xffff);
+				xem->RunTransaction(OpenOK::TransactionWireIns | OpenOK::TransactionTriggerOuts | OpenOK::TransactionWireOuts);
+				break;
+		}
+		s.add(monotonicTime()-t0);
+	}
+	s.report();
+}
+
+static void timePipe(OpenOK *xem,int addr,long blockSize,long total,bool async)
+{
+	vector<unsigned char> buf(blockSize);
+	xem->EnableAsynchronousTransfers(async);
+	long nblocks = (total + blockSize - 1)/blockSize;
+	long nbytes=0;
+	int nerrors=0;
+	double t0=monotonicTime();
+	for (long i=0;i<nblocks;i++){
+		long n = (addr >= 0xa0) ? xem->ReadFromPipeOut(addr,blockSize,&buf[0]) : xem->WriteToPipeIn(addr,blockSize,&buf[0]);
+		if (n > 0)
+			nbytes += n;
+		else
+			nerrors++;
+	}
+	double dt=monotonicTime()-t0;
+	xem->EnableAsynchronousTransfers(false);
+	printf("pipe 0x%02x %-5s %8ld byte blocks %10.3f MB/s %8.3f ms/block",addr,(async?"async":"sync"),blockSize,
+		nbytes/dt/1.0E6,1.0E3*dt/nblocks);
+	if (nerrors) printf(" (%d errors)",nerrors);
+	printf("\n");
+}
+
+static int benchmarkDevice(int ncalls,int pipeAddr)
+{
+	double t0=monotonicTime();
+	OpenOK *xem = new OpenOK;
+	if (OpenOK::NoError != xem->OpenBySerial()) {
+		cerr << "Device could not be opened.  Is one connected?" << endl;
+		delete xem;
+		return EXIT_FAILURE;
+	}
+	printf("%s %s opened in %.3f ms\n",xem->GetBoardModelString(xem->GetBoardModel()).c_str(),
+		xem->GetSerialNumber().c_str(),(monotonicTime()-t0)*1.0E3);
+
+#ifdef OPENOKSIM
+	OpenOKSim::ResetStatistics();
+#endif
+
+	timeCalls(xem,"UpdateWireIns",ncalls,0);
+	timeCalls(xem,"UpdateWireOuts",ncalls,1);
+	timeCalls(xem,"UpdateTriggerOuts",ncalls,2);
+	timeCalls(xem,"poll (separate calls)",ncalls,3);
+	timeCalls(xem,"poll (RunTransaction)",ncalls,4);
+
+	if (pipeAddr > 0){
+		long sizes[] = {4096,65536,1048576};
+		for (int i=0;i<3;i++){
+			long total = max(sizes[i]*16,4L*1048576);
+			timePipe(xem,pipeAddr,sizes[i],total,false);
+			timePipe(xem,pipeAddr,sizes[i],total,true);
+		}
+	}
+
+#ifdef OPENOKSIM
+	OpenOKSim::Statistics stats;
+	OpenOKSim::GetStatistics(stats);
+	printf("simulator: %lu control transfers, %lu bulk transfers (%lu asynchronous), %llu bytes in, %llu bytes out\n",
+		stats.controlTransfers,stats.bulkTransfers,stats.asynchronousTransfers,stats.bytesIn,stats.bytesOut);
+#endif
+
+	delete xem;
+	return EXIT_SUCCESS;
+}
+
+//
+// Pipeline benchmark
+//
+
+class PipelineStats
+{
+	public:
+
+		PipelineStats():delivery("delivery latency","ms",1.0E3),
+			acquisition("acquisition latency","ms",1.0E3),
+			endToEnd("event to delivery","ms",1.0E3),
+			nreadings(0),nbad(0),ngaps(0){for (int i=0;i<256;i++) lastSeq[i]=-1;}
+
+		void add(int channel,double timestamp,int reading,double arrival);
+		void gap(){ngaps++;}
+		void report(double duration);
+
+		Samples delivery,acquisition,endToEnd;
+		long nreadings,nbad,ngaps;
+		long long lastSeq[256]; // per channel
+};
+
+void PipelineStats::add(int channel,double timestamp,int reading,double arrival)
+{
+	nreadings++;
+	delivery.add(arrival - timestamp);
+	// Events are aligned to the system clock, so the event that was read is taken to be the last one 
+	// before the timestamp. This assumes that readings are made more often than events occur.
+	long long k = (long long) floor(timestamp*eventRate);
+#ifdef OPENOKSIM
+	// The simulator's readings identify the event, modulo OPENOK_SIM_EVENT_MODULUS events, so
+	// readings which have been queued, as in FIFO mode, can be matched with their event too.
+	// FIFO mode timestamps come from the FPGA's clock, and may be slightly early, so the next event is a candidate.
+	k++;
+	int counts = (int) ceil(reading/1.25 - 1.0E-6); // okcounterd reports whole ns
+	long long r = counts - OpenOKSim::CountsForEvent(channel,0);
+	if (r < 0 || r >= OPENOK_SIM_EVENT_MODULUS || 
+		(int) (OpenOKSim::CountsForEvent(channel,r)*5.0E-9*1.0E9/4.0) != reading){
+		nbad++;
+		return;
+	}
+	k -= ((k - r) % OPENOK_SIM_EVENT_MODULUS + OPENOK_SIM_EVENT_MODULUS) % OPENOK_SIM_EVENT_MODULUS;
+#else
+	(void) channel;
+	(void) reading;
+#endif
+	double event = k/eventRate;
+	acquisition.add(timestamp - event);
+	endToEnd.add(arrival - event);
+}
+
+void PipelineStats::report(double duration)
+{
+	printf("%ld readings in %.1f s (%.1f readings/s), %ld gaps",nreadings,duration,nreadings/duration,ngaps);
+#ifdef OPENOKSIM
+	printf(", %ld unexpected readings",nbad);
+#endif
+	printf("\n");
+	delivery.report();
+	acquisition.report();
+	endToEnd.report();
+}
+
+static int connectTo(string host,int port)
+{
+	struct addrinfo hints,*res;
+	memset(&hints,0,sizeof(hints));
+	hints.ai_family=AF_UNSPEC;
+	hints.ai_socktype=SOCK_STREAM;
+	char sport[16];
+	snprintf(sport,sizeof(sport),"%d",port);
+	if (0 != getaddrinfo(host.c_str(),sport,&hints,&res)){
+		cerr << "Unable to resolve " << host << endl;
+		return -1;
+	}
+	int sockfd=-1;
+	for (struct addrinfo *r=res;r;r=r->ai_next){
+		sockfd = socket(r->ai_family,r->ai_socktype,r->ai_protocol);
+		if (sockfd < 0) continue;
+		if (0 == connect(sockfd,r->ai_addr,r->ai_addrlen)) break;
+		close(sockfd);
+		sockfd=-1;
+	}
+	freeaddrinfo(res);
+	if (sockfd < 0)
+		cerr << "Unable to connect to " << host << ":" << port << endl;
+	return sockfd;
+}
+
+static void queryLatency(string host,int port)
+{
+	int sockfd=connectTo(host,port);
+	if (sockfd < 0) return;
+	string cmd="QUERY LATENCY";
+	send(sockfd,cmd.c_str(),cmd.size(),0);
+	char buf[1024];
+	ssize_t n;
+	printf("okcounterd latency statistics:\n");
+	while ((n=recv(sockfd,buf,sizeof(buf)-1,0)) > 0){
+		buf[n]=0;
+		printf("%s",buf);
+	}
+	close(sockfd);
+}
+
+static int benchmarkTCP(string host,int port,double duration)
+{
+	int sockfd=connectTo(host,port);
+	if (sockfd < 0) return EXIT_FAILURE;
+
+	struct timeval tv={1,0};
+	setsockopt(sockfd,SOL_SOCKET,SO_RCVTIMEO,&tv,sizeof(tv));
+
+	string cmd="LISTEN BINARY";
+	send(sockfd,cmd.c_str(),cmd.size(),0);
+
+	PipelineStats stats;
+	double tStop=monotonicTime()+duration;
+	unsigned char buf[FRAME_BINARY_SIZE*256];
+	int nbuf=0;
+
+	while (monotonicTime() < tStop){
+		ssize_t n = recv(sockfd,buf+nbuf,sizeof(buf)-nbuf,0);
+		double arrival=systemTime();
+		if (n == 0){
+			cerr << "connection closed by okcounterd" << endl;
+			break;
+		}
+		if (n < 0){
+			if (errno == EAGAIN || errno == EINTR) continue;
+			cerr << "recv(): " << strerror(errno) << endl;
+			break;
+		}
+		nbuf += n;
+		int i=0;
+		for (;i + FRAME_BINARY_SIZE <= nbuf;i += FRAME_BINARY_SIZE){
+			unsigned char *f=buf+i;
+			uint16_t u16;
+			uint32_t u32;
+			memcpy(&u16,f,2);
+			if (ntohs(u16) != FRAME_MAGIC){
+				cerr << "bad frame" << endl;
+				close(sockfd);
+				return EXIT_FAILURE;
+			}
+			int channel=f[3];
+			memcpy(&u32,f+4,4);
+			long long seq=ntohl(u32);
+			memcpy(&u32,f+8,4);
+			uint64_t secs=((uint64_t) ntohl(u32)) << 32;
+			memcpy(&u32,f+12,4);
+			secs += ntohl(u32);
+			memcpy(&u32,f+16,4);
+			double timestamp = secs + ntohl(u32)*1.0E-9;
+			memcpy(&u32,f+20,4);
+			int reading=(int32_t) ntohl(u32);
+
+			if (stats.lastSeq[channel] >= 0 && seq != stats.lastSeq[channel]+1) stats.gap();
+			stats.lastSeq[channel]=seq;
+			stats.add(channel,timestamp,reading,arrival);
+		}
+		memmove(buf,buf+i,nbuf-i);
+		nbuf -= i;
+	}
+	close(sockfd);
+
+	stats.report(duration);
+	queryLatency(host,port);
+	return EXIT_SUCCESS;
+}
+
+static int benchmarkShm(string name,double duration)
+{
+	int fd = shm_open(name.c_str(),O_RDONLY,0);
+	if (fd < 0){
+		cerr << "Unable to open shared memory " << name << ": " << strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+	ShmRingHeader *hdr = (ShmRingHeader *) mmap(NULL,sizeof(ShmRingHeader),PROT_READ,MAP_SHARED,fd,0);
+	if (hdr == MAP_FAILED || hdr->magic != SHM_RING_MAGIC || hdr->version != SHM_RING_VERSION){
+		cerr << name << " is not an okcounterd ring" << endl;
+		close(fd);
+		return EXIT_FAILURE;
+	}
+	uint32_t nslots=hdr->nslots;
+	munmap(hdr,sizeof(ShmRingHeader));
+	hdr = (ShmRingHeader *) mmap(NULL,shmRingSize(nslots),PROT_READ,MAP_SHARED,fd,0);
+	close(fd);
+	if (hdr == MAP_FAILED){
+		cerr << "mmap(): " << strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+
+	PipelineStats stats;
+	uint32_t next = hdr->head.load(std::memory_order_acquire);
+	double tStop=monotonicTime()+duration;
+	struct timespec timeout={0,100000000};
+
+	while (monotonicTime() < tStop){
+		uint32_t notify = hdr->notify.load(std::memory_order_acquire);
+		ShmRecord rec;
+		int ret;
+		while (0 == (ret = shmRingRead(hdr,next,&rec))){
+			stats.add(rec.channel,rec.tv_sec + rec.tv_nsec*1.0E-9,rec.reading,systemTime());
+			next++;
+		}
+		if (ret < 0){ // overrun - skip to the oldest record still there
+			uint32_t head = hdr->head.load(std::memory_order_acquire);
+			next = head - nslots + 1; // record numbers wrap, like head
+			stats.gap();
+			continue;
+		}
+		shmRingWait(hdr,notify,&timeout);
+	}
+	munmap(hdr,shmRingSize(nslots));
+
+	stats.report(duration);
+	return EXIT_SUCCESS;
+}
+
+static void printHelp()
+{
+	cout << endl << APPNAME << " version " << VERSION << endl;
+	cout << "Usage: " << APPNAME << " [options]" << endl;
+	cout << "Available options are" << endl;
+	cout << "-a <addr>  pipe to measure throughput on in device mode (0x80-0x9f in, 0xa0-0xbf out)" << endl;
+	cout << "-h         print this help message" << endl;
+	cout << "-H <host>  okcounterd host (default localhost)" << endl;
+	cout << "-n <calls> number of calls timed in device mode (default 1000)" << endl;
+	cout << "-p         pipeline mode, with readings received over TCP" << endl;
+	cout << "-P <port>  okcounterd port (default 21577)" << endl;
+	cout << "-r <rate>  counter events per second per channel (default 1)" << endl;
+	cout << "-s <name>  pipeline mode, with readings read from shared memory (okcounterd's default is " << SHM_RING_NAME << ")" << endl;
+	cout << "-t <secs>  duration of the pipeline benchmark (default 10)" << endl;
+	cout << "-v         print version" << endl;
+#ifdef OPENOKSIM
+	cout << "Simulator options (device mode only)" << endl;
+	cout << "-b <MB/s>  bulk transfer rate" << endl;
+	cout << "-l <us>    latency of each transfer" << endl;
+#endif
+	cout << "With no mode selected, the device is benchmarked" << endl;
+}
+
+static void printVersion()
+{
+	cout << APPNAME << " version " << VERSION << endl;
+#ifdef OPENOKSIM
+	cout << "Compiled against the OpenOK simulator" << endl;
+#endif
+	cout << "Written by " << AUTHOR << endl;
+}
+
+int main(int argc,char **argv)
+{
+	int opt;
+	enum Mode {Device,TCP,SharedMemory} mode=Device;
+	string host="localhost";
+	int port=21577;
+	string shmName;
+	double duration=10.0;
+	int ncalls=1000;
+#ifdef OPENOKSIM
+	int pipeAddr=0xa1; // a counting pattern - 0xa0 is the FIFO
+#else
+	int pipeAddr=0;    // the counter firmware has no pipes
+#endif
+
+	const char *env = getenv("OPENOK_SIM_EVENT_RATE");
+	if (env) eventRate=atof(env);
+
+	while ((opt=getopt(argc,argv,"a:b:hH:l:n:pP:r:s:t:v")) != -1)
+	{
+		switch(opt)
+		{
+			case 'a':
+				pipeAddr=strtol(optarg,NULL,0);
+				break;
+#ifdef OPENOKSIM
+			case 'b':
+				OpenOKSim::SetBulkRate(atof(optarg));
+				break;
+			case 'l':
+				OpenOKSim::SetTransferLatency(atoi(optarg));
+				break;
+#endif
+			case 'h':
+				printHelp();
+				exit(EXIT_SUCCESS);
+			case 'H':
+				host=optarg;
+				break;
+			case 'n':
+				ncalls=atoi(optarg);
+				break;
+			case 'p':
+				mode=TCP;
+				break;
+			case 'P':
+				port=atoi(optarg);
+				break;
+			case 'r':
+				eventRate=atof(optarg);
+				break;
+			case 's':
+				mode=SharedMemory;
+				shmName=optarg;
+				break;
+			case 't':
+				duration=atof(optarg);
+				break;
+			case 'v':
+				printVersion();
+				exit(EXIT_SUCCESS);
+			default:
+				printHelp();
+				exit(EXIT_FAILURE);
+		}
+	}
+
+	if (eventRate <= 0.0 || ncalls < 1 || duration <= 0.0){
+		cerr << "Invalid option value" << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	switch (mode){
+		case Device:
+#ifdef OPENOKSIM
+			OpenOKSim::SetEventRate(eventRate);
+#endif
+			return benchmarkDevice(ncalls,pipeAddr);
+		case TCP: return benchmarkTCP(host,port,duration);
+		case SharedMemory: return benchmarkShm(shmName,duration);
+	}
+	return EXIT_SUCCESS;
+}
@@ -27,6 +27,7 @@
 // Modification history
 // 2015-05-07 MJW First version 
 // 2015-03-17 MJW,ELM OpenOK support
+// 2017-12-22 MJW Skip loading if the bitfile is already loaded (OpenOK only)
 //
 
 #include <unistd.h>
@@ -61,6 +62,8 @@ static void printVersion();
 #define LOGMSG( os, msg ) os << msg << std::endl
        
 static int channelMask=1;
+static int epDesignHashIn=-1,epDesignHashOut=-1;
+static bool force=false;
 
 #ifdef OKFRONTPANEL
 okCFrontPanel * 
@@ -99,7 +102,20 @@ initializeFPGA(
 	LOGMSG(cout, "Device serial number:" << xem->GetSerialNumber());
 	LOGMSG(cout, "Device ID: " << xem->GetDeviceID());
 
-	// Download the configuration file.
+	// Download the configuration file, unless it is already loaded
+#ifndef OKFRONTPANEL
+	if (epDesignHashIn >= 0){
+		if (OpenOK::NoError != xem->SetDesignHashEndpoints(epDesignHashIn,epDesignHashOut)){
+			LOGMSG(cerr,"Invalid design hash endpoints");
+			delete xem;
+			return(NULL);
+		}
+		if (!force && xem->IsDesignLoaded(bitfile)){
+			LOGMSG(cout,bitfile << " is already loaded");
+			return xem;
+		}
+	}
+#endif
 #ifdef OKFRONTPANEL
 	if (okCFrontPanel::NoError != xem->ConfigureFPGA(bitfile.c_str())) {
 #else
@@ -124,9 +140,12 @@ static void
 printHelp(
 	)
 {
-	cout << "Usage: " << APPNAME << "[-chv] <bitfile>" << endl;
+	cout << "Usage: " << APPNAME << "[-fhvw] <bitfile>" << endl;
+	cout << "-f  load the bitfile even if it is already loaded" << endl;
 	cout << "-h  show this help" << endl;
 	cout << "-v  print version" << endl;
+	cout << "-w <in>,<out> record a hash of the bitfile in the wire ins in,in+1, which the design echoes" << endl;
+	cout << "              to the wire outs out,out+1, and skip loading if it is already loaded (OpenOK only)" << endl;
 }
 
 static void
@@ -151,9 +170,12 @@ main(int argc,
 	int opt;
 	string bitfile;
 	
-	while ((opt=getopt(argc,argv,"hv")) != -1){
+	while ((opt=getopt(argc,argv,"fhvw:")) != -1){
 		switch (opt)
 		{
+			case 'f':
+				force=true;
+				break;
 			case 'h':
 				printHelp();
 				exit(EXIT_SUCCESS);
@@ -162,6 +184,13 @@ main(int argc,
 				printVersion();
 				exit(EXIT_SUCCESS);
 				break;
+			case 'w':
+				if (2 != sscanf(optarg,"%i,%i",&epDesignHashIn,&epDesignHashOut)){
+					LOGMSG(cerr,"Bad argument to -w");
+					printHelp();
+					exit(EXIT_FAILURE);
+				}
+				break;
 			default:
 				LOGMSG(cerr,"Unknown option");
 				printHelp();
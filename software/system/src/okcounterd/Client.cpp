@@ -30,103 +30,156 @@
 #include <errno.h>
 
 #include <sstream>
+#include <cstdlib>
 #include <cstring>
 
 #include "Debug.h"
 #include "Client.h"
 #include "Server.h"
 
-#define BUFSIZE 8192
+#define MAXQUEUED 256 // readings queued per client - about 40 s of data for 6 channels
+#define MAXOUTBUF 65536 // maximum unwritten output
 
 extern ostream* debugStream;
 
-
 //
-// Public methods
+//	public
 //
 
 Client::Client(Server *s,int fd)
 {
 	ostringstream ss;
-	ss << fd;
-	threadID = "client"+ ss.str();
+	ss << "client" << fd;
+	clientID = ss.str();
 	
 	socketfd=fd;
-	channelMask=0;
 	server=s;
+	channelMask=0xffffffff;
+	decimation=averaging=1;
+	for (int i=0;i<=MAXCHANNELS;i++){
+		count[i]=0;
+		sum[i]=0.0;
+		nAverages[i]=0;
+	}
+	setState(Connected);
+	binary=false;
+	frames = new RingBuffer<Frame *>(MAXQUEUED);
+	nSent=0;
 }
 
 Client::~Client()
 {
-	// Socket is not closed until the Client is destroyed
-	// This deals with the problem that if a counter logging process exits (and the Client socket is immediately released),
-	// there is a finite time before it is destroyed. If a new process is started before it is destroyed, then the OS may give 
-	// the new process the same file descriptor, which this Client then closes 
-	close(socketfd);
+	close();
+	Frame *f;
+	while (frames->pop(f))
+		f->unref();
+	delete frames;
+}
+
+void Client::close()
+{
+	if (socketfd < 0) return;
+	DBGMSG(debugStream,clientID << " sent " << nSent << " queued " << frames->pushed() << " dropped " << frames->dropped());
+	::close(socketfd);
+	socketfd=-1;
+}
+
+void Client::setState(State s)
+{
+	st=s;
+	tState=time(NULL);
+}
+
+void Client::subscribe(const char *msg)
+{
+	// Subscription options are of the form
+	//   mask=N      channels to send, bit 0 is channel 1
+	//   decimate=N  send every N-th reading of each channel
+	//   average=N   send the average of every N readings of each channel 
+	const char *opt;
+	if ((opt = strstr(msg,"mask="))){
+		channelMask = strtoul(opt+5,NULL,0);
+	}
+	if ((opt = strstr(msg,"decimate="))){
+		decimation = atoi(opt+9);
+		if (decimation < 1) decimation=1;
+		averaging = 1;
+	}
+	if ((opt = strstr(msg,"average="))){
+		averaging = atoi(opt+8);
+		if (averaging < 1) averaging=1;
+		decimation = 1;
+	}
+	for (int i=0;i<=MAXCHANNELS;i++){
+		count[i]=0;
+		sum[i]=0.0;
+	}
+	DBGMSG(debugStream,clientID << " mask=" << channelMask << " decimate=" << decimation << " average=" << averaging);
 }
 
-void Client::sendData(vector< int >&data)
+void Client::sendFrame(Frame *f)
 {
-	DBGMSG(debugStream,"sending data:" << data.size());
+	int ch = f->channel();
+	if (!subscribed(ch))
+		return;
 	
-	string msg;
-	for (unsigned int i=0;i<data.size();i+=4){
-		ostringstream ss;
-		ss << data.at(i) << " " << data.at(i+1) << " " << data.at(i+2) << " " << data.at(i+3) << endl;
-		msg += ss.str();
+	if (averaging > 1){
+		sum[ch] += f->reading().reading;
+		if (++count[ch] < averaging) return;
+		// The average gets a frame of its own, timestamped with the last reading
+		CounterReading r = f->reading();
+		r.reading = (int) (sum[ch]/averaging + (sum[ch] >= 0 ? 0.5 : -0.5));
+		count[ch]=0;
+		sum[ch]=0.0;
+		Frame *avg = new Frame(r,nAverages[ch]++);
+		avg->ref();
+		queueFrame(avg);
+		avg->unref();
+		return;
 	}
-	DBGMSG(debugStream,msg);
 	
-	int nw,nEINTR=0;
-	int nleft = msg.size();
-	const char* pbuf=msg.c_str();
+	if (decimation > 1){
+		// Selecting by the sequence number keeps the step between frames at the decimation factor
+		if (f->sequence() % decimation != 0) return;
+	}
 	
-	while (nleft > 0){
-		if (( nw = write(socketfd,pbuf,nleft)) <= 0){
-			if (errno==EINTR){ // interrupted by signal
-				nw=0;
-				nEINTR++;
-				if (10==nEINTR){
-					DBGMSG(debugStream, "too many interrrupts - write() aborted");
-					return;
-				}
-			}
-			else{
-				DBGMSG(debugStream, strerror(errno));
-				return;
-			}
-		}
-		DBGMSG(debugStream, "wrote " << nw);
-		nleft -=nw;
-		pbuf += nw;
-	}	
+	queueFrame(f);
 }
 
-void Client::doWork()
+void Client::queueFrame(Frame *f)
 {
-	int nread;
-	char msgbuf[BUFSIZE];
-	while (!stopRequested){
-		while ((nread=recv(socketfd,msgbuf,BUFSIZE-1,0))>0){ // nread ==0 -> shutdown
-			msgbuf[nread]=0; // terminate that string
-			// Get the channel mask
-			DBGMSG(debugStream,threadID << ":" << msgbuf);
-			// Expected input is of the form mask=N
-		}
-		int serror=errno; // save the errorno since subsequent system calls will overwrite it
-		if (0==nread){
-			DBGMSG(debugStream,"connection " << threadID << " closed by remote");
-			//close(socketfd);
-			stopRequested=true;
+	// If the client is not keeping up, new readings are dropped when the queue is full.
+	if (frames->push(f))
+		f->ref();
+	else if (frames->dropped() == 1)
+		DBGMSG(debugStream,clientID << " queue full - dropping readings");
+}
+
+void Client::queueMessage(string msg)
+{
+	outbuf += msg;
+}
+
+bool Client::flush()
+{
+	Frame *f;
+	for (;;){
+		// Copy out queued frames, as long as the output buffer isn't backed up
+		while (outbuf.size() < MAXOUTBUF && frames->pop(f)){
+			outbuf += (binary ? f->binary() : f->text());
+			f->unref();
+			nSent++;
 		}
-		else if (-1==nread){
-			DBGMSG(debugStream,"recv error : " << strerror(serror) << " " << threadID << " closed");
-			//close(socketfd);
-			stopRequested=true;
+		if (outbuf.empty()) 
+			return true;
+		int nw = send(socketfd,outbuf.c_str(),outbuf.size(),MSG_DONTWAIT|MSG_NOSIGNAL);
+		if (nw < 0){
+			if (errno == EINTR) continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK) return true; // try again when writable
+			DBGMSG(debugStream,clientID << " " << strerror(errno));
+			return false;
 		}
+		DBGMSG(debugStream,clientID << " wrote " << nw);
+		outbuf.erase(0,nw);
 	}
-	DBGMSG(debugStream, "finished");
-	running=false;
 }
-
-
@@ -26,32 +26,67 @@
 #ifndef __CLIENT_H_
 #define __CLIENT_H_
 
-#include <vector>
+#include <time.h>
+#include <string>
 
-#include "Thread.h"
+#include "Frame.h"
+#include "RingBuffer.h"
+
+#define MAXCHANNELS 32
 
 using namespace std;
 
 class Server;
 
-class Client:public Thread
+// A client connection. Clients are owned by the Server and only used from the Server's thread.
+
+class Client
 {
 	public:
 	
+		enum State {Connected,Listening,Closing};
+		
 		Client(Server *,int);
-		virtual ~Client();
+		~Client();
 		
-		void sendData(vector<int> &);
-
-	protected:
+		int fd(){return socketfd;} // -1 once closed
+		void close();
+		State state(){return st;}
+		void setState(State);
+		time_t stateTime(){return tState;}
 		
-		virtual void doWork();
+		void setBinary(bool b){binary=b;}
+		void subscribe(const char *);
+		void queueFrame(Frame *);
+		void sendFrame(Frame *); // subject to the subscription
+		bool subscribed(int ch){return ch >= 1 && ch <= MAXCHANNELS && (channelMask & (1u << (ch-1)));}
+		void queueMessage(string);
+		bool flush(); // writes as much as possible without blocking; false on error
+		bool writePending(){return !outbuf.empty();}
+		
+		string id(){return clientID;}
 		
 	private:
 		
 		Server *server;
 		int socketfd;
-		int channelMask;
+		string clientID;
+		State st;
+		time_t tState;
+		
+		bool binary; // use the binary protocol
+		
+		// Subscription
+		unsigned int channelMask; // bit 0 is channel 1
+		int decimation; // send every n-th reading
+		int averaging;  // send the average of n readings
+		int count[MAXCHANNELS+1];
+		double sum[MAXCHANNELS+1];
+		unsigned int nAverages[MAXCHANNELS+1]; // sequence number of the next average
+		
+		RingBuffer<Frame *> *frames; // queued for sending
+		string outbuf; // formatted, but not yet written
+		unsigned long nSent;
 		
 };
 #endif
\ No newline at end of file
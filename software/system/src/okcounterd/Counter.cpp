@@ -0,0 +1,584 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2017  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <math.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+#include <iostream>
+#include <sstream>
+
+#include "Counter.h"
+#include "Debug.h"
+
+#define BASEADDR 0x20
+
+// Trigger outs can only be read by polling the FPGA, so polls are scheduled around 
+// the expected arrival of each channel's 1 pps event. All times are in seconds
+#define POLL_SEARCH     0.010 // poll interval when no channel is being tracked, or one has yet to trigger
+#define POLL_BACKGROUND 0.050 // poll interval for dropped channels, while other channels are tracked
+#define POLL_FAST       0.001 // poll interval around the expected arrival time
+#define POLL_GUARD      0.005 // fast polling starts this long before the expected arrival
+#define POLL_WINDOW     0.050 // and ends this long after it, when the channel is dropped
+
+#define RECONNECT_INTERVAL 1.0 // seconds between attempts to reopen a lost device
+#define MAX_ERRORS 10 // consecutive failed polls before the device is reopened
+
+extern ostream *debugStream;
+
+//
+// public members
+//
+
+Counter::Counter(OKCounterD *a,string s,int f)
+{
+	app=a;
+	serial=s;
+	first=f;
+	xem=NULL;
+	sysControl=0x0f;
+	nErrors=0;
+	arrived=left=false;
+	ostringstream ss;
+	ss << "counter " << (serial.empty() ? "(first found)" : serial);
+	threadID = ss.str();
+	for (int i=0;i<NCHANNELS;i++){
+		lastTrigger[i]=-1.0;
+		latency[i]=0.0;
+	}
+#ifndef OKFRONTPANEL
+	hotplugID = OpenOK_DeviceManager::Instance().AddHotplugCallback(&Counter::hotplug,this);
+#endif
+}
+
+Counter::~Counter()
+{
+#ifndef OKFRONTPANEL
+	OpenOK_DeviceManager::Instance().RemoveHotplugCallback(hotplugID);
+#endif
+	close();
+}
+
+bool Counter::open()
+{
+	// The device is opened without holding the mutex, since configuring the FPGA takes a while
+#ifdef OKFRONTPANEL
+	okCFrontPanel *dev = new okCFrontPanel;
+	if (okCFrontPanel::NoError != dev->OpenBySerial(serial)) {
+#else
+	OpenOK *dev = new OpenOK;
+	if (OpenOK::NoError != dev->OpenBySerial(serial)) {
+#endif
+		delete dev;
+		return false;
+	}
+	
+	left=false;
+	DBGMSG(debugStream, "Found  a device: " << dev->GetBoardModelString(dev->GetBoardModel()));
+
+	dev->LoadDefaultPLLConfiguration();	
+
+	// Get some general information about the XEM.
+	DBGMSG(debugStream, "Device firmware version: " << dev->GetDeviceMajorVersion() << "." << dev->GetDeviceMinorVersion());
+	DBGMSG(debugStream, "Device serial number:" << dev->GetSerialNumber());
+	DBGMSG(debugStream, "Device ID: " << dev->GetDeviceID());
+	
+	// Download the configuration file, if one has been specified on the command line,
+	// unless the FPGA is already running it
+	bool configure = !app->bitfile.empty();
+#ifndef OKFRONTPANEL
+	if (configure && app->epDesignHashIn >= 0){
+		if (OpenOK::NoError != dev->SetDesignHashEndpoints(app->epDesignHashIn,app->epDesignHashOut))
+			cerr << "Invalid design hash endpoints" << endl;
+		else if (dev->IsDesignLoaded(app->bitfile)){
+			DBGMSG(debugStream, app->bitfile << " is already loaded");
+			configure=false;
+		}
+	}
+#endif
+	if (configure){
+#ifdef OKFRONTPANEL
+		if (okCFrontPanel::NoError != dev->ConfigureFPGA(app->bitfile.c_str())) {
+#else
+		if (OpenOK::NoError != dev->ConfigureFPGA(app->bitfile.c_str())) {
+#endif
+			cerr << "FPGA configuration failed";
+			delete dev;
+			return false;
+		}
+	}
+	// Check for FrontPanel support in the FPGA configuration.
+	DBGMSG(debugStream, "FrontPanel support is " << (dev->IsFrontPanelEnabled()?"":"not ") << "enabled");
+	
+	dev->UpdateTriggerOuts(); // discard any stale triggers
+	
+	// system control register
+	// bits 2->0 : selection of output 1 pps source  
+	// bit  3    : enable external I/O on GPIO pin
+	pthread_mutex_lock(&mutex);
+	dev->SetWireInValue(app->epSysControl,sysControl);
+	dev->UpdateWireIns();
+	dev->UpdateWireOuts();
+	if (serial.empty()) // from now on, this device and no other
+		serial=dev->GetSerialNumber();
+#ifndef OKFRONTPANEL
+	dev->EnableStatistics(app->usbStatistics); // counted from here, so that configuring the FPGA is not included
+#endif
+	xem=dev;
+	nErrors=0;
+	pthread_mutex_unlock(&mutex);
+	
+	// bit 2->0: pps out source
+	// bit 3   : GPIO enabled
+	// bit 4   : DCM locked
+	unsigned int sysStatus=xem->GetWireOutValue(app->epSysStatus) & 0xffff;
+	DBGMSG(debugStream,"Status: " << "PPS OUT=" << (sysStatus & 0x07) << 
+		" GPIO_EN=" << ((sysStatus &0x08)>>3) << " DCM_LOCK=" << ((sysStatus & 0x10)>>4));
+	
+	return true;
+}
+
+string Counter::serialNumber()
+{
+	pthread_mutex_lock(&mutex);
+	string s=serial;
+	pthread_mutex_unlock(&mutex);
+	return s;
+}
+
+void Counter::setOutputPPSSource(int src)
+{
+	pthread_mutex_lock(&mutex);
+	sysControl = (sysControl & ~0x07) | (src & 0x07);
+	if (xem){
+		// bits 2->0 : selection of output 1 pps source   
+		xem->SetWireInValue(app->epSysControl,src & 0x07,0x07);
+#ifdef OKFRONTPANEL
+		xem->UpdateWireIns();
+#endif // otherwise, sent with the next poll by the acquisition thread
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+void Counter::setGPIOEnable(bool en)
+{
+	// bit  3    : enable external I/O on GPIO pin
+	unsigned int enb = en ? 0x08 : 0x00;
+	pthread_mutex_lock(&mutex);
+	sysControl = (sysControl & ~0x08) | enb;
+	if (xem){
+		xem->SetWireInValue(app->epSysControl,enb,0x08);
+#ifdef OKFRONTPANEL
+		xem->UpdateWireIns();
+#endif
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+void Counter::setUSBStatistics(bool en)
+{
+#ifndef OKFRONTPANEL
+	pthread_mutex_lock(&mutex);
+	if (xem){
+		if (en && !xem->IsStatisticsEnabled())
+			xem->ResetStatistics();
+		xem->EnableStatistics(en);
+	}
+	pthread_mutex_unlock(&mutex);
+#endif
+}
+
+string Counter::getUSBStatistics()
+{
+#ifdef OKFRONTPANEL
+	return "not available with the FrontPanel library\n";
+#else
+	string s;
+	pthread_mutex_lock(&mutex);
+	if (!xem)
+		s="not connected\n";
+	else{
+		if (!xem->IsStatisticsEnabled())
+			s="# not enabled\n";
+		s += xem->GetStatisticsReport(); // since the device was opened, or statistics were turned on
+	}
+	pthread_mutex_unlock(&mutex);
+	return s;
+#endif
+}
+
+string Counter::getConfiguration()
+{ 
+	ostringstream ss;
+	pthread_mutex_lock(&mutex);
+	if (xem){
+#ifdef OKFRONTPANEL
+		xem->UpdateWireOuts();
+#else
+		xem->RunTransaction(OpenOK::TransactionWireOuts); // the acquisition thread only reads them after a trigger
+#endif
+		unsigned int sysStatus=xem->GetWireOutValue(app->epSysStatus) & 0xffff;
+		ss << "PPS OUT=" << (sysStatus & 0x07) <<" GPIO_EN=" << ((sysStatus &0x08)>>3) << " DCM_LOCK=" << ((sysStatus & 0x10)>>4);
+	}
+	else
+		ss << "not connected";
+	pthread_mutex_unlock(&mutex);
+	DBGMSG(debugStream,"Status: " << ss.str());
+	return ss.str();
+}
+
+//
+// protected members
+//
+
+void Counter::doWork()
+{
+	while (!stopRequested){
+		if (!xem){
+			waitForDevice();
+			continue;
+		}
+		if (app->readoutMode == OKCounterD::FIFOReadout)
+			runFIFO();
+		else
+			runWire();
+		if (stopRequested) break;
+		
+		ostringstream ss;
+		ss << "lost device " << serial << " - waiting for it to come back";
+		syslog(LOG_WARNING,"%s",ss.str().c_str());
+		DBGMSG(debugStream,ss.str());
+		close();
+	}
+	running=false;
+}
+
+//
+// private members
+//
+
+void Counter::close()
+{
+	pthread_mutex_lock(&mutex);
+	delete xem;
+	xem=NULL;
+	pthread_mutex_unlock(&mutex);
+	for (int i=0;i<NCHANNELS;i++)
+		lastTrigger[i]=-1.0;
+}
+
+void Counter::waitForDevice()
+{
+	// Hotplug events cut the wait short
+	double tRetry=app->monotonicTime() + RECONNECT_INTERVAL;
+	while (!stopRequested && !arrived && app->monotonicTime() < tRetry)
+		usleep(10000);
+	arrived=false;
+	if (stopRequested) return;
+	if (open()){
+		ostringstream ss;
+		ss << "opened device " << serial << " for channels " << first << "-" << first+NCHANNELS-1;
+		syslog(LOG_INFO,"%s",ss.str().c_str());
+		DBGMSG(debugStream,ss.str());
+	}
+}
+
+bool Counter::deviceLost(bool ok)
+{
+#ifdef OKFRONTPANEL
+	if (!ok) nErrors++; else nErrors=0;
+	return !xem->IsOpen() || nErrors >= MAX_ERRORS;
+#else
+	if (ok){
+		nErrors=0;
+		return left;
+	}
+	nErrors++;
+	return left || nErrors >= MAX_ERRORS || !OpenOK_DeviceManager::Instance().IsAttached(serial);
+#endif
+}
+
+void Counter::runWire()
+{
+	vector<int> measurements;
+	double tPrevPoll=app->monotonicTime();
+	
+	while (!stopRequested){
+		double tNextPoll=nextPollTime(tPrevPoll);
+		double tNow=app->monotonicTime();
+		if (tNextPoll > tNow)
+			usleep((useconds_t) ((tNextPoll - tNow)*1.0E6));
+		
+		measurements.clear();
+		double tPoll=app->monotonicTime();
+		// The device is shared with the server threads, which change the wire ins
+		pthread_mutex_lock(&mutex);
+#ifdef OKFRONTPANEL
+		xem->UpdateTriggerOuts();
+		bool ok=true;
+#else
+		// Pending wire in changes and the trigger outs in one round trip. 
+		// The wire outs are only wanted after a trigger, so they are read separately.
+		bool ok = (OpenOK::NoError == 
+			xem->RunTransaction(OpenOK::TransactionWireIns | OpenOK::TransactionTriggerOuts));
+#endif
+		pthread_mutex_unlock(&mutex);
+		double tPolled=app->monotonicTime();
+		if (deviceLost(ok)) return;
+		if (!ok){
+			tPrevPoll=tPoll;
+			continue;
+		}
+		// Readings are timestamped at the end of the poll which found them, since this is 
+		// the earliest time which is certain to be after the event
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME,&ts);
+		
+		int triggered=0;
+		int bitmask=0x01;
+		for (int i=0;i<NCHANNELS;i++){
+			triggered = triggered || (xem->IsTriggered(0x60,bitmask) && (app->channelMask & bitmask));
+			bitmask=bitmask << 1;
+		}
+		
+		if (triggered){
+			int addr=BASEADDR;
+			int bitmask=0x01;
+			int rdg;
+			unsigned int upperbits,lowerbits;
+			unsigned int wireOuts[2*NCHANNELS];
+			double tRead=app->monotonicTime();
+			pthread_mutex_lock(&mutex);
+#ifdef OKFRONTPANEL
+			xem->UpdateWireOuts();
+			ok=true;
+#else
+			ok = (OpenOK::NoError == xem->RunTransaction(OpenOK::TransactionWireOuts));
+#endif
+			for (int i=0;i<2*NCHANNELS;i++) // copied, since the server thread can update them too
+				wireOuts[i]=xem->GetWireOutValue(BASEADDR+i) & 0xffff;
+			pthread_mutex_unlock(&mutex);
+			double transfer=(tPolled-tPoll) + (app->monotonicTime()-tRead);
+			if (deviceLost(ok)) return;
+			if (!ok){ // the readings are lost
+				tPrevPoll=tPoll;
+				continue;
+			}
+			for (int i=0;i<NCHANNELS;i++){
+				if (app->channelMask & bitmask){
+					if (xem->IsTriggered(0x60,bitmask)){
+						upperbits=wireOuts[addr+1-BASEADDR];
+						lowerbits=wireOuts[addr-BASEADDR];
+						rdg = (upperbits  << 16) + lowerbits;
+						rdg= (int)rdg*5.0E-9*1.0E9/4.0;
+						if (rdg>500000000) rdg -= 1000000000;
+						measurements.push_back(first+i);
+						measurements.push_back((int) ts.tv_sec);
+						measurements.push_back((int) (ts.tv_nsec/1000));
+						measurements.push_back(rdg);
+						// The event happened sometime after the previous poll started
+						lastTrigger[i]=tPoll;
+						latency[i]=tPolled-tPrevPoll;
+						app->latencyStats->add(first+i,transfer,latency[i]);
+						DBGMSG(debugStream,"channel " << first+i << " acquisition latency <= " << latency[i]*1.0E3 << " ms, transfer " 
+							<< transfer*1.0E3 << " ms");
+					}
+				}
+				bitmask=bitmask << 1;
+				addr += 2;
+			}
+			app->publish(measurements);
+		}// if triggered
+		
+		tPrevPoll=tPoll;
+	}	
+}
+
+void Counter::runFIFO()
+{
+	// The FPGA pushes events into a FIFO, which is read through a pipe out.
+	// Each event is a 16 byte record of eight 16 bit words, each sent LSB first:
+	//   word 0    0xA000 | channel (1..6) 
+	//   word 1    event count for the channel, modulo 65536 - gaps indicate FIFO overflow
+	//   word 2,3  counter reading, low word first, as for the wire outs
+	//   word 4-7  time of the event, in ticks of the FPGA clock, low word first
+	// The number of words in the FIFO is read from the wire out epFIFOCount and the FPGA's current 
+	// time from the four wire outs starting at epFIFOTime. The system time of each event is
+	// worked out from the difference between its time and the current time, 
+	// which is referred to the system clock at the middle of the wire out transfer.
+	
+	vector<int> measurements;
+	unsigned char *buf = new unsigned char[app->FIFOBlockSize];
+	int lastCount[NCHANNELS+1];
+	for (int i=0;i<=NCHANNELS;i++) lastCount[i]=-1;
+	unsigned long nSyncErrors=0,nSyncErrorsReported=0,nLost=0;
+	
+	DBGMSG(debugStream,"FIFO readout: pipe=0x" << hex << app->epFIFOPipe << " count=0x" << app->epFIFOCount << 
+		" time=0x" << app->epFIFOTime << dec << " clock=" << app->FIFOClock << 
+		" block size=" << app->FIFOBlockSize << " poll interval=" << app->FIFOPollInterval);
+	
+	while (!stopRequested){
+		struct timespec tsRef0,tsRef1;
+		pthread_mutex_lock(&mutex);
+		clock_gettime(CLOCK_REALTIME,&tsRef0);
+#ifdef OKFRONTPANEL
+		xem->UpdateWireOuts();
+		bool ok=true;
+#else
+		bool ok = (OpenOK::NoError == xem->RunTransaction(OpenOK::TransactionWireIns | OpenOK::TransactionWireOuts));
+#endif
+		clock_gettime(CLOCK_REALTIME,&tsRef1);
+		pthread_mutex_unlock(&mutex);
+		if (deviceLost(ok)) break;
+		long nbytes = (ok ? 2*(long) (xem->GetWireOutValue(app->epFIFOCount) & 0xffff) : 0);
+		nbytes -= nbytes % 16; // pipe transfers are in multiples of 16 bytes
+		if (nbytes > app->FIFOBlockSize) nbytes = app->FIFOBlockSize;
+		
+		if (nbytes == 0){
+			usleep((useconds_t) (app->FIFOPollInterval*1.0E6));
+			continue;
+		}
+		
+		// FPGA time, and the system time it corresponds to, split into seconds and the rest to keep the precision
+		unsigned long long tickRef=0;
+		for (int w=3;w>=0;w--)
+			tickRef = (tickRef << 16) | (xem->GetWireOutValue(app->epFIFOTime+w) & 0xffff);
+		long tRefSecs = tsRef0.tv_sec;
+		double tRefFrac = ((tsRef1.tv_sec - tRefSecs) + (tsRef0.tv_nsec + tsRef1.tv_nsec)*1.0E-9)/2.0;
+		
+		double tRead=app->monotonicTime();
+		pthread_mutex_lock(&mutex);
+		long nread = xem->ReadFromPipeOut(app->epFIFOPipe,nbytes,buf);
+		pthread_mutex_unlock(&mutex);
+		double transfer=app->monotonicTime()-tRead;
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME,&ts);
+		if (nread <= 0){
+			DBGMSG(debugStream,"ReadFromPipeOut() failed " << nread);
+			if (deviceLost(false)) break;
+			usleep((useconds_t) (app->FIFOPollInterval*1.0E6));
+			continue;
+		}
+		
+		measurements.clear();
+		long i=0;
+		while (i + 16 <= nread){
+			unsigned int w0 = buf[i] | (buf[i+1] << 8);
+			if ((w0 & 0xf000) != 0xa000 || (w0 & 0x0f) < 1 || (w0 & 0x0f) > NCHANNELS){
+				nSyncErrors++; // resynchronize on the next word
+				i += 2;
+				continue;
+			}
+			int chan = w0 & 0x0f;
+			int count = buf[i+2] | (buf[i+3] << 8);
+			unsigned int lowerbits = buf[i+4] | (buf[i+5] << 8);
+			unsigned int upperbits = buf[i+6] | (buf[i+7] << 8);
+			unsigned long long tick=0;
+			for (int w=7;w>=4;w--)
+				tick = (tick << 16) | buf[2*w] | (buf[2*w+1] << 8);
+			i += 16;
+			
+			if (lastCount[chan] >= 0 && count != ((lastCount[chan] + 1) & 0xffff)){
+				nLost += (count - lastCount[chan] - 1) & 0xffff;
+				DBGMSG(debugStream,"channel " << first+chan-1 << " lost events: " << nLost << " total");
+			}
+			lastCount[chan]=count;
+			
+			if (!(app->channelMask & (1 << (chan-1)))) continue;
+			
+			// Ticks are signed relative to the reference, since events can arrive after the wire outs were read
+			double tEvent = tRefFrac + ((long long) (tick - tickRef))/app->FIFOClock;
+			long long us = (long long) floor(tEvent*1.0E6 + 0.5); // rounded, so an event on the second stays there
+			long secs = tRefSecs + (long) floor(us/1.0E6);
+			long usecs = (long) (us - (secs - tRefSecs)*1000000LL);
+			
+			app->latencyStats->add(first+chan-1,transfer,(ts.tv_sec - tRefSecs) + ts.tv_nsec*1.0E-9 - tEvent);
+			
+			int rdg = (upperbits  << 16) + lowerbits;
+			rdg= (int)rdg*5.0E-9*1.0E9/4.0;
+			if (rdg>500000000) rdg -= 1000000000;
+			measurements.push_back(first+chan-1);
+			measurements.push_back((int) secs);
+			measurements.push_back((int) usecs);
+			measurements.push_back(rdg);
+		}
+		if (nSyncErrors > nSyncErrorsReported){
+			DBGMSG(debugStream,"FIFO sync errors: " << nSyncErrors);
+			nSyncErrorsReported=nSyncErrors;
+		}
+		
+		if (!measurements.empty())
+			app->publish(measurements);
+		
+		if (nread < app->FIFOBlockSize) // otherwise there's probably more to read
+			usleep((useconds_t) (app->FIFOPollInterval*1.0E6));
+	}
+	
+	delete[] buf;
+}
+
+double Counter::nextPollTime(double tPrevPoll)
+{
+	// A channel is tracked if it triggered about a second ago 
+	bool tracking=false;
+	bool untracked=false;
+	bool searching=false; // a channel hasn't triggered since the device was opened
+	double tNext=1.0E12;
+	int bitmask=0x01;
+	for (int i=0;i<NCHANNELS;i++){
+		if (app->channelMask & bitmask){
+			double tExpected = lastTrigger[i] + 1.0;
+			if (lastTrigger[i] >= 0.0 && tPrevPoll <= tExpected + POLL_WINDOW){
+				tracking=true;
+				double t = tExpected - POLL_GUARD;
+				if (t < tPrevPoll + POLL_FAST) t = tPrevPoll + POLL_FAST;
+				if (t < tNext) tNext = t;
+			}
+			else if (lastTrigger[i] < 0.0)
+				searching=true;
+			else
+				untracked=true;
+		}
+		bitmask=bitmask << 1;
+	}
+	
+	if (!tracking || (searching && tPrevPoll + POLL_SEARCH < tNext))
+		return tPrevPoll + POLL_SEARCH;
+	if (untracked && tPrevPoll + POLL_BACKGROUND < tNext)
+		return tPrevPoll + POLL_BACKGROUND;
+	return tNext;
+}
+
+#ifndef OKFRONTPANEL
+void Counter::hotplug(void *ptr,const string &serial,bool arrived)
+{
+	// Called from the OpenOK device manager's thread
+	Counter *c = static_cast<Counter *>(ptr);
+	if (serial != c->serialNumber()) return; // not ours
+	if (arrived)
+		c->arrived=true;
+	else
+		c->left=true;
+}
+#endif
@@ -0,0 +1,87 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2017  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef __COUNTER_H_
+#define __COUNTER_H_
+
+#include <string>
+
+#include "OKCounterD.h"
+#include "Thread.h"
+
+// Acquisition from one XEM, in a thread of its own. 
+// The device's channels 1..NCHANNELS are published as channels first .. first+NCHANNELS-1.
+// If the device is unplugged or stops responding, it is closed and reopened by its serial number 
+// when it is back, reconfiguring the FPGA if necessary and restoring the system control register.
+
+class Counter:public Thread
+{
+	public:
+	
+		Counter(OKCounterD *,string serial,int first);
+		virtual ~Counter();
+		
+		bool open(); // opens the device and configures the FPGA if need be
+		string serialNumber(); // empty until a device has been opened, if none was specified
+		int firstChannel(){return first;}
+		
+		// Called by the Server thread
+		void setOutputPPSSource(int);
+		void setGPIOEnable(bool);
+		string getConfiguration();
+		void setUSBStatistics(bool);
+		string getUSBStatistics();
+		
+	protected:
+	
+		virtual void doWork();
+	
+	private:
+	
+		void close();
+		void waitForDevice();
+		bool deviceLost(bool);
+		void runWire();
+		void runFIFO();
+		double nextPollTime(double);
+		
+		OKCounterD *app;
+#ifdef OKFRONTPANEL
+		okCFrontPanel *xem;
+#else
+		OpenOK *xem;
+		int hotplugID;
+		static void hotplug(void *,const string &,bool);
+#endif
+		string serial;
+		int first;
+		unsigned int sysControl; // restored when the device is reopened
+		int nErrors; // consecutive failed polls
+		volatile bool arrived,left;
+		
+		double lastTrigger[NCHANNELS]; // monotonic time of the poll which found the last event, -1 if none
+		double latency[NCHANNELS];     // upper bound on the acquisition latency of the last event
+};
+
+#endif
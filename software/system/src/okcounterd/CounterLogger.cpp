@@ -0,0 +1,350 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2017  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "CounterLogger.h"
+#include "Debug.h"
+
+#define MAXQUEUED 1024 // readings queued from the acquisition thread
+#define MJD_EPOCH 40587 // MJD of the Unix epoch
+
+extern ostream* debugStream;
+
+//
+//	public
+//
+
+CounterLogger::CounterLogger()
+{
+	threadID = "logger";
+	syncInterval=60;
+	compress=false;
+	readings = new RingBuffer<CounterReading>(MAXQUEUED);
+	wakeupfd = eventfd(0,EFD_NONBLOCK);
+}
+
+CounterLogger::~CounterLogger()
+{
+	for (unsigned int i=0;i<channels.size();i++)
+		delete channels.at(i);
+	close(wakeupfd);
+	delete readings;
+}
+
+void CounterLogger::addChannel(int channel,string path,string extension,string statusFile,string headerGenerator)
+{
+	if (!path.empty() && path.at(path.length()-1) != '/')
+		path += "/";
+	if (!extension.empty() && extension.at(0) != '.')
+		extension = "." + extension;
+	channels.push_back(new ChannelLog(channel,path,extension,statusFile,headerGenerator));
+	DBGMSG(debugStream,"logging channel " << channel << " to " << path << "MJD" << extension);
+}
+
+void CounterLogger::log(vector<int> &data)
+{
+	bool queued=false;
+	for (unsigned int i=0;i<data.size();i+=4){
+		for (unsigned int c=0;c<channels.size();c++){
+			if (channels.at(c)->channel == data.at(i)){
+				CounterReading r;
+				r.channel=data.at(i);
+				r.tv_sec=data.at(i+1);
+				r.tv_usec=data.at(i+2);
+				r.reading=data.at(i+3);
+				if (!readings->push(r))
+					DBGMSG(debugStream,"logger queue full - reading dropped");
+				queued=true;
+				break;
+			}
+		}
+	}
+	if (queued){
+		uint64_t one=1;
+		::write(wakeupfd,&one,sizeof(one));
+	}
+}
+
+void CounterLogger::stop()
+{
+	stopRequested=true;
+	uint64_t one=1;
+	::write(wakeupfd,&one,sizeof(one));
+	Thread::stop();
+}
+
+//
+//	protected
+//
+
+void CounterLogger::doWork()
+{
+	struct pollfd pfd;
+	pfd.fd=wakeupfd;
+	pfd.events=POLLIN;
+	
+	time_t lastSync=time(NULL);
+	
+	while (!stopRequested){
+		
+		if (poll(&pfd,1,1000) > 0){
+			uint64_t n;
+			read(wakeupfd,&n,sizeof(n));
+		}
+		
+		CounterReading r;
+		while (readings->pop(r))
+			logReading(r);
+		
+		for (unsigned int c=0;c<channels.size();c++){
+			channels.at(c)->write();
+			channels.at(c)->writeStatus();
+		}
+		
+		time_t now=time(NULL);
+		if (now - lastSync >= syncInterval){
+			for (unsigned int c=0;c<channels.size();c++)
+				channels.at(c)->sync();
+			lastSync=now;
+		}
+	}
+	
+	for (unsigned int c=0;c<channels.size();c++)
+		channels.at(c)->close();
+}
+
+//
+//	private
+//
+
+void CounterLogger::logReading(const CounterReading &r)
+{
+	ChannelLog *cl=NULL;
+	for (unsigned int c=0;c<channels.size();c++){
+		if (channels.at(c)->channel == r.channel){
+			cl = channels.at(c);
+			break;
+		}
+	}
+	if (!cl) return;
+	
+	int mjd = r.tv_sec/86400 + MJD_EPOCH;
+	if (mjd != cl->mjd){
+		if (mjd < cl->mjd){ // system time stepped back over midnight - let the old day's file take it
+			DBGMSG(debugStream,"channel " << cl->channel << " reading from a previous day - discarded");
+			return;
+		}
+		int oldmjd = cl->mjd;
+		cl->close(); // writes and syncs what's buffered
+		if (compress && oldmjd > 0)
+			cl->compress(oldmjd);
+		cl->mjd = mjd;
+		cl->lastSecond = -1;
+	}
+	
+	if (cl->fd < 0 && !cl->open(mjd)) // retried with each reading
+		return;
+	
+	// Don't log a second twice (at most one 1 pps per second)
+	int tod = r.tv_sec % 86400;
+	if (tod == cl->lastSecond) return;
+	cl->lastSecond = tod;
+	
+	snprintf(cl->lastLine,sizeof(cl->lastLine),"%02d:%02d:%02d  %.15g\n",tod/3600,(tod % 3600)/60,tod % 60,r.reading*1.0E-9);
+	cl->buf += cl->lastLine;
+}
+
+//
+// ChannelLog
+//
+
+CounterLogger::ChannelLog::ChannelLog(int c,string p,string e,string s,string h)
+{
+	channel=c;
+	path=p;
+	extension=e;
+	statusFile=s;
+	headerGenerator=h;
+	mjd=-1;
+	fd=-1;
+	unsynced=false;
+	lastSecond=-1;
+	lastLine[0]=0;
+}
+
+CounterLogger::ChannelLog::~ChannelLog()
+{
+	close();
+}
+
+string CounterLogger::ChannelLog::fileName(int m)
+{
+	char buf[16];
+	snprintf(buf,sizeof(buf),"%d",m);
+	return path + buf + extension;
+}
+
+bool CounterLogger::ChannelLog::open(int m)
+{
+	string fname = fileName(m);
+	
+	// A new file gets its header (if any) before anyone else can see it
+	struct stat statbuf;
+	if (0 != stat(fname.c_str(),&statbuf)){
+		string tmpname = fname + ".tmp";
+		int tfd = ::open(tmpname.c_str(),O_WRONLY|O_CREAT|O_TRUNC,0644);
+		if (tfd < 0){
+			DBGMSG(debugStream,"failed to create " << tmpname << ": " << strerror(errno));
+			return false;
+		}
+		setOwner(tfd);
+		if (!headerGenerator.empty() && 0 == access(headerGenerator.c_str(),X_OK)){
+			FILE *hg = popen(headerGenerator.c_str(),"r");
+			if (hg){
+				char hbuf[1024];
+				size_t n;
+				while ((n = fread(hbuf,1,sizeof(hbuf),hg)) > 0)
+					::write(tfd,hbuf,n);
+				pclose(hg);
+			}
+		}
+		fsync(tfd);
+		::close(tfd);
+		// link() fails if the file has appeared meanwhile, in which case that file is used
+		if (0 != link(tmpname.c_str(),fname.c_str()) && errno != EEXIST)
+			DBGMSG(debugStream,"failed to create " << fname << ": " << strerror(errno));
+		unlink(tmpname.c_str());
+	}
+	
+	fd = ::open(fname.c_str(),O_WRONLY|O_APPEND|O_CREAT,0644);
+	if (fd < 0){
+		DBGMSG(debugStream,"failed to open " << fname << ": " << strerror(errno));
+		return false;
+	}
+	DBGMSG(debugStream,"opened " << fname);
+	return true;
+}
+
+void CounterLogger::ChannelLog::close()
+{
+	if (fd < 0) return;
+	write();
+	unsynced=true;
+	sync();
+	::close(fd);
+	fd=-1;
+}
+
+void CounterLogger::ChannelLog::write()
+{
+	if (buf.empty() || fd < 0) return;
+	ssize_t n = ::write(fd,buf.c_str(),buf.length());
+	if (n < 0){
+		DBGMSG(debugStream,"write failed: " << strerror(errno));
+		if (buf.length() > 65536) buf.clear(); // give up eventually
+		return;
+	}
+	buf.erase(0,n);
+	unsynced=true;
+}
+
+void CounterLogger::ChannelLog::sync()
+{
+	if (fd < 0 || !unsynced) return;
+	fdatasync(fd);
+	unsynced=false;
+}
+
+void CounterLogger::ChannelLog::writeStatus()
+{
+	// The status file holds the last reading only, and is replaced atomically
+	if (statusFile.empty() || !lastLine[0]) return;
+	string tmpname = statusFile + ".tmp";
+	int sfd = ::open(tmpname.c_str(),O_WRONLY|O_CREAT|O_TRUNC,0644);
+	if (sfd < 0) return;
+	setOwner(sfd);
+	::write(sfd,lastLine,strlen(lastLine));
+	::close(sfd);
+	rename(tmpname.c_str(),statusFile.c_str());
+	lastLine[0]=0;
+}
+
+void CounterLogger::ChannelLog::compress(int m)
+{
+	string fname = fileName(m);
+	// Done in-process, like gzip, then the original is removed
+	FILE *fin = fopen(fname.c_str(),"r");
+	if (!fin) return;
+	
+	string gzname = fname + ".gz";
+	string tmpname = gzname + ".tmp";
+	int gzfd = ::open(tmpname.c_str(),O_WRONLY|O_CREAT|O_TRUNC,0644);
+	gzFile gz = (gzfd < 0 ? NULL : gzdopen(gzfd,"wb"));
+	if (!gz){
+		if (gzfd >= 0) ::close(gzfd);
+		fclose(fin);
+		DBGMSG(debugStream,"failed to create " << tmpname);
+		return;
+	}
+	
+	setOwner(gzfd);
+	char cbuf[8192];
+	size_t n;
+	bool ok=true;
+	while ((n = fread(cbuf,1,sizeof(cbuf),fin)) > 0){
+		if (gzwrite(gz,cbuf,n) != (int) n){
+			ok=false;
+			break;
+		}
+	}
+	ok = ok && !ferror(fin);
+	fclose(fin);
+	ok = (gzclose(gz) == Z_OK) && ok;
+	
+	if (ok && 0 == rename(tmpname.c_str(),gzname.c_str())){
+		unlink(fname.c_str());
+		DBGMSG(debugStream,"compressed " << fname);
+	}
+	else{
+		unlink(tmpname.c_str());
+		DBGMSG(debugStream,"failed to compress " << fname);
+	}
+}
+
+void CounterLogger::ChannelLog::setOwner(int f)
+{
+	struct stat statbuf;
+	if (0 == stat(path.empty() ? "." : path.c_str(),&statbuf))
+		fchown(f,statbuf.st_uid,statbuf.st_gid);
+}
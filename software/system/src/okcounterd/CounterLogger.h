@@ -0,0 +1,109 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2017  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef __COUNTER_LOGGER_H_
+#define __COUNTER_LOGGER_H_
+
+#include <time.h>
+#include <string>
+#include <vector>
+
+#include "Frame.h"
+#include "RingBuffer.h"
+#include "Thread.h"
+
+// Writes daily counter log files, named MJD.extension, with lines of the form
+//   HH:MM:SS reading(s)
+// as read by mktimetx. This replaces the okxemlog.pl logger.
+//
+// Readings are passed from the acquisition thread through a lock-free queue and written 
+// by the logger's thread. Each batch of readings is written with a single write(), and the files
+// are synced every 'sync interval' seconds, and when they are closed.
+// The day of a reading is determined by its timestamp, so readings always go into the right file.
+// A new file and its header are written to a temporary file which is then renamed, so that other
+// processes never see a partially written header. The previous day's file can be gzipped.
+// Files are given the owner of the directory they are written to, since okcounterd runs as root.
+
+class CounterLogger:public Thread
+{
+	public:
+	
+		CounterLogger();
+		virtual ~CounterLogger();
+		
+		// Must be called before go()
+		void addChannel(int channel,string path,string extension,string statusFile,string headerGenerator);
+		void setSyncInterval(int s){syncInterval=s;}
+		void setCompression(bool c){compress=c;}
+		
+		bool isLogging(){return !channels.empty();}
+		void log(vector<int> &); // called by the acquisition thread - never blocks
+		virtual void stop();
+		
+	protected:
+	
+		virtual void doWork();
+		
+	private:
+	
+		class ChannelLog
+		{
+			public:
+				ChannelLog(int,string,string,string,string);
+				~ChannelLog();
+				
+				int channel;
+				string path,extension,statusFile,headerGenerator;
+				int mjd;
+				int fd;
+				string buf;
+				bool unsynced;
+				int lastSecond;
+				char lastLine[64];
+				
+				bool open(int);
+				void close();
+				void write();
+				void sync();
+				void writeStatus();
+				void compress(int);
+				string fileName(int);
+				void setOwner(int);
+				
+			private:
+			
+				ChannelLog(const ChannelLog &);
+				ChannelLog &operator=(const ChannelLog &);
+		};
+		
+		void logReading(const CounterReading &);
+		
+		int wakeupfd;
+		int syncInterval;
+		bool compress;
+		RingBuffer<CounterReading> *readings;
+		vector<ChannelLog *> channels;
+};
+
+#endif
@@ -0,0 +1,60 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2017  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+
+#include "Frame.h"
+
+Frame::Frame(const CounterReading &r,unsigned int s)
+{
+	refs=0;
+	rdg=r;
+	seq=s;
+	
+	// Text format, as expected by the logging scripts
+	char buf[64];
+	snprintf(buf,sizeof(buf),"%d %d %d %d\n",r.channel,r.tv_sec,r.tv_usec,r.reading);
+	txt=buf;
+	
+	unsigned char b[FRAME_BINARY_SIZE];
+	uint16_t u16 = htons(FRAME_MAGIC);
+	memcpy(b,&u16,2);
+	b[2]=FRAME_VERSION;
+	b[3]=r.channel;
+	uint32_t u32 = htonl(seq);
+	memcpy(b+4,&u32,4);
+	uint64_t secs = (uint64_t) r.tv_sec;
+	u32 = htonl((uint32_t) (secs >> 32));
+	memcpy(b+8,&u32,4);
+	u32 = htonl((uint32_t) (secs & 0xffffffff));
+	memcpy(b+12,&u32,4);
+	u32 = htonl((uint32_t) r.tv_usec*1000);
+	memcpy(b+16,&u32,4);
+	u32 = htonl((uint32_t) r.reading);
+	memcpy(b+20,&u32,4);
+	bin.assign((char *) b,FRAME_BINARY_SIZE);
+}
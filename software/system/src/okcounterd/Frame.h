@@ -0,0 +1,81 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2017  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef __FRAME_H_
+#define __FRAME_H_
+
+#include <string>
+
+using namespace std;
+
+class CounterReading
+{
+	public:
+		int channel;
+		int tv_sec,tv_usec;
+		int reading;
+};
+
+// A counter reading, serialized once and shared by all the clients it is sent to.
+// Frames are reference counted and are only used by the Server's thread.
+//
+// The binary encoding is 24 bytes, in network byte order:
+//   uint16 magic (0x4f4b "OK"), uint8 version (1), uint8 channel,
+//   uint32 sequence number, uint64 seconds, uint32 nanoseconds, int32 reading
+// Each channel has its own sequence number, which increments by one for each reading on that channel, 
+// so that clients can detect gaps. With decimation, it increments by the decimation factor.
+// Averages are numbered by the client's own count of averages for the channel.
+
+#define FRAME_MAGIC 0x4f4b
+#define FRAME_VERSION 1
+#define FRAME_BINARY_SIZE 24
+
+class Frame
+{
+	public:
+	
+		Frame(const CounterReading &,unsigned int);
+		
+		void ref(){refs++;}
+		void unref(){if (--refs == 0) delete this;}
+		
+		int channel(){return rdg.channel;}
+		const CounterReading &reading(){return rdg;}
+		unsigned int sequence(){return seq;}
+		const string &text(){return txt;}
+		const string &binary(){return bin;}
+		
+	private:
+	
+		~Frame(){}
+		Frame(const Frame &);
+		Frame &operator=(const Frame &);
+		
+		int refs;
+		CounterReading rdg;
+		unsigned int seq;
+		string txt,bin;
+};
+
+#endif
@@ -0,0 +1,114 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2017  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cmath>
+#include <sstream>
+
+#include "LatencyStats.h"
+
+//
+// Histogram
+//
+
+Histogram::Histogram()
+{
+	reset();
+}
+
+void Histogram::add(double t)
+{
+	// Welford's method for the running mean and variance
+	n++;
+	double delta = t - mean;
+	mean += delta/n;
+	m2 += delta*(t - mean);
+	if (n == 1 || t < min) min=t;
+	if (n == 1 || t > max) max=t;
+	
+	int bin=0;
+	double us = t*1.0E6;
+	if (us >= 1.0){
+		bin = 1 + (int) floor(log2(us));
+		if (bin >= HISTOGRAM_BINS) bin = HISTOGRAM_BINS-1;
+	}
+	bins[bin]++;
+}
+
+void Histogram::reset()
+{
+	n=0;
+	mean=m2=min=max=0.0;
+	for (int i=0;i<HISTOGRAM_BINS;i++)
+		bins[i]=0;
+}
+
+string Histogram::report()
+{
+	ostringstream ss;
+	ss.setf(ios::fixed);
+	ss.precision(1);
+	double sd = (n > 1 ? sqrt(m2/(n-1)) : 0.0);
+	ss << n << " " << mean*1.0E6 << " " << sd*1.0E6 << " " << min*1.0E6 << " " << max*1.0E6 << " ";
+	for (int i=0;i<HISTOGRAM_BINS;i++)
+		ss << (i==0?"":",") << bins[i];
+	return ss.str();
+}
+
+//
+// LatencyStats
+//
+
+LatencyStats::LatencyStats(int nchannels):transfer(nchannels),latency(nchannels)
+{
+	pthread_mutex_init(&mutex,0);
+}
+
+LatencyStats::~LatencyStats()
+{
+	pthread_mutex_destroy(&mutex);
+}
+
+void LatencyStats::add(int channel,double ttransfer,double tlatency)
+{
+	if (channel < 1 || channel > (int) transfer.size()) return;
+	pthread_mutex_lock(&mutex);
+	transfer.at(channel-1).add(ttransfer);
+	if (tlatency >= 0.0)
+		latency.at(channel-1).add(tlatency);
+	pthread_mutex_unlock(&mutex);
+}
+
+string LatencyStats::report()
+{
+	ostringstream ss;
+	ss << "# type channel n mean(us) sd(us) min(us) max(us) histogram" << endl;
+	ss << "# histogram bins are <1 us, then [2^(k-1),2^k) us for k=1.." << HISTOGRAM_BINS-2 << ", then the rest" << endl;
+	pthread_mutex_lock(&mutex);
+	for (unsigned int i=0;i<transfer.size();i++)
+		ss << "transfer " << i+1 << " " << transfer.at(i).report() << endl;
+	for (unsigned int i=0;i<latency.size();i++)
+		ss << "latency " << i+1 << " " << latency.at(i).report() << endl;
+	pthread_mutex_unlock(&mutex);
+	return ss.str();
+}
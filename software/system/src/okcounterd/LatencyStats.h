@@ -0,0 +1,75 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2017  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef __LATENCY_STATS_H_
+#define __LATENCY_STATS_H_
+
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Running statistics and a histogram of a time interval.
+// Bin 0 is for intervals < 1 us, bin k (k > 0) for [2^(k-1),2^k) us, and the last bin for anything longer.
+
+#define HISTOGRAM_BINS 22
+
+class Histogram
+{
+	public:
+	
+		Histogram();
+		void add(double); // in seconds
+		void reset();
+		string report();
+	
+	private:
+	
+		unsigned long n;
+		double mean,m2,min,max; // in seconds
+		unsigned long bins[HISTOGRAM_BINS];
+};
+
+// Per-channel statistics of the USB transfer times and acquisition latencies.
+// Updated by the acquisition thread and reported to the Server thread.
+
+class LatencyStats
+{
+	public:
+	
+		LatencyStats(int nchannels);
+		~LatencyStats();
+		
+		void add(int channel,double transfer,double latency); // channel is 1 .. nchannels, latency < 0 if unknown
+		string report();
+		
+	private:
+	
+		pthread_mutex_t mutex;
+		vector<Histogram> transfer; // duration of the USB transactions for an event
+		vector<Histogram> latency;  // upper bound on the time from the event to its readout
+};
+
+#endif
@@ -59,20 +59,23 @@ int main(
 	FILE *str;
 	pid_t pid;
 	
-	struct sched_param	sched;
 	debugStream= NULL;
 	string bitfile="";
+	string configFile=OKCOUNTERD_CONFIG;
 	
 	OKCounterD *app = new OKCounterD(argc,argv);
 	
 	// Process the command line options
-	while ((opt=getopt(argc,argv,"b:d:hv")) != -1)
+	while ((opt=getopt(argc,argv,"b:c:d:hv")) != -1)
 	{
 		switch(opt)
 		{
 			case 'b':
 				bitfile=optarg;
 				break;
+			case 'c':
+				configFile=optarg;
+				break;
 			case 'd':	// enable debugging 
 				{
 					string dbgout = optarg;
@@ -103,6 +106,9 @@ int main(
 		}
 	}
 	
+	if (!app->readConfig(configFile))
+		exit(EXIT_FAILURE);
+	
 	// Check whether the daemon is already running and exit if it is 
 	if (!access(PID_FILE, R_OK)){
 		if ((str = fopen(PID_FILE, "r"))){
@@ -148,19 +154,11 @@ int main(
 
 	syslog(LOG_INFO,"okcounterd version %s started",OKCOUNTERD_VERSION);
 
-	// Become a low priority real-time process 
-	sched.sched_priority = sched_get_priority_min(SCHED_FIFO);
-	if ( sched_setscheduler(0, SCHED_FIFO, &sched) == -1 )
-	{
-		syslog(LOG_ERR,"%s",strerror(errno));
-		syslog(LOG_ERR,"exiting");
-		unlink(PID_FILE);
-		exit(EXIT_FAILURE);
-	}
-	// Lock memory so we don't get paged out
-	if ( mlockall(MCL_FUTURE|MCL_CURRENT) == -1 )
+	// Set scheduling, CPU affinity and memory locking
+	string err;
+	if (!app->configureProcess(err))
 	{
-		syslog(LOG_ERR,"%s",strerror(errno));
+		syslog(LOG_ERR,"%s",err.c_str());
 		syslog(LOG_ERR,"exiting");
 		unlink(PID_FILE);
 		exit(EXIT_FAILURE);
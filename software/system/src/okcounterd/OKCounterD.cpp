@@ -24,19 +24,23 @@
 //
 // Modification history
 
+#include <sys/mman.h>
 #include <sys/time.h>
+#include <syslog.h>
+#include <time.h>
 #include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 
+#include "Counter.h"
 #include "Debug.h"
 #include "OKCounterD.h"
 #include "Server.h"
 
-#define NCHANNELS 6
-#define BASEADDR 0x20
-
 extern ostream *debugStream;
 
 //
@@ -50,8 +54,21 @@ OKCounterD::OKCounterD(int argc,char **argv)
 
 OKCounterD::~OKCounterD()
 {
+	for (unsigned int i=0;i<counters.size();i++){
+		if (counters.at(i)->isRunning())
+			counters.at(i)->stop();
+		delete counters.at(i);
+	}
+#ifndef OKFRONTPANEL
+	OpenOK_DeviceManager::Instance().StopHotplug();
+#endif
+	delete latencyStats;
+	pthread_mutex_destroy(&publishMutex);
 	server->stop();
 	delete server;
+	if (logger->isRunning())
+		logger->stop();
+	delete logger;
 }
 
 void OKCounterD::showHelp()
@@ -60,6 +77,7 @@ void OKCounterD::showHelp()
 	cout << "Usage: " << APP_NAME << " [options]" << endl;
 	cout << "Available options are" << endl;
 	cout << "-b <file> specify a bitfile to load"<< endl;
+	cout << "-c <file> use this configuration file (default " << OKCOUNTERD_CONFIG << ")" << endl;
 	cout << "-d <file> turn on debugging to <file> (use 'stderr' for output to stderr)" << endl;
 	cout << "-h print this help message" << endl;
 	cout << "-v print version" << endl;
@@ -80,70 +98,38 @@ void OKCounterD::showVersion()
 
 void OKCounterD::run()
 {
-	// Collects data from the FPGA
-	
-	vector<int> measurements;
+	// Each device is read by a Counter thread. The main thread just waits
 	
 	server = new Server(this,port); // start the Server thread
+	server->setOptions(serverOptions);
 	server->go();
 	
 	DBGMSG(debugStream,"server started");
 	
-	xem->UpdateTriggerOuts();
-	
-	// system control register
-  // bits 2->0 : selection of output 1 pps source  
-  // bit  3    : enable external I/O on GPIO pin
-	xem->SetWireInValue(epSysControl,0x0f);
-	xem->UpdateWireIns();
-	xem->UpdateWireOuts();
-	
-	// bit 2->0: pps out source
-	// bit 3   : GPIO enabled
-	// bit 4   : DCM locked
-	unsigned int sysStatus=xem->GetWireOutValue(epSysStatus) & 0xffff;
-	DBGMSG(debugStream,"Status: " << "PPS OUT=" << (sysStatus & 0x07) << 
-		" GPIO_EN=" << ((sysStatus &0x08)>>3) << " DCM_LOCK=" << ((sysStatus & 0x10)>>4));
-
-	for (;;){
-		usleep(10000);
-		measurements.clear();
-		xem->UpdateTriggerOuts();
-		int triggered=0;
-		int bitmask=0x01;
-		for (int i=0;i<NCHANNELS;i++){
-			triggered = triggered || (xem->IsTriggered(0x60,bitmask) && (channelMask & bitmask));
-			bitmask=bitmask << 1;
-		}
-		
-		if (triggered){
-			int addr=BASEADDR;
-			int bitmask=0x01;
-			struct timeval tv;
-			int rdg;
-			unsigned int upperbits,lowerbits;
-			xem->UpdateWireOuts();
-			for (int i=0;i<NCHANNELS;i++){
-				if (channelMask & bitmask){
-					if (xem->IsTriggered(0x60,bitmask)){
-						gettimeofday(&tv,NULL);
-						upperbits=xem->GetWireOutValue(addr+1) & 0xffff;
-						lowerbits=xem->GetWireOutValue(addr) & 0xffff;
-						rdg = (upperbits  << 16) + lowerbits;
-						rdg= (int)rdg*5.0E-9*1.0E9/4.0;
-						if (rdg>500000000) rdg -= 1000000000;
-						measurements.push_back(i+1);
-						measurements.push_back((int) tv.tv_sec);
-						measurements.push_back((int) tv.tv_usec);
-						measurements.push_back(rdg);
-					}
-				}
-				bitmask=bitmask << 1;
-				addr += 2;
-			}
-			server->sendData(measurements);
-		}// if triggered
-	}	
+	if (logger->isLogging()){
+		logger->setOptions(loggerOptions);
+		logger->go();
+		DBGMSG(debugStream,"logger started");
+	}
+	
+	if (shmSlots > 0 && !shm.open(shmName,shmSlots))
+		log("Failed to create shared memory " + shmName);
+	
+#ifndef OKFRONTPANEL
+	// Lost devices are reopened as soon as they are plugged in again, rather than at the next retry
+	if (OpenOK_DeviceManager::Instance().StartHotplug())
+		DBGMSG(debugStream,"hotplug events started");
+#endif
+
+	for (unsigned int i=0;i<counters.size();i++){
+		counters.at(i)->setOptions(acquisitionOptions);
+		counters.at(i)->go();
+	}
+	
+	reportThreads();
+	
+	for (;;)
+		pause();
 }
 
 void OKCounterD::log(string msg)
@@ -154,30 +140,54 @@ void OKCounterD::log(string msg)
 void OKCounterD::setOutputPPSSource(int src)
 {
 	DBGMSG(debugStream,"Setting output PPS source " << src);
-  // bits 2->0 : selection of output 1 pps source   
-	xem->SetWireInValue(epSysControl,src & 0x07,0x07);
-	xem->UpdateWireIns();
+	for (unsigned int i=0;i<counters.size();i++)
+		counters.at(i)->setOutputPPSSource(src);
 }
 
 void OKCounterD::setGPIOEnable(bool en)
 {
 	DBGMSG(debugStream,"Setting GPIO enable " << (en? "ON" : "OFF"));
-	 // bit  3    : enable external I/O on GPIO pin
-	unsigned int enb = en ? 0x08 : 0x00;
-	xem->SetWireInValue(epSysControl,enb,0x08);
-	xem->UpdateWireIns();
+	for (unsigned int i=0;i<counters.size();i++)
+		counters.at(i)->setGPIOEnable(en);
 }
 
 string OKCounterD::getConfiguration()
 { 
-	xem->UpdateWireOuts();
-	unsigned int sysStatus=xem->GetWireOutValue(epSysStatus) & 0xffff;
+	// With several devices, there is a line for each
+	if (counters.size() == 1)
+		return counters.at(0)->getConfiguration();
 	ostringstream ss;
-	ss << "PPS OUT=" << (sysStatus & 0x07) <<" GPIO_EN=" << ((sysStatus &0x08)>>3) << " DCM_LOCK=" << ((sysStatus & 0x10)>>4);
-	DBGMSG(debugStream,"Status: " << ss.str());
+	for (unsigned int i=0;i<counters.size();i++){
+		Counter *c = counters.at(i);
+		ss << c->serialNumber() << " channels " << c->firstChannel() << "-" << c->firstChannel()+NCHANNELS-1 
+			<< ": " << c->getConfiguration() << endl;
+	}
 	return ss.str();
 }
 
+string OKCounterD::getLatencyStatistics()
+{
+	return latencyStats->report();
+}
+
+void OKCounterD::setUSBStatistics(bool en)
+{
+	DBGMSG(debugStream,"USB statistics " << (en? "ON" : "OFF"));
+	usbStatistics=en;
+	for (unsigned int i=0;i<counters.size();i++)
+		counters.at(i)->setUSBStatistics(en);
+}
+
+string OKCounterD::getUSBStatistics()
+{
+	ostringstream ss;
+	for (unsigned int i=0;i<counters.size();i++){
+		Counter *c = counters.at(i);
+		ss << "# device " << c->serialNumber() << " channels " << c->firstChannel() << "-" << c->firstChannel()+NCHANNELS-1 << endl;
+		ss << c->getUSBStatistics();
+	}
+	return ss.str();
+}
 		
 //
 // private members
@@ -185,54 +195,259 @@ string OKCounterD::getConfiguration()
 
 void OKCounterD::init()
 {
-	xem=NULL;
 	dbgOn=false;
+	latencyStats=NULL;
+	usbStatistics=false;
+	pthread_mutex_init(&publishMutex,0);
 	port=21577;
 	server=NULL;
 	channelMask=0xffff;
 	epSysControl=0x00;
 	epSysStatus=0x2c;
+	readoutMode=WireOutReadout;
+	epFIFOPipe=0xa0;
+	epFIFOCount=0x2d;
+	epFIFOTime=0x2e;
+	FIFOClock=200.0E6;
+	FIFOBlockSize=4096;
+	FIFOPollInterval=0.01;
+	epDesignHashIn=-1;
+	epDesignHashOut=-1;
+	logger = new CounterLogger();
+	loggerOptions.priority=0; // disk I/O does not need to be real-time
+	lockMemory=true;
+	acquisitionOptions.priority=sched_get_priority_min(SCHED_FIFO); // a low priority real-time process, as before
+	acquisitionOptions.stackSize=64*1024;
+	shmName=SHM_RING_NAME;
+	shmSlots=4096;
+}
+
+void OKCounterD::publish(vector<int> &measurements)
+{
+	// Called by each of the counters
+	pthread_mutex_lock(&publishMutex);
+	// Local readers first, since they are the most latency sensitive
+	shm.publish(measurements);
+	server->sendData(measurements);
+	if (logger->isRunning())
+		logger->log(measurements);
+	pthread_mutex_unlock(&publishMutex);
 }
 
-bool OKCounterD::initializeFPGA(string bitfile)
+bool OKCounterD::readThreadOptions(ListEntry *last,const char *section,ThreadOptions &opts)
 {
+	char *stmp;
+	int itmp;
 	
-	// Open the first XEM - try all board types.
-#ifdef OKFRONTPANEL
-	xem = new okCFrontPanel;
-	if (okCFrontPanel::NoError != xem->OpenBySerial()) {
-#else
-	xem = new OpenOK;
-	if (OpenOK::NoError != xem->OpenBySerial()) {
-#endif
-		delete xem;
-		cerr << "Device could not be opened.  Is one connected?" << endl;
-		return false;
+	if (list_get_int(last,section,"Priority",&itmp)){
+		int pmax = sched_get_priority_max(SCHED_FIFO);
+		if (itmp < -1 || itmp > pmax){
+			cerr << section << ": priority must be in the range -1 to " << pmax << endl;
+			return false;
+		}
+		opts.priority=itmp;
+	}
+	if (list_get_string(last,section,"CPUs",&stmp)){
+		opts.cpus=stmp;
+		cpu_set_t set;
+		if (!opts.cpuSet(&set)){
+			cerr << section << ": invalid CPU list " << stmp << endl;
+			return false;
+		}
+	}
+	if (list_get_int(last,section,"Stack size",&itmp)) // in kB
+		opts.stackSize=(itmp > 0 ? itmp*1024 : 0);
+	if (list_get_string(last,section,"Prefault stack",&stmp))
+		opts.prefaultStack = (0==strcasecmp(stmp,"yes"));
+	return true;
+}
+
+void OKCounterD::reportThreads()
+{
+	ostringstream ss;
+	for (unsigned int i=0;i<counters.size();i++){
+		ss.str("");
+		ss << "acquisition thread for channels " << counters.at(i)->firstChannel() << "-" 
+			<< counters.at(i)->firstChannel()+NCHANNELS-1 << ": " << counters.at(i)->describe();
+		syslog(LOG_INFO,"%s",ss.str().c_str());
+		DBGMSG(debugStream,ss.str());
 	}
 	
-	DBGMSG(debugStream, "Found  a device: " << xem->GetBoardModelString(xem->GetBoardModel()));
+	ss.str("");
+	ss << "server thread: " << server->describe();
+	syslog(LOG_INFO,"%s",ss.str().c_str());
+	DBGMSG(debugStream,ss.str());
+	
+	if (logger->isRunning()){
+		ss.str("");
+		ss << "logger thread: " << logger->describe();
+		syslog(LOG_INFO,"%s",ss.str().c_str());
+		DBGMSG(debugStream,ss.str());
+	}
+	
+	ss.str("");
+	ss << "memory " << (lockMemory ? "locked" : "not locked");
+	syslog(LOG_INFO,"%s",ss.str().c_str());
+	DBGMSG(debugStream,ss.str());
+}
 
-	xem->LoadDefaultPLLConfiguration();	
+double OKCounterD::monotonicTime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec + ts.tv_nsec*1.0E-9;
+}
 
-	// Get some general information about the XEM.
-	DBGMSG(debugStream, "Device firmware version: " << xem->GetDeviceMajorVersion() << "." << xem->GetDeviceMinorVersion());
-	DBGMSG(debugStream, "Device serial number:" << xem->GetSerialNumber());
-	DBGMSG(debugStream, "Device ID: " << xem->GetDeviceID());
+bool OKCounterD::readConfig(string configFile)
+{
+	// A missing configuration file is not an error - the defaults are used
+	if (access(configFile.c_str(),R_OK)){
+		DBGMSG(debugStream,configFile << " not found - using defaults");
+		return true;
+	}
 	
-	// Download the configuration file, if one has been specified on the command line
-	if (!bitfile.empty()){
-#ifdef OKFRONTPANEL
-		if (okCFrontPanel::NoError != xem->ConfigureFPGA(bitfile.c_str())) {
-#else
-		if (OpenOK::NoError != xem->ConfigureFPGA(bitfile.c_str())) {
-#endif
-			cerr << "FPGA configuration failed";
-			delete xem;
+	ListEntry *last;
+	if (!configfile_parse_as_list(&last,configFile.c_str())){
+		cerr << "Failed to read " << configFile << endl;
+		return false;
+	}
+	
+	char *stmp;
+	int itmp;
+	double dtmp;
+	
+	if (list_get_string(last,"Readout","Mode",&stmp)){
+		if (0==strcasecmp(stmp,"fifo"))
+			readoutMode=FIFOReadout;
+		else if (0==strcasecmp(stmp,"wire"))
+			readoutMode=WireOutReadout;
+		else{
+			cerr << "Unknown readout mode " << stmp << endl;
+			return false;
+		}
+	}
+	if (list_get_int(last,"Readout","FIFO pipe",&itmp))
+		epFIFOPipe=itmp;
+	if (list_get_int(last,"Readout","FIFO count",&itmp))
+		epFIFOCount=itmp;
+	if (list_get_int(last,"Readout","FIFO time",&itmp))
+		epFIFOTime=itmp;
+	if (list_get_double(last,"Readout","FIFO clock",&dtmp)){
+		if (dtmp <= 0.0){
+			cerr << "Bad FIFO clock " << dtmp << endl;
+			return false;
+		}
+		FIFOClock=dtmp;
+	}
+	if (list_get_int(last,"Readout","Block size",&itmp)){
+		FIFOBlockSize=itmp - (itmp % 16); // multiple of the record size and the pipe width
+		if (FIFOBlockSize < 16) FIFOBlockSize=16;
+	}
+	if (list_get_double(last,"Readout","Poll interval",&dtmp))
+		FIFOPollInterval=dtmp;
+	
+	if (list_get_string(last,"Devices","Serials",&stmp)){
+		// comma separated
+		string str=stmp;
+		size_t start=0;
+		while (start <= str.size()){
+			size_t end=str.find(',',start);
+			if (end == string::npos) end=str.size();
+			string serial=str.substr(start,end-start);
+			serial.erase(0,serial.find_first_not_of(" \t"));
+			serial.erase(serial.find_last_not_of(" \t")+1);
+			if (!serial.empty())
+				serials.push_back(serial);
+			start=end+1;
+		}
+		if (serials.size() > MAXDEVICES){
+			cerr << "Too many devices (the maximum is " << MAXDEVICES << ")" << endl;
+			list_clear(last);
+			return false;
+		}
+	}
+	
+	if (list_get_int(last,"FPGA","Design hash wire in",&itmp))
+		epDesignHashIn=itmp;
+	if (list_get_int(last,"FPGA","Design hash wire out",&itmp))
+		epDesignHashOut=itmp;
+	
+	if (list_get_string(last,"USB","Statistics",&stmp))
+		usbStatistics = (0==strcasecmp(stmp,"yes"));
+	
+	if (list_get_string(last,"Memory","Lock",&stmp))
+		lockMemory = (0==strcasecmp(stmp,"yes"));
+	if (!readThreadOptions(last,"Acquisition thread",acquisitionOptions) ||
+		  !readThreadOptions(last,"Server thread",serverOptions) ||
+		  !readThreadOptions(last,"Logger thread",loggerOptions)){
+		list_clear(last);
+		return false;
+	}
+	
+	// Counter logs
+	if (list_get_int(last,"Counter log","Sync interval",&itmp))
+		logger->setSyncInterval(itmp);
+	if (list_get_string(last,"Counter log","Compress",&stmp))
+		logger->setCompression(0==strcasecmp(stmp,"yes"));
+	for (int i=1;i<=MAXCHANNELS;i++){
+		ostringstream section;
+		section << "Counter log channel " << i;
+		string path,ext,status,header;
+		if (!list_get_string(last,section.str().c_str(),"Path",&stmp))
+			continue;
+		path=stmp;
+		if (!list_get_string(last,section.str().c_str(),"Extension",&stmp)){
+			cerr << section.str() << ": no extension" << endl;
+			list_clear(last);
 			return false;
 		}
+		ext=stmp;
+		if (list_get_string(last,section.str().c_str(),"Status file",&stmp))
+			status=stmp;
+		if (list_get_string(last,section.str().c_str(),"Header generator",&stmp))
+			header=stmp;
+		logger->addChannel(i,path,ext,status,header);
 	}
-	// Check for FrontPanel support in the FPGA configuration.
-	DBGMSG(debugStream, "FrontPanel support is " << (xem->IsFrontPanelEnabled()?"":"not ") << "enabled");
 	
+	if (list_get_string(last,"Shared memory","Name",&stmp))
+		shmName=stmp;
+	if (list_get_int(last,"Shared memory","Slots",&itmp))
+		shmSlots=(itmp > 0 ? itmp:0);
+	
+	list_clear(last);
 	return true;
 }
+
+bool OKCounterD::configureProcess(string &err)
+{
+	// Lock memory so we don't get paged out
+	if (lockMemory && mlockall(MCL_FUTURE|MCL_CURRENT) == -1){
+		err = string("mlockall(): ") + strerror(errno);
+		return false;
+	}
+	// The acquisition threads get the same options. They are also applied to the main thread, 
+	// so that threads which inherit their settings get these
+	return acquisitionOptions.applyToSelf(err);
+}
+
+bool OKCounterD::initializeFPGA(string bf)
+{
+	// Devices which can't be opened now are waited for by their counter
+	bitfile=bf;
+	
+	if (serials.empty())
+		serials.push_back(""); // the first device found
+	
+	latencyStats = new LatencyStats(NCHANNELS*serials.size());
+	
+	bool ok=true;
+	for (unsigned int i=0;i<serials.size();i++){
+		Counter *c = new Counter(this,serials.at(i),1+i*NCHANNELS);
+		counters.push_back(c);
+		if (!c->open()){
+			cerr << "Device " << (serials.at(i).empty() ? "" : serials.at(i) + " ") << "could not be opened.  Is one connected?" << endl;
+			ok=false;
+		}
+	}
+	return ok;
+}
@@ -26,7 +26,9 @@
 #ifndef __OK_COUNTERD_H_
 #define __OK_COUNTERD_H_
 
+#include <pthread.h>
 #include <string>
+#include <vector>
 
 #ifdef OKFRONTPANEL
 	#include <okFrontPanelDLL.h>
@@ -34,13 +36,24 @@
 	#include "OpenOK.h"
 #endif 
 
+#include <configurator.h>
+
+#include "CounterLogger.h"
+#include "LatencyStats.h"
+#include "ShmPublisher.h"
+#include "Thread.h"
+
 #define APP_NAME "okcounterd"
 #define AUTHOR "Michael Wouters, Louis Marais"
 #define OKCOUNTERD_VERSION "0.2.0"
 #define OKCOUNTERD_CONFIG "/usr/local/etc/okcounterd.conf"
 
+#define NCHANNELS 6 // per device
+#define MAXDEVICES 5 // so that all the channels fit in MAXCHANNELS (see Client.h)
+
 using namespace std;
 
+class Counter;
 class Server;
 
 class OKCounterD
@@ -53,6 +66,8 @@ class OKCounterD
 		void setDebugOn(bool dbg){dbgOn=dbg;}
 		
 		bool initializeFPGA(string bitfile);
+		bool readConfig(string);
+		bool configureProcess(string &);
 		
 		void showHelp();
 		void showVersion();
@@ -63,22 +78,55 @@ class OKCounterD
 		void setOutputPPSSource(int);
 		void setGPIOEnable(bool);
 		string getConfiguration();
+		string getLatencyStatistics();
+		void setUSBStatistics(bool);
+		string getUSBStatistics();
 		
 private:
 	
+		friend class Counter;
+		
 		void init();
+		void publish(vector<int> &);
+		bool readThreadOptions(ListEntry *,const char *,ThreadOptions &);
+		void reportThreads();
+		double monotonicTime();
+		
 		bool dbgOn;
-#ifdef OKFRONTPANEL
-		okCFrontPanel *xem;
-#else
-		OpenOK *xem;
-#endif
+		vector<string> serials; // of the devices to use, or empty for the first device found
+		vector<Counter *> counters;
+		string bitfile;
 		Server *server;
 		long port;
 		
+		CounterLogger *logger;
+		
+		ThreadOptions acquisitionOptions,serverOptions,loggerOptions;
+		bool lockMemory;
+		
+		pthread_mutex_t publishMutex; // the counters publish through single producer queues
+		ShmPublisher shm;
+		string shmName;
+		int shmSlots;
+		
 		unsigned int channelMask;
 		unsigned int epSysControl;
 		unsigned int epSysStatus;
+		
+		enum ReadoutMode {WireOutReadout,FIFOReadout};
+		int readoutMode;
+		int epFIFOPipe;  // pipe out for events
+		int epFIFOCount; // wire out with the number of 16 bit words in the FIFO
+		int epFIFOTime;  // first of four wire outs with the FPGA's current time, in clock ticks
+		double FIFOClock; // FPGA clock rate for event times, in Hz
+		int FIFOBlockSize; // maximum bytes per read
+		double FIFOPollInterval; // in seconds
+		
+		int epDesignHashIn;  // first of two wire ins holding the hash of the loaded bitfile, -1 if not used
+		int epDesignHashOut; // and the wire outs they are echoed to
+		
+		LatencyStats *latencyStats;
+		bool usbStatistics; // per-operation statistics of the USB transfers, collected by OpenOK
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,89 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2017  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef __RING_BUFFER_H_
+#define __RING_BUFFER_H_
+
+#include <atomic>
+
+// Bounded, lock-free ring buffer for a single producer and a single consumer.
+// When the buffer is full, new items are dropped and counted. 
+
+template <class T> class RingBuffer
+{
+	public:
+	
+		RingBuffer(unsigned int capacity):
+			head(0),tail(0),nDropped(0),nPushed(0)
+		{
+			size = capacity+1; // one slot is always empty
+			items = new T[size];
+		}
+		
+		~RingBuffer()
+		{
+			delete[] items;
+		}
+		
+		// Called by the producer. Returns false if the item was dropped.
+		bool push(const T &item)
+		{
+			unsigned int h = head.load(std::memory_order_relaxed);
+			unsigned int next = (h+1) % size;
+			if (next == tail.load(std::memory_order_acquire)){
+				nDropped++;
+				return false;
+			}
+			items[h]=item;
+			head.store(next,std::memory_order_release);
+			nPushed++;
+			return true;
+		}
+		
+		// Called by the consumer. Returns false if the buffer is empty.
+		bool pop(T &item)
+		{
+			unsigned int t = tail.load(std::memory_order_relaxed);
+			if (t == head.load(std::memory_order_acquire))
+				return false;
+			item = items[t];
+			tail.store((t+1) % size,std::memory_order_release);
+			return true;
+		}
+		
+		unsigned long dropped(){return nDropped;}
+		unsigned long pushed(){return nPushed;}
+		
+	private:
+	
+		RingBuffer(const RingBuffer &);
+		RingBuffer &operator=(const RingBuffer &);
+		
+		T *items;
+		unsigned int size;
+		std::atomic<unsigned int> head,tail;
+		std::atomic<unsigned long> nDropped,nPushed;
+};
+
+#endif
@@ -24,16 +24,19 @@
 
 #include <sys/types.h>         
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <arpa/inet.h>
 #include <string.h>
 #include <strings.h>
-#include <sys/select.h>
 #include <pthread.h>
 #include <signal.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <cstdio>
+#include <ctime>
 
 #include <iostream>
 #include <sstream>
@@ -44,12 +47,16 @@
 #include "Server.h"
 
 #define BUFSIZE 8096
-#define MAXCLIENTS 16
+#define MAXCLIENTS 512
+#define MAXEVENTS 64
+#define MAXQUEUED 1024 // readings queued from the acquisition thread
+#define CLOSE_TIMEOUT 5 // seconds to wait for the remote end to close a finished connection
+#define REQUEST_TIMEOUT 30 // seconds to wait for a request on a new connection
 
 extern ostream* debugStream;
 
 //
-// Public
+//	public
 //
 
 Server::Server(OKCounterD *a,int p)
@@ -57,26 +64,52 @@ Server::Server(OKCounterD *a,int p)
 	threadID = "server";
 	app = a;
 	port=p; 
+	readings = new RingBuffer<CounterReading>(MAXQUEUED);
+	for (int i=0;i<=MAXCHANNELS;i++){
+		sequence[i]=0;
+		latest[i]=NULL;
+	}
 	if (!init())
 		exit(EXIT_FAILURE);
 }
 
 Server::~Server()
 {
-	close(listenfd);
 	for (unsigned int i=0;i<clients.size();i++)
-		clients.at(i)->stop();
+		delete clients.at(i);
+	close(listenfd);
+	close(epollfd);
+	close(wakeupfd);
+	delete readings;
+	for (int i=0;i<=MAXCHANNELS;i++)
+		if (latest[i]) latest[i]->unref();
 }
 
-
-void Server::sendData(vector<int> &data){
-	for (unsigned int i=0;i<clients.size();i++){
-		clients.at(i)->sendData(data);
+void Server::sendData(vector<int> &data)
+{
+	for (unsigned int i=0;i<data.size();i+=4){
+		CounterReading r;
+		r.channel=data.at(i);
+		r.tv_sec=data.at(i+1);
+		r.tv_usec=data.at(i+2);
+		r.reading=data.at(i+3);
+		if (!readings->push(r))
+			DBGMSG(debugStream,"server queue full - reading dropped");
 	}
+	uint64_t one=1;
+	write(wakeupfd,&one,sizeof(one));
+}
+
+void Server::stop()
+{
+	stopRequested=true;
+	uint64_t one=1;
+	write(wakeupfd,&one,sizeof(one));
+	Thread::stop();
 }
 
 //
-// Protected
+//	protected
 //
 
 void Server::doWork()
@@ -91,56 +124,43 @@ void Server::doWork()
 	sigaddset(&blocked,SIGPIPE);
 	pthread_sigmask(SIG_BLOCK,&blocked,NULL);
 	
-	int socketfd;
-	socklen_t len;
-	struct sockaddr_in cli_addr; 
-	bzero(&cli_addr,sizeof(cli_addr));
-
-	fd_set rfds;
-  struct timeval tv;
-  int retval;
+	struct epoll_event events[MAXEVENTS];
 	
 	while (!stopRequested) 
 	{
-	
-		tv.tv_sec=5;
-		tv.tv_usec=0;
+		int nfds = epoll_wait(epollfd,events,MAXEVENTS,1000); // time out to reap idle connections
 		
-		FD_ZERO(&rfds);
-		FD_SET(listenfd, &rfds);
-
-		retval = select(listenfd+1, &rfds, NULL,NULL, &tv); // note number of file descriptors!
-	
-		if (retval) {
-			len= sizeof(cli_addr);
-			if((socketfd = accept(listenfd, (struct sockaddr *)&cli_addr, &len)) < 0)
-				app->log("ERROR in accept()");
-			else{
-				processRequest(socketfd);
+		for (int i=0;i<nfds;i++){
+			if (NULL == events[i].data.ptr){
+				acceptConnections();
 			}
-		}
-		
-		unsigned int j=0;
-		while (j<clients.size()){
-			Client *c = clients.at(j);
-			if (!c->isRunning()){
-				DBGMSG(debugStream,"stopping client");
-				c->stop();
-				clients.erase(clients.begin()+j);
-				delete c;
+			else if (this == events[i].data.ptr){
+				uint64_t n;
+				read(wakeupfd,&n,sizeof(n));
+				fanOut();
+			}
+			else{
+				Client *c = (Client *) events[i].data.ptr;
+				if (c->fd() < 0) continue; // closed earlier in this pass
+				if (events[i].events & (EPOLLIN|EPOLLHUP|EPOLLERR))
+					readRequest(c);
+				if ((events[i].events & EPOLLOUT) && c->fd() >= 0){
+					if (!c->flush())
+						closeClient(c);
+					else
+						updateEvents(c);
+				}
 			}
-			else
-				j++;
 		}
 		
+		reapClients();
 	}
 	
 	running=false;
 }
 
-
 //
-// Private
+//	private
 //
 
 bool Server::init()
@@ -188,6 +208,23 @@ bool Server::init()
 		return false;
 	}
 	
+	if ((epollfd = epoll_create1(0)) < 0){
+		app->log("ERROR in epoll_create1()");
+		return false;
+	}
+	
+	if ((wakeupfd = eventfd(0,EFD_NONBLOCK)) < 0){
+		app->log("ERROR in eventfd()");
+		return false;
+	}
+	
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL; // listen socket
+	epoll_ctl(epollfd,EPOLL_CTL_ADD,listenfd,&ev);
+	ev.data.ptr = this; // acquisition wakeup
+	epoll_ctl(epollfd,EPOLL_CTL_ADD,wakeupfd,&ev);
+	
 	ostringstream ss;
 	ss << "listening on port " << port;
 	app->log(ss.str());
@@ -196,27 +233,88 @@ bool Server::init()
 	
 }
 
-bool Server::processRequest(int socketfd)
+void Server::acceptConnections()
 {
-	// Two requests:
-	// LISTEN to counter readings
-	// CONFIGURE the counter
-	// QUERY the counter configuration
+	struct sockaddr_in cli_addr; 
+	socklen_t len;
+	int socketfd;
 	
-	long ret;
-	static char buffer[BUFSIZE+1]; 
+	for (;;){
+		len= sizeof(cli_addr);
+		if ((socketfd = accept(listenfd, (struct sockaddr *)&cli_addr, &len)) < 0){
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				app->log("ERROR in accept()");
+			return;
+		}
+		if (clients.size() >= MAXCLIENTS){
+			app->log("Too many connections");
+			close(socketfd);
+			continue;
+		}
+		fcntl(socketfd,F_SETFL,fcntl(socketfd,F_GETFL) | O_NONBLOCK);
+		Client *client = new Client(this,socketfd);
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.ptr = client;
+		if (epoll_ctl(epollfd,EPOLL_CTL_ADD,socketfd,&ev) < 0){
+			app->log("ERROR in epoll_ctl()");
+			delete client;
+			continue;
+		}
+		clients.push_back(client);
+		DBGMSG(debugStream,"new connection " << client->id() << " (" << clients.size() << " clients)");
+	}
+}
 
-	ret =read(socketfd,buffer,BUFSIZE); 	// read request in one go 
-	if(ret == 0 || ret == -1) {	// read failure
-		//app->log("failed to read client request");
-		return false;
+void Server::readRequest(Client *c)
+{
+	char buffer[BUFSIZE+1];
+	
+	for (;;){
+		long ret = recv(c->fd(),buffer,BUFSIZE,MSG_DONTWAIT);
+		if (ret > 0){
+			buffer[ret]=0;
+			processRequest(c,buffer);
+			if (c->fd() < 0) return; // closed
+		}
+		else if (ret == 0){
+			DBGMSG(debugStream,"connection " << c->id() << " closed by remote");
+			closeClient(c);
+			return;
+		}
+		else {
+			if (errno == EINTR) continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK){
+				DBGMSG(debugStream,"recv error : " << strerror(errno) << " " << c->id() << " closed");
+				closeClient(c);
+			}
+			return;
+		}
+	}
+}
+
+void Server::processRequest(Client *c,char *buffer)
+{
+	// Requests are:
+	// LISTEN to counter readings (LISTEN BINARY for the binary protocol)
+	//   followed by optional subscription options (see Client::subscribe())
+	//   and SNAPSHOT, to be sent the latest reading on each channel first
+	// CONFIGURE the counter
+	// QUERY the counter configuration (QUERY CONFIGURATION), acquisition latency statistics (QUERY LATENCY)
+	//   or USB transfer statistics (QUERY USB)
+	// Once a client is listening, further messages can change the subscription
+	
+	DBGMSG(debugStream,c->id() << " received " << buffer);
+	
+	if (c->state() == Client::Listening){
+		c->subscribe(buffer);
+		return;
+	}
+	else if (c->state() != Client::Connected){
+		return;
 	}
-	if(ret > 0 && ret < BUFSIZE)	// return code is valid chars 
-		buffer[ret]=0;		// terminate the buffer 
-	else buffer[0]=0;
 	
 	if (NULL != strstr(buffer,"CONFIGURE") ){
-		DBGMSG(debugStream,"received " << buffer);
 		if (NULL != strstr(buffer,"PPSSOURCE")){
 			int src;
 			sscanf(buffer,"%*s%*s%i",&src);
@@ -227,77 +325,120 @@ bool Server::processRequest(int socketfd)
 			sscanf(buffer,"%*s%*s%i",&en);
 			app->setGPIOEnable((en==1));
 		}
+		else if (NULL != strstr(buffer,"USBSTATISTICS")){
+			int en;
+			sscanf(buffer,"%*s%*s%i",&en);
+			app->setUSBStatistics((en==1));
+		}
 		else{
 			DBGMSG(debugStream,"unknown command");
 		}
-		
 		// done so close the connection
-		if (-1==shutdown(socketfd,SHUT_RDWR)){
-			app->log("ERROR in shutdown()");
-		}
-		if (-1==close(socketfd)){
-			app->log("ERROR in close()");
-		}
+		closeClient(c);
 	}
-	else if (NULL != strstr(buffer,"QUERY CONFIGURATION") ){
-		DBGMSG(debugStream,"received " << buffer);
-		string cfg = app->getConfiguration();
-		writeBuffer(cfg,socketfd);
-		sleep(1); // wait a bit
-		// done so close the connection
-		if (-1==shutdown(socketfd,SHUT_RDWR)){
-			app->log("ERROR in shutdown()");
-		}
-		if (-1==close(socketfd)){
-			app->log("ERROR in close()");
+	else if (NULL != strstr(buffer,"QUERY CONFIGURATION") || NULL != strstr(buffer,"QUERY LATENCY") || 
+		NULL != strstr(buffer,"QUERY USB")){
+		if (NULL != strstr(buffer,"LATENCY"))
+			c->queueMessage(app->getLatencyStatistics());
+		else if (NULL != strstr(buffer,"USB"))
+			c->queueMessage(app->getUSBStatistics());
+		else
+			c->queueMessage(app->getConfiguration());
+		// done - the connection is closed when the remote end closes it, or after a timeout
+		c->setState(Client::Closing);
+		if (!c->flush())
+			closeClient(c);
+		else{
+			shutdown(c->fd(),SHUT_WR);
+			updateEvents(c);
 		}
 	}
 	else if(NULL != strstr(buffer,"LISTEN") ){ 
-		DBGMSG(debugStream,"received " << buffer);
-		// Sanity check on number of clients
-		if (clients.size() == MAXCLIENTS){
-			app->log("Too many connections");
-			if (-1==shutdown(socketfd,SHUT_RDWR)){
-				app->log("ERROR in shutdown()");
-			}
-			if (-1==close(socketfd)){
-				app->log("ERROR in close()");
-			}
+		c->setBinary(NULL != strstr(buffer,"BINARY"));
+		c->subscribe(buffer);
+		c->setState(Client::Listening);
+		// Send a snapshot of the latest readings, if asked for. 
+		// Not by default: these readings are stale, and the text clients timestamp readings on receipt
+		if (NULL != strstr(buffer,"SNAPSHOT")){
+			for (int i=1;i<=MAXCHANNELS;i++)
+				if (latest[i] && c->subscribed(i)) c->queueFrame(latest[i]);
 		}
-		else{	
-			Client *client = new Client(this,socketfd);
-			clients.push_back(client);
-			client->go();
+		if (!c->flush())
+			closeClient(c);
+		else
+			updateEvents(c);
+	}
+}
+
+void Server::fanOut()
+{
+	CounterReading r;
+	bool got=false;
+	while (readings->pop(r)){
+		got=true;
+		// Each reading is formatted once and shared by all clients 
+		Frame *f = new Frame(r,(r.channel >= 1 && r.channel <= MAXCHANNELS ? sequence[r.channel]++ : 0));
+		f->ref();
+		for (unsigned int i=0;i<clients.size();i++){
+			Client *c = clients.at(i);
+			if (c->state() == Client::Listening)
+				c->sendFrame(f);
+		}
+		if (r.channel >= 1 && r.channel <= MAXCHANNELS){
+			if (latest[r.channel]) latest[r.channel]->unref();
+			latest[r.channel]=f; // keeps the reference
 		}
+		else
+			f->unref();
+	}
+	if (!got) return;
+	for (unsigned int i=0;i<clients.size();i++){
+		Client *c = clients.at(i);
+		if (c->state() != Client::Listening || c->writePending()) continue; // pending clients are flushed when writable
+		if (!c->flush())
+			closeClient(c);
+		else
+			updateEvents(c);
 	}
-	return true;
 }
 
-void Server::writeBuffer(string msg,int socketfd){
-	
-	int nw,nEINTR=0;
-	int nleft = msg.size();
-	const char* pbuf=msg.c_str();
+void Server::updateEvents(Client *c)
+{
+	struct epoll_event ev;
+	ev.events = EPOLLIN | (c->writePending() ? EPOLLOUT : 0);
+	ev.data.ptr = c;
+	epoll_ctl(epollfd,EPOLL_CTL_MOD,c->fd(),&ev);
+}
+
+void Server::closeClient(Client *c)
+{
+	// The Client is deleted after the current pass through the event loop, 
+	// since there may be pending events for it
+	if (c->fd() < 0) return;
+	epoll_ctl(epollfd,EPOLL_CTL_DEL,c->fd(),NULL);
+	c->close();
+	closed.push_back(c);
+}
+
+void Server::reapClients()
+{
+	time_t now=time(NULL);
+	for (unsigned int i=0;i<clients.size();i++){
+		Client *c = clients.at(i);
+		if ((c->state() == Client::Closing && now - c->stateTime() > CLOSE_TIMEOUT) ||
+			  (c->state() == Client::Connected && now - c->stateTime() > REQUEST_TIMEOUT))
+			closeClient(c);
+	}
 	
-	while (nleft > 0){
-		if (( nw = write(socketfd,pbuf,nleft)) <= 0){
-			if (errno==EINTR){ // interrupted by signal
-				nw=0;
-				nEINTR++;
-				if (10==nEINTR){
-					DBGMSG(debugStream, "too many interrrupts - write() aborted");
-					return;
-				}
-			}
-			else{
-				DBGMSG(debugStream, strerror(errno));
-				return;
+	for (unsigned int i=0;i<closed.size();i++){
+		Client *c = closed.at(i);
+		for (unsigned int j=0;j<clients.size();j++){
+			if (clients.at(j) == c){
+				clients.erase(clients.begin()+j);
+				break;
 			}
 		}
-		DBGMSG(debugStream, "wrote " << nw);
-		nleft -=nw;
-		pbuf += nw;
-	}	
+		delete c;
+	}
+	closed.clear();
 }
-
-	
@@ -27,10 +27,15 @@
 
 #include <vector>
 
+#include "Client.h"
+#include "RingBuffer.h"
 #include "Thread.h"
 
 class OKCounterD;
-class Client;
+
+// The Server runs a single epoll loop which accepts connections, handles requests and 
+// writes readings to listening clients.
+// Readings are passed from the acquisition thread through a lock-free queue.
 
 class Server:public Thread
 {
@@ -38,7 +43,8 @@ class Server:public Thread
 
 		Server(OKCounterD *,int);
 		virtual ~Server();
-		void sendData(vector<int> &);
+		void sendData(vector<int> &); // called by the acquisition thread - never blocks
+		virtual void stop();
 		
 	protected:
 		
@@ -47,12 +53,22 @@ class Server:public Thread
 	private:
 
 		bool init();
-		bool processRequest(int);
-		void writeBuffer(string,int);
+		void acceptConnections();
+		void readRequest(Client *);
+		void processRequest(Client *,char *);
+		void fanOut();
+		void updateEvents(Client *);
+		void closeClient(Client *);
+		void reapClients();
 		
 		OKCounterD *app;
 		long port,listenfd;
-		std::vector<Client *> clients;	
+		int epollfd,wakeupfd;
+		RingBuffer<CounterReading> *readings; // from the acquisition thread
+		unsigned int sequence[MAXCHANNELS+1]; // of readings on each channel
+		Frame *latest[MAXCHANNELS+1]; // most recent reading on each channel, for new clients
+		std::vector<Client *> clients;
+		std::vector<Client *> closed; // deleted at the end of each pass through the event loop
 };
 
-#endif
+#endif
\ No newline at end of file
@@ -0,0 +1,127 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2017  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include "Debug.h"
+#include "ShmPublisher.h"
+
+extern ostream *debugStream;
+
+ShmPublisher::ShmPublisher()
+{
+	hdr=NULL;
+	size=0;
+}
+
+ShmPublisher::~ShmPublisher()
+{
+	close();
+}
+
+bool ShmPublisher::open(string shmname,unsigned int nslots)
+{
+	close();
+	
+	if (nslots == 0) return false;
+	// A power of two, so that the slots follow on when the record numbers wrap
+	unsigned int n=1;
+	while (n < nslots && n < 0x40000000u) n <<= 1;
+	nslots=n;
+	
+	// Start with a new object so that readers of a previous instance are not confused 
+	// by a change in size
+	shm_unlink(shmname.c_str());
+	int fd = shm_open(shmname.c_str(),O_CREAT|O_EXCL|O_RDWR,S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+	if (fd < 0){
+		DBGMSG(debugStream,"shm_open " << shmname << " failed: " << strerror(errno));
+		return false;
+	}
+	
+	size = shmRingSize(nslots);
+	if (ftruncate(fd,size) < 0){
+		DBGMSG(debugStream,"ftruncate " << shmname << " failed: " << strerror(errno));
+		::close(fd);
+		shm_unlink(shmname.c_str());
+		return false;
+	}
+	
+	void *p = mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+	::close(fd);
+	if (p == MAP_FAILED){
+		DBGMSG(debugStream,"mmap " << shmname << " failed: " << strerror(errno));
+		shm_unlink(shmname.c_str());
+		return false;
+	}
+	
+	// The new object is zero-filled, so all the slots are empty
+	hdr = (ShmRingHeader *) p;
+	hdr->version=SHM_RING_VERSION;
+	hdr->nslots=nslots;
+	hdr->recordSize=sizeof(ShmRecord);
+	hdr->head.store(0,std::memory_order_relaxed);
+	hdr->notify.store(0,std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	hdr->magic=SHM_RING_MAGIC;
+	
+	name=shmname;
+	DBGMSG(debugStream,"publishing to " << name << " (" << nslots << " slots)");
+	return true;
+}
+
+void ShmPublisher::close()
+{
+	if (!hdr) return;
+	munmap(hdr,size);
+	shm_unlink(name.c_str());
+	hdr=NULL;
+}
+
+void ShmPublisher::publish(vector<int> &data)
+{
+	if (!hdr || data.empty()) return;
+	
+	ShmRecord *slots = shmRingSlots(hdr);
+	uint32_t n = hdr->head.load(std::memory_order_relaxed);
+	for (unsigned int i=0;i<data.size();i+=4,n++){
+		ShmRecord *slot = slots + (n % hdr->nslots);
+		slot->lock.store(2*n+1,std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot->channel=data.at(i);
+		slot->tv_sec=data.at(i+1);
+		slot->tv_nsec=data.at(i+2)*1000;
+		slot->reading=data.at(i+3);
+		slot->lock.store(2*(n+1),std::memory_order_release);
+		hdr->head.store(n+1,std::memory_order_release);
+	}
+	
+	hdr->notify.fetch_add(1,std::memory_order_release);
+	syscall(SYS_futex,&(hdr->notify),FUTEX_WAKE,INT_MAX,NULL,NULL,0);
+}
@@ -0,0 +1,118 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2017  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef __SHM_RING_H_
+#define __SHM_RING_H_
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+
+// Layout of the POSIX shared memory segment that okcounterd publishes readings in,
+// and inline functions for readers. There is a single writer (okcounterd) and any number 
+// of readers, which only need to map the segment read-only.
+//
+// Records are numbered from 0, modulo 2^32. Record n is kept in slot n % nslots, until it is overwritten
+// nslots records later; nslots is a power of two, so that slots follow on when the numbers wrap. 
+// Each slot is protected by a sequence lock: the writer makes the lock odd while the slot is being written, 
+// and sets it to 2*(n+1) (modulo 2^32) when record n is complete.
+// 
+// 'head' is the number of records written, modulo 2^32. 'notify' is incremented after each batch of records,
+// and readers can wait on it as a futex.
+//
+// The shared words are 32 bits: 64 bit atomics are not lock-free on all 32 bit ARM processors, 
+// and the locks that replace them only work within a process.
+
+#define SHM_RING_MAGIC   0x4f4b5348 // "OKSH"
+#define SHM_RING_VERSION 2
+#define SHM_RING_NAME    "/okcounterd"
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2,"the shared memory ring needs lock-free 32 bit atomics");
+
+struct ShmRecord
+{
+	std::atomic<uint32_t> lock;
+	uint32_t channel;
+	int32_t  reading;  // ns
+	uint32_t reserved0;
+	int64_t  tv_sec;   // system time of the reading
+	int32_t  tv_nsec;
+	uint32_t reserved;
+};
+
+struct ShmRingHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nslots;
+	uint32_t recordSize;
+	std::atomic<uint32_t> head;
+	std::atomic<uint32_t> notify;
+	uint32_t reserved[10];   // pad to 64 bytes
+};
+
+static inline ShmRecord *shmRingSlots(const ShmRingHeader *hdr)
+{
+	return (ShmRecord *) (((char *) hdr) + sizeof(ShmRingHeader));
+}
+
+static inline size_t shmRingSize(uint32_t nslots)
+{
+	return sizeof(ShmRingHeader) + nslots*sizeof(ShmRecord);
+}
+
+// Copies record n into rec.
+// Returns 0 on success, 1 if record n has not been written yet and -1 if it has been overwritten.
+static inline int shmRingRead(const ShmRingHeader *hdr,uint32_t n,ShmRecord *rec)
+{
+	if ((int32_t) (n - hdr->head.load(std::memory_order_acquire)) >= 0) // n is at or past the head
+		return 1;
+	const ShmRecord *slot = shmRingSlots(hdr) + (n % hdr->nslots);
+	uint32_t l = slot->lock.load(std::memory_order_acquire);
+	if (l != 2*(n+1))
+		return -1; // overwritten, or being overwritten
+	rec->channel = slot->channel;
+	rec->reading = slot->reading;
+	rec->tv_sec  = slot->tv_sec;
+	rec->tv_nsec = slot->tv_nsec;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (slot->lock.load(std::memory_order_relaxed) != l)
+		return -1;
+	rec->lock.store(l,std::memory_order_relaxed);
+	return 0;
+}
+
+// Waits until 'notify' differs from the value last seen, or the timeout (may be NULL) expires.
+static inline void shmRingWait(const ShmRingHeader *hdr,uint32_t lastNotify,const struct timespec *timeout)
+{
+	if (hdr->notify.load(std::memory_order_acquire) != lastNotify)
+		return;
+	syscall(SYS_futex,&(hdr->notify),FUTEX_WAIT,lastNotify,timeout,NULL,0);
+}
+
+#endif
@@ -27,15 +27,123 @@
 #define __THREAD_H_
 
 #include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <alloca.h>
 #include <assert.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <limits.h>
 
 using namespace::std;
 
+// Scheduling, CPU affinity and stack options for a thread
+
+class ThreadOptions
+{
+	public:
+		ThreadOptions()
+		{
+			priority=-1;
+			// default stack size is 8MB FIXME what about ARM ?
+			// seems a bit too big ... reduce to 1 MB
+			stackSize=PTHREAD_STACK_MIN*64;
+			prefaultStack=false;
+		}
+		
+		int priority;       // SCHED_FIFO priority, 0 for SCHED_OTHER, -1 to inherit from the creating thread
+		string cpus;        // CPU list, eg "0,2-3", or empty for any CPU
+		size_t stackSize;   // bytes
+		bool prefaultStack; // touch the whole stack before the thread starts, so that it is not paged in later
+		
+		// Parses the CPU list. Returns false if it is invalid
+		bool cpuSet(cpu_set_t *set)
+		{
+			CPU_ZERO(set);
+			if (cpus.empty()) return true;
+			const char *p = cpus.c_str();
+			while (*p){
+				char *end;
+				long first = strtol(p,&end,10);
+				if (end == p || first < 0 || first >= CPU_SETSIZE) return false;
+				long last = first;
+				p=end;
+				if (*p == '-'){
+					last = strtol(p+1,&end,10);
+					if (end == p+1 || last < first || last >= CPU_SETSIZE) return false;
+					p=end;
+				}
+				for (long c=first;c<=last;c++)
+					CPU_SET(c,set);
+				if (*p == ',') p++;
+				else if (*p) return false;
+			}
+			return true;
+		}
+		
+		// Applies the options to the calling thread. The stack size can't be changed
+		bool applyToSelf(string &err)
+		{
+			if (priority >= 0){
+				struct sched_param param;
+				param.sched_priority = priority;
+				int ret = pthread_setschedparam(pthread_self(),(priority > 0 ? SCHED_FIFO : SCHED_OTHER),&param);
+				if (ret){
+					err = string("pthread_setschedparam(): ") + strerror(ret);
+					return false;
+				}
+			}
+			cpu_set_t set;
+			if (!cpuSet(&set)){
+				err = "invalid CPU list " + cpus;
+				return false;
+			}
+			if (!cpus.empty()){
+				int ret = pthread_setaffinity_np(pthread_self(),sizeof(set),&set);
+				if (ret){
+					err = string("pthread_setaffinity_np(): ") + strerror(ret);
+					return false;
+				}
+			}
+			if (prefaultStack)
+				prefault(stackSize);
+			return true;
+		}
+		
+		// Reports the settings in effect for a thread
+		static string describe(pthread_t t)
+		{
+			ostringstream ss;
+			int policy;
+			struct sched_param param;
+			if (0 == pthread_getschedparam(t,&policy,&param))
+				ss << (policy == SCHED_FIFO ? "SCHED_FIFO" : (policy == SCHED_RR ? "SCHED_RR" : "SCHED_OTHER")) 
+					<< " priority " << param.sched_priority;
+			cpu_set_t set;
+			if (0 == pthread_getaffinity_np(t,sizeof(set),&set)){
+				ss << " CPUs";
+				int n=0;
+				for (int c=0;c<CPU_SETSIZE;c++)
+					if (CPU_ISSET(c,&set)) ss << (n++ ? "," : " ") << c;
+			}
+			return ss.str();
+		}
+		
+	private:
+	
+		static void prefault(size_t nbytes)
+		{
+			// Touch the pages below the current stack frame so that they are mapped (and locked, if mlockall() has been called)
+			volatile char *buf = (volatile char *) alloca(nbytes);
+			for (size_t i=0;i<nbytes;i+=4096)
+				buf[i]=0;
+		}
+};
+
 class Thread
 {
 	public:
@@ -43,30 +151,64 @@ class Thread
 				: stopRequested(false),running(false)
 		{
 			thread=NULL;
+			stack=NULL;
 			pthread_mutex_init(&mutex,0);
-			// default stack size is 8MB FIXME what about ARM ?
-			// seems a bit too big ... reduce to 1 MB
-			stackSize=PTHREAD_STACK_MIN*64;
 		}
 
 		virtual ~Thread()
 		{
 			pthread_mutex_destroy(&mutex);
+			free(stack);
 		}
 		
 		bool isRunning(){return running;}
 		
+		// Must be called before go()
+		void setOptions(const ThreadOptions &opts){options=opts;}
+		const ThreadOptions &getOptions(){return options;}
+		
+		string describe()
+		{
+			if (!thread) return "not running";
+			ostringstream ss;
+			ss << ThreadOptions::describe(*thread) << " stack " << options.stackSize/1024 << " kB" 
+				<< (stack ? " (prefaulted)" : "");
+			return ss.str();
+		}
+		
 		// Create the thread and start work
 		virtual void go() 
 		{
 			assert(!thread);
 			pthread_attr_t attr;
 			pthread_attr_init(&attr);
-			pthread_attr_setstacksize(&attr, (size_t) stackSize);
+			if (options.stackSize < (size_t) PTHREAD_STACK_MIN) options.stackSize = PTHREAD_STACK_MIN;
+			if (options.prefaultStack){
+				// Allocate the stack here and touch it, so that the thread does not take page faults later
+				if (0 != posix_memalign(&stack,4096,options.stackSize)){
+					cerr << "Error: failed to allocate a thread stack" << endl;
+					exit(EXIT_FAILURE);
+				}
+				memset(stack,0,options.stackSize);
+				pthread_attr_setstack(&attr,stack,options.stackSize);
+			}
+			else
+				pthread_attr_setstacksize(&attr, options.stackSize);
+			if (options.priority >= 0){
+				struct sched_param param;
+				param.sched_priority = options.priority;
+				pthread_attr_setinheritsched(&attr,PTHREAD_EXPLICIT_SCHED);
+				pthread_attr_setschedpolicy(&attr,(options.priority > 0 ? SCHED_FIFO : SCHED_OTHER));
+				pthread_attr_setschedparam(&attr,&param);
+			}
+			cpu_set_t cpus;
+			if (!options.cpus.empty() && options.cpuSet(&cpus))
+				pthread_attr_setaffinity_np(&attr,sizeof(cpus),&cpus);
 			thread = new pthread_t;
 			int ret =  pthread_create(thread, &attr, &workerCallback, (void *) this);
+			pthread_attr_destroy(&attr);
 			if(ret != 0) {
-				cerr << "Error: pthread_create() failed" << endl;
+				cerr << "Error: pthread_create() failed: " << strerror(ret) << endl;
 				exit(EXIT_FAILURE);
 			}
 			running=true;
@@ -87,9 +229,10 @@ class Thread
 		volatile bool running;
 		
 		string threadID;
-		int stackSize;
+		ThreadOptions options;
 		
 		pthread_t *thread;
+		void *stack;
 		pthread_mutex_t mutex;
 		
 		static void * workerCallback(void *ptr)
@@ -29,6 +29,7 @@
 # Modification history
 # 2016-03-17 MJW Initial version 0.1
 # 2016-04-01 MJW Removed backwards compatibility
+# 2017-12-21 MJW Query latency statistics
 #
 
 use POSIX;
@@ -36,7 +37,7 @@ use Getopt::Std;
 use IO::Socket;
 use TFLibrary;
 
-use vars qw($opt_d $opt_c $opt_g $opt_h $opt_o $opt_q $opt_v);
+use vars qw($opt_d $opt_c $opt_g $opt_h $opt_l $opt_o $opt_q $opt_u $opt_v);
 
 $VERSION="0.1";
 $AUTHOR="Michael Wouters";
@@ -45,7 +46,7 @@ $AUTHOR="Michael Wouters";
 if ($0=~m#^(.*/)#) {$path=$1} else {$path="./"}	# read path info
 $0=~s#.*/##;					# then strip it
 
-if (!(getopts('c:dg:ho:qv')) || $opt_h){
+if (!(getopts('c:dg:hlo:quv')) || $opt_h){
 	&ShowHelp();
 	exit;
 }
@@ -129,6 +130,27 @@ if (defined $opt_q){
 	print "Configuration: $response \n";
 }
 
+if (defined $opt_l){
+	Debug("Querying the latency statistics");
+	$cmd = "QUERY LATENCY";
+	Debug("Sending $cmd\n");
+	$sock->send($cmd);
+	# okcounterd closes its end when the reply is complete
+	while (defined($line = <$sock>)){
+		print $line;
+	}
+}
+
+if (defined $opt_u){
+	Debug("Querying the USB statistics");
+	$cmd = "QUERY USB";
+	Debug("Sending $cmd\n");
+	$sock->send($cmd);
+	while (defined($line = <$sock>)){
+		print $line;
+	}
+}
+
 $sock->close();
 
 # End of main program
@@ -140,8 +162,10 @@ sub ShowHelp{
   print "\t-c <file> use this gpscv configuration file\n";
   print "\t-g <0/1>  disable/enable GPIO\n";
   print "\t-h        show this help\n";
+  print "\t-l        show latency statistics\n";
   print "\t-o <1..6> set counter output pps source\n";
   print "\t-q        query configuration\n";
+  print "\t-u        show USB transfer statistics\n";
   print "\t-v        print version\n";
 }
 